@@ -141,6 +141,8 @@ typedef enum ls_error_code {
     LS_OPERATOR_IS_COMPLEX,     ///< Trying to apply complex operator to real vector
     LS_DIMENSION_MISMATCH,      ///< Operator dimension does not match vector length
     LS_SYSTEM_ERROR,            ///< Unknown error
+    LS_COMPILATION_FAILED,      ///< Failed to compile or load a runtime generated kernel
+    LS_NOT_CONVERGED,           ///< Iterative algorithm did not reach the requested tolerance
 } ls_error_code;
 
 char const* ls_error_to_string(ls_error_code code);
@@ -250,6 +252,8 @@ ls_error_code ls_build_unsafe(ls_spin_basis* basis, uint64_t size,
                               uint64_t const representatives[]);
 void          ls_get_state_info(ls_spin_basis const* basis, ls_bits512 const* bits,
                                 ls_bits512* representative, void* character, double* norm);
+void          ls_get_state_info_64(ls_spin_basis const* basis, ls_bits64 bits,
+                                   ls_bits64* representative, void* character, double* norm);
 void ls_batched_get_state_info(ls_spin_basis const* basis, uint64_t count, ls_bits512 const* spins,
                                uint64_t spins_stride, ls_bits512* repr, uint64_t repr_stride,
                                LATTICE_SYMMETRIES_COMPLEX128* eigenvalues,
@@ -283,8 +287,20 @@ bool          ls_interaction_is_real(ls_interaction const* interaction);
 
 ls_error_code ls_create_operator(ls_operator** ptr, ls_spin_basis const* basis,
                                  unsigned number_terms, ls_interaction const* const terms[]);
+/// `terms` must map the sector of `input_basis` into the sector of `output_basis`. This is not
+/// checked: matrix elements are only computed for one representative per orbit, so otherwise
+/// the result is silently wrong.
+ls_error_code ls_create_sector_operator(ls_operator** ptr, ls_spin_basis const* input_basis,
+                                        ls_spin_basis const* output_basis, unsigned number_terms,
+                                        ls_interaction const* const terms[]);
 void          ls_destroy_operator(ls_operator* op);
 
+ls_error_code ls_operator_sum(ls_operator** ptr, ls_operator const* a, ls_operator const* b);
+ls_error_code ls_operator_product(ls_operator** ptr, ls_operator const* a, ls_operator const* b);
+ls_error_code ls_operator_commutator(ls_operator** ptr, ls_operator const* a,
+                                     ls_operator const* b);
+uint64_t      ls_operator_get_number_local_terms(ls_operator const* op);
+
 typedef enum {
     LS_FLOAT32,
     LS_FLOAT64,
@@ -297,22 +313,264 @@ typedef ls_error_code (*ls_callback)(ls_bits512 const* bits, void const* coeff,
 ls_error_code ls_operator_apply(ls_operator const* op, ls_bits512 const* bits, ls_callback func,
                                 void* cxt);
 
+typedef ls_error_code (*ls_callback64)(ls_bits64 bits, void const* coeff, void* cxt);
+
+ls_error_code ls_operator_apply_64(ls_operator const* op, ls_bits64 bits, ls_callback64 func,
+                                   void* cxt);
+
+typedef ls_error_code (*ls_chunk_callback)(uint64_t first, uint64_t number_inputs,
+                                           uint64_t const* offsets, ls_bits512 const* spins,
+                                           void const* coeffs, void* cxt);
+
+ls_error_code ls_operator_apply_chunked(ls_operator const* op, uint64_t count,
+                                        ls_bits512 const* spins, uint64_t chunk_size,
+                                        ls_chunk_callback func, void* cxt);
+
 uint64_t ls_batched_operator_apply(ls_operator const* op, uint64_t count, ls_bits512 const* spins,
                                    ls_bits512* out_spins, LATTICE_SYMMETRIES_COMPLEX128* out_coeffs,
                                    uint64_t* out_counts);
 
+ls_error_code ls_operator_batched_diagonal(ls_operator const* op, uint64_t count,
+                                           uint64_t const* spins, uint64_t spins_stride,
+                                           LATTICE_SYMMETRIES_COMPLEX128* out,
+                                           uint64_t out_stride);
+
 ls_error_code ls_operator_matmat(ls_operator const* op, ls_datatype dtype, uint64_t size,
                                  uint64_t block_size, void const* x, uint64_t x_stride, void* y,
                                  uint64_t y_stride);
 
+ls_error_code ls_operator_matmat_rows(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                      uint64_t block_size, void const* x, uint64_t x_stride,
+                                      uint64_t number_rows, uint64_t const rows[], void* y,
+                                      uint64_t y_stride);
+
+typedef struct ls_matmat_handle ls_matmat_handle;
+
+ls_error_code ls_operator_matmat_async(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                       uint64_t block_size, void const* x, uint64_t x_stride,
+                                       void* y, uint64_t y_stride, ls_matmat_handle** handle);
+bool          ls_matmat_test(ls_matmat_handle* handle);
+ls_error_code ls_matmat_wait(ls_matmat_handle* handle);
+void          ls_destroy_matmat_handle(ls_matmat_handle* handle);
+
+typedef struct ls_out_of_core_options {
+    uint64_t tile_rows;   ///< Rows of y computed at once, 0 chooses tiles of about 64 MiB
+    unsigned queue_depth; ///< Maximal number of tiles waiting to be written
+} ls_out_of_core_options;
+
+void          ls_out_of_core_default_options(ls_out_of_core_options* options);
+ls_error_code ls_operator_matmat_file(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                      uint64_t block_size, char const* x_filename,
+                                      char const* y_filename,
+                                      ls_out_of_core_options const* options);
+
 ls_error_code ls_operator_expectation(ls_operator const* op, ls_datatype dtype, uint64_t size,
                                       uint64_t block_size, void const* x, uint64_t x_stride,
                                       void* out);
 
+typedef struct ls_sparse_vector ls_sparse_vector;
+
+ls_error_code   ls_operator_apply_sparse(ls_operator const* op, uint64_t count,
+                                         uint64_t const indices[], void const* values,
+                                         ls_sparse_vector** out);
+void            ls_destroy_sparse_vector(ls_sparse_vector* vector);
+uint64_t        ls_sparse_vector_get_size(ls_sparse_vector const* vector);
+uint64_t const* ls_sparse_vector_get_indices(ls_sparse_vector const* vector);
+void const*     ls_sparse_vector_get_values(ls_sparse_vector const* vector);
+
+typedef enum {
+    LS_CORRELATOR_ZZ,         ///< σᶻᵢσᶻⱼ
+    LS_CORRELATOR_HEISENBERG, ///< σᵢ·σⱼ = σˣᵢσˣⱼ + σʸᵢσʸⱼ + σᶻᵢσᶻⱼ
+} ls_correlator_kind;
+
+ls_error_code ls_spin_correlations(ls_spin_basis const* basis, ls_correlator_kind kind,
+                                   ls_datatype dtype, uint64_t size, void const* x,
+                                   double* correlations, uint64_t number_momenta,
+                                   double const* phases, double* structure_factor);
+
+ls_error_code ls_reduced_density_matrix(ls_spin_basis const* basis, ls_datatype dtype,
+                                        uint64_t size, void const* x, uint64_t subsystem_mask,
+                                        void* out);
+ls_error_code ls_entanglement_entropy(uint64_t dimension, void const* density_matrix,
+                                      double order, double* out);
+
+ls_error_code ls_unpack_vector(ls_spin_basis const* basis, ls_spin_basis const* subgroup_basis,
+                               ls_datatype dtype, uint64_t size, uint64_t block_size,
+                               void const* x, uint64_t x_stride, void* y, uint64_t y_stride);
+ls_error_code ls_pack_vector(ls_spin_basis const* subgroup_basis, ls_spin_basis const* basis,
+                             ls_datatype dtype, uint64_t size, uint64_t block_size, void const* x,
+                             uint64_t x_stride, void* y, uint64_t y_stride);
+ls_error_code ls_unpack_vector_file(ls_spin_basis const* basis,
+                                    ls_spin_basis const* subgroup_basis, ls_datatype dtype,
+                                    uint64_t size, uint64_t block_size, void const* x,
+                                    uint64_t x_stride, char const* filename,
+                                    ls_out_of_core_options const* options);
+ls_error_code ls_batched_amplitude(ls_spin_basis const* basis, ls_datatype dtype, uint64_t size,
+                                   void const* x, uint64_t count, uint64_t const spins[],
+                                   void* out);
+
+typedef struct ls_lanczos_options {
+    unsigned number_eigenvalues; ///< Number of lowest eigenvalues to compute
+    unsigned krylov_dimension;   ///< Maximal dimension of the Krylov subspace between restarts
+    unsigned max_restarts;       ///< Maximal number of restarts
+    double   tolerance;          ///< Convergence threshold for relative residuals
+    ls_datatype storage;         ///< Precision in which Krylov vectors are stored (tolerance is
+                                 ///< raised to 10ε of this type)
+    bool        two_pass;        ///< Use two-pass Lanczos without reorthogonalization
+} ls_lanczos_options;
+
+typedef struct ls_lanczos_info {
+    unsigned number_iterations; ///< Number of matrix-vector products
+    unsigned number_restarts;
+    bool     converged;
+    double   max_residual; ///< Largest relative residual of the computed eigenpairs
+} ls_lanczos_info;
+
+void          ls_lanczos_default_options(ls_lanczos_options* options);
+ls_error_code ls_operator_lanczos(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                  ls_lanczos_options const* options, void const* initial,
+                                  double* eigenvalues, void* eigenvectors,
+                                  uint64_t eigenvectors_stride, ls_lanczos_info* info);
+
+typedef struct ls_lobpcg_options {
+    unsigned number_eigenvalues; ///< Number of lowest eigenvalues to compute
+    unsigned max_iterations;
+    double   tolerance;    ///< Convergence threshold for relative residuals
+    bool     precondition; ///< Use the diagonal of the operator as preconditioner
+} ls_lobpcg_options;
+
+typedef struct ls_lobpcg_info {
+    unsigned number_iterations;
+    unsigned number_matvecs; ///< Total number of vectors the operator was applied to
+    bool     converged;
+    double   max_residual; ///< Largest relative residual of the computed eigenpairs
+} ls_lobpcg_info;
+
+void          ls_lobpcg_default_options(ls_lobpcg_options* options);
+ls_error_code ls_operator_lobpcg(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                 ls_lobpcg_options const* options, void const* initial,
+                                 uint64_t initial_stride, double* eigenvalues, void* eigenvectors,
+                                 uint64_t eigenvectors_stride, ls_lobpcg_info* info);
+
+typedef struct ls_expm_options {
+    unsigned krylov_dimension; ///< Maximal dimension of Krylov subspaces
+    double   tolerance;        ///< Bound on the accumulated error relative to ‖x‖
+} ls_expm_options;
+
+typedef struct ls_expm_info {
+    unsigned number_steps;
+    unsigned number_matvecs;
+    double   error_estimate; ///< Sum of local error estimates
+} ls_expm_info;
+
+void          ls_expm_default_options(ls_expm_options* options);
+ls_error_code ls_operator_expm_multiply(ls_operator const* op, uint64_t size, double t,
+                                        void const* x, void* out, ls_expm_options const* options,
+                                        ls_expm_info* info);
+ls_error_code ls_operator_evolve(ls_operator const* op, uint64_t size, void const* x,
+                                 uint64_t number_times, double const times[],
+                                 uint64_t number_observables,
+                                 ls_operator const* const observables[], void* expectations,
+                                 void* out, ls_expm_options const* options, ls_expm_info* info);
+
+typedef enum {
+    LS_KPM_NO_KERNEL,
+    LS_KPM_JACKSON,
+    LS_KPM_LORENTZ,
+} ls_kpm_kernel;
+
+ls_error_code ls_operator_spectral_bounds(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                          double* lower, double* upper);
+ls_error_code ls_operator_kpm_dos(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                  double lower, double upper, uint64_t number_moments,
+                                  uint64_t number_vectors, uint64_t block_size, uint64_t seed,
+                                  double* moments);
+ls_error_code ls_operator_kpm_correlation(ls_operator const* op, ls_datatype dtype, uint64_t size,
+                                          double lower, double upper, uint64_t number_moments,
+                                          void const* right, void const* left, void* moments);
+ls_error_code ls_kpm_reconstruct(uint64_t number_moments, double const* moments,
+                                 ls_kpm_kernel kernel, double lorentz_lambda, double lower,
+                                 double upper, uint64_t number_points, double const* energies,
+                                 double* out);
+
+typedef struct ls_ftlm_options {
+    unsigned krylov_dimension; ///< Number of Lanczos steps per random vector
+    unsigned number_vectors;   ///< Number of random vectors per sector
+    unsigned block_size;       ///< Number of random vectors processed together
+    uint64_t seed;
+} ls_ftlm_options;
+
+void          ls_ftlm_default_options(ls_ftlm_options* options);
+ls_error_code ls_ftlm(unsigned number_sectors, ls_operator const* const operators[],
+                      double const degeneracies[], ls_ftlm_options const* options,
+                      uint64_t number_temperatures, double const temperatures[],
+                      double* log_partition_function, double* energy, double* specific_heat);
+
+typedef enum {
+    LS_JOB_BUILD,    ///< Only build the basis
+    LS_JOB_SPECTRUM, ///< All eigenvalues by dense diagonalization
+    LS_JOB_LANCZOS,  ///< Lowest eigenpairs, see ls_operator_lanczos
+    LS_JOB_KPM_DOS,  ///< Chebyshev moments of the density of states, see ls_operator_kpm_dos
+} ls_job_kind;
+
+typedef struct ls_sector_job {
+    ls_job_kind        kind;
+    ls_operator const* op;    ///< Hamiltonian in the sector; its basis is built if necessary
+    ls_datatype        dtype; ///< LS_FLOAT64 or LS_COMPLEX128
+    double*            values; ///< Eigenvalues (LS_JOB_SPECTRUM, LS_JOB_LANCZOS) or moments
+    void*              vectors; ///< Eigenvectors for LS_JOB_LANCZOS (may be NULL)
+    ls_lanczos_options const* lanczos_options; ///< May be NULL
+    ls_lanczos_info*          lanczos_info;    ///< May be NULL
+    uint64_t                  number_moments;  ///< LS_JOB_KPM_DOS parameters
+    uint64_t                  number_vectors;
+    uint64_t                  block_size;
+    uint64_t                  seed;
+    double        lower;  ///< Spectral bounds for LS_JOB_KPM_DOS, estimated if lower >= upper
+    double        upper;
+    ls_error_code status; ///< Written by ls_run_sector_jobs
+} ls_sector_job;
+
+typedef struct ls_scheduler_options {
+    unsigned number_threads; ///< Size of the thread pool, 0 means omp_get_max_threads()
+    uint64_t memory_budget;  ///< Approximate memory limit in bytes, 0 means unlimited
+} ls_scheduler_options;
+
+void          ls_scheduler_default_options(ls_scheduler_options* options);
+ls_error_code ls_run_sector_jobs(uint64_t number_jobs, ls_sector_job jobs[],
+                                 ls_scheduler_options const* options);
+
 uint64_t ls_operator_max_buffer_size(ls_operator const* op);
 
+ls_error_code ls_operator_enable_jit(ls_operator* op);
+bool          ls_operator_has_jit(ls_operator const* op);
+
+ls_error_code ls_operator_plan(ls_operator* op, ls_datatype dtype, uint64_t block_size,
+                               uint64_t memory_budget);
+void          ls_operator_set_tile_size(ls_operator* op, uint64_t tile_size);
+ls_error_code ls_save_wisdom(char const* filename);
+ls_error_code ls_load_wisdom(char const* filename);
+void          ls_forget_wisdom(void);
+
+ls_error_code ls_reorder_basis(ls_spin_basis* basis, ls_operator const* op);
+ls_error_code ls_reset_basis_order(ls_spin_basis* basis);
+
 bool ls_operator_is_real(ls_operator const* op);
 
+typedef struct ls_term_view {
+    unsigned number_spins; ///< Number of spins the term acts on (1-4)
+    /// Element-wise complex conjugate of the row-major 2ⁿ×2ⁿ matrix O passed to
+    /// ls_create_interaction*: `matrix[k * 2ⁿ + m]` is ⟨k|O|m⟩*, i.e. ⟨m|O|k⟩ for Hermitian terms.
+    /// Row k thus holds the coefficients generated from the local configuration k.
+    LATTICE_SYMMETRIES_COMPLEX128 const* matrix;
+    uint64_t        number_sites; ///< Number of site tuples
+    uint16_t const* sites;        ///< Contiguous array of site tuples
+} ls_term_view;
+
+ls_spin_basis const* ls_operator_get_basis(ls_operator const* op);
+ls_spin_basis const* ls_operator_get_input_basis(ls_operator const* op);
+unsigned             ls_operator_get_number_terms(ls_operator const* op);
+void ls_operator_get_term(ls_operator const* op, unsigned i, ls_term_view* term);
+
 #if defined(__cplusplus)
 } // extern "C"
 #endif
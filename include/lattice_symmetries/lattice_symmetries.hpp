@@ -0,0 +1,239 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file lattice_symmetries.hpp
+///
+/// Header-only C++ interface on top of the C API. Unlike `ls_operator_apply` which calls a
+/// function pointer for every matrix element, functions in this header accept arbitrary
+/// callables which the compiler can inline.
+
+#ifndef LATTICE_SYMMETRIES_HPP
+#define LATTICE_SYMMETRIES_HPP
+
+#include "lattice_symmetries.h"
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace detail {
+    constexpr auto test_bit(ls_bits64 const bits, unsigned const i) noexcept -> unsigned
+    {
+        return static_cast<unsigned>((bits >> i) & 1U);
+    }
+    constexpr auto test_bit(ls_bits512 const& bits, unsigned const i) noexcept -> unsigned
+    {
+        return test_bit(bits.words[i / 64U], i % 64U);
+    }
+
+    constexpr auto set_bit_to(ls_bits64& bits, unsigned const i, unsigned const value) noexcept
+        -> void
+    {
+        bits = (bits & ~(ls_bits64{1} << i)) | (static_cast<ls_bits64>(value) << i);
+    }
+    constexpr auto set_bit_to(ls_bits512& bits, unsigned const i, unsigned const value) noexcept
+        -> void
+    {
+        set_bit_to(bits.words[i / 64U], i % 64U, value);
+    }
+
+    /// Extracts bits at positions `indices` from `bits` into a local configuration.
+    template <class Bits, std::size_t N>
+    constexpr auto gather_bits(Bits const& bits, std::array<uint16_t, N> const& indices) noexcept
+        -> unsigned
+    {
+        // ============================= IMPORTANT ==============================
+        // The order is REALLY important here. This is done to adhere to the
+        // definition of cronecker product, i.e. that
+        //
+        //     kron(A, B) =  A00 B     A01 B     A02 B  ...
+        //                   A10 B     A11 B     A12 B  ...
+        //                    .
+        //                    .
+        //                    .
+        //
+        // In other words, if you change it to
+        //    r |= test_bit(bits, i);
+        //    r <<= 1U;
+        // shit will break in really difficult to track ways...
+        auto r = 0U;
+        for (auto const i : indices) {
+            r <<= 1U;
+            r |= test_bit(bits, i);
+        }
+        return r;
+    }
+
+    /// Inverse of #gather_bits: writes local configuration `r` to positions `indices` of `bits`.
+    template <class Bits, std::size_t N>
+    constexpr auto scatter_bits(Bits& bits, unsigned r,
+                                std::array<uint16_t, N> const& indices) noexcept -> void
+    {
+        for (auto i = N; i-- > 0;) {
+            set_bit_to(bits, indices[i], r & 1U);
+            r >>= 1U;
+        }
+    }
+
+    inline auto get_state_info(ls_spin_basis const* basis, ls_bits64 const& bits,
+                               ls_bits64& representative, std::complex<double>& character,
+                               double& norm) noexcept -> void
+    {
+        ls_get_state_info_64(basis, bits, &representative, &character, &norm);
+    }
+    inline auto get_state_info(ls_spin_basis const* basis, ls_bits512 const& bits,
+                               ls_bits512& representative, std::complex<double>& character,
+                               double& norm) noexcept -> void
+    {
+        ls_get_state_info(basis, &bits, &representative, &character, &norm);
+    }
+
+    template <unsigned N, class Bits, class OffDiag>
+    auto apply_term(ls_term_view const& term, Bits const& x, std::complex<double>& diagonal,
+                    OffDiag& off_diag) -> ls_error_code
+    {
+        constexpr auto Dim    = 1U << N;
+        auto const*    matrix = term.matrix;
+        // NOLINTNEXTLINE: sites are stored as contiguous N-tuples
+        auto const* sites = reinterpret_cast<std::array<uint16_t, N> const*>(term.sites);
+        for (auto i = uint64_t{0}; i < term.number_sites; ++i) {
+            auto const  k   = gather_bits(x, sites[i]);
+            auto const* row = matrix + k * Dim;
+            for (auto n = 0U; n < Dim; ++n) {
+                if (row[n] == 0.0) { continue; }
+                if (n == k) { diagonal += row[n]; }
+                else {
+                    auto y = x;
+                    scatter_bits(y, n, sites[i]);
+                    auto const status = off_diag(y, row[n]);
+                    if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+                }
+            }
+        }
+        return LS_SUCCESS;
+    }
+} // namespace detail
+
+/// A lightweight non-owning view of an `ls_operator`.
+///
+/// Constructing the view queries the terms of the operator once such that #apply does not have to
+/// go through the C API for every spin configuration. The view must not outlive the operator.
+class operator_view_t {
+  public:
+    explicit operator_view_t(ls_operator const* op)
+        : _basis{ls_operator_get_basis(op)}
+        , _input_basis{ls_operator_get_input_basis(op)}
+        , _terms(ls_operator_get_number_terms(op))
+    {
+        for (auto i = 0U; i < _terms.size(); ++i) {
+            ls_operator_get_term(op, i, &_terms[i]);
+        }
+    }
+
+    [[nodiscard]] auto basis() const noexcept -> ls_spin_basis const* { return _basis; }
+    /// Basis in which generated spin configurations are expressed (see ls_create_sector_operator)
+    [[nodiscard]] auto input_basis() const noexcept -> ls_spin_basis const* { return _input_basis; }
+    [[nodiscard]] auto terms() const noexcept -> std::vector<ls_term_view> const&
+    {
+        return _terms;
+    }
+
+  private:
+    ls_spin_basis const*      _basis;
+    ls_spin_basis const*      _input_basis;
+    std::vector<ls_term_view> _terms;
+};
+
+/// Applies operator `op` to a basis element `spin` calling `callback(bits, coeff)` for every
+/// matrix element. Order of the matrix elements and their values are exactly the same as in
+/// `ls_operator_apply`, i.e. off-diagonal elements come first and the diagonal one last.
+///
+/// `Bits` is either `ls_bits64` (only allowed for systems with at most 64 spins) or `ls_bits512`.
+/// `callback` must return `ls_error_code`. Any status other than `LS_SUCCESS` terminates the
+/// iteration and is propagated to the caller.
+template <class Bits, class Callback>
+auto apply(operator_view_t const& op, Bits const& spin, Callback&& callback) -> ls_error_code
+{
+    static_assert(std::is_same_v<Bits, ls_bits64> || std::is_same_v<Bits, ls_bits512>,
+                  "Bits must be either ls_bits64 or ls_bits512");
+    auto                 repr = spin;
+    std::complex<double> eigenvalue;
+    double               norm; // NOLINT: norm is initialized by get_state_info
+    detail::get_state_info(op.basis(), spin, repr, eigenvalue, norm);
+    if (norm == 0.0) { return LS_INVALID_STATE; }
+    auto const old_norm = norm;
+    auto       diagonal = std::complex<double>{0.0, 0.0};
+    auto       off_diag = [&](Bits const& x, std::complex<double> const& c) -> ls_error_code {
+        detail::get_state_info(op.input_basis(), x, repr, eigenvalue, norm);
+        if (norm > 0.0) {
+            return callback(static_cast<Bits const&>(repr), c * norm / old_norm * eigenvalue);
+        }
+        return LS_SUCCESS;
+    };
+    for (auto const& term : op.terms()) {
+        auto status = LS_SUCCESS;
+        switch (term.number_spins) {
+        case 1: status = detail::apply_term<1>(term, spin, diagonal, off_diag); break;
+        case 2: status = detail::apply_term<2>(term, spin, diagonal, off_diag); break;
+        case 3: status = detail::apply_term<3>(term, spin, diagonal, off_diag); break;
+        case 4: status = detail::apply_term<4>(term, spin, diagonal, off_diag); break;
+        default: LATTICE_SYMMETRIES_UNREACHABLE;
+        }
+        if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+    }
+    if (diagonal != 0.0) {
+        // For sector-changing operators spin has to be expressed in the input basis as well
+        if (op.input_basis() != op.basis()) { return off_diag(spin, diagonal); }
+        return callback(spin, static_cast<std::complex<double> const&>(diagonal));
+    }
+    return LS_SUCCESS;
+}
+
+/// Applies operator `op` to `count` basis elements `spins` calling `callback(i, bits, coeff)` for
+/// every matrix element, where `i` is the index of the input spin configuration.
+template <class Bits, class Callback>
+auto batched_apply(operator_view_t const& op, uint64_t const count, Bits const* spins,
+                   Callback&& callback) -> ls_error_code
+{
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        auto const status =
+            apply(op, spins[i], [&callback, i](Bits const& x, std::complex<double> const& c) {
+                return callback(i, x, c);
+            });
+        if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+    }
+    return LS_SUCCESS;
+}
+
+} // namespace lattice_symmetries
+
+#endif // LATTICE_SYMMETRIES_HPP
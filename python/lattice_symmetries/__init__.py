@@ -41,7 +41,11 @@ __all__ = [
     "SpinBasis",
     "Interaction",
     "Operator",
+    "MatmatFuture",
     "diagonalize",
+    "kpm_reconstruct",
+    "ftlm",
+    "run_sector_jobs",
     "enable_logging",
     "disable_logging",
     "is_logging_enabled",
@@ -126,6 +130,87 @@ _lib = __load_shared_library()
 
 ls_bits512 = c_uint64 * 8
 ls_callback = CFUNCTYPE(c_int, POINTER(ls_bits512), POINTER(c_double * 2), c_void_p)
+ls_chunk_callback = CFUNCTYPE(
+    c_int, c_uint64, c_uint64, POINTER(c_uint64), POINTER(ls_bits512), POINTER(c_double), c_void_p
+)
+
+
+class ls_lanczos_options(ctypes.Structure):
+    _fields_ = [
+        ("number_eigenvalues", c_uint),
+        ("krylov_dimension", c_uint),
+        ("max_restarts", c_uint),
+        ("tolerance", c_double),
+        ("storage", c_int),
+        ("two_pass", c_bool),
+    ]
+
+
+class ls_lanczos_info(ctypes.Structure):
+    _fields_ = [
+        ("number_iterations", c_uint),
+        ("number_restarts", c_uint),
+        ("converged", c_bool),
+        ("max_residual", c_double),
+    ]
+
+
+class ls_expm_options(ctypes.Structure):
+    _fields_ = [("krylov_dimension", c_uint), ("tolerance", c_double)]
+
+
+class ls_ftlm_options(ctypes.Structure):
+    _fields_ = [
+        ("krylov_dimension", c_uint),
+        ("number_vectors", c_uint),
+        ("block_size", c_uint),
+        ("seed", c_uint64),
+    ]
+
+
+class ls_sector_job(ctypes.Structure):
+    _fields_ = [
+        ("kind", c_int),
+        ("op", c_void_p),
+        ("dtype", c_int),
+        ("values", POINTER(c_double)),
+        ("vectors", c_void_p),
+        ("lanczos_options", POINTER(ls_lanczos_options)),
+        ("lanczos_info", c_void_p),
+        ("number_moments", c_uint64),
+        ("number_vectors", c_uint64),
+        ("block_size", c_uint64),
+        ("seed", c_uint64),
+        ("lower", c_double),
+        ("upper", c_double),
+        ("status", c_int),
+    ]
+
+
+class ls_scheduler_options(ctypes.Structure):
+    _fields_ = [("number_threads", c_uint), ("memory_budget", c_uint64)]
+
+
+class ls_out_of_core_options(ctypes.Structure):
+    _fields_ = [("tile_rows", c_uint64), ("queue_depth", c_uint)]
+
+
+class ls_lobpcg_options(ctypes.Structure):
+    _fields_ = [
+        ("number_eigenvalues", c_uint),
+        ("max_iterations", c_uint),
+        ("tolerance", c_double),
+        ("precondition", c_bool),
+    ]
+
+
+class ls_lobpcg_info(ctypes.Structure):
+    _fields_ = [
+        ("number_iterations", c_uint),
+        ("number_matvecs", c_uint),
+        ("converged", c_bool),
+        ("max_residual", c_double),
+    ]
 
 
 def __preprocess_library():
@@ -188,13 +273,81 @@ def __preprocess_library():
         ("ls_destroy_interaction", [c_void_p], None),
         # Operator
         ("ls_create_operator", [POINTER(c_void_p), c_void_p, c_uint, POINTER(c_void_p)], c_int),
+        ("ls_create_sector_operator", [POINTER(c_void_p), c_void_p, c_void_p, c_uint, POINTER(c_void_p)], c_int),
         ("ls_destroy_operator", [c_void_p], None),
+        ("ls_operator_sum", [POINTER(c_void_p), c_void_p, c_void_p], c_int),
+        ("ls_operator_product", [POINTER(c_void_p), c_void_p, c_void_p], c_int),
+        ("ls_operator_commutator", [POINTER(c_void_p), c_void_p, c_void_p], c_int),
+        ("ls_operator_get_number_local_terms", [c_void_p], c_uint64),
         ("ls_operator_max_buffer_size", [c_void_p], c_uint64),
+        ("ls_operator_enable_jit", [c_void_p], c_int),
+        ("ls_operator_has_jit", [c_void_p], c_bool),
+        ("ls_operator_plan", [c_void_p, c_int, c_uint64, c_uint64], c_int),
+        ("ls_operator_set_tile_size", [c_void_p, c_uint64], None),
+        ("ls_save_wisdom", [c_char_p], c_int),
+        ("ls_load_wisdom", [c_char_p], c_int),
+        ("ls_forget_wisdom", [], None),
+        ("ls_reorder_basis", [c_void_p, c_void_p], c_int),
+        ("ls_reset_basis_order", [c_void_p], c_int),
         ("ls_operator_apply", [c_void_p, POINTER(ls_bits512), ls_callback, c_void_p], c_int),
+        ("ls_operator_apply_chunked", [c_void_p, c_uint64, POINTER(c_uint64), c_uint64,
+                                       ls_chunk_callback, c_void_p], c_int),
         ("ls_batched_operator_apply", [c_void_p, c_uint64, POINTER(c_uint64),
                                        POINTER(c_uint64), c_void_p, POINTER(c_uint64)], c_uint64),
+        ("ls_operator_batched_diagonal", [c_void_p, c_uint64, POINTER(c_uint64), c_uint64, c_void_p, c_uint64], c_int),
         ("ls_operator_matmat", [c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64, c_void_p, c_uint64], c_int),
+        ("ls_operator_matmat_rows", [c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64, c_uint64,
+                                     POINTER(c_uint64), c_void_p, c_uint64], c_int),
+        ("ls_operator_matmat_async", [c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64,
+                                      c_void_p, c_uint64, POINTER(c_void_p)], c_int),
+        ("ls_matmat_test", [c_void_p], c_bool),
+        ("ls_matmat_wait", [c_void_p], c_int),
+        ("ls_destroy_matmat_handle", [c_void_p], None),
+        ("ls_out_of_core_default_options", [POINTER(ls_out_of_core_options)], None),
+        ("ls_operator_matmat_file", [c_void_p, c_int, c_uint64, c_uint64, c_char_p, c_char_p,
+                                     POINTER(ls_out_of_core_options)], c_int),
         ("ls_operator_expectation", [c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64, c_void_p], c_int),
+        ("ls_operator_apply_sparse", [c_void_p, c_uint64, POINTER(c_uint64), c_void_p, POINTER(c_void_p)], c_int),
+        ("ls_destroy_sparse_vector", [c_void_p], None),
+        ("ls_sparse_vector_get_size", [c_void_p], c_uint64),
+        ("ls_sparse_vector_get_indices", [c_void_p], POINTER(c_uint64)),
+        ("ls_sparse_vector_get_values", [c_void_p], c_void_p),
+        ("ls_spin_correlations", [c_void_p, c_int, c_int, c_uint64, c_void_p, POINTER(c_double),
+                                  c_uint64, POINTER(c_double), POINTER(c_double)], c_int),
+        ("ls_reduced_density_matrix", [c_void_p, c_int, c_uint64, c_void_p, c_uint64, c_void_p], c_int),
+        ("ls_entanglement_entropy", [c_uint64, c_void_p, c_double, POINTER(c_double)], c_int),
+        ("ls_unpack_vector", [c_void_p, c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64,
+                              c_void_p, c_uint64], c_int),
+        ("ls_pack_vector", [c_void_p, c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64,
+                            c_void_p, c_uint64], c_int),
+        ("ls_unpack_vector_file", [c_void_p, c_void_p, c_int, c_uint64, c_uint64, c_void_p,
+                                   c_uint64, c_char_p, POINTER(ls_out_of_core_options)], c_int),
+        ("ls_batched_amplitude", [c_void_p, c_int, c_uint64, c_void_p, c_uint64, POINTER(c_uint64),
+                                  c_void_p], c_int),
+        ("ls_lanczos_default_options", [POINTER(ls_lanczos_options)], None),
+        ("ls_operator_lanczos", [c_void_p, c_int, c_uint64, POINTER(ls_lanczos_options), c_void_p,
+                                 POINTER(c_double), c_void_p, c_uint64, POINTER(ls_lanczos_info)], c_int),
+        ("ls_expm_default_options", [POINTER(ls_expm_options)], None),
+        ("ls_operator_expm_multiply", [c_void_p, c_uint64, c_double, c_void_p, c_void_p,
+                                       POINTER(ls_expm_options), c_void_p], c_int),
+        ("ls_operator_evolve", [c_void_p, c_uint64, c_void_p, c_uint64, POINTER(c_double), c_uint64,
+                                POINTER(c_void_p), c_void_p, c_void_p, POINTER(ls_expm_options),
+                                c_void_p], c_int),
+        ("ls_operator_spectral_bounds", [c_void_p, c_int, c_uint64, POINTER(c_double), POINTER(c_double)], c_int),
+        ("ls_operator_kpm_dos", [c_void_p, c_int, c_uint64, c_double, c_double, c_uint64, c_uint64,
+                                 c_uint64, c_uint64, POINTER(c_double)], c_int),
+        ("ls_operator_kpm_correlation", [c_void_p, c_int, c_uint64, c_double, c_double, c_uint64,
+                                         c_void_p, c_void_p, c_void_p], c_int),
+        ("ls_kpm_reconstruct", [c_uint64, POINTER(c_double), c_int, c_double, c_double, c_double,
+                                c_uint64, POINTER(c_double), POINTER(c_double)], c_int),
+        ("ls_ftlm_default_options", [POINTER(ls_ftlm_options)], None),
+        ("ls_ftlm", [c_uint, POINTER(c_void_p), POINTER(c_double), POINTER(ls_ftlm_options), c_uint64,
+                     POINTER(c_double), POINTER(c_double), POINTER(c_double), POINTER(c_double)], c_int),
+        ("ls_scheduler_default_options", [POINTER(ls_scheduler_options)], None),
+        ("ls_run_sector_jobs", [c_uint64, POINTER(ls_sector_job), POINTER(ls_scheduler_options)], c_int),
+        ("ls_lobpcg_default_options", [POINTER(ls_lobpcg_options)], None),
+        ("ls_operator_lobpcg", [c_void_p, c_int, c_uint64, POINTER(ls_lobpcg_options), c_void_p, c_uint64,
+                                POINTER(c_double), c_void_p, c_uint64, POINTER(ls_lobpcg_info)], c_int),
     ]
     # fmt: on
     for (name, argtypes, restype) in info:
@@ -221,6 +374,21 @@ def is_logging_enabled() -> bool:
     return _lib.ls_is_logging_enabled()
 
 
+def save_wisdom(filename: str) -> None:
+    """Save plans created by `Operator.plan` to a file."""
+    _check_error(_lib.ls_save_wisdom(str(filename).encode("utf-8")))
+
+
+def load_wisdom(filename: str) -> None:
+    """Load plans previously saved with `save_wisdom`."""
+    _check_error(_lib.ls_load_wisdom(str(filename).encode("utf-8")))
+
+
+def forget_wisdom() -> None:
+    """Discard all plans remembered by `Operator.plan`."""
+    _lib.ls_forget_wisdom()
+
+
 def debug_log(msg: str, end: str = "\n") -> None:
     if is_logging_enabled():
         current_frame = inspect.currentframe()
@@ -287,6 +455,16 @@ def _get_dtype(dtype: np.dtype) -> int:
     )
 
 
+def _make_expm_options(tol: Optional[float], krylov_dimension: Optional[int]):
+    options = ls_expm_options()
+    _lib.ls_expm_default_options(byref(options))
+    if tol is not None:
+        options.tolerance = tol
+    if krylov_dimension is not None:
+        options.krylov_dimension = krylov_dimension
+    return options
+
+
 def _create_symmetry(permutation: List[int], sector: int) -> c_void_p:
     assert isinstance(sector, int)
     permutation = np.asarray(permutation, dtype=np.uint32)
@@ -311,6 +489,7 @@ def _destroy(fn):
         (_lib.ls_destroy_interaction, "Interaction"),
         (_lib.ls_destroy_operator, "Operator"),
         (_lib.ls_destroy_string, "C-string"),
+        (_lib.ls_destroy_matmat_handle, "matmat handle"),
     ]
     name = None
     for (k, v) in known_destructors:
@@ -638,6 +817,190 @@ class SpinBasis:
         )
         return representative, eigenvalue, norm
 
+    def reorder(self, operator: "Operator") -> None:
+        """Reorder states (Reverse Cuthill-McKee ordering of the graph defined by `operator`) to
+        improve memory locality of `Operator.matvec` and `Operator.matmat`.
+
+        `operator` must be defined on this basis. Vectors computed before reordering are not valid
+        anymore.
+        """
+        _check_error(_lib.ls_reorder_basis(self._payload, operator._payload))
+
+    def reset_order(self) -> None:
+        """Restore the ascending order of states after `SpinBasis.reorder`."""
+        _check_error(_lib.ls_reset_basis_order(self._payload))
+
+    def correlations(self, x: np.ndarray, kind: str = "heisenberg", phases=None):
+        """Compute ⟨x|Cᵢⱼ|x⟩ for all pairs of sites, where `kind` is either "zz" (Cᵢⱼ = σᶻᵢσᶻⱼ)
+        or "heisenberg" (Cᵢⱼ = σᵢ·σⱼ).
+
+        If `phases` (a matrix with φᵢ(q) = q·rᵢ along the rows) is given, the structure factor
+        S(q) is computed as well and a tuple `(correlations, structure_factor)` is returned.
+        """
+        kinds = {"zz": 0, "heisenberg": 1}
+        if kind not in kinds:
+            raise ValueError("invalid kind: {}; expected one of {}".format(kind, list(kinds)))
+        x = np.ascontiguousarray(x)
+        n = self.number_spins
+        out = np.empty((n, n), dtype=np.float64)
+        if phases is None:
+            phases_ptr, number_momenta, structure_factor = None, 0, None
+        else:
+            phases = np.ascontiguousarray(phases, dtype=np.float64).reshape(-1, n)
+            number_momenta = phases.shape[0]
+            phases_ptr = phases.ctypes.data_as(POINTER(c_double))
+            structure_factor = np.empty(number_momenta, dtype=np.float64)
+        _check_error(
+            _lib.ls_spin_correlations(
+                self._payload,
+                kinds[kind],
+                _get_dtype(x.dtype),
+                x.shape[0],
+                x.ctypes.data_as(c_void_p),
+                out.ctypes.data_as(POINTER(c_double)),
+                number_momenta,
+                phases_ptr,
+                structure_factor.ctypes.data_as(POINTER(c_double))
+                if structure_factor is not None
+                else None,
+            )
+        )
+        if structure_factor is None:
+            return out
+        return out, structure_factor
+
+    def reduced_density_matrix(self, x: np.ndarray, sites: List[int]) -> np.ndarray:
+        """Compute the reduced density matrix of subsystem `sites` for vector `x` in this basis."""
+        x = np.ascontiguousarray(x)
+        mask = 0
+        for i in sites:
+            mask |= 1 << int(i)
+        dimension = 1 << len(set(sites))
+        out = np.empty((dimension, dimension), dtype=np.complex128)
+        _check_error(
+            _lib.ls_reduced_density_matrix(
+                self._payload,
+                _get_dtype(x.dtype),
+                x.shape[0],
+                x.ctypes.data_as(c_void_p),
+                mask,
+                out.ctypes.data_as(c_void_p),
+            )
+        )
+        return out
+
+    def entanglement_entropy(self, x: np.ndarray, sites: List[int], order: float = 1.0) -> float:
+        """Compute the Rényi entropy of order `order` (von Neumann entropy for `order=1`) of
+        subsystem `sites` for vector `x` in this basis."""
+        rho = self.reduced_density_matrix(x, sites)
+        out = c_double()
+        _check_error(
+            _lib.ls_entanglement_entropy(
+                rho.shape[0], rho.ctypes.data_as(c_void_p), order, byref(out)
+            )
+        )
+        return out.value
+
+    def unpack(self, x: np.ndarray, subgroup_basis: "SpinBasis",
+               filename: Optional[str] = None) -> Optional[np.ndarray]:
+        """Express vector(s) `x` from this basis in `subgroup_basis`.
+
+        `subgroup_basis` must be built with a subgroup of the symmetries of this basis (e.g. the
+        trivial group to obtain vectors in the full Hilbert space). If `filename` is given, the
+        result is written to that file (in column-major order) instead of being returned.
+        """
+        self.build()
+        subgroup_basis.build()
+        x_was_a_vector = x.ndim == 1
+        x = np.asfortranarray(x.reshape(-1, 1) if x_was_a_vector else x)
+        if filename is not None:
+            options = ls_out_of_core_options()
+            _lib.ls_out_of_core_default_options(byref(options))
+            _check_error(
+                _lib.ls_unpack_vector_file(
+                    self._payload,
+                    subgroup_basis._payload,
+                    _get_dtype(x.dtype),
+                    x.shape[0],
+                    x.shape[1],
+                    x.ctypes.data_as(c_void_p),
+                    x.strides[1] // x.itemsize,
+                    os.fsencode(filename),
+                    byref(options),
+                )
+            )
+            return None
+        out = np.empty((subgroup_basis.number_states, x.shape[1]), dtype=x.dtype, order="F")
+        _check_error(
+            _lib.ls_unpack_vector(
+                self._payload,
+                subgroup_basis._payload,
+                _get_dtype(x.dtype),
+                x.shape[0],
+                x.shape[1],
+                x.ctypes.data_as(c_void_p),
+                x.strides[1] // x.itemsize,
+                out.ctypes.data_as(c_void_p),
+                out.strides[1] // out.itemsize,
+            )
+        )
+        if x_was_a_vector:
+            out = np.squeeze(out, axis=1)
+        return out
+
+    def pack(self, x: np.ndarray, subgroup_basis: "SpinBasis") -> np.ndarray:
+        """Express vector(s) `x` from `subgroup_basis` in this basis.
+
+        This is the inverse of :py:meth:`unpack` for vectors which belong to the symmetry sector of
+        this basis.
+        """
+        self.build()
+        subgroup_basis.build()
+        x_was_a_vector = x.ndim == 1
+        x = np.asfortranarray(x.reshape(-1, 1) if x_was_a_vector else x)
+        out = np.empty((self.number_states, x.shape[1]), dtype=x.dtype, order="F")
+        _check_error(
+            _lib.ls_pack_vector(
+                subgroup_basis._payload,
+                self._payload,
+                _get_dtype(x.dtype),
+                x.shape[0],
+                x.shape[1],
+                x.ctypes.data_as(c_void_p),
+                x.strides[1] // x.itemsize,
+                out.ctypes.data_as(c_void_p),
+                out.strides[1] // out.itemsize,
+            )
+        )
+        if x_was_a_vector:
+            out = np.squeeze(out, axis=1)
+        return out
+
+    def amplitude(self, x: np.ndarray, spins: np.ndarray) -> np.ndarray:
+        """Compute amplitudes ψ(s) of vector `x` for arbitrary spin configurations `spins`.
+
+        Unlike :py:meth:`index`, `spins` need not be representatives. Configurations which do not
+        belong to the basis get amplitude zero.
+        """
+        self.build()
+        x = np.ascontiguousarray(x)
+        spins = np.ascontiguousarray(spins, dtype=np.uint64)
+        if x.ndim != 1 or spins.ndim != 1:
+            raise ValueError("'x' and 'spins' must be 1D arrays")
+        out = np.empty(spins.shape[0], dtype=x.dtype)
+        _check_error(
+            _lib.ls_batched_amplitude(
+                self._payload,
+                _get_dtype(x.dtype),
+                x.shape[0],
+                x.ctypes.data_as(c_void_p),
+                spins.shape[0],
+                spins.ctypes.data_as(POINTER(c_uint64)),
+                out.ctypes.data_as(c_void_p),
+            )
+        )
+        return out
+
     def index(self, bits: int) -> int:
         """Obtain index of a representative in `self.states` array. This function is available only
         after a call to `self.build`."""
@@ -865,24 +1228,77 @@ class Interaction:
         return Interaction(matrix, src["sites"])
 
 
-def _create_operator(basis: SpinBasis, terms: List[Interaction]) -> c_void_p:
+def _create_operator(
+    basis: SpinBasis, terms: List[Interaction], output_basis: Optional[SpinBasis] = None
+) -> c_void_p:
     if not isinstance(basis, SpinBasis):
         raise TypeError("expected SpinBasis, but got {}".format(type(basis)))
+    if output_basis is not None and not isinstance(output_basis, SpinBasis):
+        raise TypeError("expected SpinBasis, but got {}".format(type(output_basis)))
     if not all(map(lambda x: isinstance(x, Interaction), terms)):
         raise TypeError("expected List[Interaction]")
     view = (c_void_p * len(terms))()
     for i in range(len(terms)):
         view[i] = terms[i]._payload
     op = c_void_p()
-    _check_error(_lib.ls_create_operator(byref(op), basis._payload, len(terms), view))
+    if output_basis is None:
+        _check_error(_lib.ls_create_operator(byref(op), basis._payload, len(terms), view))
+    else:
+        _check_error(
+            _lib.ls_create_sector_operator(
+                byref(op), basis._payload, output_basis._payload, len(terms), view
+            )
+        )
     return op
 
 
 class Operator:
-    def __init__(self, basis, terms):
-        self._payload = _create_operator(basis, terms)
+    def __init__(self, basis, terms, output_basis=None):
+        """Create an operator acting in `basis`.
+
+        If `output_basis` is given, the operator maps vectors in `basis` to vectors in
+        `output_basis` (e.g. S⁺ between sectors with different Hamming weights). `terms` must map
+        the sector of `basis` into the sector of `output_basis` (e.g. Sᶻ(q) maps momentum k onto
+        k + q). This is not checked, and results are silently wrong otherwise.
+        """
+        self._payload = _create_operator(basis, terms, output_basis)
         self._finalizer = weakref.finalize(self, _destroy(_lib.ls_destroy_operator), self._payload)
         self.basis = basis
+        self.output_basis = output_basis if output_basis is not None else basis
+
+    @staticmethod
+    def _from_payload(basis: SpinBasis, payload: c_void_p) -> "Operator":
+        op = Operator.__new__(Operator)
+        op._payload = payload
+        op._finalizer = weakref.finalize(op, _destroy(_lib.ls_destroy_operator), payload)
+        op.basis = basis
+        op.output_basis = basis
+        return op
+
+    def _combine(self, other: "Operator", fn) -> "Operator":
+        if not isinstance(other, Operator):
+            raise TypeError("expected Operator, but got {}".format(type(other)))
+        payload = c_void_p()
+        _check_error(fn(byref(payload), self._payload, other._payload))
+        return Operator._from_payload(self.basis, payload)
+
+    def __add__(self, other: "Operator") -> "Operator":
+        """Symbolic sum of two operators."""
+        return self._combine(other, _lib.ls_operator_sum)
+
+    def __matmul__(self, other: "Operator") -> "Operator":
+        """Symbolic product of two operators, e.g. `H @ H` for H²."""
+        return self._combine(other, _lib.ls_operator_product)
+
+    def commutator(self, other: "Operator") -> "Operator":
+        """Symbolic commutator `[self, other]`."""
+        return self._combine(other, _lib.ls_operator_commutator)
+
+    @property
+    def number_local_terms(self) -> int:
+        """Number of local terms (site tuples). Cost of applying the operator is roughly
+        proportional to it."""
+        return _lib.ls_operator_get_number_local_terms(self._payload)
 
     def __call__(self, x, out=None):
         if x.ndim != 1 and x.ndim != 2:
@@ -902,7 +1318,10 @@ class Operator:
             )
             x = np.asfortranarray(x)
         if out is None:
-            out = np.empty_like(x, order="F")
+            if self.output_basis is self.basis:
+                out = np.empty_like(x, order="F")
+            else:
+                out = np.empty((self.output_basis.number_states, x.shape[1]), dtype=x.dtype, order="F")
         else:
             if not out.flags["F_CONTIGUOUS"]:
                 warnings.warn(
@@ -931,6 +1350,127 @@ class Operator:
             out = np.squeeze(out)
         return out
 
+    def matmat_rows(self, x: np.ndarray, rows: np.ndarray) -> np.ndarray:
+        """Compute only rows `rows` of `self(x)`."""
+        x_was_a_vector = x.ndim == 1
+        x = np.asfortranarray(x.reshape(-1, 1) if x_was_a_vector else x)
+        rows = np.ascontiguousarray(rows, dtype=np.uint64)
+        out = np.empty((rows.shape[0], x.shape[1]), dtype=x.dtype, order="F")
+        _check_error(
+            _lib.ls_operator_matmat_rows(
+                self._payload,
+                _get_dtype(x.dtype),
+                x.shape[0],
+                x.shape[1],
+                x.ctypes.data_as(c_void_p),
+                x.strides[1] // x.itemsize,
+                rows.shape[0],
+                rows.ctypes.data_as(POINTER(c_uint64)),
+                out.ctypes.data_as(c_void_p),
+                out.strides[1] // out.itemsize,
+            )
+        )
+        if x_was_a_vector:
+            out = np.squeeze(out, axis=1)
+        return out
+
+    def matmat_async(self, x: np.ndarray, out: Optional[np.ndarray] = None) -> "MatmatFuture":
+        """Start computing `self(x)` in the background.
+
+        Returns a :py:class:`MatmatFuture`. `x` and `out` must not be modified until
+        :py:meth:`MatmatFuture.wait` returns.
+        """
+        x_was_a_vector = x.ndim == 1
+        x = np.asfortranarray(x.reshape(-1, 1) if x_was_a_vector else x)
+        if out is None:
+            out = np.empty((self.output_basis.number_states, x.shape[1]), dtype=x.dtype, order="F")
+        else:
+            out = out.reshape(-1, 1) if out.ndim == 1 else out
+            if not out.flags["F_CONTIGUOUS"]:
+                raise ValueError("'out' must be Fortran-contiguous")
+            if x.dtype != out.dtype:
+                raise ValueError(
+                    "datatypes of 'x' and 'out' do not match: {} vs {}".format(x.dtype, out.dtype)
+                )
+        handle = c_void_p()
+        _check_error(
+            _lib.ls_operator_matmat_async(
+                self._payload,
+                _get_dtype(x.dtype),
+                x.shape[0],
+                x.shape[1],
+                x.ctypes.data_as(c_void_p),
+                x.strides[1] // x.itemsize,
+                out.ctypes.data_as(c_void_p),
+                out.strides[1] // out.itemsize,
+                byref(handle),
+            )
+        )
+        return MatmatFuture(self, x, out, handle, x_was_a_vector)
+
+    def matmat_file(self, x_filename: str, y_filename: str, block_size: int = 1,
+                    dtype=np.float64, tile_rows: Optional[int] = None,
+                    queue_depth: Optional[int] = None):
+        """Compute `y = self(x)` for `block_size` vectors stored in files.
+
+        Both files contain raw column-major data of type `dtype` (e.g. written using
+        `np.asfortranarray(x).tofile(x_filename)`). `x` is memory-mapped, and `y` is computed in
+        tiles of `tile_rows` rows which are written to `y_filename` in the background.
+        """
+        self.basis.build()
+        self.output_basis.build()
+        options = ls_out_of_core_options()
+        _lib.ls_out_of_core_default_options(byref(options))
+        if tile_rows is not None:
+            options.tile_rows = tile_rows
+        if queue_depth is not None:
+            options.queue_depth = queue_depth
+        _check_error(
+            _lib.ls_operator_matmat_file(
+                self._payload,
+                _get_dtype(np.dtype(dtype)),
+                self.basis.number_states,
+                block_size,
+                os.fsencode(x_filename),
+                os.fsencode(y_filename),
+                byref(options),
+            )
+        )
+
+    def apply_sparse(self, indices: np.ndarray, values: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+        """Apply the operator to a sparse vector given by basis `indices` and `values`.
+
+        Returns indices (in ascending order) and values of non-zero elements of the result.
+        """
+        indices = np.ascontiguousarray(indices, dtype=np.uint64)
+        values = np.ascontiguousarray(values, dtype=np.complex128)
+        if indices.shape != values.shape or indices.ndim != 1:
+            raise ValueError("'indices' and 'values' must be 1D arrays of the same length")
+        y = c_void_p()
+        _check_error(
+            _lib.ls_operator_apply_sparse(
+                self._payload,
+                indices.shape[0],
+                indices.ctypes.data_as(POINTER(c_uint64)),
+                values.ctypes.data_as(c_void_p),
+                byref(y),
+            )
+        )
+        try:
+            size = _lib.ls_sparse_vector_get_size(y)
+            out_indices = np.empty(size, dtype=np.uint64)
+            out_values = np.empty(size, dtype=np.complex128)
+            if size > 0:
+                ctypes.memmove(
+                    out_indices.ctypes.data, _lib.ls_sparse_vector_get_indices(y), out_indices.nbytes
+                )
+                ctypes.memmove(
+                    out_values.ctypes.data, _lib.ls_sparse_vector_get_values(y), out_values.nbytes
+                )
+        finally:
+            _lib.ls_destroy_sparse_vector(y)
+        return out_indices, out_values
+
     def expectation(self, x):
         if x.ndim != 1 and x.ndim != 2:
             raise ValueError(
@@ -964,37 +1504,216 @@ class Operator:
             out = complex(out)
         return out
 
+    def expm_multiply(self, x: np.ndarray, t: float, tol: Optional[float] = None,
+                      krylov_dimension: Optional[int] = None) -> np.ndarray:
+        """Compute `exp(-iHt) x` using adaptive Krylov subspace methods."""
+        x = np.ascontiguousarray(x, dtype=np.complex128)
+        out = np.empty_like(x)
+        _check_error(
+            _lib.ls_operator_expm_multiply(
+                self._payload,
+                x.shape[0],
+                t,
+                x.ctypes.data_as(c_void_p),
+                out.ctypes.data_as(c_void_p),
+                byref(_make_expm_options(tol, krylov_dimension)),
+                None,
+            )
+        )
+        return out
+
+    def evolve(self, x: np.ndarray, times, observables: List["Operator"] = [],
+               tol: Optional[float] = None, krylov_dimension: Optional[int] = None):
+        """Evolve `x` with `exp(-iHt)` and measure `observables` at non-decreasing `times`.
+
+        Intermediate states are not stored. Returns a tuple of expectation values (an array of
+        shape `(len(times), len(observables))`) and the state at `times[-1]`.
+        """
+        x = np.ascontiguousarray(x, dtype=np.complex128)
+        times = np.ascontiguousarray(times, dtype=np.float64)
+        expectations = np.empty((len(times), len(observables)), dtype=np.complex128)
+        out = np.empty_like(x)
+        view = (c_void_p * max(len(observables), 1))()
+        for i, o in enumerate(observables):
+            view[i] = o._payload
+        _check_error(
+            _lib.ls_operator_evolve(
+                self._payload,
+                x.shape[0],
+                x.ctypes.data_as(c_void_p),
+                len(times),
+                times.ctypes.data_as(POINTER(c_double)),
+                len(observables),
+                view,
+                expectations.ctypes.data_as(c_void_p),
+                out.ctypes.data_as(c_void_p),
+                byref(_make_expm_options(tol, krylov_dimension)),
+                None,
+            )
+        )
+        return expectations, out
+
+    def spectral_bounds(self, dtype=np.float64) -> Tuple[float, float]:
+        """Estimate an interval which contains the whole spectrum."""
+        self.basis.build()
+        lower = c_double()
+        upper = c_double()
+        _check_error(
+            _lib.ls_operator_spectral_bounds(
+                self._payload,
+                _get_dtype(np.dtype(dtype)),
+                self.basis.number_states,
+                byref(lower),
+                byref(upper),
+            )
+        )
+        return lower.value, upper.value
+
+    def kpm_dos(self, number_moments: int, number_vectors: int = 16, block_size: int = 8,
+                bounds: Optional[Tuple[float, float]] = None, seed: int = 0,
+                dtype=np.float64) -> Tuple[np.ndarray, Tuple[float, float]]:
+        """Chebyshev moments of the density of states (normalized to one).
+
+        The trace is estimated using `number_vectors` random vectors which are processed in
+        blocks of `block_size`. Returns moments and the spectral bounds used to compute them.
+        """
+        if bounds is None:
+            bounds = self.spectral_bounds(dtype)
+        moments = np.empty(number_moments, dtype=np.float64)
+        _check_error(
+            _lib.ls_operator_kpm_dos(
+                self._payload,
+                _get_dtype(np.dtype(dtype)),
+                self.basis.number_states,
+                bounds[0],
+                bounds[1],
+                number_moments,
+                number_vectors,
+                block_size,
+                seed,
+                moments.ctypes.data_as(POINTER(c_double)),
+            )
+        )
+        return moments, bounds
+
+    def kpm_correlation(self, right: np.ndarray, number_moments: int,
+                        bounds: Optional[Tuple[float, float]] = None,
+                        left: Optional[np.ndarray] = None) -> Tuple[np.ndarray, Tuple[float, float]]:
+        """Chebyshev moments ⟨left|Tₙ(H̃)|right⟩ (`left` defaults to `right`)."""
+        right = np.ascontiguousarray(right)
+        if bounds is None:
+            bounds = self.spectral_bounds(right.dtype)
+        if left is not None:
+            left = np.ascontiguousarray(left, dtype=right.dtype)
+        moments = np.empty(number_moments, dtype=np.complex128)
+        _check_error(
+            _lib.ls_operator_kpm_correlation(
+                self._payload,
+                _get_dtype(right.dtype),
+                right.shape[0],
+                bounds[0],
+                bounds[1],
+                number_moments,
+                right.ctypes.data_as(c_void_p),
+                left.ctypes.data_as(c_void_p) if left is not None else None,
+                moments.ctypes.data_as(c_void_p),
+            )
+        )
+        return moments, bounds
+
     @property
     def max_buffer_size(self):
         return int(_lib.ls_operator_max_buffer_size(self._payload))
 
+    def enable_jit(self):
+        """Generate and compile code specialized to this operator.
+
+        Subsequent calls to `matvec`, `matmat` and `expectation` use the compiled kernel.
+        """
+        _check_error(_lib.ls_operator_enable_jit(self._payload))
+
+    @property
+    def has_jit(self) -> bool:
+        return bool(_lib.ls_operator_has_jit(self._payload))
+
+    def plan(self, dtype=np.float64, block_size: int = 1, memory_budget: int = 0):
+        """Choose the fastest way to apply the operator to `block_size` vectors of type `dtype`.
+
+        `memory_budget` (in bytes) limits extra memory which the chosen strategy may use; 0 means
+        no limit. See also `save_wisdom` and `load_wisdom`.
+        """
+        _check_error(
+            _lib.ls_operator_plan(
+                self._payload, _get_dtype(np.dtype(dtype)), block_size, memory_budget
+            )
+        )
+
+    def set_tile_size(self, tile_size: int):
+        """Process `tile_size` rows at a time sorting matrix elements by column index. 0 disables
+        tiling."""
+        _lib.ls_operator_set_tile_size(self._payload, tile_size)
+
     def apply(self, x: int):
-        max_size = self.max_buffer_size
-        spins = np.empty((max_size, 8), dtype=np.uint64)
-        coeffs = np.empty((max_size, 2), dtype=np.float64)
-        i = 0
+        spins, coeffs, _ = self.apply_chunked(
+            np.array([list(_int_to_ls_bits512(x))], dtype=np.uint64)
+        )
+        return spins, coeffs
+
+    def apply_chunked(
+        self, x: np.ndarray, chunk_size: int = 4096
+    ) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+        """Apply the operator to a batch of spin configurations.
+
+        Unlike `apply`, results are transferred from C in chunks of approximately `chunk_size`
+        elements rather than one element at a time. Returns a tuple `(spins, coeffs, counts)`
+        where `counts[i]` is the number of elements produced by `x[i]`.
+        """
+        x = np.asarray(x, dtype=np.uint64)
+        if x.ndim == 1:
+            x = np.hstack([x.reshape(-1, 1), np.zeros((x.shape[0], 7), dtype=np.uint64)])
+        elif x.ndim != 2 or x.shape[1] != 8:
+            raise ValueError("'x' has wrong shape: {}; expected (?,) or (?, 8)".format(x.shape))
+        x = np.ascontiguousarray(x)
+        spins = []
+        coeffs = []
+        counts = np.zeros(x.shape[0], dtype=np.int64)
         e = None
 
-        def callback(spin, coeff, cxt):
-            nonlocal i, e
+        def callback(first, number_inputs, offsets, chunk_spins, chunk_coeffs, cxt):
+            nonlocal e
             try:
-                spins[i] = spin.contents
-                coeffs[i] = coeff.contents
-                i += 1
+                offsets = np.ctypeslib.as_array(offsets, shape=(number_inputs + 1,))
+                counts[first : first + number_inputs] = np.diff(offsets)
+                size = int(offsets[-1])
+                if size > 0:
+                    spins.append(
+                        np.ctypeslib.as_array(
+                            ctypes.cast(chunk_spins, POINTER(c_uint64)), shape=(size, 8)
+                        ).copy()
+                    )
+                    coeffs.append(np.ctypeslib.as_array(chunk_coeffs, shape=(size, 2)).copy())
                 return 0
             except Exception as _e:
                 e = _e
                 return -1
 
-        status = _lib.ls_operator_apply(
-            self._payload, byref(_int_to_ls_bits512(x)), ls_callback(callback), None
+        status = _lib.ls_operator_apply_chunked(
+            self._payload,
+            x.shape[0],
+            x.ctypes.data_as(POINTER(c_uint64)),
+            chunk_size,
+            ls_chunk_callback(callback),
+            None,
         )
         if status == -1:
             assert e is not None
             raise e
         _check_error(status)
-        coeffs = coeffs.view(np.complex128).reshape(-1)
-        return spins[:i], coeffs[:i]
+        if len(spins) == 0:
+            return np.empty((0, 8), dtype=np.uint64), np.empty(0, dtype=np.complex128), counts
+        spins = np.concatenate(spins)
+        coeffs = np.concatenate(coeffs).view(np.complex128).reshape(-1)
+        return spins, coeffs, counts
 
     def batched_apply(self, x: np.ndarray) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
         x = np.asarray(x, dtype=np.uint64)
@@ -1021,6 +1740,30 @@ class Operator:
         )
         return spins[:written], coeffs[:written], counts.astype(np.int64)
 
+    def batched_diagonal(self, x: np.ndarray) -> np.ndarray:
+        """Compute diagonal matrix elements ⟨σ|O|σ⟩ for a batch of spin configurations.
+
+        `x` may be either a 1D array of `uint64` (for systems with at most 64 spins) or a 2D
+        array of shape `(?, 8)`.
+        """
+        x = np.ascontiguousarray(x, dtype=np.uint64)
+        if x.ndim == 1:
+            x = x.reshape(-1, 1)
+        elif x.ndim != 2 or x.shape[1] != 8:
+            raise ValueError("'x' has wrong shape: {}; expected (?,) or (?, 8)".format(x.shape))
+        out = np.empty(x.shape[0], dtype=np.complex128)
+        _check_error(
+            _lib.ls_operator_batched_diagonal(
+                self._payload,
+                x.shape[0],
+                x.ctypes.data_as(POINTER(c_uint64)),
+                x.shape[1],
+                out.ctypes.data_as(c_void_p),
+                1,
+            )
+        )
+        return out
+
     @staticmethod
     def load_from_yaml(src, basis: SpinBasis):
         """Load Operator from a parsed YAML document."""
@@ -1028,18 +1771,352 @@ class Operator:
         return Operator(basis, terms)
 
 
-def diagonalize(hamiltonian: Operator, k: int = 1, dtype=None, **kwargs):
-    import gc
-    import scipy.sparse.linalg
+class MatmatFuture:
+    """Result of :py:meth:`Operator.matmat_async` (wrapper around `ls_matmat_handle` C type)."""
+
+    def __init__(self, operator: Operator, x: np.ndarray, out: np.ndarray, handle: c_void_p,
+                 squeeze: bool):
+        # Keep the operator and the buffers alive while the product is running
+        self._operator = operator
+        self._x = x
+        self._out = out
+        self._squeeze = squeeze
+        self._payload = handle
+        self._finalizer = weakref.finalize(
+            self, _destroy(_lib.ls_destroy_matmat_handle), self._payload
+        )
+
+    def done(self) -> bool:
+        """Return whether the product has finished."""
+        return bool(_lib.ls_matmat_test(self._payload))
+
+    def wait(self) -> np.ndarray:
+        """Block until the product has finished and return the result."""
+        _check_error(_lib.ls_matmat_wait(self._payload))
+        return np.squeeze(self._out, axis=1) if self._squeeze else self._out
+
 
+def diagonalize(hamiltonian: Operator, k: int = 1, dtype=None, method: str = "arpack", **kwargs):
+    """Compute `k` lowest eigenvalues and corresponding eigenvectors of `hamiltonian`.
+
+    By default, `scipy.sparse.linalg.eigsh` is called with `which="SA"`, and `kwargs` are passed
+    to it.
+
+    `method="lanczos"` selects the native thick-restart Lanczos solver, and `method="lobpcg"`
+    the native block LOBPCG solver. Both accept the `eigsh` keywords `v0`, `tol`, `maxiter`,
+    `which` (only "SA" is supported), and `return_eigenvectors`. `tol=0` (the `eigsh` default)
+    selects the default tolerance of the native solver. Lanczos additionally accepts `ncv`
+    (Krylov subspace dimension; `maxiter` is then the number of restarts), `storage` (datatype
+    in which Krylov vectors are stored), and `two_pass`. LOBPCG accepts `precondition`, and `v0`
+    must then have shape `(n, k)`. For `float32` and `complex64` dtypes the native
+    solvers work in double precision, store Krylov vectors in single precision (unless
+    `storage` is given), and cast eigenvectors back. If they fail to converge, a
+    `LatticeSymmetriesException` is raised.
+    """
     hamiltonian.basis.build()
     n = hamiltonian.basis.number_states
     if dtype is None:
         dtype = np.float64
 
-    def matvec(x):
-        gc.collect()
-        return hamiltonian(x)
+    if method == "arpack":
+        import gc
+        import scipy.sparse.linalg
+
+        def matvec(x):
+            gc.collect()
+            return hamiltonian(x)
+
+        op = scipy.sparse.linalg.LinearOperator(shape=(n, n), matvec=matvec, dtype=dtype)
+        kwargs.setdefault("which", "SA")
+        return scipy.sparse.linalg.eigsh(op, k=k, **kwargs)
+    if method not in ("lanczos", "lobpcg"):
+        raise ValueError(
+            "invalid method: {}; expected one of 'arpack', 'lanczos', or 'lobpcg'".format(method)
+        )
+    which = kwargs.pop("which", "SA")
+    if which != "SA":
+        raise ValueError(
+            "invalid which: {}; method='{}' only computes the lowest eigenvalues ('SA'), use "
+            "method='arpack' instead".format(which, method)
+        )
+    if kwargs.get("tol", None) == 0:
+        del kwargs["tol"]
+    return_eigenvectors = kwargs.pop("return_eigenvectors", True)
+    v0 = kwargs.pop("v0", None)
+
+    dtype = np.dtype(dtype)
+    if dtype == np.float32 or dtype == np.complex64:
+        if method == "lanczos":
+            kwargs.setdefault("storage", dtype)
+        result_dtype = dtype
+        dtype = np.dtype(np.float64 if dtype == np.float32 else np.complex128)
+    elif dtype == np.float64 or dtype == np.complex128:
+        result_dtype = dtype
+    else:
+        raise ValueError(
+            "invalid dtype: {}; expected one of float32, float64, complex64, or "
+            "complex128".format(dtype)
+        )
+    if method == "lobpcg":
+        eigenvalues, eigenvectors = _lobpcg(hamiltonian, k, dtype, v0, **kwargs)
+    else:
+        eigenvalues, eigenvectors = _lanczos(
+            hamiltonian, k, dtype, v0, return_eigenvectors, **kwargs
+        )
+    if not return_eigenvectors:
+        return eigenvalues
+    return eigenvalues, eigenvectors.astype(result_dtype, copy=False)
+
+
+def _lanczos(
+    hamiltonian: Operator,
+    k: int,
+    dtype: np.dtype,
+    v0: Optional[np.ndarray],
+    return_eigenvectors: bool,
+    **kwargs
+):
+    n = hamiltonian.basis.number_states
+    options = ls_lanczos_options()
+    _lib.ls_lanczos_default_options(byref(options))
+    options.number_eigenvalues = k
+    if "tol" in kwargs:
+        options.tolerance = kwargs.pop("tol")
+    if "ncv" in kwargs:
+        options.krylov_dimension = kwargs.pop("ncv")
+    if "maxiter" in kwargs:
+        options.max_restarts = kwargs.pop("maxiter")
+    if "storage" in kwargs:
+        options.storage = _get_dtype(np.dtype(kwargs.pop("storage")))
+    if "two_pass" in kwargs:
+        options.two_pass = kwargs.pop("two_pass")
+    if len(kwargs) != 0:
+        raise TypeError("unexpected keyword arguments: {}".format(list(kwargs.keys())))
+    if v0 is not None:
+        v0 = np.ascontiguousarray(v0, dtype=dtype)
+        if v0.shape != (n,):
+            raise ValueError("'v0' has wrong shape: {}; expected ({},)".format(v0.shape, n))
+
+    eigenvalues = np.empty(k, dtype=np.float64)
+    eigenvectors = np.empty((n, k), dtype=dtype, order="F") if return_eigenvectors else None
+    info = ls_lanczos_info()
+    _check_error(
+        _lib.ls_operator_lanczos(
+            hamiltonian._payload,
+            _get_dtype(dtype),
+            n,
+            byref(options),
+            v0.ctypes.data_as(c_void_p) if v0 is not None else None,
+            eigenvalues.ctypes.data_as(POINTER(c_double)),
+            eigenvectors.ctypes.data_as(c_void_p) if eigenvectors is not None else None,
+            n,
+            byref(info),
+        )
+    )
+    return eigenvalues, eigenvectors
+
 
-    op = scipy.sparse.linalg.LinearOperator(shape=(n, n), matvec=matvec, dtype=dtype)
-    return scipy.sparse.linalg.eigsh(op, k=k, which="SA", **kwargs)
+def _lobpcg(hamiltonian: Operator, k: int, dtype: np.dtype, v0: Optional[np.ndarray], **kwargs):
+    n = hamiltonian.basis.number_states
+    options = ls_lobpcg_options()
+    _lib.ls_lobpcg_default_options(byref(options))
+    options.number_eigenvalues = k
+    if "tol" in kwargs:
+        options.tolerance = kwargs.pop("tol")
+    if "maxiter" in kwargs:
+        options.max_iterations = kwargs.pop("maxiter")
+    if "precondition" in kwargs:
+        options.precondition = kwargs.pop("precondition")
+    if len(kwargs) != 0:
+        raise TypeError("unexpected keyword arguments: {}".format(list(kwargs.keys())))
+    if v0 is not None:
+        v0 = np.asfortranarray(v0, dtype=dtype).reshape(n, -1, order="F")
+        if v0.shape != (n, k):
+            raise ValueError("'v0' has wrong shape: {}; expected ({}, {})".format(v0.shape, n, k))
+
+    eigenvalues = np.empty(k, dtype=np.float64)
+    eigenvectors = np.empty((n, k), dtype=dtype, order="F")
+    info = ls_lobpcg_info()
+    _check_error(
+        _lib.ls_operator_lobpcg(
+            hamiltonian._payload,
+            _get_dtype(dtype),
+            n,
+            byref(options),
+            v0.ctypes.data_as(c_void_p) if v0 is not None else None,
+            n,
+            eigenvalues.ctypes.data_as(POINTER(c_double)),
+            eigenvectors.ctypes.data_as(c_void_p),
+            n,
+            byref(info),
+        )
+    )
+    return eigenvalues, eigenvectors
+
+
+def kpm_reconstruct(
+    moments: np.ndarray,
+    bounds: Tuple[float, float],
+    energies: np.ndarray,
+    kernel: str = "jackson",
+    lorentz_lambda: float = 4.0,
+) -> np.ndarray:
+    """Reconstruct a spectral density from Chebyshev moments using kernel damping.
+
+    `kernel` is one of "jackson", "lorentz", or None. Complex moments are handled by
+    reconstructing real and imaginary parts separately.
+    """
+    moments = np.asarray(moments)
+    if np.iscomplexobj(moments):
+        return kpm_reconstruct(
+            moments.real, bounds, energies, kernel, lorentz_lambda
+        ) + 1j * kpm_reconstruct(moments.imag, bounds, energies, kernel, lorentz_lambda)
+    kernels = {None: 0, "jackson": 1, "lorentz": 2}
+    if kernel not in kernels:
+        raise ValueError("invalid kernel: {}; expected 'jackson', 'lorentz', or None".format(kernel))
+    moments = np.ascontiguousarray(moments, dtype=np.float64)
+    energies = np.ascontiguousarray(energies, dtype=np.float64)
+    out = np.empty_like(energies)
+    _check_error(
+        _lib.ls_kpm_reconstruct(
+            moments.shape[0],
+            moments.ctypes.data_as(POINTER(c_double)),
+            kernels[kernel],
+            lorentz_lambda,
+            bounds[0],
+            bounds[1],
+            energies.size,
+            energies.ctypes.data_as(POINTER(c_double)),
+            out.ctypes.data_as(POINTER(c_double)),
+        )
+    )
+    return out
+
+
+def ftlm(
+    operators: List["Operator"],
+    temperatures,
+    degeneracies: Optional[List[float]] = None,
+    krylov_dimension: Optional[int] = None,
+    number_vectors: Optional[int] = None,
+    block_size: Optional[int] = None,
+    seed: Optional[int] = None,
+) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+    """Compute ln Z, energy, and specific heat at `temperatures` using finite-temperature Lanczos.
+
+    `operators` is the Hamiltonian restricted to every symmetry sector. `degeneracies[s]` is the
+    number of sectors equivalent to `operators[s]` (1 by default).
+    """
+    temperatures = np.ascontiguousarray(temperatures, dtype=np.float64)
+    options = ls_ftlm_options()
+    _lib.ls_ftlm_default_options(byref(options))
+    if krylov_dimension is not None:
+        options.krylov_dimension = krylov_dimension
+    if number_vectors is not None:
+        options.number_vectors = number_vectors
+    if block_size is not None:
+        options.block_size = block_size
+    if seed is not None:
+        options.seed = seed
+    view = (c_void_p * max(len(operators), 1))()
+    for i, o in enumerate(operators):
+        o.basis.build()
+        view[i] = o._payload
+    if degeneracies is not None:
+        degeneracies = np.ascontiguousarray(degeneracies, dtype=np.float64)
+        if degeneracies.shape != (len(operators),):
+            raise ValueError("expected one degeneracy per operator")
+        degeneracies = degeneracies.ctypes.data_as(POINTER(c_double))
+    log_z = np.empty_like(temperatures)
+    energy = np.empty_like(temperatures)
+    specific_heat = np.empty_like(temperatures)
+    _check_error(
+        _lib.ls_ftlm(
+            len(operators),
+            view,
+            degeneracies,
+            byref(options),
+            temperatures.size,
+            temperatures.ctypes.data_as(POINTER(c_double)),
+            log_z.ctypes.data_as(POINTER(c_double)),
+            energy.ctypes.data_as(POINTER(c_double)),
+            specific_heat.ctypes.data_as(POINTER(c_double)),
+        )
+    )
+    return log_z, energy, specific_heat
+
+
+def run_sector_jobs(
+    jobs: List[dict], number_threads: Optional[int] = None, memory_budget: Optional[int] = None
+) -> list:
+    """Run eigenvalue and KPM computations for many sectors concurrently.
+
+    Every job is a dictionary with keys "operator", "kind" (one of "build", "spectrum",
+    "lanczos", or "kpm_dos"), and optionally "dtype" (float64 by default). "lanczos" jobs accept
+    "k" (1 by default), and "kpm_dos" jobs accept "number_moments", "number_vectors",
+    "block_size", "seed", and "bounds" (like `Operator.kpm_dos`).
+
+    Bases are built first. Jobs then share a pool of `number_threads` threads, and every job gets
+    a share of it proportional to its size. `memory_budget` (in bytes) limits how many large jobs
+    run at once. Returns a list with one result per job: None for "build", eigenvalues for
+    "spectrum", a tuple of eigenvalues and eigenvectors for "lanczos", and a tuple of moments and
+    bounds for "kpm_dos".
+    """
+    kinds = {"build": 0, "spectrum": 1, "lanczos": 2, "kpm_dos": 3}
+    options = ls_scheduler_options()
+    _lib.ls_scheduler_default_options(byref(options))
+    if number_threads is not None:
+        options.number_threads = number_threads
+    if memory_budget is not None:
+        options.memory_budget = memory_budget
+
+    view = (ls_sector_job * max(len(jobs), 1))()
+    for i, job in enumerate(jobs):
+        if job["kind"] not in kinds:
+            raise ValueError(
+                "invalid kind: {}; expected one of {}".format(job["kind"], list(kinds.keys()))
+            )
+        view[i].op = job["operator"]._payload
+        view[i].dtype = _get_dtype(np.dtype(job.get("dtype", np.float64)))
+    # Build all bases such that outputs can be allocated
+    _check_error(_lib.ls_run_sector_jobs(len(jobs), view, byref(options)))
+
+    results = []
+    keep_alive = []
+    for i, job in enumerate(jobs):
+        n = job["operator"].basis.number_states
+        dtype = np.dtype(job.get("dtype", np.float64))
+        view[i].kind = kinds[job["kind"]]
+        if job["kind"] == "build":
+            results.append(None)
+        elif job["kind"] == "spectrum":
+            values = np.empty(n, dtype=np.float64)
+            view[i].values = values.ctypes.data_as(POINTER(c_double))
+            results.append(values)
+        elif job["kind"] == "lanczos":
+            k = job.get("k", 1)
+            lanczos = ls_lanczos_options()
+            _lib.ls_lanczos_default_options(byref(lanczos))
+            lanczos.number_eigenvalues = k
+            values = np.empty(k, dtype=np.float64)
+            vectors = np.empty((n, k), dtype=dtype, order="F")
+            view[i].values = values.ctypes.data_as(POINTER(c_double))
+            view[i].vectors = vectors.ctypes.data_as(c_void_p)
+            view[i].lanczos_options = ctypes.pointer(lanczos)
+            keep_alive.append(lanczos)
+            results.append((values, vectors))
+        else:
+            moments = np.empty(job["number_moments"], dtype=np.float64)
+            view[i].values = moments.ctypes.data_as(POINTER(c_double))
+            view[i].number_moments = moments.size
+            view[i].number_vectors = job.get("number_vectors", 16)
+            view[i].block_size = job.get("block_size", 8)
+            view[i].seed = job.get("seed", 0)
+            if "bounds" in job:
+                view[i].lower, view[i].upper = job["bounds"]
+            results.append(moments)
+    _check_error(_lib.ls_run_sector_jobs(len(jobs), view, byref(options)))
+    for i, job in enumerate(jobs):
+        if job["kind"] == "kpm_dos":
+            results[i] = (results[i], (view[i].lower, view[i].upper))
+    return results
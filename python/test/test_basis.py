@@ -36,6 +36,28 @@ def test_4_spins():
     assert np.isclose(ls.diagonalize(operator, k=1)[0], -8)
 
 
+def test_native_diagonalize():
+    matrix = np.array([[1, 0, 0, 0], [0, -1, 2, 0], [0, 2, -1, 0], [0, 0, 0, 1]])
+    edges = [(i, (i + 1) % 10) for i in range(10)]
+    basis = ls.SpinBasis(ls.Group([]), number_spins=10, hamming_weight=5)
+    basis.build()
+    operator = ls.Operator(basis, [ls.Interaction(matrix, edges)])
+    expected = ls.diagonalize(operator, k=2)[0]
+    for method in ["lanczos", "lobpcg"]:
+        # eigsh keywords are understood
+        shape = (basis.number_states,) if method == "lanczos" else (basis.number_states, 2)
+        v0 = np.random.default_rng(seed=0).standard_normal(shape)
+        e, v = ls.diagonalize(operator, k=2, method=method, v0=v0, which="SA", tol=0)
+        assert np.allclose(e, expected)
+        assert v.shape == (basis.number_states, 2)
+        e, v = ls.diagonalize(operator, k=2, dtype=np.float32, method=method)
+        assert v.dtype == np.float32
+        assert np.allclose(e, expected, atol=1e-5)
+        assert np.allclose(
+            ls.diagonalize(operator, k=2, method=method, return_eigenvectors=False), expected
+        )
+
+
 def test_index():
     L_x, L_y = (4, 6)
     backend = "ls"
@@ -51,6 +51,27 @@ def test_batched_apply():
         assert offset == coeffs.shape[0]
 
 
+def test_apply_chunked():
+    basis = ls.SpinBasis(ls.Group([]), number_spins=10, hamming_weight=5)
+    basis.build()
+    # fmt: off
+    matrix = np.array([[1,  0,  0, 0],
+                       [0, -1,  2, 0],
+                       [0,  2, -1, 0],
+                       [0,  0,  0, 1]])
+    # fmt: on
+    edges = [(i, (i + 1) % basis.number_spins) for i in range(basis.number_spins)]
+    operator = ls.Operator(basis, [ls.Interaction(matrix, edges)])
+
+    x = basis.states[7:57]
+    expected_spins, expected_coeffs, expected_counts = operator.batched_apply(x)
+    for chunk_size in [1, 3, 100, 10000]:
+        spins, coeffs, counts = operator.apply_chunked(x, chunk_size=chunk_size)
+        assert np.all(counts == expected_counts)
+        assert np.all(spins == expected_spins)
+        assert np.all(coeffs == expected_coeffs)
+
+
 def test_non_hermitian_matvec():
     basis = ls.SpinBasis(ls.Group([]), number_spins=2)
     basis.build()
@@ -0,0 +1,308 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "operator.hpp"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Sorted list of sites a local term acts on.
+    using support_t = std::vector<uint16_t>;
+    /// Row-major 2ᵐ × 2ᵐ matrix (m is the size of the support) in the same convention as the
+    /// matrices passed to ls_create_interaction*, i.e. the first site is the most significant bit.
+    using local_matrix_t = std::vector<std::complex<double>>;
+    /// Operator as a sum of local terms with at most one term per support.
+    using local_terms_t = std::map<support_t, local_matrix_t>;
+
+    constexpr auto max_support_size = 4U;
+
+    /// Embeds `matrix` acting on sites `tuple` (in that order) into the larger support `support`.
+    auto embed(tcb::span<std::complex<double> const> matrix, tcb::span<uint16_t const> tuple,
+               support_t const& support) -> local_matrix_t
+    {
+        auto const m         = static_cast<unsigned>(support.size());
+        auto const t         = static_cast<unsigned>(tuple.size());
+        auto const dimension = 1U << m;
+        // bits[j] is the bit in the larger index corresponding to tuple[j]
+        auto bits = std::array<unsigned, max_support_size>{};
+        auto rest = dimension - 1U;
+        for (auto j = 0U; j < t; ++j) {
+            auto const p =
+                std::distance(std::begin(support),
+                              std::lower_bound(std::begin(support), std::end(support), tuple[j]));
+            bits[j] = m - 1U - static_cast<unsigned>(p);
+            rest &= ~(1U << bits[j]);
+        }
+        auto const local = [&bits, t](unsigned const k) {
+            auto r = 0U;
+            for (auto j = 0U; j < t; ++j) {
+                r = (r << 1U) | ((k >> bits[j]) & 1U);
+            }
+            return r;
+        };
+        auto r = local_matrix_t(dimension * dimension);
+        for (auto k = 0U; k < dimension; ++k) {
+            for (auto l = 0U; l < dimension; ++l) {
+                if ((k & rest) != (l & rest)) { continue; }
+                r[k * dimension + l] = matrix[local(k) * (1U << t) + local(l)];
+            }
+        }
+        return r;
+    }
+
+    auto add_to(local_terms_t& terms, support_t const& support, local_matrix_t const& matrix,
+                std::complex<double> const scale) -> void
+    {
+        auto& target = terms[support];
+        if (target.empty()) { target.resize(matrix.size()); }
+        for (auto k = uint64_t{0}; k < matrix.size(); ++k) {
+            target[k] += scale * matrix[k];
+        }
+    }
+
+    /// Expands terms of `op` into local terms. Terms of `op` are stored Hermitian conjugated (see
+    /// ls_operator::ls_operator) and column-major, i.e. payload[k][n] = conj(matrix[k][n]).
+    auto to_local_terms(ls_operator const& op) -> local_terms_t
+    {
+        auto r = local_terms_t{};
+        for (auto const& term : op.terms) {
+            std::visit(
+                [&r](auto const& x) {
+                    constexpr auto N   = std::decay_t<decltype(x)>::number_spins;
+                    constexpr auto Dim = 1U << N;
+                    auto matrix        = local_matrix_t(Dim * Dim);
+                    for (auto k = 0U; k < Dim; ++k) {
+                        for (auto n = 0U; n < Dim; ++n) {
+                            matrix[k * Dim + n] = std::conj(x.matrix->payload[k][n]);
+                        }
+                    }
+                    for (auto const& tuple : x.sites) {
+                        auto support = support_t(std::begin(tuple), std::end(tuple));
+                        std::sort(std::begin(support), std::end(support));
+                        add_to(r, support, embed(matrix, tuple, support), 1.0);
+                    }
+                },
+                term.payload);
+        }
+        return r;
+    }
+
+    auto support_union(support_t const& a, support_t const& b) -> support_t
+    {
+        auto r = support_t{};
+        std::set_union(std::begin(a), std::end(a), std::begin(b), std::end(b),
+                       std::back_inserter(r));
+        return r;
+    }
+
+    auto overlaps(support_t const& a, support_t const& b) -> bool
+    {
+        return support_union(a, b).size() < a.size() + b.size();
+    }
+
+    /// Accumulates `scale · a · b` into `out`. Returns LS_INVALID_NUMBER_SPINS if a product of two
+    /// terms acts on more than #max_support_size sites.
+    auto multiply_into(local_terms_t& out, local_terms_t const& a, local_terms_t const& b,
+                       std::complex<double> const scale, bool const only_overlapping)
+        -> outcome::result<void>
+    {
+        for (auto const& [support_a, matrix_a] : a) {
+            for (auto const& [support_b, matrix_b] : b) {
+                // Terms with disjoint supports commute, so they cancel in commutators
+                if (only_overlapping && !overlaps(support_a, support_b)) { continue; }
+                auto const support = support_union(support_a, support_b);
+                if (support.size() > max_support_size) { return LS_INVALID_NUMBER_SPINS; }
+                auto const lhs       = embed(matrix_a, support_a, support);
+                auto const rhs       = embed(matrix_b, support_b, support);
+                auto const dimension = uint64_t{1} << support.size();
+                auto       product   = local_matrix_t(dimension * dimension);
+                for (auto i = uint64_t{0}; i < dimension; ++i) {
+                    for (auto k = uint64_t{0}; k < dimension; ++k) {
+                        if (lhs[i * dimension + k] == 0.0) { continue; }
+                        for (auto j = uint64_t{0}; j < dimension; ++j) {
+                            product[i * dimension + j] +=
+                                lhs[i * dimension + k] * rhs[k * dimension + j];
+                        }
+                    }
+                }
+                add_to(out, support, product, scale);
+            }
+        }
+        return outcome::success();
+    }
+
+    struct matrix_less_fn_t {
+        auto operator()(local_matrix_t const& a, local_matrix_t const& b) const noexcept -> bool
+        {
+            return std::lexicographical_compare(
+                std::begin(a), std::end(a), std::begin(b), std::end(b),
+                [](auto const& x, auto const& y) {
+                    return std::make_pair(x.real(), x.imag()) < std::make_pair(y.real(), y.imag());
+                });
+        }
+    };
+
+    template <unsigned N>
+    auto make_interaction(local_matrix_t const& matrix, std::vector<support_t> const& supports)
+        -> ls_interaction
+    {
+        auto sites = std::vector<std::array<uint16_t, N>>(supports.size());
+        for (auto i = uint64_t{0}; i < supports.size(); ++i) {
+            std::copy(std::begin(supports[i]), std::end(supports[i]), std::begin(sites[i]));
+        }
+        return ls_interaction{std::in_place_type_t<interaction_t<N>>{}, matrix.data(),
+                              tcb::span<std::array<uint16_t, N> const>{sites}};
+    }
+
+    /// Builds an operator from local terms. Negligible terms (relative to the largest matrix
+    /// element) are dropped and terms with identical matrices are merged into one interaction.
+    auto from_local_terms(ls_spin_basis const& basis, local_terms_t const& terms)
+        -> std::unique_ptr<ls_operator>
+    {
+        constexpr auto tolerance = 1e-13;
+        auto           largest   = 0.0;
+        for (auto const& [support, matrix] : terms) {
+            for (auto const& x : matrix) {
+                largest = std::max(largest, std::abs(x));
+            }
+        }
+        auto groups = std::map<local_matrix_t, std::vector<support_t>, matrix_less_fn_t>{};
+        for (auto const& [support, matrix] : terms) {
+            auto cleaned = matrix;
+            for (auto& x : cleaned) {
+                if (std::abs(x) <= tolerance * largest) { x = 0.0; }
+            }
+            if (std::all_of(std::begin(cleaned), std::end(cleaned),
+                            [](auto const& x) { return x == 0.0; })) {
+                continue;
+            }
+            groups[cleaned].push_back(support);
+        }
+        auto interactions = std::vector<ls_interaction>{};
+        interactions.reserve(groups.size());
+        for (auto const& [matrix, supports] : groups) {
+            switch (supports.front().size()) {
+            case 1: interactions.push_back(make_interaction<1>(matrix, supports)); break;
+            case 2: interactions.push_back(make_interaction<2>(matrix, supports)); break;
+            case 3: interactions.push_back(make_interaction<3>(matrix, supports)); break;
+            case 4: interactions.push_back(make_interaction<4>(matrix, supports)); break;
+            default: LATTICE_SYMMETRIES_UNREACHABLE;
+            }
+        }
+        auto pointers = std::vector<ls_interaction const*>(interactions.size());
+        std::transform(std::begin(interactions), std::end(interactions), std::begin(pointers),
+                       [](auto const& x) { return &x; });
+        return std::make_unique<ls_operator>(&basis, pointers);
+    }
+
+    /// Both operators must act in the same basis. Sector-changing operators are not supported.
+    auto check_compatible(ls_operator const& a, ls_operator const& b) noexcept -> ls_error_code
+    {
+        if (a.input_basis != nullptr || b.input_basis != nullptr) { return LS_INVALID_ARGUMENT; }
+        if (a.basis.get() != b.basis.get()) { return LS_INVALID_ARGUMENT; }
+        return LS_SUCCESS;
+    }
+
+    enum class algebra_op_t { sum, product, commutator };
+
+    auto combine(ls_operator const& a, ls_operator const& b, algebra_op_t const kind)
+        -> outcome::result<std::unique_ptr<ls_operator>>
+    {
+        auto const status = check_compatible(a, b);
+        if (status != LS_SUCCESS) { return status; }
+        auto const lhs = to_local_terms(a);
+        auto const rhs = to_local_terms(b);
+        auto       out = local_terms_t{};
+        if (kind == algebra_op_t::sum) {
+            for (auto const& [support, matrix] : lhs) {
+                add_to(out, support, matrix, 1.0);
+            }
+            for (auto const& [support, matrix] : rhs) {
+                add_to(out, support, matrix, 1.0);
+            }
+        }
+        else if (kind == algebra_op_t::product) {
+            OUTCOME_TRY(multiply_into(out, lhs, rhs, 1.0, false));
+        }
+        else {
+            OUTCOME_TRY(multiply_into(out, lhs, rhs, 1.0, true));
+            OUTCOME_TRY(multiply_into(out, rhs, lhs, -1.0, true));
+        }
+        return from_local_terms(*a.basis, out);
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+namespace {
+auto combine_c_api(ls_operator** ptr, ls_operator const* a, ls_operator const* b,
+                   algebra_op_t const kind) noexcept -> ls_error_code
+{
+    auto r = combine(*a, *b, kind);
+    if (!r) { return to_error_code(r.error()); }
+    *ptr = std::move(r).value().release();
+    return LS_SUCCESS;
+}
+} // namespace
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_sum(ls_operator**      ptr,
+                                                                   ls_operator const* a,
+                                                                   ls_operator const* b)
+{
+    return combine_c_api(ptr, a, b, algebra_op_t::sum);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_product(ls_operator**      ptr,
+                                                                       ls_operator const* a,
+                                                                       ls_operator const* b)
+{
+    return combine_c_api(ptr, a, b, algebra_op_t::product);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_commutator(ls_operator**      ptr,
+                                                                          ls_operator const* a,
+                                                                          ls_operator const* b)
+{
+    return combine_c_api(ptr, a, b, algebra_op_t::commutator);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t
+ls_operator_get_number_local_terms(ls_operator const* op)
+{
+    auto r = uint64_t{0};
+    for (auto const& term : op->terms) {
+        r += std::visit([](auto const& x) noexcept { return x.sites.size(); }, term.payload);
+    }
+    return r;
+}
@@ -0,0 +1,196 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "operator.hpp"
+#include <omp.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct ls_matmat_handle {
+    ls_operator const* op;
+    ls_datatype        dtype;
+    uint64_t           size;
+    uint64_t           block_size;
+    void const*        x;
+    uint64_t           x_stride;
+    void*              y;
+    uint64_t           y_stride;
+
+    std::mutex              mutex;
+    std::condition_variable finished;
+    bool                    done   = false;
+    ls_error_code           status = LS_SUCCESS;
+};
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Background thread which executes asynchronous matrix-vector products in submission order.
+    /// Every product is still parallelized with OpenMP, but with one thread less than the thread
+    /// which created the worker would use. The calling thread thus keeps a core for its own
+    /// (typically memory-bound) work instead of oversubscribing the machine.
+    ///
+    /// The worker is destroyed at process exit when operators referenced by queued products may
+    /// already be gone. Products which have not started by then are therefore discarded and
+    /// complete with #LS_SYSTEM_ERROR instead of being executed.
+    class async_worker_t {
+      public:
+        async_worker_t()
+            : _number_threads{get_number_threads()}, _thread{[this]() { loop(); }}
+        {}
+
+        async_worker_t(async_worker_t const&) = delete;
+        async_worker_t(async_worker_t&&)      = delete;
+        auto operator=(async_worker_t const&) -> async_worker_t& = delete;
+        auto operator=(async_worker_t&&) -> async_worker_t& = delete;
+
+        ~async_worker_t()
+        {
+            {
+                std::lock_guard<std::mutex> lock{_mutex};
+                _stop = true;
+            }
+            _changed.notify_one();
+            _thread.join();
+        }
+
+        auto submit(ls_matmat_handle* handle) -> void
+        {
+            {
+                std::lock_guard<std::mutex> lock{_mutex};
+                _queue.push_back(handle);
+            }
+            _changed.notify_one();
+        }
+
+      private:
+        static auto get_number_threads() noexcept -> int
+        {
+            auto const n = omp_get_max_threads();
+            return n > 1 ? n - 1 : 1;
+        }
+
+        static auto finish(ls_matmat_handle* handle, ls_error_code const status) -> void
+        {
+            {
+                std::lock_guard<std::mutex> lock{handle->mutex};
+                handle->status = status;
+                handle->done   = true;
+            }
+            handle->finished.notify_all();
+        }
+
+        auto loop() -> void
+        {
+            // The number of OpenMP threads is a per-thread setting, so it has to be set here
+            omp_set_num_threads(_number_threads);
+            for (;;) {
+                ls_matmat_handle* handle; // NOLINT: initialized inside the critical section
+                {
+                    std::unique_lock<std::mutex> lock{_mutex};
+                    _changed.wait(lock, [this]() { return !_queue.empty() || _stop; });
+                    if (_stop) {
+                        for (auto* pending : _queue) {
+                            finish(pending, LS_SYSTEM_ERROR);
+                        }
+                        _queue.clear();
+                        return;
+                    }
+                    handle = _queue.front();
+                    _queue.pop_front();
+                }
+                finish(handle, ls_operator_matmat(handle->op, handle->dtype, handle->size,
+                                                  handle->block_size, handle->x, handle->x_stride,
+                                                  handle->y, handle->y_stride));
+            }
+        }
+
+        std::mutex                    _mutex;
+        std::condition_variable       _changed;
+        std::deque<ls_matmat_handle*> _queue;
+        bool                          _stop = false;
+        int                           _number_threads;
+        std::thread                   _thread;
+    };
+
+    auto get_async_worker() -> async_worker_t&
+    {
+        static async_worker_t worker;
+        return worker;
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_matmat_async(ls_operator const* op, ls_datatype const dtype, uint64_t const size,
+                         uint64_t const block_size, void const* x, uint64_t const x_stride,
+                         void* y, uint64_t const y_stride, ls_matmat_handle** handle)
+{
+    if (dtype != LS_FLOAT32 && dtype != LS_FLOAT64 && dtype != LS_COMPLEX64
+        && dtype != LS_COMPLEX128) {
+        return LS_INVALID_DATATYPE;
+    }
+    auto p        = std::make_unique<ls_matmat_handle>();
+    p->op         = op;
+    p->dtype      = dtype;
+    p->size       = size;
+    p->block_size = block_size;
+    p->x          = x;
+    p->x_stride   = x_stride;
+    p->y          = y;
+    p->y_stride   = y_stride;
+    *handle       = p.release();
+    get_async_worker().submit(*handle);
+    return LS_SUCCESS;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT bool ls_matmat_test(ls_matmat_handle* handle)
+{
+    std::lock_guard<std::mutex> lock{handle->mutex};
+    return handle->done;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_matmat_wait(ls_matmat_handle* handle)
+{
+    std::unique_lock<std::mutex> lock{handle->mutex};
+    handle->finished.wait(lock, [handle]() { return handle->done; });
+    return handle->status;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_destroy_matmat_handle(ls_matmat_handle* handle)
+{
+    if (handle == nullptr) { return; }
+    static_cast<void>(ls_matmat_wait(handle));
+    std::default_delete<ls_matmat_handle>{}(handle);
+}
@@ -87,32 +87,10 @@ big_basis_t::big_basis_t(ls_group const& group)
 
 using namespace lattice_symmetries;
 
-struct ls_spin_basis {
-    basis_base_t                             header;
-    std::variant<small_basis_t, big_basis_t> payload;
-
-    template <class T>
-    explicit ls_spin_basis(std::in_place_type_t<T> tag, ls_group const& group,
-                           unsigned const                number_spins,
-                           std::optional<unsigned> const hamming_weight, int const spin_inversion)
-        : header{{},
-                 number_spins,
-                 hamming_weight,
-                 spin_inversion,
-                 ls_get_group_size(&group) > 1 || spin_inversion != 0}
-        , payload{tag, group}
-    {}
-
-    ls_spin_basis(ls_spin_basis const&) = delete;
-    ls_spin_basis(ls_spin_basis&&)      = delete;
-    auto operator=(ls_spin_basis const&) -> ls_spin_basis& = delete;
-    auto operator=(ls_spin_basis&&) -> ls_spin_basis& = delete;
-
-    ~ls_spin_basis()
-    {
-        LATTICE_SYMMETRIES_CHECK(load(header.refcount) == 0, "there remain references to object");
-    }
-};
+ls_spin_basis::~ls_spin_basis()
+{
+    LATTICE_SYMMETRIES_CHECK(load(header.refcount) == 0, "there remain references to object");
+}
 
 struct ls_states {
     tcb::span<uint64_t const> payload;
@@ -304,6 +282,18 @@ extern "C" LATTICE_SYMMETRIES_EXPORT void ls_get_state_info(ls_spin_basis const*
                basis->payload);
 }
 
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_get_state_info_64(ls_spin_basis const* basis,
+                                                               ls_bits64 const      bits,
+                                                               ls_bits64*           representative,
+                                                               void* character, double* norm)
+{
+    auto const* payload = std::get_if<small_basis_t>(&basis->payload);
+    LATTICE_SYMMETRIES_CHECK(payload != nullptr, "basis supports more than 64 spins");
+    auto& ch = *reinterpret_cast<std::complex<double>*>(character); // NOLINT
+    get_state_info_64(basis->header, *payload, bits, *representative, ch, *norm);
+}
+
 // cppcheck-suppress unusedFunction
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_states(ls_states**          ptr,
                                                                  ls_spin_basis const* basis)
@@ -342,8 +332,8 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_save_cache(ls_spin_basis c
     auto const* small_basis = std::get_if<small_basis_t>(&basis->payload);
     if (small_basis == nullptr) { return LS_WRONG_BASIS_TYPE; }
     if (small_basis->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
-    auto const states = small_basis->cache->states();
-    auto const r      = save_states(states, filename);
+    auto const& cache = *small_basis->cache;
+    auto const  r     = save_states(cache.sorted_states(), cache.permutation(), filename);
     if (!r) {
         if (r.error().category() == get_error_category()) {
             return static_cast<ls_error_code>(r.error().value());
@@ -369,7 +359,11 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_load_cache(ls_spin_basis*
         }
         return LS_SYSTEM_ERROR;
     }
-    p->cache = std::make_unique<basis_cache_t>(basis->header, *p, r.value());
+    auto cache = std::make_unique<basis_cache_t>(basis->header, *p, std::move(r.value().states));
+    if (cache->set_permutation(std::move(r.value().permutation)) != LS_SUCCESS) {
+        return LS_CACHE_IS_CORRUPT;
+    }
+    p->cache = std::move(cache);
     return LS_SUCCESS;
 }
 
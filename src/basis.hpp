@@ -32,6 +32,7 @@
 #include "symmetry.hpp"
 #include <memory>
 #include <optional>
+#include <variant>
 
 namespace lattice_symmetries {
 
@@ -63,3 +64,27 @@ struct big_basis_t {
 auto is_real(ls_spin_basis const& basis) noexcept -> bool;
 
 } // namespace lattice_symmetries
+
+struct ls_spin_basis {
+    lattice_symmetries::basis_base_t header;
+    std::variant<lattice_symmetries::small_basis_t, lattice_symmetries::big_basis_t> payload;
+
+    template <class T>
+    explicit ls_spin_basis(std::in_place_type_t<T> tag, ls_group const& group,
+                           unsigned const                number_spins,
+                           std::optional<unsigned> const hamming_weight, int const spin_inversion)
+        : header{{},
+                 number_spins,
+                 hamming_weight,
+                 spin_inversion,
+                 ls_get_group_size(&group) > 1 || spin_inversion != 0}
+        , payload{tag, group}
+    {}
+
+    ls_spin_basis(ls_spin_basis const&) = delete;
+    ls_spin_basis(ls_spin_basis&&)      = delete;
+    auto operator=(ls_spin_basis const&) -> ls_spin_basis& = delete;
+    auto operator=(ls_spin_basis&&) -> ls_spin_basis& = delete;
+
+    ~ls_spin_basis();
+};
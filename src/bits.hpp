@@ -29,6 +29,8 @@
 #pragma once
 
 #include <lattice_symmetries/lattice_symmetries.h>
+#include <cstddef>
+#include <cstdint>
 
 constexpr auto operator==(ls_bits512 const& x, ls_bits512 const& y) noexcept -> bool
 {
@@ -149,4 +151,30 @@ inline auto popcount(unsigned long long const x) noexcept -> unsigned
     return static_cast<unsigned>(__builtin_popcountll(x));
 }
 
+/// Smallest integer greater than `v` with the same number of set bits (Gosper's hack). `v` must
+/// be non-zero.
+inline auto next_with_same_weight(uint64_t const v) noexcept -> uint64_t
+{
+    auto const t = v | (v - 1U); // t gets v's least significant 0 bits set to 1
+    // Next set to 1 the most significant bit to change,
+    // set to 0 the least significant ones, and add the necessary 1 bits.
+    return (t + 1U)
+           // cppcheck-suppress oppositeExpression
+           | (((~t & -~t) - 1U) >> (static_cast<unsigned>(__builtin_ctzl(v)) + 1U));
+}
+
+/// 64-bit FNV-1a hash of `size` bytes starting at `data`. Pass the result of a previous call as
+/// `hash` to hash multiple buffers.
+inline auto fnv1a(void const* data, size_t const size,
+                  uint64_t hash = uint64_t{14695981039346656037ULL}) noexcept -> uint64_t
+{
+    constexpr auto prime = uint64_t{1099511628211ULL};
+    auto const*    bytes = static_cast<unsigned char const*>(data);
+    for (auto i = size_t{0}; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= prime;
+    }
+    return hash;
+}
+
 } // namespace lattice_symmetries
@@ -146,14 +146,7 @@ namespace {
 
     template <bool FixedHammingWeight> auto next_state(uint64_t const v) noexcept -> uint64_t
     {
-        if constexpr (FixedHammingWeight) {
-            auto const t = v | (v - 1U); // t gets v's least significant 0 bits set to 1
-            // Next set to 1 the most significant bit to change,
-            // set to 0 the least significant ones, and add the necessary 1 bits.
-            return (t + 1U)
-                   // cppcheck-suppress oppositeExpression
-                   | (((~t & -~t) - 1U) >> (static_cast<unsigned>(__builtin_ctzl(v)) + 1U));
-        }
+        if constexpr (FixedHammingWeight) { return next_with_same_weight(v); }
         else {
             return v + 1;
         }
@@ -335,11 +328,12 @@ namespace {
 
 basis_cache_t::basis_cache_t(basis_base_t const& header, small_basis_t const& payload,
                              std::vector<uint64_t> _unsafe_states)
-    : _shift{make_shift(header.number_spins, bits)}
+    : _bits{std::min(bits, header.number_spins)}
+    , _shift{make_shift(header.number_spins, _bits)}
     , _states{_unsafe_states.empty() ? concatenate(generate_states(header, payload))
                                      : std::move(_unsafe_states)}
-    , _ranges{generate_ranges(_states, bits, _shift)}
-    , _ranges_v2{generate_ranges_v2(_states, bits, _shift)}
+    , _ranges{generate_ranges(_states, _bits, _shift)}
+    , _ranges_v2{generate_ranges_v2(_states, _bits, _shift)}
 {
     for (auto i = uint64_t{0}; i < _ranges.size(); ++i) {
         LATTICE_SYMMETRIES_CHECK(_ranges[i].second == _ranges_v2[i + 1] - _ranges_v2[i], nullptr);
@@ -350,13 +344,50 @@ basis_cache_t::basis_cache_t(basis_base_t const& header, small_basis_t const& pa
     LATTICE_SYMMETRIES_CHECK(_ranges_v2[_ranges.size()] == _states.size(), nullptr);
 }
 
-auto basis_cache_t::states() const noexcept -> tcb::span<uint64_t const> { return _states; }
+auto basis_cache_t::states() const noexcept -> tcb::span<uint64_t const>
+{
+    if (_indexed_states.empty()) { return _states; }
+    return _ordered_states;
+}
+
+auto basis_cache_t::sorted_states() const noexcept -> tcb::span<uint64_t const> { return _states; }
+
+auto basis_cache_t::permutation() const -> std::vector<uint64_t>
+{
+    auto r = std::vector<uint64_t>(_indexed_states.size());
+    std::transform(std::begin(_indexed_states), std::end(_indexed_states), std::begin(r),
+                   [](auto const& x) { return x.index; });
+    return r;
+}
+
+auto basis_cache_t::set_permutation(std::vector<uint64_t> permutation) noexcept -> ls_error_code
+{
+    if (permutation.empty()) {
+        _indexed_states.clear();
+        _ordered_states.clear();
+        return LS_SUCCESS;
+    }
+    if (permutation.size() != _states.size()) { return LS_INVALID_ARGUMENT; }
+    auto ordered_states = std::vector<uint64_t>(_states.size());
+    auto indexed_states = std::vector<indexed_state_t>(_states.size());
+    auto seen           = std::vector<bool>(_states.size(), false);
+    for (auto i = uint64_t{0}; i < permutation.size(); ++i) {
+        auto const j = permutation[i];
+        if (j >= permutation.size() || seen[j]) { return LS_INVALID_ARGUMENT; }
+        seen[j]           = true;
+        ordered_states[j] = _states[i];
+        indexed_states[i] = {_states[i], j};
+    }
+    _indexed_states = std::move(indexed_states);
+    _ordered_states = std::move(ordered_states);
+    return LS_SUCCESS;
+}
 
 auto basis_cache_t::number_states() const noexcept -> uint64_t { return _states.size(); }
 
 auto basis_cache_t::index_v2(uint64_t const x, uint64_t* out) const noexcept -> ls_error_code
 {
-    auto const  size  = uint64_t{1} << bits;
+    auto const  size  = uint64_t{1} << _bits;
     auto const  mask  = size - 1;
     auto const  i     = (x >> _shift) & mask;
     auto const* first = _states.data() + _ranges_v2[i];
@@ -388,7 +419,16 @@ auto basis_cache_t::index(uint64_t const x, uint64_t* out) const noexcept -> ls_
         return LS_SUCCESS;
     }
     else {
-        return index_v2(x, out);
+        if (_indexed_states.empty()) { return index_v2(x, out); }
+        // Reordered basis: search among (state, position) pairs of the bucket
+        auto const  i     = (x >> _shift) & ((uint64_t{1} << _bits) - 1);
+        auto const* first = _indexed_states.data() + _ranges_v2[i];
+        auto const* last  = _indexed_states.data() + _ranges_v2[i + 1];
+        auto const* found = std::lower_bound(
+            first, last, x, [](indexed_state_t const& a, uint64_t const b) { return a.state < b; });
+        if (found == last || found->state != x) { return LS_NOT_A_REPRESENTATIVE; }
+        *out = found->index;
+        return LS_SUCCESS;
     }
 }
 
@@ -415,55 +455,93 @@ namespace {
     }
 } // namespace
 
-auto save_states(tcb::span<uint64_t const> states, char const* filename) -> outcome::result<void>
+namespace {
+    /// Every cache file starts with 16 copies of one of these bytes
+    constexpr auto cache_header_size       = 16U;
+    constexpr char states_only_marker      = 42; // NOLINT: magic number
+    constexpr char with_permutation_marker = 43; // NOLINT: magic number
+
+    auto write_array(tcb::span<uint64_t const> array, std::FILE* stream) -> outcome::result<void>
+    {
+        constexpr auto chunk_size = uint64_t{4096};
+        auto           buffer     = std::vector<uint64_t>(chunk_size);
+        for (auto first = std::begin(array), last = std::end(array); first != last;) {
+            auto const count =
+                std::min(chunk_size, static_cast<uint64_t>(std::distance(first, last)));
+            auto const* next = std::next(first, static_cast<int64_t>(count));
+            std::transform(first, next, std::begin(buffer),
+                           [](auto const x) { return htole64(x); });
+            if (std::fwrite(buffer.data(), sizeof(uint64_t), count, stream) != count) {
+                return LS_FILE_IO_FAILED;
+            }
+            // Move forward
+            first = next;
+        }
+        return outcome::success();
+    }
+
+    auto read_array(uint64_t const size, std::FILE* stream)
+        -> outcome::result<std::vector<uint64_t>>
+    {
+        auto array = std::vector<uint64_t>(size);
+        if (std::fread(array.data(), sizeof(uint64_t), array.size(), stream) != array.size()) {
+            return LS_FILE_IO_FAILED;
+        }
+        std::transform(std::begin(array), std::end(array), std::begin(array),
+                       [](auto const x) { return le64toh(x); });
+        return outcome::success(std::move(array));
+    }
+} // namespace
+
+auto save_states(tcb::span<uint64_t const> states, tcb::span<uint64_t const> permutation,
+                 char const* filename) -> outcome::result<void>
 {
-    constexpr auto                 chunk_size = uint64_t{4096};
-    constexpr std::array<char, 16> header     = {42, 42, 42, 42, 42, 42, 42, 42,
-                                             42, 42, 42, 42, 42, 42, 42, 42};
+    LATTICE_SYMMETRIES_CHECK(permutation.empty() || permutation.size() == states.size(),
+                             "invalid permutation");
+    std::array<char, cache_header_size> header; // NOLINT: header is initialized by fill
+    header.fill(permutation.empty() ? states_only_marker : with_permutation_marker);
     OUTCOME_TRY(stream, open_file(filename, "wb"));
     if (std::fwrite(header.data(), sizeof(char), std::size(header), stream.get())
         != std::size(header)) {
         return LS_FILE_IO_FAILED;
     }
-    auto buffer = std::vector<uint64_t>(chunk_size);
-    for (auto first = std::begin(states), last = std::end(states); first != last;) {
-        auto const  count = std::min(chunk_size, static_cast<uint64_t>(std::distance(first, last)));
-        auto const* next  = std::next(first, static_cast<int64_t>(count));
-        std::transform(first, next, std::begin(buffer), [](auto const x) { return htole64(x); });
-        if (std::fwrite(buffer.data(), sizeof(uint64_t), count, stream.get()) != count) {
-            return LS_FILE_IO_FAILED;
-        }
-        // Move forward
-        first = next;
-    }
-    return LS_SUCCESS;
+    OUTCOME_TRY(write_array(states, stream.get()));
+    OUTCOME_TRY(write_array(permutation, stream.get()));
+    return outcome::success();
 }
 
-auto load_states(char const* filename) -> outcome::result<std::vector<uint64_t>>
+auto load_states(char const* filename) -> outcome::result<states_file_t>
 {
     OUTCOME_TRY(stream, open_file(filename, "rb"));
 
-    auto           size        = file_size(filename);
-    constexpr auto header_size = 16U;
-    if (size < header_size) { return LS_CACHE_IS_CORRUPT; }
-    size -= header_size;
+    auto size = file_size(filename);
+    if (size < cache_header_size) { return LS_CACHE_IS_CORRUPT; }
+    size -= cache_header_size;
     if (size % sizeof(uint64_t) != 0) { return LS_CACHE_IS_CORRUPT; }
 
-    std::array<char, header_size> header; // NOLINT: header is initialized by fread
-    if (std::fread(header.data(), sizeof(char), header_size, stream.get()) != std::size(header)) {
+    std::array<char, cache_header_size> header; // NOLINT: header is initialized by fread
+    if (std::fread(header.data(), sizeof(char), header.size(), stream.get()) != header.size()) {
         return LS_FILE_IO_FAILED;
     }
-    // NOLINTNEXTLINE: 42 is indeed a magic number, that's why it's used here
-    if (!std::all_of(std::begin(header), std::end(header), [](auto const c) { return c == 42; })) {
+    auto const marker = header[0];
+    if ((marker != states_only_marker && marker != with_permutation_marker)
+        || !std::all_of(std::begin(header), std::end(header),
+                        [marker](auto const c) { return c == marker; })) {
         return LS_CACHE_IS_CORRUPT;
     }
-    auto states = std::vector<uint64_t>(size / sizeof(uint64_t));
-    if (std::fread(states.data(), sizeof(uint64_t), states.size(), stream.get()) != states.size()) {
-        return LS_FILE_IO_FAILED;
+    auto number_states = size / sizeof(uint64_t);
+    if (marker == with_permutation_marker) {
+        if (number_states % 2 != 0) { return LS_CACHE_IS_CORRUPT; }
+        number_states /= 2;
+    }
+    states_file_t file;
+    OUTCOME_TRY(states, read_array(number_states, stream.get()));
+    file.states = std::move(states);
+    if (marker == with_permutation_marker) {
+        OUTCOME_TRY(permutation, read_array(number_states, stream.get()));
+        file.permutation = std::move(permutation);
     }
-    std::transform(std::begin(states), std::end(states), std::begin(states),
-                   [](auto const x) { return le64toh(x); });
-    return outcome::success(std::move(states));
+    return outcome::success(std::move(file));
 }
 
 } // namespace lattice_symmetries
@@ -47,10 +47,24 @@ struct basis_cache_t {
   private:
     static constexpr auto bits = 22U;
 
+    /// Number of leading bits used to bucket states: min(bits, number_spins) such that small
+    /// bases do not pay for 2²² bucket boundaries
+    unsigned                                   _bits;
     unsigned                                   _shift;
     std::vector<uint64_t>                      _states;
     std::vector<std::pair<uint64_t, uint64_t>> _ranges;
     std::vector<uint64_t>                      _ranges_v2;
+    /// A state together with its position in the basis
+    struct indexed_state_t {
+        uint64_t state;
+        uint64_t index;
+    };
+    /// _states[i] together with its position in the basis. Empty unless the basis has been
+    /// reordered. Storing positions next to the states means that #index finds the position in
+    /// the same cache line as the state instead of doing a second random access.
+    std::vector<indexed_state_t>               _indexed_states;
+    /// States in the basis order. Empty unless the basis has been reordered.
+    std::vector<uint64_t>                      _ordered_states;
 
   public:
     // basis_cache_t(tcb::span<batched_small_symmetry_t const> batched,
@@ -61,13 +75,30 @@ struct basis_cache_t {
     basis_cache_t(basis_base_t const& header, small_basis_t const& payload,
                   std::vector<uint64_t> _unsafe_states = {});
 
+    /// Returns states in the basis order, i.e. `states()[index(x)] == x`.
     [[nodiscard]] auto states() const noexcept -> tcb::span<uint64_t const>;
+    /// Returns states in ascending order.
+    [[nodiscard]] auto sorted_states() const noexcept -> tcb::span<uint64_t const>;
+    /// Returns positions of `sorted_states()` in the basis or an empty vector if the basis has
+    /// not been reordered.
+    [[nodiscard]] auto permutation() const -> std::vector<uint64_t>;
     [[nodiscard]] auto number_states() const noexcept -> uint64_t;
     [[nodiscard]] auto index_v2(uint64_t x, uint64_t* out) const noexcept -> ls_error_code;
     [[nodiscard]] auto index(uint64_t x, uint64_t* out) const noexcept -> ls_error_code;
+
+    /// Reorders the basis such that `sorted_states()[i]` ends up at position `permutation[i]`. An
+    /// empty `permutation` restores the ascending order. Returns LS_INVALID_ARGUMENT if
+    /// `permutation` is not a permutation of `0, 1, ..., number_states() - 1`.
+    auto set_permutation(std::vector<uint64_t> permutation) noexcept -> ls_error_code;
+};
+
+struct states_file_t {
+    std::vector<uint64_t> states;      ///< Sorted states
+    std::vector<uint64_t> permutation; ///< See basis_cache_t::set_permutation
 };
 
-auto save_states(tcb::span<uint64_t const> states, char const* filename) -> outcome::result<void>;
-auto load_states(char const* filename) -> outcome::result<std::vector<uint64_t>>;
+auto save_states(tcb::span<uint64_t const> states, tcb::span<uint64_t const> permutation,
+                 char const* filename) -> outcome::result<void>;
+auto load_states(char const* filename) -> outcome::result<states_file_t>;
 
 } // namespace lattice_symmetries
@@ -0,0 +1,425 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "bits.hpp"
+#include "cache.hpp"
+#include "operator.hpp"
+#include "out_of_core.hpp"
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    template <class T> auto scale(T const& x, std::complex<double> const& c) noexcept -> T
+    {
+        if constexpr (is_complex_v<T>) {
+            return static_cast<T>(static_cast<std::complex<double>>(x) * c);
+        }
+        else {
+            return static_cast<T>(static_cast<double>(x) * c.real());
+        }
+    }
+
+    /// A symmetry of a basis: the permutation of sites it performs and its eigenvalue in the
+    /// symmetry sector of the basis
+    struct group_element_t {
+        std::vector<unsigned> permutation;
+        std::complex<double>  eigenvalue;
+    };
+
+    /// Recovers the elements of the group of `basis` by applying the Benes networks to states
+    /// with a single spin up. The identity is skipped since it is implicit in every basis.
+    auto group_elements(ls_spin_basis const& basis) -> std::vector<group_element_t>
+    {
+        constexpr auto batch_size   = batched_small_symmetry_t::batch_size;
+        auto const&    body         = std::get<small_basis_t>(basis.payload);
+        auto const     number_spins = basis.header.number_spins;
+        auto           elements     = std::vector<group_element_t>{};
+        auto const     extract      = [&](batched_small_symmetry_t const& batch, unsigned count) {
+            auto permutations = site_permutations(batch, count, number_spins);
+            for (auto k = 0U; k < count; ++k) {
+                auto& p           = permutations[k];
+                auto  is_identity = true;
+                for (auto i = 0U; i < number_spins; ++i) {
+                    is_identity = is_identity && p[i] == i;
+                }
+                if (is_identity) { continue; }
+                elements.push_back({std::move(p), std::complex<double>{batch.eigenvalues_real[k],
+                                                                       batch.eigenvalues_imag[k]}});
+            }
+        };
+        for (auto const& batch : body.batched_symmetries) {
+            extract(batch, batch_size);
+        }
+        if (body.other_symmetries.has_value()) {
+            extract(*body.other_symmetries, body.number_other_symmetries);
+        }
+        return elements;
+    }
+
+    /// Whether the symmetry sector of `basis` is contained in the one of `subgroup`, i.e. every
+    /// symmetry of `subgroup` is also a symmetry of `basis` with the same eigenvalue.
+    auto is_subgroup_sector(ls_spin_basis const& subgroup, ls_spin_basis const& basis) -> bool
+    {
+        if (subgroup.header.spin_inversion != 0
+            && subgroup.header.spin_inversion != basis.header.spin_inversion) {
+            return false;
+        }
+        auto const elements = group_elements(basis);
+        for (auto const& h : group_elements(subgroup)) {
+            auto const match = [&h](auto const& g) {
+                return g.permutation == h.permutation
+                       && std::abs(g.eigenvalue - h.eigenvalue) < 1e-10;
+            };
+            if (std::none_of(std::begin(elements), std::end(elements), match)) { return false; }
+        }
+        return true;
+    }
+
+    /// Checks that vectors in `source` can be converted to `target` and that `x` has `size` rows.
+    /// One of the bases must be built with a subgroup of the symmetries of the other one and the
+    /// sectors must agree on this subgroup.
+    auto check_conversion(ls_spin_basis const& source, ls_spin_basis const& target,
+                          ls_datatype const dtype, uint64_t const size) noexcept
+        -> outcome::result<void>
+    {
+        auto const* source_body = std::get_if<small_basis_t>(&source.payload);
+        auto const* target_body = std::get_if<small_basis_t>(&target.payload);
+        if (source_body == nullptr || target_body == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        if (source_body->cache == nullptr || target_body->cache == nullptr) {
+            return LS_CACHE_NOT_BUILT;
+        }
+        if (source.header.number_spins != target.header.number_spins) {
+            return LS_INVALID_NUMBER_SPINS;
+        }
+        auto const& source_weight = source.header.hamming_weight;
+        auto const& target_weight = target.header.hamming_weight;
+        if (source_weight.has_value() && target_weight.has_value()
+            && *source_weight != *target_weight) {
+            return LS_INVALID_HAMMING_WEIGHT;
+        }
+        if (!is_subgroup_sector(target, source) && !is_subgroup_sector(source, target)) {
+            return LS_INVALID_ARGUMENT;
+        }
+        if (datatype_size(dtype) == 0) { return LS_INVALID_DATATYPE; }
+        // Characters are only real if all eigenvalues of symmetries are real
+        if ((dtype == LS_FLOAT32 || dtype == LS_FLOAT64) && !(is_real(source) && is_real(target))) {
+            return LS_INVALID_DATATYPE;
+        }
+        if (size != source_body->cache->number_states()) { return LS_DIMENSION_MISMATCH; }
+        return outcome::success();
+    }
+
+    /// Amplitude of a spin configuration s in the full 2^N space is ψ(s) = x[index(r)]·‖r‖·χ̄
+    /// where r, χ and ‖r‖ are the representative, character and norm of s (see entanglement.cpp).
+    /// Computes `index` and `coeff` such that ψ(s) = x[index]·coeff. `coeff` is zero if s does
+    /// not belong to the basis.
+    template <class StateInfo>
+    auto amplitude_of(StateInfo const& state_info, basis_cache_t const& cache,
+                      std::optional<unsigned> const& weight, uint64_t const spin, uint64_t& index,
+                      std::complex<double>& coeff) noexcept -> ls_error_code
+    {
+        index = 0;
+        coeff = {0.0, 0.0};
+        if (weight.has_value() && popcount(spin) != *weight) { return LS_SUCCESS; }
+        ls_bits64            repr;      // NOLINT: initialized by state_info
+        std::complex<double> character; // NOLINT: initialized by state_info
+        double               norm;      // NOLINT: initialized by state_info
+        state_info(spin, repr, character, norm);
+        if (norm == 0.0) { return LS_SUCCESS; }
+        auto const status = cache.index(repr, &index);
+        if (LATTICE_SYMMETRIES_LIKELY(status == LS_SUCCESS)) {
+            coeff = norm * std::conj(character);
+        }
+        return status;
+    }
+
+    /// Computes rows [first, first + count) of `y`, i.e. the vectors `x` in basis `source`
+    /// expressed in basis `target`. Rows of `y` are relative to `first`.
+    ///
+    /// Every state s of `target` is a representative, hence its character is 1 and the
+    /// corresponding element of y is ψ(s)/‖s‖.
+    template <class T>
+    auto convert_rows(ls_spin_basis const& source, ls_spin_basis const& target,
+                      uint64_t const first, uint64_t const count, uint64_t const block_size,
+                      T const* x, uint64_t const x_stride, T* y, uint64_t const y_stride) noexcept
+        -> ls_error_code
+    {
+        auto const* cache      = std::get<small_basis_t>(source.payload).cache.get();
+        auto const  states     = std::get<small_basis_t>(target.payload).cache->states();
+        auto const  source_fn  = make_state_info_fn<ls_bits64>(source);
+        auto const  target_fn  = make_state_info_fn<ls_bits64>(target);
+        auto const  weight     = source.header.hamming_weight;
+        auto const  chunk_size = get_chunk_size(operator_plan_t{}, count);
+        auto status = LS_SUCCESS;
+#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
+    firstprivate(first, count, block_size, x, x_stride, y, y_stride, cache, states, weight,        \
+                 chunk_size) shared(source_fn, target_fn, status)
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            auto const           spin = states[first + i];
+            uint64_t             index; // NOLINT: initialized by amplitude_of
+            std::complex<double> coeff; // NOLINT: initialized by amplitude_of
+            auto const local_status = amplitude_of(source_fn, *cache, weight, spin, index, coeff);
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+                continue;
+            }
+            if (coeff != 0.0) {
+                ls_bits64            repr;      // NOLINT: initialized by state_info
+                std::complex<double> character; // NOLINT: initialized by state_info
+                double               norm;      // NOLINT: initialized by state_info
+                target_fn(spin, repr, character, norm);
+                coeff /= norm;
+            }
+            for (auto j = uint64_t{0}; j < block_size; ++j) {
+                y[i + j * y_stride] =
+                    coeff == 0.0 ? T{} : scale(x[index + j * x_stride], coeff);
+            }
+        }
+        return status;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LS_CALL_CONVERT_ROWS(T)                                                                    \
+    convert_rows<T>(source, target, first, count, block_size, static_cast<T const*>(x), x_stride,  \
+                    static_cast<T*>(y), y_stride)
+
+    auto convert_rows(ls_spin_basis const& source, ls_spin_basis const& target,
+                      ls_datatype const dtype, uint64_t const first, uint64_t const count,
+                      uint64_t const block_size, void const* x, uint64_t const x_stride, void* y,
+                      uint64_t const y_stride) noexcept -> ls_error_code
+    {
+        switch (dtype) {
+        case LS_FLOAT32: return LS_CALL_CONVERT_ROWS(float);
+        case LS_FLOAT64: return LS_CALL_CONVERT_ROWS(double);
+        case LS_COMPLEX64: return LS_CALL_CONVERT_ROWS(std::complex<float>);
+        case LS_COMPLEX128: return LS_CALL_CONVERT_ROWS(std::complex<double>);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }
+
+#undef LS_CALL_CONVERT_ROWS
+
+    auto convert_helper(ls_spin_basis const& source, ls_spin_basis const& target,
+                        ls_datatype const dtype, uint64_t const size, uint64_t const block_size,
+                        void const* x, uint64_t const x_stride, void* y,
+                        uint64_t const y_stride) noexcept -> outcome::result<void>
+    {
+        OUTCOME_TRY(check_conversion(source, target, dtype, size));
+        auto const number_rows = std::get<small_basis_t>(target.payload).cache->number_states();
+        auto const status = convert_rows(source, target, dtype, 0, number_rows, block_size, x,
+                                         x_stride, y, y_stride);
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success();
+    }
+
+    auto convert_file_helper(ls_spin_basis const& source, ls_spin_basis const& target,
+                             ls_datatype const dtype, uint64_t const size,
+                             uint64_t const block_size, void const* x, uint64_t const x_stride,
+                             char const* filename, ls_out_of_core_options const& options)
+        -> outcome::result<void>
+    {
+        OUTCOME_TRY(check_conversion(source, target, dtype, size));
+        if (block_size == 0 || options.queue_depth == 0) { return LS_INVALID_ARGUMENT; }
+        auto const element_size = datatype_size(dtype);
+        auto const number_rows  = std::get<small_basis_t>(target.payload).cache->number_states();
+        auto const default_tile_rows =
+            std::max<uint64_t>(1, default_tile_bytes / (block_size * element_size));
+        auto const tile_rows = std::max<uint64_t>(
+            1, std::min(number_rows,
+                        options.tile_rows != 0 ? options.tile_rows : default_tile_rows));
+
+        auto const y = file_t{::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+        if (y.fd < 0) { return LS_COULD_NOT_OPEN_FILE; }
+        if (::ftruncate(y.fd, static_cast<off_t>(number_rows * block_size * element_size)) != 0) {
+            return LS_FILE_IO_FAILED;
+        }
+        auto writer = tile_writer_t{y.fd,     number_rows, block_size, element_size,
+                                    tile_rows, options.queue_depth};
+        for (auto first = uint64_t{0}; first < number_rows; first += tile_rows) {
+            auto* tile = writer.acquire();
+            if (tile == nullptr) { break; }
+            tile->first       = first;
+            tile->count       = std::min(tile_rows, number_rows - first);
+            auto const status = convert_rows(source, target, dtype, first, tile->count, block_size,
+                                             x, x_stride, tile->data.data(), tile->count);
+            if (status != LS_SUCCESS) {
+                static_cast<void>(writer.finish());
+                return status;
+            }
+            writer.submit(tile);
+        }
+        auto const status = writer.finish();
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success();
+    }
+
+    /// Number of spin configurations which are canonicalized before their amplitudes are loaded
+    constexpr auto amplitude_batch_size = uint64_t{64};
+
+    auto check_amplitude(ls_spin_basis const& basis, ls_datatype const dtype,
+                         uint64_t const size) noexcept -> outcome::result<void>
+    {
+        auto const* body = std::get_if<small_basis_t>(&basis.payload);
+        if (body == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        if (body->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+        if (datatype_size(dtype) == 0) { return LS_INVALID_DATATYPE; }
+        if ((dtype == LS_FLOAT32 || dtype == LS_FLOAT64) && !is_real(basis)) {
+            return LS_INVALID_DATATYPE;
+        }
+        if (size != body->cache->number_states()) { return LS_DIMENSION_MISMATCH; }
+        return outcome::success();
+    }
+
+    /// Computes ψ(s) for arbitrary spin configurations s. Spins are processed in batches: first
+    /// representatives and indices of the whole batch are computed and the corresponding elements
+    /// of `x` are prefetched, then the amplitudes are gathered. This way the random accesses to `x`
+    /// overlap with the canonicalization of other spins.
+    template <class T>
+    auto batched_amplitude(ls_spin_basis const& basis, T const* x, uint64_t const count,
+                           uint64_t const* spins, T* out) noexcept -> ls_error_code
+    {
+        auto const* cache        = std::get<small_basis_t>(basis.payload).cache.get();
+        auto const  state_fn     = make_state_info_fn<ls_bits64>(basis);
+        auto const  weight       = basis.header.hamming_weight;
+        auto const  number_spins = basis.header.number_spins;
+        auto const  mask =
+            number_spins == 64U ? ~uint64_t{0} : ((uint64_t{1} << number_spins) - 1U);
+        auto const number_batches = (count + amplitude_batch_size - 1) / amplitude_batch_size;
+        auto       status         = LS_SUCCESS;
+#pragma omp parallel for default(none) schedule(dynamic, 1)                                        \
+    firstprivate(x, count, spins, out, cache, weight, mask, number_batches)                        \
+        shared(state_fn, status)
+        for (auto b = uint64_t{0}; b < number_batches; ++b) {
+            auto const first = b * amplitude_batch_size;
+            auto const size  = std::min(count - first, uint64_t{amplitude_batch_size});
+            std::array<uint64_t, amplitude_batch_size>             indices; // NOLINT
+            std::array<std::complex<double>, amplitude_batch_size> coeffs;  // NOLINT
+            auto local_status = LS_SUCCESS;
+            for (auto k = uint64_t{0}; k < size; ++k) {
+                auto const spin = spins[first + k];
+                if (LATTICE_SYMMETRIES_UNLIKELY((spin & ~mask) != 0)) {
+                    local_status = LS_INVALID_STATE;
+                    break;
+                }
+                local_status = amplitude_of(state_fn, *cache, weight, spin, indices[k], coeffs[k]);
+                if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { break; }
+                if (coeffs[k] != 0.0) { __builtin_prefetch(x + indices[k]); }
+            }
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+                continue;
+            }
+            for (auto k = uint64_t{0}; k < size; ++k) {
+                out[first + k] = coeffs[k] == 0.0 ? T{} : scale(x[indices[k]], coeffs[k]);
+            }
+        }
+        return status;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LS_CALL_BATCHED_AMPLITUDE(T)                                                               \
+    batched_amplitude<T>(basis, static_cast<T const*>(x), count, spins, static_cast<T*>(out))
+
+    auto batched_amplitude_helper(ls_spin_basis const& basis, ls_datatype const dtype,
+                                  uint64_t const size, void const* x, uint64_t const count,
+                                  uint64_t const* spins, void* out) noexcept
+        -> outcome::result<void>
+    {
+        OUTCOME_TRY(check_amplitude(basis, dtype, size));
+        auto const status = [&]() {
+            switch (dtype) {
+            case LS_FLOAT32: return LS_CALL_BATCHED_AMPLITUDE(float);
+            case LS_FLOAT64: return LS_CALL_BATCHED_AMPLITUDE(double);
+            case LS_COMPLEX64: return LS_CALL_BATCHED_AMPLITUDE(std::complex<float>);
+            case LS_COMPLEX128: return LS_CALL_BATCHED_AMPLITUDE(std::complex<double>);
+            default: return LS_INVALID_DATATYPE;
+            }
+        }();
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success();
+    }
+
+#undef LS_CALL_BATCHED_AMPLITUDE
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_unpack_vector(ls_spin_basis const* basis, ls_spin_basis const* subgroup_basis,
+                 ls_datatype const dtype, uint64_t const size, uint64_t const block_size,
+                 void const* x, uint64_t const x_stride, void* y, uint64_t const y_stride)
+{
+    auto r = convert_helper(*basis, *subgroup_basis, dtype, size, block_size, x, x_stride, y,
+                            y_stride);
+    return to_error_code(r);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_pack_vector(ls_spin_basis const* subgroup_basis, ls_spin_basis const* basis,
+               ls_datatype const dtype, uint64_t const size, uint64_t const block_size,
+               void const* x, uint64_t const x_stride, void* y, uint64_t const y_stride)
+{
+    // Packing is the same operation with the roles of the bases swapped: every representative of
+    // `basis` is looked up in `subgroup_basis`. It is only the inverse of ls_unpack_vector for
+    // vectors which belong to the symmetry sector of `basis`.
+    auto r = convert_helper(*subgroup_basis, *basis, dtype, size, block_size, x, x_stride, y,
+                            y_stride);
+    return to_error_code(r);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_unpack_vector_file(ls_spin_basis const* basis, ls_spin_basis const* subgroup_basis,
+                      ls_datatype const dtype, uint64_t const size, uint64_t const block_size,
+                      void const* x, uint64_t const x_stride, char const* filename,
+                      ls_out_of_core_options const* options)
+{
+    auto defaults = ls_out_of_core_options{};
+    if (options == nullptr) {
+        ls_out_of_core_default_options(&defaults);
+        options = &defaults;
+    }
+    auto r = convert_file_helper(*basis, *subgroup_basis, dtype, size, block_size, x, x_stride,
+                                 filename, *options);
+    return to_error_code(r);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_batched_amplitude(ls_spin_basis const* basis, ls_datatype const dtype, uint64_t const size,
+                     void const* x, uint64_t const count, uint64_t const spins[], void* out)
+{
+    auto r = batched_amplitude_helper(*basis, dtype, size, x, count, spins, out);
+    return to_error_code(r);
+}
@@ -0,0 +1,224 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "cache.hpp"
+#include "operator.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Site permutations of all symmetries in `basis`. An empty result means that the basis has
+    /// no lattice symmetries.
+    auto all_site_permutations(small_basis_t const& basis, unsigned const number_spins)
+        -> std::vector<std::vector<unsigned>>
+    {
+        auto       r       = std::vector<std::vector<unsigned>>{};
+        auto const process = [&r, number_spins](batched_small_symmetry_t const& batch,
+                                                unsigned const                  count) {
+            auto permutations = site_permutations(batch, count, number_spins);
+            r.insert(std::end(r), std::make_move_iterator(std::begin(permutations)),
+                     std::make_move_iterator(std::end(permutations)));
+        };
+        for (auto const& symmetry : basis.batched_symmetries) {
+            process(symmetry, batched_small_symmetry_t::batch_size);
+        }
+        if (basis.other_symmetries.has_value()) {
+            process(*basis.other_symmetries, basis.number_other_symmetries);
+        }
+        return r;
+    }
+
+    template <class T>
+    auto correlations_helper(ls_spin_basis const& basis, ls_correlator_kind const kind,
+                             uint64_t const size, T const* x, double* out) noexcept
+        -> outcome::result<void>
+    {
+        if (kind != LS_CORRELATOR_ZZ && kind != LS_CORRELATOR_HEISENBERG) {
+            return LS_INVALID_ARGUMENT;
+        }
+        auto const* body = std::get_if<small_basis_t>(&basis.payload);
+        if (body == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        if (body->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+        auto const* cache  = body->cache.get();
+        auto const  states = cache->states();
+        if (size != states.size()) { return LS_DIMENSION_MISMATCH; }
+
+        // raw[a * n + b] accumulates Σᵢ x̄ᵢ ⟨ẽᵢ|Oₐᵦ|x⟩ over representatives. Oₐᵦ is not invariant
+        // under the symmetry group, so raw is only meaningful after averaging over the group
+        // below. Every thread gets its own copy of raw.
+        auto const n          = basis.header.number_spins;
+        auto const state_info = make_state_info_fn<ls_bits64>(basis);
+        auto       raw        = std::vector<std::vector<std::complex<double>>>(
+            static_cast<unsigned>(omp_get_max_threads()),
+            std::vector<std::complex<double>>(n * n));
+        auto       norm_sq    = std::vector<double>(raw.size());
+        auto       status     = LS_SUCCESS;
+        auto const chunk_size = get_chunk_size(operator_plan_t{}, states.size());
+#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
+    firstprivate(x, n, states, cache, kind, chunk_size) shared(state_info, raw, norm_sq, status)
+        for (auto i = uint64_t{0}; i < states.size(); ++i) {
+            ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            local_status = status;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+            auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
+            auto&      acc        = raw[thread_num];
+            auto const spin       = states[i];
+            auto const x_i        = static_cast<std::complex<double>>(x[i]);
+            auto const weight     = std::norm(x_i);
+            norm_sq[thread_num] += weight;
+            // Diagonal part: σᶻₐσᶻᵦ is +1 when bits a and b coincide and -1 otherwise
+            for (auto a = 0U; a < n; ++a) {
+                auto const same = ((spin >> a) & 1U) != 0U ? spin : ~spin;
+                for (auto b = 0U; b < n; ++b) {
+                    acc[a * n + b] += ((same >> b) & 1U) != 0U ? weight : -weight;
+                }
+            }
+            if (kind != LS_CORRELATOR_HEISENBERG) { continue; }
+            // Off-diagonal part: σˣₐσˣᵦ + σʸₐσʸᵦ = 2(σ⁺ₐσ⁻ᵦ + σ⁻ₐσ⁺ᵦ) flips a pair of
+            // anti-aligned spins
+            ls_bits64            repr;       // NOLINT: initialized by state_info
+            std::complex<double> character;  // NOLINT: initialized by state_info
+            double               norm;       // NOLINT: initialized by state_info
+            state_info(spin, repr, character, norm);
+            auto const old_norm = norm;
+            for (auto a = 0U; a < n && local_status == LS_SUCCESS; ++a) {
+                for (auto b = a + 1U; b < n; ++b) {
+                    if (((spin >> a) & 1U) == ((spin >> b) & 1U)) { continue; }
+                    state_info(spin ^ ((uint64_t{1} << a) | (uint64_t{1} << b)), repr, character,
+                               norm);
+                    if (norm == 0.0) { continue; }
+                    uint64_t index; // NOLINT: index is initialized by index
+                    local_status = cache->index(repr, &index);
+                    if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { break; }
+                    auto const element = std::conj(x_i) * 2.0 * norm / old_norm
+                                         * std::conj(character)
+                                         * static_cast<std::complex<double>>(x[index]);
+                    acc[a * n + b] += element;
+                    acc[b * n + a] += element;
+                }
+            }
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+            }
+        }
+        if (status != LS_SUCCESS) { return status; }
+
+        for (auto k = 1U; k < raw.size(); ++k) {
+            std::transform(std::begin(raw[0]), std::end(raw[0]), std::begin(raw[k]),
+                           std::begin(raw[0]), std::plus<>{});
+        }
+        if (kind == LS_CORRELATOR_HEISENBERG) {
+            // σᵢ·σᵢ = 3, but the loops above only produced σᶻᵢσᶻᵢ = 1
+            auto const w = std::accumulate(std::begin(norm_sq), std::end(norm_sq), 0.0);
+            for (auto a = 0U; a < n; ++a) {
+                raw[0][a * n + a] += 2.0 * w;
+            }
+        }
+        auto const& total = raw[0];
+
+        // ⟨x|Oᵢⱼ|x⟩ = ⟨x|Ōᵢⱼ|x⟩ where Ōᵢⱼ = 1/|G| Σ_g O_{g(i)g(j)} is invariant under the group and
+        // can thus be computed from representatives. Rows of the result related by a symmetry
+        // coincide, so for translationally invariant systems each row is a shifted reference row.
+        auto const permutations = all_site_permutations(*body, n);
+        if (permutations.empty()) {
+            for (auto k = 0U; k < n * n; ++k) {
+                out[k] = total[k].real();
+            }
+            return outcome::success();
+        }
+        auto const scale = 1.0 / static_cast<double>(permutations.size());
+        std::fill(out, out + n * n, 0.0);
+        for (auto const& p : permutations) {
+            for (auto a = 0U; a < n; ++a) {
+                for (auto b = 0U; b < n; ++b) {
+                    out[a * n + b] += scale * total[p[a] * n + p[b]].real();
+                }
+            }
+        }
+        return outcome::success();
+    }
+
+    auto structure_factor(unsigned const n, double const* correlations,
+                          uint64_t const number_momenta, double const* phases, double* out) noexcept
+        -> void
+    {
+        for (auto k = uint64_t{0}; k < number_momenta; ++k) {
+            auto const* phi = phases + k * n;
+            auto        sum = 0.0;
+            for (auto a = 0U; a < n; ++a) {
+                for (auto b = 0U; b < n; ++b) {
+                    sum += std::cos(phi[a] - phi[b]) * correlations[a * n + b];
+                }
+            }
+            out[k] = sum / static_cast<double>(n);
+        }
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LS_CALL_CORRELATIONS_HELPER(dtype)                                                         \
+    correlations_helper<dtype>(*basis, kind, size, static_cast<dtype const*>(x), correlations)
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_spin_correlations(ls_spin_basis const* basis, ls_correlator_kind const kind,
+                     ls_datatype const dtype, uint64_t const size, void const* x,
+                     double* correlations, uint64_t const number_momenta, double const* phases,
+                     double* structure_factor)
+{
+    auto r = [&]() -> outcome::result<void> {
+        switch (dtype) {
+        case LS_FLOAT32: return LS_CALL_CORRELATIONS_HELPER(float);
+        case LS_FLOAT64: return LS_CALL_CORRELATIONS_HELPER(double);
+        case LS_COMPLEX64: return LS_CALL_CORRELATIONS_HELPER(std::complex<float>);
+        case LS_COMPLEX128: return LS_CALL_CORRELATIONS_HELPER(std::complex<double>);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }();
+    if (!r) { return to_error_code(r.error()); }
+    if (number_momenta != 0 && structure_factor != nullptr) {
+        lattice_symmetries::structure_factor(basis->header.number_spins, correlations,
+                                             number_momenta, phases, structure_factor);
+    }
+    return LS_SUCCESS;
+}
+
+#undef LS_CALL_CORRELATIONS_HELPER
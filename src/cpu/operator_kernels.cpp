@@ -0,0 +1,646 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "operator_kernels.hpp"
+#include "../cache.hpp"
+#include "../operator.hpp"
+#include <vectorclass.h>
+#include <omp.h>
+#include <array>
+#include <vector>
+
+#if LATTICE_SYMMETRIES_HAS_AVX2()
+#    define ARCH avx2
+#elif LATTICE_SYMMETRIES_HAS_AVX()
+#    define ARCH avx
+#elif LATTICE_SYMMETRIES_HAS_SSE4()
+#    define ARCH sse4
+#else
+#    define ARCH sse2
+#endif
+
+namespace lattice_symmetries::ARCH {
+namespace vcl = VCL_NAMESPACE;
+
+namespace {
+    template <unsigned N> struct term_info_t {
+        static constexpr unsigned Dim = 1U << N;
+
+        /// nonzero[k] has bit n set if the transition k -> n (n != k) has a nonzero coefficient
+        uint64_t nonzero[Dim];
+        /// Bitwise OR of all nonzero[k]
+        uint64_t any_nonzero;
+
+        explicit term_info_t(std::complex<double> const* matrix) noexcept : nonzero{}, any_nonzero{}
+        {
+            for (auto k = 0U; k < Dim; ++k) {
+                for (auto n = 0U; n < Dim; ++n) {
+                    if (n != k && matrix[k * Dim + n] != 0.0) { nonzero[k] |= uint64_t{1} << n; }
+                }
+                any_nonzero |= nonzero[k];
+            }
+        }
+    };
+
+    template <unsigned N>
+    auto apply_term_8_impl(ls_term_view const& term, uint64_t const* spins, uint64_t const stride,
+                           uint64_t* out_spins, std::complex<double>* out_coeffs, uint64_t* counts,
+                           std::complex<double>* diagonal) noexcept -> void
+    {
+        constexpr auto Dim       = term_info_t<N>::Dim;
+        constexpr auto one       = uint64_t{1};
+        auto const*    matrix    = term.matrix;
+        auto const     info      = term_info_t<N>{matrix};
+        auto const     x         = vcl::Vec8uq{}.load(spins);
+        auto const*    all_sites = reinterpret_cast<std::array<uint16_t, N> const*>(term.sites);
+
+        for (auto i = uint64_t{0}; i < term.number_sites; ++i) {
+            auto const& sites = all_sites[i];
+            // Gather local configurations in all lanes. Bit order must match gather_bits.
+            auto     k         = vcl::Vec8uq{0};
+            uint64_t site_mask = 0;
+            for (auto const site : sites) {
+                k         = (k << 1) | ((x >> site) & vcl::Vec8uq{1});
+                site_mask = site_mask | (one << site);
+            }
+            alignas(64) uint64_t ks[apply_batch_size];
+            k.store_a(ks);
+            // Diagonal matrix elements
+            for (auto lane = 0U; lane < apply_batch_size; ++lane) {
+                diagonal[lane] += matrix[ks[lane] * Dim + ks[lane]];
+            }
+            if (info.any_nonzero == 0) { continue; }
+            // Off-diagonal matrix elements: y = x with local configuration replaced by n
+            auto const nonzero = vcl::Vec8uq{info.nonzero[ks[0]], info.nonzero[ks[1]],
+                                             info.nonzero[ks[2]], info.nonzero[ks[3]],
+                                             info.nonzero[ks[4]], info.nonzero[ks[5]],
+                                             info.nonzero[ks[6]], info.nonzero[ks[7]]};
+            auto const cleared = x & vcl::Vec8uq{~site_mask};
+            for (auto n = 0U; n < Dim; ++n) {
+                if (((info.any_nonzero >> n) & one) == 0) { continue; }
+                auto pattern = uint64_t{0};
+                for (auto m = 0U; m < N; ++m) {
+                    pattern |= static_cast<uint64_t>((n >> (N - 1U - m)) & 1U) << sites[m];
+                }
+                auto const y = cleared | vcl::Vec8uq{pattern};
+                alignas(64) uint64_t ys[apply_batch_size];
+                y.store_a(ys);
+                // Emulate compress-store by iterating over set bits of the mask
+                auto mask = static_cast<unsigned>(
+                    vcl::to_bits(((nonzero >> n) & vcl::Vec8uq{1}) != vcl::Vec8uq{0}));
+                while (mask != 0) {
+                    auto const lane   = static_cast<unsigned>(__builtin_ctz(mask));
+                    auto const offset = lane * stride + counts[lane];
+                    out_spins[offset]  = ys[lane];
+                    out_coeffs[offset] = matrix[ks[lane] * Dim + n];
+                    ++counts[lane];
+                    mask &= mask - 1U;
+                }
+            }
+        }
+    }
+} // namespace
+
+auto apply_term_8(ls_term_view const& term, uint64_t const* spins, uint64_t const stride,
+                  uint64_t* out_spins, std::complex<double>* out_coeffs, uint64_t* counts,
+                  std::complex<double>* diagonal) noexcept -> void
+{
+    switch (term.number_spins) {
+    case 1:
+        return apply_term_8_impl<1>(term, spins, stride, out_spins, out_coeffs, counts, diagonal);
+    case 2:
+        return apply_term_8_impl<2>(term, spins, stride, out_spins, out_coeffs, counts, diagonal);
+    case 3:
+        return apply_term_8_impl<3>(term, spins, stride, out_spins, out_coeffs, counts, diagonal);
+    case 4:
+        return apply_term_8_impl<4>(term, spins, stride, out_spins, out_coeffs, counts, diagonal);
+    default: LATTICE_SYMMETRIES_UNREACHABLE;
+    }
+}
+
+namespace {
+    namespace detail {
+        inline auto aligned_alloc(uint64_t const alignment, uint64_t const size) noexcept -> void*
+        {
+#if defined(__APPLE__)
+            return ::aligned_alloc(alignment, size);
+#else
+            return std::aligned_alloc(alignment, size);
+#endif
+        }
+    } // namespace detail
+
+    template <class T> struct block_acc_t {
+        using acc_t = std::conditional_t<is_complex_v<T>, std::complex<double>, double>;
+        struct free_fn_t {
+            // NOLINTNEXTLINE: we are using RAII, that's the purpose of this struct
+            auto operator()(void* p) const noexcept -> void { std::free(p); }
+        };
+
+        explicit block_acc_t(uint64_t const _block_size)
+            : data{}
+            , num_threads{static_cast<unsigned>(omp_get_max_threads())}
+            , block_size{_block_size}
+            , stride{l1_cache_size * ((block_size + l1_cache_size - 1) / l1_cache_size)}
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+            auto* p = detail::aligned_alloc(l1_cache_size, sizeof(acc_t) * num_threads * stride);
+
+            LATTICE_SYMMETRIES_CHECK(p != nullptr, "memory allocation failed");
+            data = std::unique_ptr<acc_t, free_fn_t>{static_cast<acc_t*>(p)};
+            std::fill_n(data.get(), num_threads * stride, acc_t{0});
+        }
+
+        constexpr auto operator[](unsigned const thread_num) const noexcept -> tcb::span<acc_t>
+        {
+            LATTICE_SYMMETRIES_ASSERT(thread_num < num_threads, "index out of bounds");
+            return {data.get() + stride * thread_num, block_size};
+        }
+
+#if LATTICE_SYMMETRIES_GCC()
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wclass-memaccess"
+#endif
+        auto set_zero(unsigned const thread_num) const noexcept -> void
+        {
+            // memset for std::complex is okay since it's standard layout.
+            std::memset(data.get() + stride * thread_num, 0, sizeof(acc_t) * block_size);
+        }
+#if LATTICE_SYMMETRIES_GCC()
+#    pragma GCC diagnostic pop
+#endif
+
+        auto sum_over_threads(tcb::span<std::complex<double>> out) noexcept -> void
+        {
+            auto const* p = data.get();
+            for (auto j = 0U; j < block_size; ++j) {
+                auto sum = acc_t{0.0};
+                for (auto i = 0U; i < num_threads; ++i) {
+                    sum += p[stride * i + j];
+                }
+                out[j] = sum;
+            }
+        }
+
+      private:
+        std::unique_ptr<acc_t, free_fn_t> data;
+        uint64_t                          num_threads;
+        uint64_t                          block_size;
+        uint64_t                          stride;
+    };
+
+    auto use_jit(ls_operator const& op, operator_plan_t const& plan) noexcept -> bool
+    {
+        return op.jit != nullptr && plan.use_jit;
+    }
+
+    auto make_jit_scratch(ls_operator const& op, operator_plan_t const& plan)
+        -> std::vector<jit_scratch_t>
+    {
+        if (!use_jit(op, plan)) { return {}; }
+        auto const max_size = max_buffer_size(op.terms);
+        return std::vector<jit_scratch_t>(
+            static_cast<unsigned>(omp_get_max_threads()),
+            jit_scratch_t{std::vector<uint64_t>(max_size),
+                          std::vector<std::complex<double>>(max_size)});
+    }
+
+    auto get_basis_representatives(ls_spin_basis const& basis) noexcept
+        -> outcome::result<tcb::span<uint64_t const>>
+    {
+        ls_states* states = nullptr;
+        auto const status = ls_get_states(&states, &basis);
+        if (status != LS_SUCCESS) { return status; }
+        auto const representatives =
+            tcb::span<uint64_t const>{ls_states_get_data(states), ls_states_get_size(states)};
+        ls_destroy_states(states);
+        return representatives;
+    }
+
+    /// Returns the cache of the basis in which column indices are looked up.
+    auto get_input_cache(ls_operator const& op) noexcept -> outcome::result<basis_cache_t const*>
+    {
+        auto const* payload = std::get_if<small_basis_t>(&input_basis_of(op).payload);
+        if (payload == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        if (payload->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+        return payload->cache.get();
+    }
+
+    /// Matrix element collected in tiled mode
+    struct tile_element_t {
+        uint64_t             index; ///< Column index
+        uint64_t             row;   ///< Row relative to the beginning of the tile
+        std::complex<double> coeff;
+    };
+    static_assert(2 * sizeof(tile_element_t) == tile_bytes_per_element);
+
+    /// Per-thread storage of tiled mode. Element buffers are allocated once with room for all
+    /// matrix elements of a tile, so collecting them never reallocates.
+    template <class Acc> struct tile_workspace_t {
+        struct free_fn_t {
+            // NOLINTNEXTLINE: we are using RAII, that's the purpose of this struct
+            auto operator()(void* p) const noexcept -> void { std::free(p); }
+        };
+        using buffer_t = std::unique_ptr<tile_element_t, free_fn_t>;
+
+        buffer_t         elements;
+        buffer_t         buffer; ///< Scratch space for #radix_sort
+        uint64_t         size;
+        uint64_t         capacity;
+        std::vector<Acc> acc;
+    };
+
+    /// Allocates `number_threads` workspaces which hold up to `capacity` elements each.
+    template <class Acc>
+    auto make_tile_workspaces(unsigned const number_threads, uint64_t const capacity) noexcept
+        -> outcome::result<std::vector<tile_workspace_t<Acc>>>
+    {
+        using workspace_t = tile_workspace_t<Acc>;
+        auto const allocate = [capacity]() {
+            // NOLINTNEXTLINE(cppcoreguidelines-owning-memory, cppcoreguidelines-no-malloc)
+            auto* p = std::malloc(std::max<uint64_t>(capacity, 1) * sizeof(tile_element_t));
+            return typename workspace_t::buffer_t{static_cast<tile_element_t*>(p)};
+        };
+        auto workspaces = std::vector<workspace_t>(number_threads);
+        for (auto& workspace : workspaces) {
+            workspace.elements = allocate();
+            workspace.buffer   = allocate();
+            if (workspace.elements == nullptr || workspace.buffer == nullptr) {
+                return LS_OUT_OF_MEMORY;
+            }
+            workspace.size     = 0;
+            workspace.capacity = capacity;
+        }
+        return workspaces;
+    }
+
+    /// Sorts the elements of `workspace` by index using LSD radix sort. Only the lowest
+    /// `number_bits` bits of indices are considered.
+    template <class Acc>
+    auto radix_sort(tile_workspace_t<Acc>& workspace, unsigned const number_bits) noexcept -> void
+    {
+        constexpr auto radix_bits = 8U;
+        constexpr auto mask       = (uint64_t{1} << radix_bits) - 1U;
+        for (auto shift = 0U; shift < number_bits; shift += radix_bits) {
+            auto const* first = workspace.elements.get();
+            auto const* last  = first + workspace.size;
+            auto*       out   = workspace.buffer.get();
+            std::array<uint64_t, mask + 1U> offsets{};
+            std::for_each(first, last,
+                          [&](auto const& e) { ++offsets[(e.index >> shift) & mask]; });
+            auto total = uint64_t{0};
+            for (auto& offset : offsets) {
+                auto const count = offset;
+                offset           = total;
+                total += count;
+            }
+            std::for_each(first, last,
+                          [&](auto const& e) { out[offsets[(e.index >> shift) & mask]++] = e; });
+            std::swap(workspace.elements, workspace.buffer);
+        }
+    }
+
+    /// Tiled version of #matmat_helper (see operator_plan_t::tile_size).
+    template <class T>
+    auto matmat_tiled_helper(ls_operator const& op, operator_plan_t const& plan,
+                             tcb::span<uint64_t const> representatives,
+                             basis_cache_t const* cache, uint64_t const block_size, T const* x,
+                             uint64_t const x_stride, T* y, uint64_t const y_stride,
+                             uint64_t const first, uint64_t const last,
+                             uint64_t const* rows) noexcept -> outcome::result<void>
+    {
+        using acc_t = typename block_acc_t<T>::acc_t;
+
+        alignas(l1_cache_size) auto status = LS_SUCCESS;
+        auto const jit          = use_jit(op, plan);
+        auto       scratch      = make_jit_scratch(op, plan);
+        auto const tile_size    = plan.tile_size;
+        auto const number_tiles = (last - first + tile_size - 1) / tile_size;
+        auto const size         = cache->number_states();
+        auto const number_bits =
+            size > 1 ? 64U - static_cast<unsigned>(__builtin_clzll(size - 1)) : 0U;
+        // Every row generates at most max_buffer_size off-diagonal elements plus the diagonal one
+        auto const capacity = tile_size * (max_buffer_size(op.terms) + 1);
+        OUTCOME_TRY(workspaces, make_tile_workspaces<acc_t>(
+                                    static_cast<unsigned>(omp_get_max_threads()), capacity));
+#pragma omp parallel for default(none) schedule(dynamic, 1)                                        \
+    firstprivate(x, x_stride, y, y_stride, first, last, rows, tile_size, number_tiles,            \
+                 number_bits, block_size, representatives, cache, jit)                             \
+        shared(status, op, scratch, workspaces)
+        for (auto tile = uint64_t{0}; tile < number_tiles; ++tile) {
+            ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            local_status = status;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+            auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
+            auto&      workspace  = workspaces[thread_num];
+            auto const tile_first = first + tile * tile_size;
+            auto const tile_last  = std::min(last, tile_first + tile_size);
+
+            // Collect all matrix elements of the tile
+            workspace.size = 0;
+            for (auto i = tile_first; i < tile_last && local_status == LS_SUCCESS; ++i) {
+                auto const collect = [&workspace, cache, row = i - tile_first](
+                                         ls_bits64 const             spin,
+                                         std::complex<double> const& coeff) noexcept {
+                    LATTICE_SYMMETRIES_ASSERT(workspace.size < workspace.capacity,
+                                              "buffer overflow");
+                    uint64_t   index; // NOLINT: index is initialized by index
+                    auto const _status = cache->index(spin, &index);
+                    if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
+                        workspace.elements.get()[workspace.size++] = {index, row, coeff};
+                    }
+                    return _status;
+                };
+                auto const spin = representatives[rows == nullptr ? i : rows[i]];
+                local_status =
+                    jit ? apply_helper(op, *op.jit, spin, scratch[thread_num], collect)
+                        : apply_helper(op, spin, collect);
+            }
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+                continue;
+            }
+            // Sort them by column index such that x is read sequentially
+            radix_sort(workspace, number_bits);
+            // Stream through x accumulating into rows
+            workspace.acc.assign((tile_last - tile_first) * block_size, acc_t{0});
+            auto const* elements = workspace.elements.get();
+            for (auto k = uint64_t{0}; k < workspace.size; ++k) {
+                auto const& e   = elements[k];
+                auto*       acc = workspace.acc.data() + e.row * block_size;
+                for (auto j = uint64_t{0}; j < block_size; ++j) {
+                    auto const xj = static_cast<acc_t>(x[e.index + x_stride * j]);
+                    if constexpr (is_complex_v<T>) {
+                        acc[j] += std::conj(e.coeff) * xj;
+                    }
+                    else {
+                        acc[j] += e.coeff.real() * xj;
+                    }
+                }
+            }
+            for (auto i = tile_first; i < tile_last; ++i) {
+                auto const* acc = workspace.acc.data() + (i - tile_first) * block_size;
+                for (auto j = uint64_t{0}; j < block_size; ++j) {
+                    y[i + y_stride * j] = static_cast<T>(acc[j]);
+                }
+            }
+        }
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success();
+    }
+
+    template <class T>
+    auto matmat_helper(ls_operator const& op, uint64_t const size, uint64_t const block_size,
+                       T const* x, uint64_t const x_stride, T* y, uint64_t const y_stride,
+                       uint64_t const first, uint64_t const last, uint64_t const* rows) noexcept
+        -> outcome::result<void>
+    {
+        if (!is_complex_v<T> && !op.is_real) { return LS_OPERATOR_IS_COMPLEX; }
+        // gcc-7.3 gets confused by OUTCOME_TRY here (because of auto&&), so we expand it manually
+        auto&& _r = get_basis_representatives(*op.basis);
+        if (!_r) { return _r.as_failure(); }
+        auto const representatives = _r.value(); // OUTCOME_TRY uses auto&& here
+        auto&&     _c              = get_input_cache(op);
+        if (!_c) { return _c.as_failure(); }
+        auto const* cache = _c.value();
+        if (size != cache->number_states()) { return LS_DIMENSION_MISMATCH; }
+        auto const number_rows = representatives.size();
+        LATTICE_SYMMETRIES_ASSERT(first <= last && (rows != nullptr || last <= number_rows),
+                                  "invalid range of rows");
+        if (rows != nullptr
+            && !std::all_of(rows + first, rows + last,
+                            [number_rows](auto const i) { return i < number_rows; })) {
+            return LS_INVALID_ARGUMENT;
+        }
+        auto const& plan = get_plan(op, datatype_of<T>(), block_size);
+        if (plan.tile_size != 0) {
+            return matmat_tiled_helper(op, plan, representatives, cache, block_size, x, x_stride,
+                                       y, y_stride, first, last, rows);
+        }
+
+        alignas(l1_cache_size) auto status    = LS_SUCCESS;
+        alignas(l1_cache_size) auto block_acc = block_acc_t<T>{block_size};
+        using acc_t                           = typename block_acc_t<T>::acc_t;
+
+        auto const jit        = use_jit(op, plan);
+        auto       scratch    = make_jit_scratch(op, plan);
+        auto const chunk_size = get_chunk_size(plan, last - first);
+#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
+    firstprivate(x, x_stride, y, y_stride, chunk_size, first, last, rows, representatives, cache,  \
+                 jit) shared(status, block_acc, op, scratch)
+        for (auto i = first; i < last; ++i) {
+            ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            local_status = status;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+            // Reset the accumulator
+            auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
+            block_acc.set_zero(thread_num);
+            auto const acc = block_acc[thread_num];
+            auto const accumulate = [acc, cache, x, x_stride](
+                                        ls_bits64 const spin,
+                                        std::complex<double> const& coeff) noexcept {
+                uint64_t   index; // NOLINT: index is initialized by index
+                auto const _status = cache->index(spin, &index);
+                if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
+                    for (auto j = uint64_t{0}; j < acc.size(); ++j) {
+                        if constexpr (is_complex_v<T>) {
+                            acc[j] +=
+                                std::conj(coeff) * static_cast<acc_t>(x[index + x_stride * j]);
+                        }
+                        else {
+                            acc[j] += coeff.real() * static_cast<acc_t>(x[index + x_stride * j]);
+                        }
+                    }
+                }
+                return _status;
+            };
+            // Apply the operator to the representative
+            auto const spin = representatives[rows == nullptr ? i : rows[i]];
+            local_status    = jit ? apply_helper(op, *op.jit, spin, scratch[thread_num], accumulate)
+                                  : apply_helper(op, spin, accumulate);
+            // Store the results
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+            }
+            else {
+                for (auto j = uint64_t{0}; j < acc.size(); ++j) {
+                    y[i + y_stride * j] = static_cast<T>(acc[j]);
+                }
+            }
+        }
+        // Callers inside the library use OUTCOME_TRY, so success must not travel as an error
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success();
+    }
+
+    template <class T>
+    auto expectation_helper(ls_operator const& op, uint64_t const size, uint64_t const block_size,
+                            T const* x, uint64_t const x_stride, std::complex<double>* out) noexcept
+        -> outcome::result<void>
+    {
+        // ⟨x|O|x⟩ only makes sense if input and output bases coincide
+        if (op.input_basis != nullptr) { return LS_INVALID_ARGUMENT; }
+        // gcc-7.3 gets confused by OUTCOME_TRY here (because of auto&&), so we expand it manually
+        auto&& _r = get_basis_representatives(*op.basis);
+        if (!_r) { return _r.as_failure(); }
+        auto const representatives = _r.value(); // OUTCOME_TRY uses auto&& here
+        if (size != representatives.size()) { return LS_DIMENSION_MISMATCH; }
+
+        alignas(l1_cache_size) auto status    = LS_SUCCESS;
+        alignas(l1_cache_size) auto block_acc = block_acc_t<std::complex<double>>{block_size};
+        alignas(l1_cache_size) auto sum_acc   = block_acc_t<std::complex<double>>{block_size};
+        using acc_t                           = std::complex<double>;
+
+        auto const* cache      = std::get_if<small_basis_t>(&op.basis->payload)->cache.get();
+        auto const& plan       = get_plan(op, datatype_of<T>(), block_size);
+        auto const  jit        = use_jit(op, plan);
+        auto        scratch    = make_jit_scratch(op, plan);
+        auto const  chunk_size = get_chunk_size(plan, representatives.size());
+#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
+    firstprivate(x, x_stride, chunk_size, representatives, cache, jit)                             \
+        shared(status, block_acc, sum_acc, op, scratch)
+        for (auto i = uint64_t{0}; i < representatives.size(); ++i) {
+            ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            local_status = status;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+            // Reset the accumulator
+            auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
+            block_acc.set_zero(thread_num);
+            auto const acc = block_acc[thread_num];
+            // Apply the operator to the representative
+            auto const accumulate = [acc, cache, x, x_stride](
+                                        ls_bits64 const spin,
+                                        std::complex<double> const& coeff) noexcept {
+                uint64_t   index; // NOLINT: index is initialized by index
+                auto const _status = cache->index(spin, &index);
+                if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
+                    for (auto j = uint64_t{0}; j < acc.size(); ++j) {
+                        using T_ = typename block_acc_t<T>::acc_t;
+                        acc[j] += std::conj(coeff) * static_cast<T_>(x[index + x_stride * j]);
+                    }
+                }
+                return _status;
+            };
+            local_status = jit ? apply_helper(op, *op.jit, representatives[i], scratch[thread_num],
+                                              accumulate)
+                               : apply_helper(op, representatives[i], accumulate);
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+                continue;
+            }
+            // Accumulate the results into thread local sum
+            auto const sum = sum_acc[thread_num];
+            for (auto j = uint64_t{0}; j < acc.size(); ++j) {
+                sum[j] += static_cast<acc_t>(std::conj(x[i + x_stride * j])) * acc[j];
+            }
+        }
+        if (LATTICE_SYMMETRIES_LIKELY(status == LS_SUCCESS)) {
+            // Compute the final reduction
+            sum_acc.sum_over_threads(tcb::span{out, block_size});
+        }
+        return status;
+    }
+} // namespace
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LS_CALL_MATMAT_HELPER(dtype)                                                               \
+    matmat_helper<dtype>(op, size, block_size, static_cast<dtype const*>(x), x_stride,             \
+                         static_cast<dtype*>(y), y_stride, first, last,                            \
+                         rows) // NOLINT(bugprone-macro-parentheses)
+
+auto operator_matmat(ls_operator const& op, ls_datatype const dtype, uint64_t const size,
+                     uint64_t const block_size, void const* x, uint64_t const x_stride, void* y,
+                     uint64_t const y_stride, uint64_t const first, uint64_t const last,
+                     uint64_t const* rows) noexcept -> outcome::result<void>
+{
+    switch (dtype) {
+    case LS_FLOAT32: return LS_CALL_MATMAT_HELPER(float);
+    case LS_FLOAT64: return LS_CALL_MATMAT_HELPER(double);
+    case LS_COMPLEX64: return LS_CALL_MATMAT_HELPER(std::complex<float>);
+    case LS_COMPLEX128: return LS_CALL_MATMAT_HELPER(std::complex<double>);
+    default: return LS_INVALID_DATATYPE;
+    }
+}
+
+#undef LS_CALL_MATMAT_HELPER
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LS_CALL_EXPECTATION_HELPER(dtype)                                                          \
+    expectation_helper<dtype>(op, size, block_size, static_cast<dtype const*>(x), x_stride,        \
+                              static_cast<std::complex<double>*>(out))
+
+auto operator_expectation(ls_operator const& op, ls_datatype const dtype, uint64_t const size,
+                          uint64_t const block_size, void const* x, uint64_t const x_stride,
+                          void* out) noexcept -> outcome::result<void>
+{
+    switch (dtype) {
+    case LS_FLOAT32: return LS_CALL_EXPECTATION_HELPER(float);
+    case LS_FLOAT64: return LS_CALL_EXPECTATION_HELPER(double);
+    case LS_COMPLEX64: return LS_CALL_EXPECTATION_HELPER(std::complex<float>);
+    case LS_COMPLEX128: return LS_CALL_EXPECTATION_HELPER(std::complex<double>);
+    default: return LS_INVALID_DATATYPE;
+    }
+}
+
+#undef LS_CALL_EXPECTATION_HELPER
+
+} // namespace lattice_symmetries::ARCH
+
+#if defined(LATTICE_SYMMETRIES_ADD_DISPATCH_CODE)
+namespace lattice_symmetries {
+auto apply_term_8(ls_term_view const& term, uint64_t const* spins, uint64_t stride,
+                  uint64_t* out_spins, std::complex<double>* out_coeffs, uint64_t* counts,
+                  std::complex<double>* diagonal) noexcept -> void
+{
+    LATTICE_SYMMETRIES_DISPATCH(apply_term_8, term, spins, stride, out_spins, out_coeffs, counts,
+                                diagonal);
+}
+
+auto operator_matmat(ls_operator const& op, ls_datatype dtype, uint64_t size, uint64_t block_size,
+                     void const* x, uint64_t x_stride, void* y, uint64_t y_stride, uint64_t first,
+                     uint64_t last, uint64_t const* rows) noexcept -> outcome::result<void>
+{
+    LATTICE_SYMMETRIES_DISPATCH(operator_matmat, op, dtype, size, block_size, x, x_stride, y,
+                                y_stride, first, last, rows);
+}
+
+auto operator_expectation(ls_operator const& op, ls_datatype dtype, uint64_t size,
+                          uint64_t block_size, void const* x, uint64_t x_stride, void* out) noexcept
+    -> outcome::result<void>
+{
+    LATTICE_SYMMETRIES_DISPATCH(operator_expectation, op, dtype, size, block_size, x, x_stride,
+                                out);
+}
+} // namespace lattice_symmetries
+#endif
@@ -0,0 +1,80 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <outcome.hpp>
+#include <complex>
+#include <cstdint>
+
+namespace outcome = OUTCOME_V2_NAMESPACE;
+
+#define LATTICE_SYMMETRIES_DECLARE()                                                               \
+    auto apply_term_8(ls_term_view const& term, uint64_t const* spins, uint64_t stride,           \
+                      uint64_t* out_spins, std::complex<double>* out_coeffs, uint64_t* counts,     \
+                      std::complex<double>* diagonal) noexcept->void;                     \
+    auto operator_matmat(ls_operator const& op, ls_datatype dtype, uint64_t size,                 \
+                         uint64_t block_size, void const* x, uint64_t x_stride, void* y,           \
+                         uint64_t y_stride, uint64_t first, uint64_t last,                         \
+                         uint64_t const* rows) noexcept->outcome::result<void>;                    \
+    auto operator_expectation(ls_operator const& op, ls_datatype dtype, uint64_t size,            \
+                              uint64_t block_size, void const* x, uint64_t x_stride,              \
+                              void* out) noexcept->outcome::result<void>;
+#define LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(arch)                                                  \
+    namespace arch {                                                                               \
+    LATTICE_SYMMETRIES_DECLARE()                                                                   \
+    } /*namespace arch*/
+
+namespace lattice_symmetries {
+
+/// Number of spin configurations processed simultaneously by #apply_term_8.
+inline constexpr unsigned apply_batch_size = 8;
+
+// apply_term_8 applies one term to #apply_batch_size spin configurations `spins` at once.
+//
+// Off-diagonal matrix elements (before canonicalization) generated from `spins[i]` are appended to
+// `out_spins + i * stride` and `out_coeffs + i * stride`; `counts[i]` is the number of elements
+// already written there and is updated accordingly. Diagonal matrix elements are added to
+// `diagonal[i]`. Elements are produced in exactly the same order as by `ls_operator_apply`.
+//
+// operator_matmat and operator_expectation implement ls_operator_matmat and
+// ls_operator_expectation respectively. operator_matmat only computes rows in [first, last) of
+// `y`. If `rows` is not nullptr, row `i` of `y` is row `rows[i]` of the operator. They live here
+// rather than in operator.cpp such that the inner accumulation loops are compiled for every
+// supported architecture.
+LATTICE_SYMMETRIES_DECLARE()
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(avx2)
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(avx)
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(sse4)
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(sse2)
+
+} // namespace lattice_symmetries
+
+#undef LATTICE_SYMMETRIES_DECLARE
+#undef LATTICE_SYMMETRIES_DECLARE_FOR_ARCH
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "../basis.hpp"
 
 namespace lattice_symmetries {
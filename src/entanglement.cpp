@@ -0,0 +1,316 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "bits.hpp"
+#include "cache.hpp"
+#include "linalg.hpp"
+#include "operator.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Spreads the lowest bits of `x` over the set bits of `mask` (i.e. `_pdep_u64`).
+    auto deposit(uint64_t x, uint64_t mask) noexcept -> uint64_t
+    {
+        auto r = uint64_t{0};
+        for (; mask != 0; mask &= mask - 1U) {
+            if ((x & 1U) != 0U) { r |= mask & (~mask + 1U); }
+            x >>= 1U;
+        }
+        return r;
+    }
+
+    /// Enumerates configurations of `size` spins with Hamming weights in `[min_weight,
+    /// max_weight]`, weight by weight. Configurations are compact, i.e. they still have to be
+    /// deposited onto the environment sites.
+    class environment_generator_t {
+      public:
+        environment_generator_t(unsigned const size, unsigned const min_weight,
+                                unsigned const max_weight) noexcept
+            : _size{size}, _weight{min_weight}, _max_weight{max_weight}, _current{first(min_weight)}
+        {}
+
+        /// Writes up to `count` configurations and their Hamming weights. Returns the number of
+        /// written configurations which is zero once all have been enumerated.
+        auto next(uint64_t const count, uint64_t* spins, unsigned* weights) noexcept -> uint64_t
+        {
+            auto n = uint64_t{0};
+            for (; n < count && _weight <= _max_weight; ++n) {
+                spins[n]   = _current;
+                weights[n] = _weight;
+                if (_current == last(_weight)) {
+                    ++_weight;
+                    _current = first(_weight);
+                }
+                else {
+                    _current = next_with_same_weight(_current);
+                }
+            }
+            return n;
+        }
+
+      private:
+        static constexpr auto first(unsigned const weight) noexcept -> uint64_t
+        {
+            return weight >= 64U ? ~uint64_t{0} : (uint64_t{1} << weight) - 1U;
+        }
+        [[nodiscard]] constexpr auto last(unsigned const weight) const noexcept -> uint64_t
+        {
+            return weight == 0U ? 0U : first(weight) << (_size - weight);
+        }
+
+        unsigned _size;
+        unsigned _weight;
+        unsigned _max_weight;
+        uint64_t _current;
+    };
+
+    /// Number of environment configurations processed at once. Their amplitudes are stored
+    /// in a 2^|A| × batch_size matrix and added to ρ_A as a rank-batch_size update.
+    constexpr auto environment_batch_size = uint64_t{256};
+
+    template <class T>
+    auto reduced_density_matrix_helper(ls_spin_basis const& basis, uint64_t const size,
+                                       T const* x, uint64_t const subsystem_mask,
+                                       std::complex<double>* out) noexcept
+        -> outcome::result<void>
+    {
+        auto const* body = std::get_if<small_basis_t>(&basis.payload);
+        if (body == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        if (body->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+        auto const* cache = body->cache.get();
+        if (size != cache->number_states()) { return LS_DIMENSION_MISMATCH; }
+        auto const number_spins = basis.header.number_spins;
+        auto const full_mask =
+            number_spins == 64U ? ~uint64_t{0} : ((uint64_t{1} << number_spins) - 1U);
+        if (subsystem_mask == 0 || (subsystem_mask & ~full_mask) != 0) {
+            return LS_INVALID_ARGUMENT;
+        }
+        auto const environment_mask = full_mask & ~subsystem_mask;
+        auto const subsystem_size   = popcount(subsystem_mask);
+        auto const environment_size = number_spins - subsystem_size;
+        auto const dimension        = uint64_t{1} << subsystem_size;
+        auto const hamming_weight   = basis.header.hamming_weight;
+
+        // Subsystem configurations grouped by Hamming weight. With a fixed total weight w only
+        // environments of weight w - |a| contribute, so neither these nor the incompatible
+        // environments have to be visited.
+        auto subsystem_spins = std::vector<uint64_t>(dimension);
+        auto by_weight       = std::vector<std::vector<uint64_t>>(subsystem_size + 1);
+        for (auto a = uint64_t{0}; a < dimension; ++a) {
+            subsystem_spins[a] = deposit(a, subsystem_mask);
+            by_weight[popcount(a)].push_back(a);
+        }
+        auto all = std::vector<uint64_t>(dimension);
+        std::iota(std::begin(all), std::end(all), uint64_t{0});
+        auto const min_weight = hamming_weight.has_value() && *hamming_weight > subsystem_size
+                                    ? *hamming_weight - subsystem_size
+                                    : 0U;
+        auto const max_weight =
+            hamming_weight.has_value() ? std::min(*hamming_weight, environment_size)
+                                       : environment_size;
+        auto       generator  = environment_generator_t{environment_size, min_weight, max_weight};
+        auto const state_info = make_state_info_fn<ls_bits64>(basis);
+        std::fill(out, out + dimension * dimension, std::complex<double>{0.0, 0.0});
+
+        // Amplitude of a spin configuration s in the full 2^N space is ψ(s) = x[index(r)]·‖r‖·χ̄
+        // where r, χ and ‖r‖ are the representative, character and norm of s. ρ_A[a, a'] =
+        // Σ_b ψ(a, b) ψ̄(a', b) is computed by streaming over environment configurations b such
+        // that at no point the full vector needs to be stored.
+        auto amplitudes   = std::vector<std::complex<double>>(dimension * environment_batch_size);
+        auto non_zero     = std::vector<char>(dimension);
+        auto environments = std::vector<uint64_t>(environment_batch_size);
+        auto weights      = std::vector<unsigned>(environment_batch_size);
+        auto batch        = uint64_t{0};
+        auto status       = LS_SUCCESS;
+        // A single parallel region for all batches: one thread generates the next batch, then
+        // all of them compute amplitudes and update ρ_A.
+#pragma omp parallel default(none)                                                                 \
+    firstprivate(environment_mask, dimension, hamming_weight, x, cache, out)                       \
+        shared(generator, environments, weights, batch, subsystem_spins, by_weight, all,           \
+               state_info, amplitudes, non_zero, status)
+        for (;;) {
+#pragma omp single
+            {
+                batch = generator.next(environment_batch_size, environments.data(), weights.data());
+                std::fill(std::begin(amplitudes), std::end(amplitudes),
+                          std::complex<double>{0.0, 0.0});
+                std::fill(std::begin(non_zero), std::end(non_zero), char{0});
+            }
+            if (batch == 0) { break; }
+#pragma omp for schedule(dynamic, 1)
+            for (auto k = uint64_t{0}; k < batch; ++k) {
+                ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+                local_status = status;
+                if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+                auto const  environment = deposit(environments[k], environment_mask);
+                auto const& candidates =
+                    hamming_weight.has_value() ? by_weight[*hamming_weight - weights[k]] : all;
+                for (auto const a : candidates) {
+                    auto const           spin = subsystem_spins[a] | environment;
+                    ls_bits64            repr;      // NOLINT: initialized by state_info
+                    std::complex<double> character; // NOLINT: initialized by state_info
+                    double               norm;      // NOLINT: initialized by state_info
+                    state_info(spin, repr, character, norm);
+                    if (norm == 0.0) { continue; }
+                    uint64_t index; // NOLINT: index is initialized by index
+                    local_status = cache->index(repr, &index);
+                    if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { break; }
+                    amplitudes[a * environment_batch_size + k] =
+                        static_cast<std::complex<double>>(x[index]) * norm * std::conj(character);
+                    non_zero[a] = 1;
+                }
+                if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                    status = local_status;
+                }
+            }
+            // All threads see the same status after the implicit barrier
+            ls_error_code current_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            current_status = status;
+            if (current_status != LS_SUCCESS) { break; }
+            // Rank-batch update of the upper triangle. Different threads own different rows, so
+            // no synchronization is needed.
+#pragma omp for schedule(dynamic, 1)
+            for (auto a = uint64_t{0}; a < dimension; ++a) {
+                if (non_zero[a] == 0) { continue; }
+                auto const* row = amplitudes.data() + a * environment_batch_size;
+                for (auto b = a; b < dimension; ++b) {
+                    if (non_zero[b] == 0) { continue; }
+                    auto const* other = amplitudes.data() + b * environment_batch_size;
+                    auto        sum   = std::complex<double>{0.0, 0.0};
+                    for (auto k = uint64_t{0}; k < batch; ++k) {
+                        sum += row[k] * std::conj(other[k]);
+                    }
+                    out[a * dimension + b] += sum;
+                }
+            }
+        }
+        if (status != LS_SUCCESS) { return status; }
+        for (auto a = uint64_t{0}; a < dimension; ++a) {
+            for (auto b = uint64_t{0}; b < a; ++b) {
+                out[a * dimension + b] = std::conj(out[b * dimension + a]);
+            }
+        }
+        return outcome::success();
+    }
+
+    /// Eigenvalues of a Hermitian matrix. Reduced density matrices are block diagonal (e.g. due
+    /// to magnetization conservation), so we first split the matrix into connected blocks and
+    /// diagonalize each of them separately.
+    auto hermitian_eigenvalues(uint64_t const n, std::complex<double> const* matrix)
+        -> std::vector<double>
+    {
+        auto block_of = std::vector<uint64_t>(n, n);
+        auto r        = std::vector<double>{};
+        r.reserve(n);
+        auto members = std::vector<uint64_t>{};
+        auto block   = std::vector<std::complex<double>>{};
+        for (auto i = uint64_t{0}; i < n; ++i) {
+            if (block_of[i] != n) { continue; }
+            members.clear();
+            members.push_back(i);
+            block_of[i] = i;
+            for (auto j = uint64_t{0}; j < members.size(); ++j) {
+                auto const row = members[j];
+                for (auto k = uint64_t{0}; k < n; ++k) {
+                    if (block_of[k] == n && matrix[row * n + k] != 0.0) {
+                        block_of[k] = i;
+                        members.push_back(k);
+                    }
+                }
+            }
+            auto const m = members.size();
+            block.resize(m * m);
+            for (auto a = uint64_t{0}; a < m; ++a) {
+                for (auto b = uint64_t{0}; b < m; ++b) {
+                    block[a * m + b] = matrix[members[a] * n + members[b]];
+                }
+            }
+            auto const eigenvalues =
+                hermitian_eigen<std::complex<double>>(m, block.data(), nullptr);
+            r.insert(std::end(r), std::begin(eigenvalues), std::end(eigenvalues));
+        }
+        return r;
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LS_CALL_DENSITY_MATRIX_HELPER(dtype)                                                       \
+    reduced_density_matrix_helper<dtype>(*basis, size, static_cast<dtype const*>(x),               \
+                                         subsystem_mask, static_cast<std::complex<double>*>(out))
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_reduced_density_matrix(ls_spin_basis const* basis, ls_datatype const dtype, uint64_t const size,
+                          void const* x, uint64_t const subsystem_mask, void* out)
+{
+    auto r = [&]() -> outcome::result<void> {
+        switch (dtype) {
+        case LS_FLOAT32: return LS_CALL_DENSITY_MATRIX_HELPER(float);
+        case LS_FLOAT64: return LS_CALL_DENSITY_MATRIX_HELPER(double);
+        case LS_COMPLEX64: return LS_CALL_DENSITY_MATRIX_HELPER(std::complex<float>);
+        case LS_COMPLEX128: return LS_CALL_DENSITY_MATRIX_HELPER(std::complex<double>);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }();
+    return to_error_code(r);
+}
+
+#undef LS_CALL_DENSITY_MATRIX_HELPER
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_entanglement_entropy(uint64_t const dimension, void const* density_matrix, double const order,
+                        double* out)
+{
+    if (!(order > 0.0)) { return LS_INVALID_ARGUMENT; }
+    auto const eigenvalues = hermitian_eigenvalues(
+        dimension, static_cast<std::complex<double> const*>(density_matrix));
+    // x passed to ls_reduced_density_matrix need not be normalized
+    auto const trace = std::accumulate(std::begin(eigenvalues), std::end(eigenvalues), 0.0);
+    if (!(trace > 0.0)) { return LS_INVALID_ARGUMENT; }
+    auto sum = 0.0;
+    for (auto const eigenvalue : eigenvalues) {
+        auto const p = eigenvalue / trace;
+        if (p <= 0.0) { continue; } // also discards tiny negative eigenvalues due to round-off
+        sum += order == 1.0 ? -p * std::log(p) : std::pow(p, order);
+    }
+    *out = order == 1.0 ? sum : std::log(sum) / (1.0 - order);
+    return LS_SUCCESS;
+}
@@ -154,6 +154,12 @@ LATTICE_SYMMETRIES_EXPORT char const* ls_error_to_string(ls_error_code code)
         return "operator is complex. Are you trying to apply a complex operator to a real vector?";
     case LS_DIMENSION_MISMATCH:
         return "dimension of the operator does not match dimension of the vector";
+    case LS_COMPILATION_FAILED:
+        return "failed to compile or load operator-specific kernel. Is a C++ compiler available? "
+               "You can specify it using LATTICE_SYMMETRIES_JIT_CXX environment variable";
+    case LS_NOT_CONVERGED:
+        return "iterative algorithm did not converge. Try increasing the number of iterations or "
+               "the size of the Krylov subspace";
     case LS_SYSTEM_ERROR:
     default: return "unknown error";
     }
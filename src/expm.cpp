@@ -0,0 +1,286 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "krylov.hpp"
+#include "operator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    using complex_type = std::complex<double>;
+
+    /// Computes exp(-iHt)|ψ⟩ for Hermitian H using Krylov subspaces of dimension at most m.
+    ///
+    /// Every step builds an orthonormal Krylov basis V for the current state using Lanczos with
+    /// full reorthogonalization and diagonalizes the tridiagonal projection T. Afterwards,
+    /// ψ(t + τ) ≈ ‖ψ‖ V exp(-iτT) e₀ can be evaluated for any τ without further matrix-vector
+    /// products. We use it in two ways:
+    ///
+    ///   * The step size is chosen as the largest τ for which the a posteriori error estimate
+    ///     βₘ |[exp(-iτT) e₀]ₘ₋₁| (Saad, 1992) stays within the error budget. Rejected step sizes
+    ///     thus cost nothing.
+    ///   * States at all requested times within a step are obtained from the same basis.
+    class krylov_exponential_t {
+      public:
+        krylov_exponential_t(ls_operator const& op, uint64_t const n, uint64_t const m)
+            : _op{op}, _n{n}, _m{m}, _basis{n, m + 1}, _psi(n), _w(n)
+        {}
+
+        /// Evolves `x` up to `times[count - 1]` (in direction `sign`). The state at times[i] is
+        /// passed to `observe(i, state)`.
+        template <class Observe>
+        auto run(complex_type const* x, double const sign, uint64_t const count,
+                 double const* times, double const tolerance, ls_expm_info& info,
+                 Observe&& observe) -> outcome::result<void>
+        {
+            std::copy_n(x, _n, std::begin(_psi));
+            auto const final_time = count > 0 ? times[count - 1] : 0.0;
+            auto       current    = 0.0;
+            auto       i          = uint64_t{0};
+            for (; i < count && times[i] <= 0.0; ++i) {
+                OUTCOME_TRY(observe(i, _psi.data()));
+            }
+            auto state = std::vector<complex_type>(i < count ? _n : 0);
+            while (i < count) {
+                auto const norm = lattice_symmetries::norm(_n, _psi.data());
+                if (norm == 0.0) {
+                    // exp(-iHt)·0 = 0
+                    for (; i < count; ++i) {
+                        OUTCOME_TRY(observe(i, _psi.data()));
+                    }
+                    break;
+                }
+                OUTCOME_TRY(build(norm, info));
+                auto const remaining = final_time - current;
+                auto const budget    = [&](double const tau) {
+                    return tolerance * norm * tau / final_time;
+                };
+                auto tau   = remaining;
+                auto error = estimate_error(norm, sign * tau);
+                while (error > budget(tau)) {
+                    // The error grows as τ^size while the budget grows only linearly
+                    auto const factor =
+                        0.9 * std::pow(budget(tau) / error, 1.0 / static_cast<double>(_size - 1));
+                    tau *= std::clamp(factor, 0.1, 0.9);
+                    if (tau < 1e-14 * final_time) { return LS_NOT_CONVERGED; }
+                    error = estimate_error(norm, sign * tau);
+                }
+                if (tau > 0.99 * remaining) { tau = remaining; }
+
+                for (; i < count && times[i] <= current + tau; ++i) {
+                    evaluate(norm, sign * (times[i] - current), state.data());
+                    OUTCOME_TRY(observe(i, state.data()));
+                }
+                evaluate(norm, sign * tau, _psi.data());
+                current += tau;
+                info.error_estimate += error;
+                ++info.number_steps;
+            }
+            return outcome::success();
+        }
+
+        [[nodiscard]] auto state() const noexcept -> complex_type const* { return _psi.data(); }
+
+      private:
+        /// Lanczos with full reorthogonalization starting from ψ/‖ψ‖.
+        auto build(double const norm, ls_expm_info& info) -> outcome::result<void>
+        {
+            auto overlaps = std::vector<complex_type>(_m);
+            _basis.store(0, _psi.data(), 1.0 / norm);
+            _alpha.clear();
+            _beta.clear();
+            _size = _m;
+            for (auto j = uint64_t{0}; j < _m; ++j) {
+                _basis.load(j, _psi.data());
+                auto const status = ls_operator_matmat(&_op, LS_COMPLEX128, _n, 1, _psi.data(), _n,
+                                                       _w.data(), _n);
+                if (status != LS_SUCCESS) { return status; }
+                ++info.number_matvecs;
+                auto const beta = _basis.orthogonalize(j, _w.data(), overlaps.data());
+                _alpha.push_back(overlaps[j].real());
+                // Krylov subspace became invariant: the exponential is exact for all τ
+                if (beta <= 1e-12 * std::abs(_alpha.back())
+                    || beta < std::numeric_limits<double>::min()) {
+                    _size = j + 1;
+                    _beta.push_back(0.0);
+                    break;
+                }
+                _beta.push_back(beta);
+                _basis.store(j + 1, _w.data(), 1.0 / beta);
+            }
+            _eigenvalues = tridiagonal_eigen(_alpha, {std::begin(_beta), std::prev(std::end(_beta))},
+                                             &_eigenvectors);
+            return outcome::success();
+        }
+
+        /// exp(-iτT) e₀
+        auto propagator(double const tau) const -> std::vector<complex_type>
+        {
+            auto weights = std::vector<complex_type>(_size);
+            for (auto k = uint64_t{0}; k < _size; ++k) {
+                weights[k] = _eigenvectors[k] * std::exp(complex_type{0.0, -tau * _eigenvalues[k]});
+            }
+            auto r = std::vector<complex_type>(_size);
+            for (auto j = uint64_t{0}; j < _size; ++j) {
+                for (auto k = uint64_t{0}; k < _size; ++k) {
+                    r[j] += _eigenvectors[j * _size + k] * weights[k];
+                }
+            }
+            return r;
+        }
+
+        auto estimate_error(double const norm, double const tau) const -> double
+        {
+            return norm * _beta.back() * std::abs(propagator(tau).back());
+        }
+
+        /// out ← ‖ψ‖ V exp(-iτT) e₀
+        auto evaluate(double const norm, double const tau, complex_type* out) const -> void
+        {
+            auto coefficients = propagator(tau);
+            for (auto& c : coefficients) {
+                c *= norm;
+            }
+            _basis.combine(_size, 1, coefficients.data(), 1, out, _n);
+        }
+
+        ls_operator const&                         _op;
+        uint64_t                                   _n;
+        uint64_t                                   _m;
+        krylov_basis_t<complex_type, complex_type> _basis;
+        std::vector<complex_type>                  _psi;
+        std::vector<complex_type>                  _w;
+        uint64_t                                   _size = 0;
+        std::vector<double>                        _alpha;
+        std::vector<double>                        _beta;
+        std::vector<double>                        _eigenvalues;
+        std::vector<double>                        _eigenvectors;
+    };
+
+    auto check_arguments(ls_operator const& op, uint64_t const size,
+                         ls_expm_options const& options) -> outcome::result<void>
+    {
+        auto const status = check_square(op, size);
+        if (status != LS_SUCCESS) { return status; }
+        if (options.krylov_dimension < 2 || !(options.tolerance > 0.0)) {
+            return LS_INVALID_ARGUMENT;
+        }
+        return outcome::success();
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_expm_default_options(ls_expm_options* options)
+{
+    options->krylov_dimension = 30;
+    options->tolerance        = 1e-10;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_expm_multiply(ls_operator const* op, uint64_t const size, double const t,
+                          void const* x, void* out, ls_expm_options const* options,
+                          ls_expm_info* info)
+{
+    auto defaults = ls_expm_options{};
+    if (options == nullptr) {
+        ls_expm_default_options(&defaults);
+        options = &defaults;
+    }
+    auto dummy = ls_expm_info{};
+    if (info == nullptr) { info = &dummy; }
+    *info = ls_expm_info{0, 0, 0.0};
+
+    return to_error_code([&]() -> outcome::result<void> {
+        OUTCOME_TRY(check_arguments(*op, size, *options));
+        auto const m = std::min<uint64_t>(options->krylov_dimension, size);
+        auto       engine   = krylov_exponential_t{*op, size, m};
+        auto const duration = std::abs(t);
+        OUTCOME_TRY(engine.run(static_cast<complex_type const*>(x), t < 0.0 ? -1.0 : 1.0, 1,
+                               &duration, options->tolerance, *info,
+                               [](uint64_t, complex_type const*) -> outcome::result<void> {
+                                   return outcome::success();
+                               }));
+        std::copy_n(engine.state(), size, static_cast<complex_type*>(out));
+        return outcome::success();
+    }());
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_evolve(ls_operator const* op, uint64_t const size, void const* x,
+                   uint64_t const number_times, double const times[],
+                   uint64_t const number_observables, ls_operator const* const observables[],
+                   void* expectations, void* out, ls_expm_options const* options,
+                   ls_expm_info* info)
+{
+    auto defaults = ls_expm_options{};
+    if (options == nullptr) {
+        ls_expm_default_options(&defaults);
+        options = &defaults;
+    }
+    auto dummy = ls_expm_info{};
+    if (info == nullptr) { info = &dummy; }
+    *info = ls_expm_info{0, 0, 0.0};
+
+    return to_error_code([&]() -> outcome::result<void> {
+        OUTCOME_TRY(check_arguments(*op, size, *options));
+        for (auto i = uint64_t{0}; i < number_times; ++i) {
+            if (!(times[i] >= 0.0) || (i > 0 && times[i] < times[i - 1])) {
+                return LS_INVALID_ARGUMENT;
+            }
+        }
+        for (auto j = uint64_t{0}; j < number_observables; ++j) {
+            if (observables[j]->basis.get() != op->basis.get()) { return LS_INVALID_ARGUMENT; }
+        }
+        auto const m      = std::min<uint64_t>(options->krylov_dimension, size);
+        auto       engine = krylov_exponential_t{*op, size, m};
+        auto*      values = static_cast<complex_type*>(expectations);
+        OUTCOME_TRY(engine.run(
+            static_cast<complex_type const*>(x), 1.0, number_times, times, options->tolerance,
+            *info, [&](uint64_t const i, complex_type const* state) -> outcome::result<void> {
+                for (auto j = uint64_t{0}; j < number_observables; ++j) {
+                    auto const status =
+                        ls_operator_expectation(observables[j], LS_COMPLEX128, size, 1, state,
+                                                size, values + i * number_observables + j);
+                    if (status != LS_SUCCESS) { return status; }
+                }
+                return outcome::success();
+            }));
+        if (out != nullptr) {
+            std::copy_n(engine.state(), size, static_cast<complex_type*>(out));
+        }
+        return outcome::success();
+    }());
+}
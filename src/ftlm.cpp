@@ -0,0 +1,289 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "linalg.hpp"
+#include "operator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Standard normal number obtained from a counter using the Box-Muller transform. Since
+    /// every element is a pure function of (seed, sector, vector, row), vectors can be generated
+    /// in parallel and do not depend on the number of threads or the block size.
+    auto gaussian(uint64_t const key, uint64_t const counter, unsigned const component) noexcept
+        -> double
+    {
+        constexpr auto pi = 3.141592653589793238462643383279502884;
+        auto const     u1 = static_cast<double>(splitmix64(key + 2 * counter) >> 11U) * 0x1.0p-53;
+        auto const u2 = static_cast<double>(splitmix64(key + 2 * counter + 1) >> 11U) * 0x1.0p-53;
+        auto const r  = std::sqrt(-2.0 * std::log1p(-u1));
+        return component == 0 ? r * std::cos(2.0 * pi * u2) : r * std::sin(2.0 * pi * u2);
+    }
+
+    /// Ritz value together with its weight in the partition function
+    struct ritz_pair_t {
+        double energy;
+        double weight;
+    };
+
+    /// Runs `count` independent Lanczos recurrences of length at most m side by side. Since they
+    /// share matrix-vector products (one `ls_operator_matmat` call per step), the cost of
+    /// canonicalizing spin configurations is amortized over the block.
+    ///
+    /// No reorthogonalization is performed, which is standard for FTLM: spurious copies of
+    /// converged Ritz values come with correspondingly reduced weights.
+    template <class T> class block_lanczos_t {
+      public:
+        block_lanczos_t(ls_operator const& op, uint64_t const n, uint64_t const m,
+                        uint64_t const width)
+            : _op{op}, _n{n}, _m{m}, _u(n * width), _v(n * width), _w(n * width)
+        {}
+
+        /// Appends Ritz pairs from random vectors number `first`, …, `first + count - 1`
+        /// (weighted by `scale`) to `out`.
+        auto run(uint64_t const key, uint64_t const first, uint64_t const count, double const scale,
+                 std::vector<ritz_pair_t>& out) -> outcome::result<void>
+        {
+            random_block(key, first, count);
+            std::fill(std::begin(_u), std::end(_u), T{0});
+            auto alphas = std::vector<std::vector<double>>(count);
+            auto betas  = std::vector<std::vector<double>>(count);
+            auto active = std::vector<bool>(count, true);
+            for (auto step = uint64_t{0}; step < _m; ++step) {
+                constexpr auto dtype  = std::is_same_v<T, double> ? LS_FLOAT64 : LS_COMPLEX128;
+                auto const     status = ls_operator_matmat(&_op, dtype, _n, count, _v.data(), _n,
+                                                           _w.data(), _n);
+                if (status != LS_SUCCESS) { return status; }
+                auto any_active = false;
+                for (auto j = uint64_t{0}; j < count; ++j) {
+                    if (!active[j]) { continue; }
+                    auto const beta = betas[j].empty() ? 0.0 : betas[j].back();
+                    auto const [alpha, norm] = three_term_step(j, beta);
+                    alphas[j].push_back(alpha);
+                    betas[j].push_back(norm);
+                    // Invariant subspace or requested length reached
+                    if (norm <= 1e-12 * std::max(std::abs(alpha), beta) || step + 1 == _m) {
+                        active[j] = false;
+                        continue;
+                    }
+                    any_active = true;
+                }
+                if (!any_active) { break; }
+            }
+            for (auto j = uint64_t{0}; j < count; ++j) {
+                auto       vectors = std::vector<double>{};
+                auto const theta   = tridiagonal_eigen(
+                    alphas[j], {std::begin(betas[j]), std::prev(std::end(betas[j]))}, &vectors);
+                auto const size = theta.size();
+                for (auto k = uint64_t{0}; k < size; ++k) {
+                    // Starting vectors are normalized, so |⟨r|ψₖ⟩|² = Q[0][k]²
+                    out.push_back({theta[k], scale * vectors[k] * vectors[k]});
+                }
+            }
+            return outcome::success();
+        }
+
+      private:
+        auto random_block(uint64_t const key, uint64_t const first, uint64_t const count) -> void
+        {
+            auto const n = _n;
+            auto*      v = _v.data();
+#pragma omp parallel for default(none) schedule(static) firstprivate(n, key, first, count, v)
+            for (auto r = uint64_t{0}; r < n; ++r) {
+                for (auto j = uint64_t{0}; j < count; ++j) {
+                    auto const counter = (first + j) * n + r;
+                    if constexpr (is_complex_v<T>) {
+                        v[r + j * n] = T{gaussian(key, counter, 0), gaussian(key, counter, 1)};
+                    }
+                    else {
+                        v[r + j * n] = gaussian(key, counter, 0);
+                    }
+                }
+            }
+            for (auto j = uint64_t{0}; j < count; ++j) {
+                scale(n, 1.0 / norm(n, v + j * n), v + j * n);
+            }
+        }
+
+        /// For column j: α = ⟨v|w⟩, w ← w - αv - βu, u ← v, v ← w/‖w‖. Returns (α, ‖w‖).
+        auto three_term_step(uint64_t const j, double const beta) -> std::pair<double, double>
+        {
+            auto const n     = _n;
+            auto*      u     = _u.data() + j * n;
+            auto*      v     = _v.data() + j * n;
+            auto*      w     = _w.data() + j * n;
+            auto const alpha = std::real(dot(n, v, w));
+            auto const norm_squared =
+                parallel_accumulate<double>(
+                    n, 1,
+                    [=](uint64_t const first, uint64_t const last, double* acc) {
+                        for (auto r = first; r < last; ++r) {
+                            w[r] -= alpha * v[r] + beta * u[r];
+                            *acc += std::norm(w[r]);
+                        }
+                    })
+                    .front();
+            auto const norm = std::sqrt(norm_squared);
+            auto const inverse = norm > 0.0 ? 1.0 / norm : 0.0;
+#pragma omp parallel for default(none) schedule(static) if (n > 8192) firstprivate(n, u, v, w, inverse)
+            for (auto r = uint64_t{0}; r < n; ++r) {
+                u[r] = v[r];
+                v[r] = w[r] * inverse;
+            }
+            return {alpha, norm};
+        }
+
+        ls_operator const& _op;
+        uint64_t           _n;
+        uint64_t           _m;
+        std::vector<T>     _u;
+        std::vector<T>     _v;
+        std::vector<T>     _w;
+    };
+
+    template <class T>
+    auto sector_helper(ls_operator const& op, uint64_t const n, uint64_t const sector,
+                       double const degeneracy, ls_ftlm_options const& options,
+                       std::vector<ritz_pair_t>& out) -> outcome::result<void>
+    {
+        // Small sectors are diagonalized exactly
+        if (n <= options.krylov_dimension) {
+            auto       eigenvalues = std::vector<double>{};
+            auto const status      = dense_spectrum<T>(op, n, eigenvalues);
+            if (status != LS_SUCCESS) { return status; }
+            for (auto const energy : eigenvalues) {
+                out.push_back({energy, degeneracy});
+            }
+            return outcome::success();
+        }
+        auto const number_vectors = static_cast<uint64_t>(options.number_vectors);
+        auto const width     = std::min<uint64_t>(options.block_size, number_vectors);
+        auto       lanczos   = block_lanczos_t<T>{op, n, options.krylov_dimension, width};
+        auto const key       = splitmix64(options.seed ^ splitmix64(sector));
+        // Tr e^{-βH} ≈ D/R Σᵣ ⟨r|e^{-βH}|r⟩
+        auto const scale = degeneracy * static_cast<double>(n) / static_cast<double>(number_vectors);
+        for (auto first = uint64_t{0}; first < number_vectors; first += width) {
+            auto const count = std::min(width, number_vectors - first);
+            OUTCOME_TRY(lanczos.run(key, first, count, scale, out));
+        }
+        return outcome::success();
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_ftlm_default_options(ls_ftlm_options* options)
+{
+    options->krylov_dimension = 100;
+    options->number_vectors   = 20;
+    options->block_size       = 8;
+    options->seed             = 0;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_ftlm(unsigned const number_sectors, ls_operator const* const operators[],
+        double const degeneracies[], ls_ftlm_options const* options,
+        uint64_t const number_temperatures, double const temperatures[],
+        double* log_partition_function, double* energy, double* specific_heat)
+{
+    auto defaults = ls_ftlm_options{};
+    if (options == nullptr) {
+        ls_ftlm_default_options(&defaults);
+        options = &defaults;
+    }
+    if (options->krylov_dimension == 0 || options->number_vectors == 0
+        || options->block_size == 0) {
+        return LS_INVALID_ARGUMENT;
+    }
+    for (auto i = uint64_t{0}; i < number_temperatures; ++i) {
+        if (!(temperatures[i] > 0.0)) { return LS_INVALID_ARGUMENT; }
+    }
+
+    auto pairs  = std::vector<ritz_pair_t>{};
+    auto status = to_error_code([&]() -> outcome::result<void> {
+        for (auto s = 0U; s < number_sectors; ++s) {
+            auto const& op = *operators[s];
+            if (op.input_basis != nullptr) { return LS_INVALID_ARGUMENT; }
+            auto n = uint64_t{0};
+            if (auto const e = ls_get_number_states(op.basis.get(), &n); e != LS_SUCCESS) {
+                return e;
+            }
+            if (n == 0) { continue; }
+            auto const degeneracy = degeneracies != nullptr ? degeneracies[s] : 1.0;
+            if (op.is_real) {
+                OUTCOME_TRY(sector_helper<double>(op, n, s, degeneracy, *options, pairs));
+            }
+            else {
+                OUTCOME_TRY(
+                    sector_helper<std::complex<double>>(op, n, s, degeneracy, *options, pairs));
+            }
+        }
+        return outcome::success();
+    }());
+    if (status != LS_SUCCESS) { return status; }
+    if (pairs.empty()) { return LS_INVALID_ARGUMENT; }
+
+    // Energies are shifted by the smallest Ritz value to avoid overflow in e^{-βE}
+    auto const ground_state = std::min_element(std::begin(pairs), std::end(pairs),
+                                               [](auto const& a, auto const& b) {
+                                                   return a.energy < b.energy;
+                                               })
+                                  ->energy;
+    auto const* p     = pairs.data();
+    auto const  count = pairs.size();
+#pragma omp parallel for default(none) schedule(static)                                            \
+    firstprivate(number_temperatures, temperatures, log_partition_function, energy,            \
+                 specific_heat, ground_state, p, count)
+    for (auto i = uint64_t{0}; i < number_temperatures; ++i) {
+        auto const beta = 1.0 / temperatures[i];
+        auto       z    = 0.0;
+        auto       e1   = 0.0;
+        auto       e2   = 0.0;
+        for (auto k = uint64_t{0}; k < count; ++k) {
+            auto const shifted = p[k].energy - ground_state;
+            auto const w       = p[k].weight * std::exp(-beta * shifted);
+            z += w;
+            e1 += w * shifted;
+            e2 += w * shifted * shifted;
+        }
+        auto const mean = e1 / z;
+        if (log_partition_function != nullptr) {
+            log_partition_function[i] = std::log(z) - beta * ground_state;
+        }
+        if (energy != nullptr) { energy[i] = mean + ground_state; }
+        if (specific_heat != nullptr) { specific_heat[i] = beta * beta * (e2 / z - mean * mean); }
+    }
+    return LS_SUCCESS;
+}
@@ -0,0 +1,342 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "jit.hpp"
+#include "bits.hpp"
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+extern "C" char** environ; // NOLINT: passed on to the compiler
+
+namespace lattice_symmetries {
+
+jit_kernel_t::~jit_kernel_t()
+{
+    if (handle != nullptr) { dlclose(handle); }
+}
+
+namespace {
+    constexpr auto jit_symbol_name = "ls_jit_apply";
+    constexpr auto jit_flags       = "-O2 -march=native -fPIC -shared";
+
+    auto to_hex(uint64_t const x) -> std::string
+    {
+        std::array<char, 32> buffer; // NOLINT: initialized by snprintf
+        std::snprintf(buffer.data(), buffer.size(), "UINT64_C(0x%016" PRIx64 ")", x);
+        return buffer.data();
+    }
+
+    /// Hexadecimal floating point representation is exact, so the generated kernel produces
+    /// exactly the same matrix elements as the generic code.
+    auto to_hex(double const x) -> std::string
+    {
+        std::array<char, 64> buffer; // NOLINT: initialized by snprintf
+        std::snprintf(buffer.data(), buffer.size(), "%a", x);
+        return buffer.data();
+    }
+
+    template <unsigned N> auto generate_term(std::string& out, ls_term_view const& term) -> void
+    {
+        constexpr auto Dim = 1U << N;
+        // NOLINTNEXTLINE: sites are stored as contiguous N-tuples
+        auto const* tuples = reinterpret_cast<std::array<uint16_t, N> const*>(term.sites);
+        for (auto i = uint64_t{0}; i < term.number_sites; ++i) {
+            auto const& sites = tuples[i];
+            auto        mask  = uint64_t{0};
+            std::array<uint64_t, Dim> patterns{};
+            for (auto m = 0U; m < N; ++m) {
+                mask |= uint64_t{1} << sites[m];
+                for (auto k = 0U; k < Dim; ++k) {
+                    // Same bit order as in gather_bits
+                    patterns[k] |= static_cast<uint64_t>((k >> (N - 1U - m)) & 1U) << sites[m];
+                }
+            }
+            out += "    {\n        uint64_t const s = x & " + to_hex(mask) + ";\n";
+            auto first = true;
+            for (auto k = 0U; k < Dim; ++k) {
+                auto const* row = term.matrix + k * Dim;
+                std::string branch;
+                if (row[k] != 0.0) {
+                    branch += "            d_re += " + to_hex(row[k].real()) + ";\n";
+                    branch += "            d_im += " + to_hex(row[k].imag()) + ";\n";
+                }
+                for (auto n = 0U; n < Dim; ++n) {
+                    if (n == k || row[n] == 0.0) { continue; }
+                    branch += "            LS_EMIT(x ^ " + to_hex(patterns[k] ^ patterns[n]) + ", "
+                              + to_hex(row[n].real()) + ", " + to_hex(row[n].imag()) + ");\n";
+                }
+                if (branch.empty()) { continue; }
+                out += first ? "        if" : "        else if";
+                out += " (s == " + to_hex(patterns[k]) + ") {\n" + branch + "        }\n";
+                first = false;
+            }
+            out += "    }\n";
+        }
+    }
+
+    auto get_compiler() -> std::string
+    {
+        for (auto const* name : {"LATTICE_SYMMETRIES_JIT_CXX", "CXX"}) {
+            auto const* value = std::getenv(name); // NOLINT: we don't modify the environment
+            if (value != nullptr && *value != '\0') { return value; }
+        }
+        return "c++";
+    }
+
+    auto get_cache_dir() -> std::string
+    {
+        // NOLINTNEXTLINE: we don't modify the environment
+        if (auto const* dir = std::getenv("LATTICE_SYMMETRIES_JIT_CACHE"); dir != nullptr) {
+            return dir;
+        }
+        // NOLINTNEXTLINE: we don't modify the environment
+        if (auto const* dir = std::getenv("XDG_CACHE_HOME"); dir != nullptr) {
+            return std::string{dir} + "/lattice-symmetries";
+        }
+        // NOLINTNEXTLINE: we don't modify the environment
+        if (auto const* dir = std::getenv("HOME"); dir != nullptr) {
+            return std::string{dir} + "/.cache/lattice-symmetries";
+        }
+        return "/tmp/lattice-symmetries";
+    }
+
+    /// Returns a description of the host CPU. Kernels are compiled with `-march=native`, so it is
+    /// part of the cache key: a cache directory shared between machines (e.g. over NFS) must not
+    /// hand out a library which uses instructions the current CPU lacks.
+    auto get_host_cpu() -> std::string
+    {
+        auto description = std::string{};
+        if (utsname info; uname(&info) == 0) { description += info.machine; }
+        // Only fields which identify the CPU model and its features are used, others (e.g.
+        // "cpu MHz") change over time. The first six keys are used on x86 and the rest on ARM.
+        constexpr char const* keys[] = {
+            "vendor_id",       "cpu family",       "model",       "model name", "stepping", "flags",
+            "CPU implementer", "CPU architecture", "CPU variant", "CPU part",   "Features"};
+        auto stream = std::ifstream{"/proc/cpuinfo"};
+        // The first processor is enough, its block ends with an empty line
+        for (std::string line; std::getline(stream, line) && !line.empty();) {
+            auto key = line.substr(0, line.find(':'));
+            key.erase(key.find_last_not_of(" \t") + 1);
+            for (auto const* k : keys) {
+                if (key == k) {
+                    description += '\n';
+                    description += line;
+                    break;
+                }
+            }
+        }
+        return description;
+    }
+
+    /// Splits `s` at whitespace. Compilers from the environment may contain a launcher or flags
+    /// (e.g. `CXX="ccache g++"`).
+    auto split_words(std::string const& s) -> std::vector<std::string>
+    {
+        auto words  = std::vector<std::string>{};
+        auto stream = std::istringstream{s};
+        for (std::string word; stream >> word;) {
+            words.push_back(std::move(word));
+        }
+        return words;
+    }
+
+    /// Runs the program `args[0]` (looked up in `PATH`) with arguments `args` and waits for it to
+    /// finish. The shell is not involved, so arguments need no quoting. Output is discarded unless
+    /// logging is enabled. Returns whether the program exited successfully.
+    auto run_program(std::vector<std::string> const& args) -> bool
+    {
+        if (args.empty()) { return false; }
+        auto argv = std::vector<char*>{};
+        for (auto const& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str())); // NOLINT: argv is not modified
+        }
+        argv.push_back(nullptr);
+        posix_spawn_file_actions_t actions;
+        if (posix_spawn_file_actions_init(&actions) != 0) { return false; }
+        if (!ls_is_logging_enabled()) {
+            posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+            posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+        }
+        pid_t      pid; // NOLINT: initialized by posix_spawnp
+        auto const status = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (status != 0) { return false; }
+        int wait_status; // NOLINT: initialized by waitpid
+        while (waitpid(pid, &wait_status, 0) < 0) {
+            if (errno != EINTR) { return false; }
+        }
+        return WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 0;
+    }
+
+    auto make_directories(std::string const& path) -> bool
+    {
+        for (auto i = path.find('/', 1); i != std::string::npos; i = path.find('/', i + 1)) {
+            auto const parent = path.substr(0, i);
+            if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) { return false; }
+        }
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+    }
+
+    /// Creates a new empty file `prefix` + unique string + `suffix` and returns its name. Files
+    /// are renamed into place once complete, so concurrent processes (possibly on different hosts
+    /// sharing the cache) never read partially written ones.
+    auto make_temporary_file(std::string const& prefix, std::string const& suffix)
+        -> outcome::result<std::string>
+    {
+        auto       name = prefix + ".XXXXXX" + suffix;
+        auto const fd   = mkstemps(name.data(), static_cast<int>(suffix.size()));
+        if (fd < 0) { return LS_COULD_NOT_OPEN_FILE; }
+        close(fd);
+        return name;
+    }
+
+    auto write_file(std::string const& filename, std::string const& contents)
+        -> outcome::result<void>
+    {
+        // NOLINTNEXTLINE: we're not using GSL, so no gsl::owner
+        auto* stream = std::fopen(filename.c_str(), "w");
+        if (stream == nullptr) { return LS_COULD_NOT_OPEN_FILE; }
+        auto const written = std::fwrite(contents.data(), sizeof(char), contents.size(), stream);
+        auto const closed  = std::fclose(stream);
+        if (written != contents.size() || closed != 0) { return LS_FILE_IO_FAILED; }
+        return outcome::success();
+    }
+} // namespace
+
+auto generate_jit_source(tcb::span<ls_term_view const> terms) -> std::string
+{
+    std::string out = "// Generated by lattice_symmetries. Do not edit.\n"
+                      "#include <cstdint>\n"
+                      "\n"
+                      "#define LS_EMIT(y, re, im)                                           \\\n"
+                      "    out_spins[count] = (y);                                          \\\n"
+                      "    out_coeffs[2 * count] = (re);                                    \\\n"
+                      "    out_coeffs[2 * count + 1] = (im);                                \\\n"
+                      "    ++count\n"
+                      "\n"
+                      "extern \"C\" __attribute__((visibility(\"default\"))) uint64_t\n";
+    out += jit_symbol_name;
+    out += "(uint64_t const x, uint64_t* const out_spins, double* const out_coeffs,\n"
+           "             double* const diagonal) noexcept\n"
+           "{\n"
+           "    uint64_t count = 0;\n"
+           "    double   d_re  = 0.0;\n"
+           "    double   d_im  = 0.0;\n";
+    for (auto const& term : terms) {
+        switch (term.number_spins) {
+        case 1: generate_term<1>(out, term); break;
+        case 2: generate_term<2>(out, term); break;
+        case 3: generate_term<3>(out, term); break;
+        case 4: generate_term<4>(out, term); break;
+        default: LATTICE_SYMMETRIES_UNREACHABLE;
+        }
+    }
+    out += "    diagonal[0] = d_re;\n"
+           "    diagonal[1] = d_im;\n"
+           "    return count;\n"
+           "}\n";
+    return out;
+}
+
+auto compile_jit_kernel(tcb::span<ls_term_view const> terms)
+    -> outcome::result<std::unique_ptr<jit_kernel_t>>
+{
+    auto const source   = generate_jit_source(terms);
+    auto const compiler = get_compiler();
+    auto const dir      = get_cache_dir();
+    if (!make_directories(dir)) { return LS_COULD_NOT_OPEN_FILE; }
+
+    auto const key = compiler + '\n' + jit_flags + '\n' + get_host_cpu() + '\n' + source;
+    std::array<char, 32> name; // NOLINT: initialized by snprintf
+    std::snprintf(name.data(), name.size(), "/operator_%016" PRIx64, fnv1a(key.data(), key.size()));
+    auto const base    = dir + name.data();
+    auto const library = base + ".so";
+    if (access(library.c_str(), R_OK) != 0) {
+        LATTICE_SYMMETRIES_LOG_DEBUG("Compiling %s.cpp using %s ...\n", base.c_str(),
+                                     compiler.c_str());
+        OUTCOME_TRY(temporary_source, make_temporary_file(base, ".cpp"));
+        auto const temporary_library = make_temporary_file(base, ".so");
+        auto const cleanup           = [&]() {
+            std::remove(temporary_source.c_str());
+            if (temporary_library) { std::remove(temporary_library.value().c_str()); }
+        };
+        if (!temporary_library) {
+            cleanup();
+            return temporary_library.error();
+        }
+        if (auto const r = write_file(temporary_source, source); !r) {
+            cleanup();
+            return r.error();
+        }
+        auto args = split_words(compiler);
+        for (auto& flag : split_words(jit_flags)) {
+            args.push_back(std::move(flag));
+        }
+        args.insert(std::end(args), {"-o", temporary_library.value(), temporary_source});
+        if (!run_program(args)) {
+            cleanup();
+            return LS_COMPILATION_FAILED;
+        }
+        // The source is kept next to the library for inspection
+        if (std::rename(temporary_library.value().c_str(), library.c_str()) != 0
+            || std::rename(temporary_source.c_str(), (base + ".cpp").c_str()) != 0) {
+            cleanup();
+            return LS_FILE_IO_FAILED;
+        }
+    }
+
+    auto* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        LATTICE_SYMMETRIES_LOG_DEBUG("dlopen failed: %s\n", dlerror());
+        return LS_COMPILATION_FAILED;
+    }
+    auto* symbol = dlsym(handle, jit_symbol_name);
+    if (symbol == nullptr) {
+        dlclose(handle);
+        return LS_COMPILATION_FAILED;
+    }
+    // NOLINTNEXTLINE: casting between function and object pointers is what dlsym is all about
+    return std::make_unique<jit_kernel_t>(handle,
+                                          reinterpret_cast<jit_kernel_t::apply_fn_t>(symbol));
+}
+
+} // namespace lattice_symmetries
@@ -0,0 +1,70 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <outcome.hpp>
+#include <span.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace outcome = OUTCOME_V2_NAMESPACE;
+
+namespace lattice_symmetries {
+
+/// A kernel generated at runtime for a specific operator.
+///
+/// `apply(x, out_spins, out_coeffs, diagonal)` writes all off-diagonal matrix elements (before
+/// canonicalization) generated from `x` to `out_spins` and `out_coeffs` (pairs of doubles) and
+/// returns their number. The diagonal matrix element is stored to `diagonal` (a pair of doubles).
+/// Elements are produced in the same order as by `ls_operator_apply`.
+struct jit_kernel_t {
+    using apply_fn_t = uint64_t (*)(uint64_t x, uint64_t* out_spins, double* out_coeffs,
+                                    double* diagonal) noexcept;
+
+    void*      handle;
+    apply_fn_t apply;
+
+    jit_kernel_t(void* _handle, apply_fn_t _apply) noexcept : handle{_handle}, apply{_apply} {}
+    jit_kernel_t(jit_kernel_t const&) = delete;
+    jit_kernel_t(jit_kernel_t&&)      = delete;
+    auto operator=(jit_kernel_t const&) -> jit_kernel_t& = delete;
+    auto operator=(jit_kernel_t&&) -> jit_kernel_t& = delete;
+    ~jit_kernel_t();
+};
+
+/// Generates C++ source code of #jit_kernel_t::apply for operator with the given terms.
+auto generate_jit_source(tcb::span<ls_term_view const> terms) -> std::string;
+
+/// Compiles (or loads from the on-disk cache) a kernel for operator with the given terms.
+auto compile_jit_kernel(tcb::span<ls_term_view const> terms)
+    -> outcome::result<std::unique_ptr<jit_kernel_t>>;
+
+} // namespace lattice_symmetries
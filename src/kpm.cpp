@@ -0,0 +1,392 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "krylov.hpp"
+#include "operator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    constexpr auto pi = 3.141592653589793238462643383279502884;
+
+    /// Fills columns of an `n × count` block with random vectors number `first`, …,
+    /// `first + count - 1`. Real vectors have ±1 entries, complex ones random phases. Both have
+    /// unit-modulus entries which minimizes the variance of the trace estimator.
+    template <class T>
+    auto random_block(uint64_t const n, uint64_t const first, uint64_t const count,
+                      uint64_t const seed, T* out) -> void
+    {
+#pragma omp parallel for default(none) schedule(static) firstprivate(n, first, count, seed, out)
+        for (auto r = uint64_t{0}; r < n; ++r) {
+            for (auto j = uint64_t{0}; j < count; ++j) {
+                auto const bits = splitmix64(splitmix64(seed ^ (first + j)) + r);
+                if constexpr (is_complex_v<T>) {
+                    auto const phase = static_cast<double>(bits >> 11U) * 0x1.0p-53 * 2.0 * pi;
+                    out[r + j * n]   = std::polar(1.0, phase);
+                }
+                else {
+                    out[r + j * n] = (bits >> 63U) != 0 ? 1.0 : -1.0;
+                }
+            }
+        }
+    }
+
+    /// Chebyshev recursion φₙ₊₁ = 2H̃φₙ - φₙ₋₁ for a block of vectors, where H̃ = αH + β maps the
+    /// spectrum of H onto [-1, 1].
+    ///
+    /// `ls_operator_matmat` computes y = Hφₙ, and a single fused pass then overwrites φₙ₋₁ by
+    /// φₙ₊₁ = 2(αy + βφₙ) - φₙ₋₁ while accumulating the overlaps needed for moments.
+    template <class T> class chebyshev_t {
+      public:
+        chebyshev_t(ls_operator const& op, uint64_t const n, uint64_t const width,
+                    double const lower, double const upper)
+            : _op{op}
+            , _n{n}
+            , _width{width}
+            , _alpha{2.0 / (upper - lower)}
+            , _beta{-(upper + lower) / (upper - lower)}
+            , _previous(n * width)
+            , _current(n * width)
+            , _y(n * width)
+        {}
+
+        auto current() noexcept -> T* { return _current.data(); }
+
+        /// Advances the recursion by one step. `accumulate(r, j, next, current)` is called for
+        /// every element of the block before φₙ is discarded.
+        template <class Accumulate>
+        auto step(bool const first, uint64_t const count, Accumulate&& accumulate)
+            -> outcome::result<void>
+        {
+            auto const status = ls_operator_matmat(&_op, datatype_of<T>(), _n, count,
+                                                   _current.data(), _n, _y.data(), _n);
+            if (status != LS_SUCCESS) { return status; }
+            auto const  n        = _n;
+            auto const  alpha    = _alpha;
+            auto const  beta     = _beta;
+            auto const* y        = _y.data();
+            auto const* current  = _current.data();
+            auto*       previous = _previous.data();
+            // φ₁ = H̃φ₀ has no factor of 2 and no φ₋₁
+            auto const  factor   = first ? 1.0 : 2.0;
+            auto const  keep     = first ? 0.0 : 1.0;
+            for (auto j = uint64_t{0}; j < count; ++j) {
+                accumulate(j, [=](uint64_t const first_row, uint64_t const last_row, auto&& fn) {
+                    for (auto r = first_row; r < last_row; ++r) {
+                        auto const i    = r + j * n;
+                        auto const next = factor * (alpha * y[i] + beta * current[i])
+                                          - keep * previous[i];
+                        previous[i]     = next;
+                        fn(r, next, current[i]);
+                    }
+                });
+            }
+            std::swap(_previous, _current);
+            return outcome::success();
+        }
+
+      private:
+        ls_operator const& _op;
+        uint64_t           _n;
+        uint64_t           _width;
+        double             _alpha;
+        double             _beta;
+        std::vector<T>     _previous;
+        std::vector<T>     _current;
+        std::vector<T>     _y;
+    };
+
+    template <class T>
+    auto dos_helper(ls_operator const& op, uint64_t const n, double const lower, double const upper,
+                    uint64_t const number_moments, uint64_t const number_vectors,
+                    uint64_t const block_size, uint64_t const seed, double* moments)
+        -> outcome::result<void>
+    {
+        auto       chebyshev = chebyshev_t<T>{op, n, block_size, lower, upper};
+        auto const half      = (number_moments + 1) / 2;
+        // ⟨φₙ|φₙ⟩ and ⟨φₙ₊₁|φₙ⟩ summed over all random vectors
+        auto squares = std::vector<double>(half);
+        auto overlaps = std::vector<double>(half);
+        for (auto first = uint64_t{0}; first < number_vectors; first += block_size) {
+            auto const count = std::min(block_size, number_vectors - first);
+            random_block(n, first, count, seed, chebyshev.current());
+            for (auto k = uint64_t{0}; k < half; ++k) {
+                OUTCOME_TRY(chebyshev.step(k == 0, count, [&](uint64_t, auto&& sweep) {
+                    auto const sums = parallel_accumulate<double>(
+                        n, 2, [&sweep](uint64_t const first_row, uint64_t const last_row,
+                                       double* acc) {
+                            sweep(first_row, last_row,
+                                  [acc](uint64_t, T const& next, T const& current) {
+                                      acc[0] += std::norm(current);
+                                      acc[1] += std::real(conj_if_complex(next) * current);
+                                  });
+                        });
+                    squares[k] += sums[0];
+                    overlaps[k] += sums[1];
+                }));
+            }
+        }
+        // μ₀ = ⟨φ₀|φ₀⟩, μ₁ = ⟨φ₁|φ₀⟩, μ₂ₖ = 2⟨φₖ|φₖ⟩ - μ₀, μ₂ₖ₊₁ = 2⟨φₖ₊₁|φₖ⟩ - μ₁
+        auto const normalization = 1.0 / static_cast<double>(number_vectors * n);
+        for (auto k = uint64_t{0}; k < half; ++k) {
+            auto const even = k == 0 ? squares[0] : 2.0 * squares[k] - squares[0];
+            auto const odd  = k == 0 ? overlaps[0] : 2.0 * overlaps[k] - overlaps[0];
+            moments[2 * k] = normalization * even;
+            if (2 * k + 1 < number_moments) { moments[2 * k + 1] = normalization * odd; }
+        }
+        return outcome::success();
+    }
+
+    template <class T>
+    auto correlation_helper(ls_operator const& op, uint64_t const n, double const lower,
+                            double const upper, uint64_t const number_moments, T const* right,
+                            T const* left, std::complex<double>* moments) -> outcome::result<void>
+    {
+        auto chebyshev = chebyshev_t<T>{op, n, 1, lower, upper};
+        std::copy_n(right, n, chebyshev.current());
+        if (left == nullptr) {
+            // Same trick as for the density of states: two moments per matrix-vector product
+            auto const half     = (number_moments + 1) / 2;
+            auto       squares  = std::vector<std::complex<double>>(half);
+            auto       overlaps = std::vector<std::complex<double>>(half);
+            for (auto k = uint64_t{0}; k < half; ++k) {
+                OUTCOME_TRY(chebyshev.step(k == 0, 1, [&](uint64_t, auto&& sweep) {
+                    auto const sums = parallel_accumulate<std::complex<double>>(
+                        n, 2, [&sweep](uint64_t const first_row, uint64_t const last_row,
+                                       std::complex<double>* acc) {
+                            sweep(first_row, last_row,
+                                  [acc](uint64_t, T const& next, T const& current) {
+                                      acc[0] += std::norm(current);
+                                      acc[1] += conj_if_complex(next) * current;
+                                  });
+                        });
+                    squares[k]  = sums[0];
+                    overlaps[k] = sums[1];
+                }));
+            }
+            for (auto k = uint64_t{0}; k < half; ++k) {
+                moments[2 * k] = k == 0 ? squares[0] : 2.0 * squares[k] - squares[0];
+                if (2 * k + 1 < number_moments) {
+                    moments[2 * k + 1] = k == 0 ? overlaps[0] : 2.0 * overlaps[k] - overlaps[0];
+                }
+            }
+            return outcome::success();
+        }
+
+        moments[0] = dot(n, left, right);
+        for (auto k = uint64_t{1}; k < number_moments; ++k) {
+            OUTCOME_TRY(chebyshev.step(k == 1, 1, [&](uint64_t, auto&& sweep) {
+                moments[k] = parallel_accumulate<std::complex<double>>(
+                                 n, 1,
+                                 [&sweep, left](uint64_t const first_row, uint64_t const last_row,
+                                                std::complex<double>* acc) {
+                                     sweep(first_row, last_row,
+                                           [acc, left](uint64_t const r, T const& next, T const&) {
+                                               *acc += conj_if_complex(left[r]) * next;
+                                           });
+                                 })
+                                 .front();
+            }));
+        }
+        return outcome::success();
+    }
+
+    /// Short Lanczos run. Every extreme Ritz value θ has an eigenvalue within β|yₘ₋₁| of it.
+    template <class T>
+    auto spectral_bounds_helper(ls_operator const& op, uint64_t const n, double& lower,
+                                double& upper) -> outcome::result<void>
+    {
+        constexpr auto max_iterations = uint64_t{40};
+        auto const     m              = std::min(max_iterations, n);
+        auto           basis          = krylov_basis_t<T, T>{n, m + 1};
+        auto           v              = std::vector<T>(n);
+        auto           w              = std::vector<T>(n);
+        auto           overlaps       = std::vector<T>(m);
+        auto           alpha          = std::vector<double>{};
+        auto           beta           = std::vector<double>{};
+        random_block(n, 0, 1, 0, v.data());
+        basis.store(0, v.data(), 1.0 / norm(n, v.data()));
+        for (auto j = uint64_t{0}; j < m; ++j) {
+            basis.load(j, v.data());
+            auto const status =
+                ls_operator_matmat(&op, datatype_of<T>(), n, 1, v.data(), n, w.data(), n);
+            if (status != LS_SUCCESS) { return status; }
+            auto const b = basis.orthogonalize(j, w.data(), overlaps.data());
+            alpha.push_back(std::real(overlaps[j]));
+            beta.push_back(b);
+            if (b <= 1e-12 * std::abs(alpha.back()) || b < std::numeric_limits<double>::min()) {
+                beta.back() = 0.0;
+                break;
+            }
+            basis.store(j + 1, w.data(), 1.0 / b);
+        }
+        auto const size    = alpha.size();
+        auto       vectors = std::vector<double>{};
+        auto const theta   = tridiagonal_eigen(alpha, {std::begin(beta), std::prev(std::end(beta))},
+                                               &vectors);
+        auto const residual = [&](uint64_t const i) {
+            return beta.back() * std::abs(vectors[(size - 1) * size + i]);
+        };
+        lower = theta.front() - residual(0);
+        upper = theta.back() + residual(size - 1);
+        // Padding such that the spectrum lies strictly inside (T_n'(±1) blows up)
+        auto const padding = 0.01 * std::max(upper - lower, 1.0);
+        lower -= padding;
+        upper += padding;
+        return outcome::success();
+    }
+
+    auto check_operator(ls_operator const& op, uint64_t const size) -> outcome::result<void>
+    {
+        auto const status = check_square(op, size);
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success();
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_spectral_bounds(
+    ls_operator const* op, ls_datatype const dtype, uint64_t const size, double* lower,
+    double* upper)
+{
+    return to_error_code([&]() -> outcome::result<void> {
+        OUTCOME_TRY(check_operator(*op, size));
+        switch (dtype) {
+        case LS_FLOAT64: return spectral_bounds_helper<double>(*op, size, *lower, *upper);
+        case LS_COMPLEX128:
+            return spectral_bounds_helper<std::complex<double>>(*op, size, *lower, *upper);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }());
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_kpm_dos(ls_operator const* op, ls_datatype const dtype, uint64_t const size,
+                    double const lower, double const upper, uint64_t const number_moments,
+                    uint64_t const number_vectors, uint64_t const block_size, uint64_t const seed,
+                    double* moments)
+{
+    return to_error_code([&]() -> outcome::result<void> {
+        OUTCOME_TRY(check_operator(*op, size));
+        if (!(lower < upper) || number_moments == 0 || number_vectors == 0 || block_size == 0) {
+            return LS_INVALID_ARGUMENT;
+        }
+        switch (dtype) {
+        case LS_FLOAT64:
+            return dos_helper<double>(*op, size, lower, upper, number_moments, number_vectors,
+                                      block_size, seed, moments);
+        case LS_COMPLEX128:
+            return dos_helper<std::complex<double>>(*op, size, lower, upper, number_moments,
+                                                    number_vectors, block_size, seed, moments);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }());
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_kpm_correlation(ls_operator const* op, ls_datatype const dtype, uint64_t const size,
+                            double const lower, double const upper,
+                            uint64_t const number_moments, void const* right, void const* left,
+                            void* moments)
+{
+    return to_error_code([&]() -> outcome::result<void> {
+        OUTCOME_TRY(check_operator(*op, size));
+        if (!(lower < upper) || number_moments == 0) { return LS_INVALID_ARGUMENT; }
+        auto* out = static_cast<std::complex<double>*>(moments);
+        switch (dtype) {
+        case LS_FLOAT64:
+            return correlation_helper<double>(*op, size, lower, upper, number_moments,
+                                              static_cast<double const*>(right),
+                                              static_cast<double const*>(left), out);
+        case LS_COMPLEX128:
+            return correlation_helper<std::complex<double>>(
+                *op, size, lower, upper, number_moments,
+                static_cast<std::complex<double> const*>(right),
+                static_cast<std::complex<double> const*>(left), out);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }());
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_kpm_reconstruct(uint64_t const number_moments, double const* moments, ls_kpm_kernel const kernel,
+                   double const lorentz_lambda, double const lower, double const upper,
+                   uint64_t const number_points, double const* energies, double* out)
+{
+    if (!(lower < upper) || number_moments == 0) { return LS_INVALID_ARGUMENT; }
+    auto const n       = static_cast<double>(number_moments);
+    auto       damping = std::vector<double>(number_moments);
+    for (auto k = uint64_t{0}; k < number_moments; ++k) {
+        auto const x = static_cast<double>(k);
+        switch (kernel) {
+        case LS_KPM_NO_KERNEL: damping[k] = 1.0; break;
+        case LS_KPM_JACKSON:
+            damping[k] = ((n - x + 1) * std::cos(pi * x / (n + 1))
+                          + std::sin(pi * x / (n + 1)) / std::tan(pi / (n + 1)))
+                         / (n + 1);
+            break;
+        case LS_KPM_LORENTZ:
+            if (!(lorentz_lambda > 0.0)) { return LS_INVALID_ARGUMENT; }
+            damping[k] = std::sinh(lorentz_lambda * (1.0 - x / n)) / std::sinh(lorentz_lambda);
+            break;
+        default: return LS_INVALID_ARGUMENT;
+        }
+        damping[k] *= moments[k] * (k == 0 ? 1.0 : 2.0);
+    }
+    auto const  a = 0.5 * (upper - lower);
+    auto const  b = 0.5 * (upper + lower);
+    auto const* g = damping.data();
+#pragma omp parallel for default(none) schedule(static)                                             \
+    firstprivate(number_moments, number_points, energies, out, a, b, g)
+    for (auto i = uint64_t{0}; i < number_points; ++i) {
+        auto const x = (energies[i] - b) / a;
+        if (!(std::abs(x) < 1.0)) {
+            out[i] = 0.0;
+            continue;
+        }
+        // Clenshaw summation of Σₖ gₖ Tₖ(x)
+        auto b1 = 0.0;
+        auto b2 = 0.0;
+        for (auto k = number_moments; k-- > 1;) {
+            auto const b0 = g[k] + 2.0 * x * b1 - b2;
+            b2            = b1;
+            b1            = b0;
+        }
+        auto const sum = g[0] + x * b1 - b2;
+        out[i]         = sum / (pi * a * std::sqrt(1.0 - x * x));
+    }
+    return LS_SUCCESS;
+}
@@ -0,0 +1,195 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "linalg.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/// \file krylov.hpp
+///
+/// Storage for orthonormal Krylov bases shared by the Lanczos eigensolver and the Krylov
+/// exponential.
+
+namespace lattice_symmetries {
+
+/// Up to `capacity` vectors of length `n` stored row-major, i.e. as an `n × capacity` matrix, such
+/// that operations touching all vectors at once sweep over memory only once. Elements are stored
+/// as `S`, which may have lower precision than the working type `T`.
+///
+/// Orthogonalization uses classical Gram-Schmidt twice. The first sweep computes all overlaps at
+/// once, the second one subtracts the projections and computes the norm at the same time.
+template <class T, class S> class krylov_basis_t {
+  public:
+    krylov_basis_t(uint64_t const n, uint64_t const capacity)
+        : _n{n}, _capacity{capacity}, _data(n * capacity)
+    {}
+
+    [[nodiscard]] auto capacity() const noexcept -> uint64_t { return _capacity; }
+
+    /// x ← vⱼ
+    auto load(uint64_t const j, T* x) const -> void
+    {
+        auto const  n      = _n;
+        auto const  stride = _capacity;
+        auto const* data   = _data.data();
+#pragma omp parallel for default(none) schedule(static) firstprivate(n, stride, data, j, x)
+        for (auto r = uint64_t{0}; r < n; ++r) {
+            x[r] = static_cast<T>(data[r * stride + j]);
+        }
+    }
+
+    /// vⱼ ← αx
+    auto store(uint64_t const j, T const* x, double const alpha) -> void
+    {
+        auto const n      = _n;
+        auto const stride = _capacity;
+        auto*      data   = _data.data();
+#pragma omp parallel for default(none) schedule(static) firstprivate(n, stride, data, j, x, alpha)
+        for (auto r = uint64_t{0}; r < n; ++r) {
+            data[r * stride + j] = static_cast<S>(x[r] * alpha);
+        }
+    }
+
+    /// Overlaps ⟨vᵢ|w⟩ for i ≤ j restricted to rows in [first, last) of `w`. This allows to
+    /// compute the first Gram-Schmidt pass tile by tile while `w` is being produced.
+    auto project(uint64_t const j, uint64_t const first, uint64_t const last, T const* w) const
+        -> std::vector<T>
+    {
+        auto const  stride = _capacity;
+        auto const* data   = _data.data() + first * stride;
+        w += first;
+        return parallel_accumulate<T>(
+            last - first, j + 1, [=](uint64_t const begin, uint64_t const end, T* acc) {
+                for (auto r = begin; r < end; ++r) {
+                    auto const* v_r = data + r * stride;
+                    for (auto i = uint64_t{0}; i <= j; ++i) {
+                        acc[i] += conj_if_complex(static_cast<T>(v_r[i])) * w[r];
+                    }
+                }
+            });
+    }
+
+    /// Orthogonalizes `w` against v₀, …, vⱼ. Overlaps ⟨vᵢ|w⟩ (summed over both passes) are
+    /// written to `overlaps`. Returns ‖w‖ after orthogonalization. If `projected` is not
+    /// `nullptr`, it must contain ⟨vᵢ|w⟩ (see #project), and the first sweep over `w` is skipped.
+    auto orthogonalize(uint64_t const j, T* w, T* overlaps, T const* projected = nullptr) const
+        -> double
+    {
+        auto const  n            = _n;
+        auto const  stride       = _capacity;
+        auto const* data         = _data.data();
+        auto        norm_squared = 0.0;
+        std::fill_n(overlaps, j + 1, T{0});
+        for (auto pass = 0; pass < 2; ++pass) {
+            auto const h = pass == 0 && projected != nullptr
+                               ? std::vector<T>(projected, projected + j + 1)
+                               : project(j, 0, n, w);
+            for (auto i = uint64_t{0}; i <= j; ++i) {
+                overlaps[i] += h[i];
+            }
+            auto const* c = h.data();
+            norm_squared  = parallel_accumulate<double>(
+                               n, 1,
+                               [=](uint64_t const first, uint64_t const last, double* acc) {
+                                   for (auto r = first; r < last; ++r) {
+                                       auto const* v_r = data + r * stride;
+                                       auto        sum = T{0};
+                                       for (auto i = uint64_t{0}; i <= j; ++i) {
+                                           sum += static_cast<T>(v_r[i]) * c[i];
+                                       }
+                                       w[r] -= sum;
+                                       *acc += std::norm(w[r]);
+                                   }
+                               })
+                               .front();
+        }
+        return std::sqrt(norm_squared);
+    }
+
+    /// out[:, i] ← V[:, :size]·y[:, i] for i < count. `y` is row-major with leading dimension
+    /// `y_stride`, and `out` is column-major with leading dimension `out_stride`.
+    auto combine(uint64_t const size, uint64_t const count, T const* y, uint64_t const y_stride,
+                 T* out, uint64_t const out_stride) const -> void
+    {
+        auto const  n      = _n;
+        auto const  stride = _capacity;
+        auto const* data   = _data.data();
+#pragma omp parallel for default(none) schedule(static)                                            \
+    firstprivate(n, stride, data, size, count, y, y_stride, out, out_stride)
+        for (auto r = uint64_t{0}; r < n; ++r) {
+            auto const* v_r = data + r * stride;
+            for (auto i = uint64_t{0}; i < count; ++i) {
+                auto sum = T{0};
+                for (auto j = uint64_t{0}; j < size; ++j) {
+                    sum += static_cast<T>(v_r[j]) * y[j * y_stride + i];
+                }
+                out[r + i * out_stride] = sum;
+            }
+        }
+    }
+
+    /// Replaces v₀, …, v_{count-1} by V[:, :size]·y[:, :count] and moves v_size to position
+    /// `count`. Used for restarting.
+    auto compress(uint64_t const size, uint64_t const count, T const* y, uint64_t const y_stride)
+        -> void
+    {
+        auto const n      = _n;
+        auto const stride = _capacity;
+        auto*      data   = _data.data();
+#pragma omp parallel default(none) firstprivate(n, stride, data, size, count, y, y_stride)
+        {
+            auto tmp = std::vector<T>(count);
+#pragma omp for schedule(static)
+            for (auto r = uint64_t{0}; r < n; ++r) {
+                auto* v_r = data + r * stride;
+                std::fill(std::begin(tmp), std::end(tmp), T{0});
+                for (auto j = uint64_t{0}; j < size; ++j) {
+                    auto const x = static_cast<T>(v_r[j]);
+                    for (auto i = uint64_t{0}; i < count; ++i) {
+                        tmp[i] += x * y[j * y_stride + i];
+                    }
+                }
+                for (auto i = uint64_t{0}; i < count; ++i) {
+                    v_r[i] = static_cast<S>(tmp[i]);
+                }
+                v_r[count] = v_r[size];
+            }
+        }
+    }
+
+  private:
+    uint64_t       _n;
+    uint64_t       _capacity;
+    std::vector<S> _data;
+};
+
+} // namespace lattice_symmetries
@@ -0,0 +1,449 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "cpu/operator_kernels.hpp"
+#include "krylov.hpp"
+#include "operator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Deterministic pseudo-random number in [-1, 1)
+    auto random_uniform(uint64_t const i) noexcept -> double
+    {
+        return static_cast<double>(splitmix64(i) >> 11U) * 0x1.0p-52 - 1.0;
+    }
+
+    /// Fills `x` with the user-provided initial vector or a deterministic random one and
+    /// normalizes it.
+    template <class T> auto initialize(uint64_t const n, T const* initial, T* x) -> void
+    {
+#pragma omp parallel for default(none) schedule(static) firstprivate(n, initial, x)
+        for (auto i = uint64_t{0}; i < n; ++i) {
+            if (initial != nullptr) { x[i] = initial[i]; }
+            else if constexpr (is_complex_v<T>) {
+                x[i] = T{random_uniform(2 * i), random_uniform(2 * i + 1)};
+            }
+            else {
+                x[i] = random_uniform(i);
+            }
+        }
+        scale(n, 1.0 / norm(n, x), x);
+    }
+
+    /// Number of rows of Hx produced at once by #fused_matvec. A tile of y then still resides
+    /// in L2 cache when it is consumed.
+    constexpr auto fused_tile_size = uint64_t{1} << 14U;
+
+    /// y ← Hx computed in tiles of #fused_tile_size rows. `fn(first, last)` is called after
+    /// every tile such that dot products and axpy updates can use rows [first, last) of `y`
+    /// before they are evicted from cache.
+    template <class T, class Fn>
+    auto fused_matvec(ls_operator const& op, uint64_t const n, T const* x, T* y, Fn&& fn)
+        -> outcome::result<void>
+    {
+        for (auto first = uint64_t{0}; first < n; first += fused_tile_size) {
+            auto const last = std::min(n, first + fused_tile_size);
+            OUTCOME_TRY(operator_matmat(op, datatype_of<T>(), n, 1, x, n, y, n, first, last,
+                                        nullptr));
+            fn(first, last);
+        }
+        return outcome::success();
+    }
+
+    /// Smallest relative residual which Krylov vectors stored as `S` can resolve. Ritz vectors
+    /// are linear combinations of rounded vectors, and the residual estimate from the projected
+    /// matrix keeps decreasing long after the true residual has stagnated around ε(S).
+    template <class S>
+    constexpr auto storage_tolerance =
+        10.0 * std::numeric_limits<decltype(std::real(std::declval<S>()))>::epsilon();
+
+    /// Largest absolute value among Ritz values; used to turn residual norms into relative ones.
+    auto spectral_scale(std::vector<double> const& theta) noexcept -> double
+    {
+        return std::max({std::abs(theta.front()), std::abs(theta.back()),
+                         std::numeric_limits<double>::min()});
+    }
+
+    /// Thick-restart Lanczos (Wu & Simon, 2000) with full reorthogonalization.
+    ///
+    /// Since all overlaps computed during reorthogonalization are kept, the projected matrix is
+    /// exactly V†HV, and the "arrowhead" structure after restarts requires no special treatment.
+    template <class T, class S> class thick_restart_lanczos_t {
+      public:
+        thick_restart_lanczos_t(ls_operator const& op, uint64_t const n, uint64_t const m,
+                                uint64_t const k)
+            : _op{op}, _n{n}, _m{m}, _k{k}, _basis{n, m + 1}, _projected(m * m), _v(n), _w(n)
+        {}
+
+        auto run(ls_lanczos_options const& options, T const* initial, double* eigenvalues,
+                 T* eigenvectors, uint64_t const stride, ls_lanczos_info& info)
+            -> outcome::result<void>
+        {
+            auto const tolerance = std::max(options.tolerance, storage_tolerance<S>);
+            initialize(_n, initial, _v.data());
+            _basis.store(0, _v.data(), 1.0);
+            auto overlaps = std::vector<T>(_m);
+            auto start    = uint64_t{0};
+            for (;;) {
+                auto size = _m;
+                auto beta = 0.0;
+                for (auto j = start; j < _m; ++j) {
+                    _basis.load(j, _v.data());
+                    // The first Gram-Schmidt pass is fused with the matrix-vector product
+                    auto projected = std::vector<T>(j + 1);
+                    OUTCOME_TRY(fused_matvec(_op, _n, _v.data(), _w.data(),
+                                             [this, j, &projected](uint64_t const first,
+                                                                   uint64_t const last) {
+                                                 auto const h =
+                                                     _basis.project(j, first, last, _w.data());
+                                                 for (auto i = uint64_t{0}; i <= j; ++i) {
+                                                     projected[i] += h[i];
+                                                 }
+                                             }));
+                    ++info.number_iterations;
+                    beta = _basis.orthogonalize(j, _w.data(), overlaps.data(), projected.data());
+                    for (auto i = uint64_t{0}; i < j; ++i) {
+                        _projected[i * _m + j] += overlaps[i];
+                        _projected[j * _m + i] = conj_if_complex(_projected[i * _m + j]);
+                    }
+                    _projected[j * _m + j] = std::real(overlaps[j]);
+                    // Krylov subspace became invariant: Ritz values are exact
+                    if (beta <= 1e-12 * std::abs(_projected[j * _m + j])
+                        || beta < std::numeric_limits<double>::min()) {
+                        size = j + 1;
+                        beta = 0.0;
+                        break;
+                    }
+                    _basis.store(j + 1, _w.data(), 1.0 / beta);
+                }
+
+                auto matrix = std::vector<T>(size * size);
+                for (auto i = uint64_t{0}; i < size; ++i) {
+                    std::copy_n(_projected.data() + i * _m, size, matrix.data() + i * size);
+                }
+                auto       ritz   = std::vector<T>(size * size);
+                auto const theta  = hermitian_eigen(size, matrix.data(), ritz.data());
+                auto const found  = std::min(_k, size);
+                auto const scale_ = spectral_scale(theta);
+                info.max_residual = 0.0;
+                for (auto i = uint64_t{0}; i < found; ++i) {
+                    info.max_residual = std::max(
+                        info.max_residual, beta * std::abs(ritz[(size - 1) * size + i]) / scale_);
+                }
+                info.converged = found == _k && info.max_residual <= tolerance;
+                if (info.converged && !std::is_same_v<S, T>) {
+                    OUTCOME_TRY(true_residual, residual(size, found, ritz, theta, info));
+                    info.max_residual = true_residual / scale_;
+                    info.converged    = info.max_residual <= tolerance;
+                }
+                if (info.converged || beta == 0.0 || info.number_restarts == options.max_restarts) {
+                    std::copy_n(std::begin(theta), found, eigenvalues);
+                    std::fill(eigenvalues + found, eigenvalues + _k,
+                              std::numeric_limits<double>::quiet_NaN());
+                    if (eigenvectors != nullptr) {
+                        _basis.combine(size, found, ritz.data(), size, eigenvectors, stride);
+                        for (auto i = found; i < _k; ++i) {
+                            std::fill_n(eigenvectors + i * stride, _n, T{0});
+                        }
+                    }
+                    return info.converged ? outcome::success()
+                                          : outcome::result<void>{LS_NOT_CONVERGED};
+                }
+
+                // We keep more Ritz vectors than requested to speed up convergence
+                auto const l = std::min(size - 1, _k + (size - _k) / 2);
+                _basis.compress(size, l, ritz.data(), size);
+                std::fill(std::begin(_projected), std::end(_projected), T{0});
+                for (auto i = uint64_t{0}; i < l; ++i) {
+                    _projected[i * _m + i] = theta[i];
+                }
+                start = l;
+                ++info.number_restarts;
+            }
+        }
+
+      private:
+        /// Largest ‖Hy - θy‖ among the first `count` Ritz pairs computed explicitly. With reduced
+        /// precision storage the estimate from the projected matrix cannot be trusted.
+        auto residual(uint64_t const size, uint64_t const count, std::vector<T> const& ritz,
+                      std::vector<double> const& theta, ls_lanczos_info& info)
+            -> outcome::result<double>
+        {
+            auto r = 0.0;
+            for (auto i = uint64_t{0}; i < count; ++i) {
+                _basis.combine(size, 1, ritz.data() + i, size, _v.data(), _n);
+                OUTCOME_TRY(operator_matmat(_op, datatype_of<T>(), _n, 1, _v.data(), _n,
+                                            _w.data(), _n, 0, _n, nullptr));
+                ++info.number_iterations;
+                auto const n     = _n;
+                auto const e     = theta[i];
+                auto const* v    = _v.data();
+                auto const* w    = _w.data();
+                auto const  norm = parallel_accumulate<double>(
+                    n, 1, [=](uint64_t const first, uint64_t const last, double* acc) {
+                        for (auto k = first; k < last; ++k) {
+                            *acc += std::norm(w[k] - e * v[k]);
+                        }
+                    });
+                r = std::max(r, std::sqrt(norm.front()));
+            }
+            return r;
+        }
+
+        ls_operator const&   _op;
+        uint64_t             _n;
+        uint64_t             _m;
+        uint64_t             _k;
+        krylov_basis_t<T, S> _basis;
+        std::vector<T>       _projected;
+        std::vector<T>       _v;
+        std::vector<T>       _w;
+    };
+
+    /// Plain Lanczos without reorthogonalization which keeps only four vectors in memory. Only
+    /// the ground state is supported, because without reorthogonalization spurious copies of
+    /// converged eigenvalues appear. The first pass builds the tridiagonal matrix; the second
+    /// one regenerates the Lanczos vectors from the same initial vector using the stored
+    /// coefficients and accumulates the eigenvector.
+    template <class T> class two_pass_lanczos_t {
+      public:
+        two_pass_lanczos_t(ls_operator const& op, uint64_t const n, T const* initial)
+            : _op{op}, _n{n}, _initial{initial}, _u(n), _v(n), _w(n)
+        {}
+
+        auto run(ls_lanczos_options const& options, double* eigenvalue, T* eigenvector,
+                 ls_lanczos_info& info) -> outcome::result<void>
+        {
+            constexpr auto check_every    = uint64_t{5};
+            auto const     max_iterations = static_cast<uint64_t>(options.krylov_dimension)
+                                        * (static_cast<uint64_t>(options.max_restarts) + 1);
+            auto alphas       = std::vector<double>{};
+            auto betas        = std::vector<double>{};
+            auto coefficients = std::vector<double>{};
+            auto theta        = std::vector<double>{};
+            reset();
+            for (;;) {
+                OUTCOME_TRY(step(alphas, betas, nullptr));
+                ++info.number_iterations;
+                auto const size = alphas.size();
+                if (betas.back() != 0.0 && size % check_every != 0 && size < max_iterations) {
+                    continue;
+                }
+                auto vectors = std::vector<double>{};
+                theta = tridiagonal_eigen(alphas, {std::begin(betas), std::prev(std::end(betas))},
+                                          &vectors);
+                coefficients.resize(size);
+                for (auto j = uint64_t{0}; j < size; ++j) {
+                    coefficients[j] = vectors[j * size];
+                }
+                info.max_residual =
+                    betas.back() * std::abs(coefficients.back()) / spectral_scale(theta);
+                info.converged = info.max_residual <= options.tolerance;
+                if (info.converged || betas.back() == 0.0 || size >= max_iterations) { break; }
+            }
+            *eigenvalue = theta.front();
+            if (eigenvector != nullptr) {
+                // Second pass
+                std::fill(eigenvector, eigenvector + _n, T{0});
+                reset();
+                for (auto j = uint64_t{0}; j < coefficients.size(); ++j) {
+                    axpy(coefficients[j], _v.data(), eigenvector);
+                    if (j + 1 == coefficients.size()) { break; }
+                    OUTCOME_TRY(step(alphas, betas, &j));
+                }
+                scale(_n, 1.0 / norm(_n, eigenvector), eigenvector);
+            }
+            return info.converged ? outcome::success() : outcome::result<void>{LS_NOT_CONVERGED};
+        }
+
+      private:
+        auto reset() -> void
+        {
+            initialize(_n, _initial, _v.data());
+            std::fill(std::begin(_u), std::end(_u), T{0});
+        }
+
+        /// y ← αx + y
+        auto axpy(double const alpha, T const* x, T* y) const -> void
+        {
+            auto const n = _n;
+#pragma omp parallel for default(none) schedule(static) firstprivate(n, alpha, x, y)
+            for (auto i = uint64_t{0}; i < n; ++i) {
+                y[i] += alpha * x[i];
+            }
+        }
+
+        /// w ← Hv - αv - βu, u ← v, v ← w/‖w‖. When `known` is `nullptr`, α and β are computed
+        /// and appended to `alphas` and `betas`. Otherwise, stored coefficients number `*known`
+        /// are used. βu is subtracted and α = ⟨v|Hv - βu⟩ is computed tile by tile during the
+        /// matrix-vector product; αv is subtracted in the same sweep which computes ‖w‖.
+        auto step(std::vector<double>& alphas, std::vector<double>& betas,
+                  uint64_t const* known) -> outcome::result<void>
+        {
+            auto const j       = known != nullptr ? *known : alphas.size();
+            auto const beta    = j > 0 ? betas[j - 1] : 0.0;
+            auto const n       = _n;
+            auto const* u      = _u.data();
+            auto const* v      = _v.data();
+            auto*       w      = _w.data();
+            auto        alpha  = known != nullptr ? alphas[j] : 0.0;
+            auto        sum    = T{0};
+            OUTCOME_TRY(fused_matvec(_op, n, v, w, [&](uint64_t const first, uint64_t const last) {
+                sum += parallel_accumulate<T>(
+                           last - first, 1,
+                           [=](uint64_t const begin, uint64_t const end, T* acc) {
+                               for (auto i = first + begin; i < first + end; ++i) {
+                                   w[i] -= alpha * v[i] + beta * u[i];
+                                   *acc += conj_if_complex(v[i]) * w[i];
+                               }
+                           })
+                           .front();
+            }));
+            if (known != nullptr) {
+                std::swap(_u, _v);
+                std::swap(_v, _w);
+                scale(n, 1.0 / betas[j], _v.data());
+                return outcome::success();
+            }
+            alpha                = std::real(sum);
+            auto const next_beta = std::sqrt(
+                parallel_accumulate<double>(n, 1,
+                                            [=](uint64_t const first, uint64_t const last,
+                                                double* acc) {
+                                                for (auto i = first; i < last; ++i) {
+                                                    w[i] -= alpha * v[i];
+                                                    *acc += std::norm(w[i]);
+                                                }
+                                            })
+                    .front());
+            alphas.push_back(alpha);
+            betas.push_back(next_beta <= 1e-12 * std::max(std::abs(alpha), std::abs(beta))
+                                ? 0.0
+                                : next_beta);
+            if (betas.back() == 0.0) { return outcome::success(); }
+            std::swap(_u, _v);
+            std::swap(_v, _w);
+            scale(n, 1.0 / next_beta, _v.data());
+            return outcome::success();
+        }
+
+        ls_operator const& _op;
+        uint64_t           _n;
+        T const*           _initial;
+        std::vector<T>     _u;
+        std::vector<T>     _v;
+        std::vector<T>     _w;
+    };
+
+
+    template <class T>
+    auto lanczos_helper(ls_operator const& op, uint64_t const size,
+                        ls_lanczos_options const& options, void const* initial,
+                        double* eigenvalues, void* eigenvectors, uint64_t const stride,
+                        ls_lanczos_info& info) -> outcome::result<void>
+    {
+        auto const* x0 = static_cast<T const*>(initial);
+        auto*       x  = static_cast<T*>(eigenvectors);
+        if (options.two_pass) {
+            if (options.number_eigenvalues != 1) { return LS_INVALID_ARGUMENT; }
+            return two_pass_lanczos_t<T>{op, size, x0}.run(options, eigenvalues, x, info);
+        }
+        auto const k = static_cast<uint64_t>(options.number_eigenvalues);
+        auto const m = std::min<uint64_t>(options.krylov_dimension, size);
+        // There must be room for at least one new Krylov vector after a restart
+        if (m <= k && m < size) { return LS_INVALID_ARGUMENT; }
+        // Only the precision of the storage type matters
+        switch (options.storage) {
+        case LS_FLOAT32:
+        case LS_COMPLEX64: {
+            using S = std::conditional_t<is_complex_v<T>, std::complex<float>, float>;
+            return thick_restart_lanczos_t<T, S>{op, size, m, k}.run(options, x0, eigenvalues, x,
+                                                                      stride, info);
+        }
+        case LS_FLOAT64:
+        case LS_COMPLEX128:
+            return thick_restart_lanczos_t<T, T>{op, size, m, k}.run(options, x0, eigenvalues, x,
+                                                                      stride, info);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_lanczos_default_options(ls_lanczos_options* options)
+{
+    options->number_eigenvalues = 1;
+    options->krylov_dimension   = 40;
+    options->max_restarts       = 500;
+    options->tolerance          = 1e-10;
+    options->storage            = LS_FLOAT64;
+    options->two_pass           = false;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_lanczos(ls_operator const* op, ls_datatype const dtype, uint64_t const size,
+                    ls_lanczos_options const* options, void const* initial, double* eigenvalues,
+                    void* eigenvectors, uint64_t eigenvectors_stride, ls_lanczos_info* info)
+{
+    auto status = check_square(*op, size);
+    if (status != LS_SUCCESS) { return status; }
+    auto defaults = ls_lanczos_options{};
+    if (options == nullptr) {
+        ls_lanczos_default_options(&defaults);
+        options = &defaults;
+    }
+    if (options->number_eigenvalues == 0 || options->number_eigenvalues > size) {
+        return LS_INVALID_ARGUMENT;
+    }
+    if (eigenvectors != nullptr && eigenvectors_stride < size) { return LS_INVALID_ARGUMENT; }
+    auto dummy = ls_lanczos_info{};
+    if (info == nullptr) { info = &dummy; }
+    *info = ls_lanczos_info{0, 0, false, 0.0};
+
+    auto const result = [&]() -> outcome::result<void> {
+        switch (dtype) {
+        case LS_FLOAT64:
+            return lanczos_helper<double>(*op, size, *options, initial, eigenvalues, eigenvectors,
+                                          eigenvectors_stride, *info);
+        case LS_COMPLEX128:
+            return lanczos_helper<std::complex<double>>(*op, size, *options, initial, eigenvalues,
+                                                        eigenvectors, eigenvectors_stride, *info);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }();
+    return to_error_code(result);
+}
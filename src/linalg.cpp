@@ -0,0 +1,238 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "linalg.hpp"
+#include "operator.hpp"
+#include <limits>
+#include <numeric>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Sorts eigenvalues in ascending order permuting columns of `vectors` accordingly.
+    template <class T>
+    auto sort_eigenpairs(uint64_t const n, std::vector<double>& eigenvalues, T* vectors) -> void
+    {
+        auto order = std::vector<uint64_t>(n);
+        std::iota(std::begin(order), std::end(order), uint64_t{0});
+        std::stable_sort(std::begin(order), std::end(order),
+                         [&eigenvalues](auto const a, auto const b) {
+                             return eigenvalues[a] < eigenvalues[b];
+                         });
+        auto const sorted = [&order, n](auto const& values) {
+            auto r = values;
+            for (auto i = uint64_t{0}; i < n; ++i) {
+                r[i] = values[order[i]];
+            }
+            return r;
+        };
+        eigenvalues = sorted(eigenvalues);
+        if (vectors != nullptr) {
+            auto row = std::vector<T>(n);
+            for (auto k = uint64_t{0}; k < n; ++k) {
+                std::copy(vectors + k * n, vectors + (k + 1) * n, std::begin(row));
+                auto const permuted = sorted(row);
+                std::copy(std::begin(permuted), std::end(permuted), vectors + k * n);
+            }
+        }
+    }
+} // namespace
+
+template <class T> auto hermitian_eigen(uint64_t const n, T* a, T* vectors) -> std::vector<double>
+{
+    constexpr auto max_sweeps = 100;
+    auto const     at         = [a, n](uint64_t i, uint64_t j) -> T& { return a[i * n + j]; };
+    if (vectors != nullptr) {
+        std::fill(vectors, vectors + n * n, T{0});
+        for (auto i = uint64_t{0}; i < n; ++i) {
+            vectors[i * n + i] = T{1};
+        }
+    }
+    for (auto sweep = 0; sweep < max_sweeps; ++sweep) {
+        auto off = 0.0;
+        auto all = 0.0;
+        for (auto p = uint64_t{0}; p < n; ++p) {
+            for (auto q = uint64_t{0}; q < n; ++q) {
+                all += std::norm(at(p, q));
+                if (p != q) { off += std::norm(at(p, q)); }
+            }
+        }
+        if (off <= 1e-30 * all) { break; }
+        for (auto p = uint64_t{0}; p < n; ++p) {
+            for (auto q = p + 1; q < n; ++q) {
+                auto const magnitude = std::abs(at(p, q));
+                if (magnitude <= 1e-300) { continue; }
+                // A ← D†AD with D = diag(…, e^{-iφ}, …) makes a_pq real. For real matrices this
+                // is just a sign change.
+                auto const phase = at(p, q) / magnitude;
+                for (auto k = uint64_t{0}; k < n; ++k) {
+                    at(q, k) *= phase;
+                    at(k, q) *= conj_if_complex(phase);
+                }
+                if (vectors != nullptr) {
+                    for (auto k = uint64_t{0}; k < n; ++k) {
+                        vectors[k * n + q] *= conj_if_complex(phase);
+                    }
+                }
+                // Ordinary real Jacobi rotation
+                auto const theta = (std::real(at(q, q)) - std::real(at(p, p))) / (2.0 * magnitude);
+                auto const t     = (theta >= 0.0 ? 1.0 : -1.0)
+                               / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                auto const c      = 1.0 / std::sqrt(t * t + 1.0);
+                auto const s      = t * c;
+                auto const rotate = [c, s](T& x, T& y) {
+                    auto const old_x = x;
+                    x                = c * old_x - s * y;
+                    y                = s * old_x + c * y;
+                };
+                for (auto k = uint64_t{0}; k < n; ++k) {
+                    rotate(at(k, p), at(k, q));
+                }
+                for (auto k = uint64_t{0}; k < n; ++k) {
+                    rotate(at(p, k), at(q, k));
+                }
+                if (vectors != nullptr) {
+                    for (auto k = uint64_t{0}; k < n; ++k) {
+                        rotate(vectors[k * n + p], vectors[k * n + q]);
+                    }
+                }
+                at(p, q) = T{0};
+                at(q, p) = T{0};
+            }
+        }
+    }
+    auto r = std::vector<double>(n);
+    for (auto i = uint64_t{0}; i < n; ++i) {
+        r[i] = std::real(at(i, i));
+    }
+    sort_eigenpairs(n, r, vectors);
+    return r;
+}
+
+template auto hermitian_eigen(uint64_t, double*, double*) -> std::vector<double>;
+template auto hermitian_eigen(uint64_t, std::complex<double>*, std::complex<double>*)
+    -> std::vector<double>;
+
+auto tridiagonal_eigen(std::vector<double> d, std::vector<double> e,
+                       std::vector<double>* vectors) -> std::vector<double>
+{
+    constexpr auto max_iterations = 60;
+    auto const     n              = d.size();
+    e.resize(n, 0.0);
+    if (vectors != nullptr) {
+        vectors->assign(n * n, 0.0);
+        for (auto i = uint64_t{0}; i < n; ++i) {
+            (*vectors)[i * n + i] = 1.0;
+        }
+    }
+    auto* const D = d.data();
+    auto* const E = e.data();
+    auto const  z = [vectors, n](uint64_t const k, uint64_t const i) -> double& {
+        return (*vectors)[k * n + i];
+    };
+    for (auto l = uint64_t{0}; l < n; ++l) {
+        for (auto iteration = 0; iteration < max_iterations; ++iteration) {
+            auto m = l;
+            for (; m + 1 < n; ++m) {
+                auto const dd = std::abs(D[m]) + std::abs(D[m + 1]);
+                if (std::abs(E[m]) <= std::numeric_limits<double>::epsilon() * dd) { break; }
+            }
+            if (m == l) { break; }
+            auto g = (D[l + 1] - D[l]) / (2.0 * E[l]);
+            auto r = std::hypot(g, 1.0);
+            g      = D[m] - D[l] + E[l] / (g + std::copysign(r, g));
+            auto s = 1.0;
+            auto c = 1.0;
+            auto p = 0.0;
+            // The QL sweep runs over i = m - 1, …, l. Loop over i + 1 to keep indices unsigned
+            auto underflow = false;
+            for (auto j = m; j > l; --j) {
+                auto const i = j - 1;
+                auto       f = s * E[i];
+                auto       b = c * E[i];
+                r            = std::hypot(f, g);
+                E[j]         = r;
+                if (r == 0.0) {
+                    D[j] -= p;
+                    E[m]      = 0.0;
+                    underflow = true;
+                    break;
+                }
+                s    = f / r;
+                c    = g / r;
+                g    = D[j] - p;
+                r    = (D[i] - g) * s + 2.0 * c * b;
+                p    = s * r;
+                D[j] = g + p;
+                g    = c * r - b;
+                if (vectors != nullptr) {
+                    for (auto k = uint64_t{0}; k < n; ++k) {
+                        f       = z(k, j);
+                        z(k, j) = s * z(k, i) + c * f;
+                        z(k, i) = c * z(k, i) - s * f;
+                    }
+                }
+            }
+            if (underflow) { continue; }
+            D[l] -= p;
+            E[l] = g;
+            E[m] = 0.0;
+        }
+    }
+    sort_eigenpairs(d.size(), d, vectors != nullptr ? vectors->data() : nullptr);
+    return d;
+}
+
+template <class T>
+auto dense_spectrum(ls_operator const& op, uint64_t const n, std::vector<double>& eigenvalues)
+    -> ls_error_code
+{
+    eigenvalues.clear();
+    if (n == 0) { return LS_SUCCESS; }
+    auto identity = std::vector<T>(n * n);
+    auto matrix   = std::vector<T>(n * n);
+    for (auto i = uint64_t{0}; i < n; ++i) {
+        identity[i * n + i] = T{1};
+    }
+    auto const status =
+        ls_operator_matmat(&op, datatype_of<T>(), n, n, identity.data(), n, matrix.data(), n);
+    if (status != LS_SUCCESS) { return status; }
+    identity.clear();
+    identity.shrink_to_fit();
+    // Reading the column-major result as row-major gives Hᵀ = H* which has the same spectrum
+    eigenvalues = hermitian_eigen<T>(n, matrix.data(), nullptr);
+    return LS_SUCCESS;
+}
+
+template auto dense_spectrum<double>(ls_operator const&, uint64_t, std::vector<double>&)
+    -> ls_error_code;
+template auto dense_spectrum<std::complex<double>>(ls_operator const&, uint64_t,
+                                                   std::vector<double>&) -> ls_error_code;
+
+} // namespace lattice_symmetries
@@ -0,0 +1,144 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/// \file linalg.hpp
+///
+/// Small dense linear algebra and BLAS-1 style helpers used by the iterative solvers. We do not
+/// depend on BLAS/LAPACK, and the dense problems we solve (projected Krylov matrices, reduced
+/// density matrices) are small.
+
+namespace lattice_symmetries {
+
+/// Eigenvalues (in ascending order) of a Hermitian `n × n` row-major matrix `a` computed using
+/// the cyclic Jacobi method. `a` is destroyed. If `vectors` is not `nullptr`, the corresponding
+/// eigenvectors are stored into its columns (`vectors` is `n × n` row-major).
+template <class T> auto hermitian_eigen(uint64_t n, T* a, T* vectors) -> std::vector<double>;
+extern template auto hermitian_eigen(uint64_t, double*, double*) -> std::vector<double>;
+extern template auto hermitian_eigen(uint64_t, std::complex<double>*, std::complex<double>*)
+    -> std::vector<double>;
+
+/// Eigenvalues (in ascending order) of a real symmetric tridiagonal matrix with `diagonal` and
+/// `off_diagonal` (`off_diagonal[i]` couples `i` and `i + 1`) computed using the implicit QL
+/// method. If `vectors` is not `nullptr`, it is resized to `n × n` and eigenvectors are stored
+/// into its columns.
+auto tridiagonal_eigen(std::vector<double> diagonal, std::vector<double> off_diagonal,
+                       std::vector<double>* vectors) -> std::vector<double>;
+
+/// Eigenvalues (in ascending order) of `op` acting on a sector of dimension `n`, computed by exact
+/// diagonalization. The dense matrix is obtained column by column using the block matmat on the
+/// identity, so this is only meant for small sectors. `T` is `double` or `std::complex<double>`.
+template <class T>
+auto dense_spectrum(ls_operator const& op, uint64_t n, std::vector<double>& eigenvalues)
+    -> ls_error_code;
+extern template auto dense_spectrum<double>(ls_operator const&, uint64_t, std::vector<double>&)
+    -> ls_error_code;
+extern template auto dense_spectrum<std::complex<double>>(ls_operator const&, uint64_t,
+                                                          std::vector<double>&) -> ls_error_code;
+
+/// SplitMix64 mixing function. Random vectors are pure functions of a counter hashed with it, such
+/// that they do not depend on the number of threads.
+constexpr auto splitmix64(uint64_t x) noexcept -> uint64_t
+{
+    x += 0x9E3779B97F4A7C15U;
+    x = (x ^ (x >> 30U)) * 0xBF58476D1CE4E5B9U;
+    x = (x ^ (x >> 27U)) * 0x94D049BB133111EBU;
+    return x ^ (x >> 31U);
+}
+
+inline auto conj_if_complex(double const x) noexcept -> double { return x; }
+inline auto conj_if_complex(std::complex<double> const& x) noexcept -> std::complex<double>
+{
+    return std::conj(x);
+}
+
+/// Number of independent partial sums in #parallel_accumulate. It is fixed (rather than equal to
+/// the number of threads) such that results do not depend on the number of threads.
+inline constexpr uint64_t number_partial_sums = 256;
+
+/// Calls `fn(first, last, acc)` on disjoint ranges of `[0, n)` in parallel, where `acc` points
+/// to `width` zero-initialized accumulators. Partial sums are then added in a fixed order.
+template <class T, class Fn>
+auto parallel_accumulate(uint64_t const n, uint64_t const width, Fn fn) -> std::vector<T>
+{
+    auto const number_chunks = std::max<uint64_t>(1, std::min(n, number_partial_sums));
+    auto       partial       = std::vector<T>(number_chunks * width);
+#pragma omp parallel for default(none) schedule(static) if (n > 8192)                              \
+    firstprivate(n, width, number_chunks) shared(partial, fn)
+    for (auto chunk = uint64_t{0}; chunk < number_chunks; ++chunk) {
+        fn(n * chunk / number_chunks, n * (chunk + 1) / number_chunks,
+           partial.data() + chunk * width);
+    }
+    auto r = std::vector<T>(width);
+    for (auto chunk = uint64_t{0}; chunk < number_chunks; ++chunk) {
+        for (auto i = uint64_t{0}; i < width; ++i) {
+            r[i] += partial[chunk * width + i];
+        }
+    }
+    return r;
+}
+
+/// ⟨x|y⟩
+template <class T> auto dot(uint64_t const n, T const* x, T const* y) -> T
+{
+    return parallel_accumulate<T>(n, 1,
+                                  [x, y](uint64_t const first, uint64_t const last, T* acc) {
+                                      for (auto i = first; i < last; ++i) {
+                                          *acc += conj_if_complex(x[i]) * y[i];
+                                      }
+                                  })
+        .front();
+}
+
+/// ‖x‖₂
+template <class T> auto norm(uint64_t const n, T const* x) -> double
+{
+    return std::sqrt(std::real(dot(n, x, x)));
+}
+
+/// x ← αx
+template <class T, class S> auto scale(uint64_t const n, S const alpha, T* x) -> void
+{
+#pragma omp parallel for default(none) schedule(static) if (n > 8192) firstprivate(n, alpha, x)
+    for (auto i = uint64_t{0}; i < n; ++i) {
+        x[i] *= alpha;
+    }
+}
+
+} // namespace lattice_symmetries
@@ -0,0 +1,432 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "linalg.hpp"
+#include "operator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Locally optimal block preconditioned conjugate gradient method (Knyazev, 2001).
+    ///
+    /// Blocks X (current approximations), W (preconditioned residuals), and P (search directions)
+    /// are stored column-major in one `n × 3k` buffer such that the operator can be applied to the
+    /// whole W block with a single call to `ls_operator_matmat`. H·X and H·P are never recomputed
+    /// but updated alongside X and P. Only residuals of not yet converged eigenpairs are added to
+    /// the search space ("soft locking").
+    ///
+    /// Rayleigh-Ritz is performed on the Gram matrices of [X, W, P] without explicitly
+    /// orthogonalizing the blocks. Columns are normalized implicitly, and directions corresponding
+    /// to small eigenvalues of the Gram matrix are dropped. This keeps the method stable once W
+    /// and P become almost linearly dependent close to convergence.
+    template <class T> class lobpcg_t {
+      public:
+        lobpcg_t(ls_operator const& op, uint64_t const n, uint64_t const k)
+            : _op{op}, _n{n}, _k{k}, _s(3 * k * n), _hs(3 * k * n), _diagonal{}
+        {}
+
+        auto run(ls_lobpcg_options const& options, T const* initial, uint64_t const initial_stride,
+                 double* eigenvalues, T* eigenvectors, uint64_t const stride,
+                 ls_lobpcg_info& info) -> outcome::result<void>
+        {
+            if (options.precondition) { OUTCOME_TRY(compute_diagonal()); }
+            initialize(initial, initial_stride);
+            OUTCOME_TRY(apply(0, _k));
+            ++info.number_matvecs;
+            auto columns = std::vector<uint64_t>(_k);
+            std::iota(std::begin(columns), std::end(columns), uint64_t{0});
+            auto theta = rayleigh_ritz(columns, false);
+            // Only a user-supplied block can be linearly dependent
+            if (!theta) { return initial != nullptr ? LS_INVALID_ARGUMENT : LS_SYSTEM_ERROR; }
+
+            auto has_p = false;
+            for (;;) {
+                auto const scale = std::max({std::abs(theta->front()), std::abs(theta->back()),
+                                             std::numeric_limits<double>::min()});
+                auto const norms = residual_norms(*theta);
+                auto       active = std::vector<uint64_t>{};
+                info.max_residual = 0.0;
+                for (auto i = uint64_t{0}; i < _k; ++i) {
+                    auto const residual = norms[i] / scale;
+                    info.max_residual   = std::max(info.max_residual, residual);
+                    if (residual > options.tolerance) { active.push_back(i); }
+                }
+                info.converged = active.empty();
+                if (info.converged || info.number_iterations == options.max_iterations) { break; }
+                ++info.number_iterations;
+
+                compute_search_directions(*theta, active);
+                OUTCOME_TRY(apply(_k, active.size()));
+                info.number_matvecs += static_cast<unsigned>(active.size());
+
+                columns.resize(_k + active.size());
+                std::iota(std::begin(columns) + static_cast<std::ptrdiff_t>(_k),
+                          std::end(columns), _k);
+                if (has_p) {
+                    for (auto i = uint64_t{0}; i < _k; ++i) {
+                        columns.push_back(2 * _k + i);
+                    }
+                }
+                auto next = rayleigh_ritz(columns, true);
+                if (!next) {
+                    // Search space collapsed: restart from X only
+                    has_p = false;
+                    continue;
+                }
+                theta = std::move(next);
+                has_p = true;
+            }
+
+            std::copy_n(std::begin(*theta), _k, eigenvalues);
+            if (eigenvectors != nullptr) {
+                for (auto i = uint64_t{0}; i < _k; ++i) {
+                    std::copy_n(column(i), _n, eigenvectors + i * stride);
+                }
+            }
+            return info.converged ? outcome::success() : outcome::result<void>{LS_NOT_CONVERGED};
+        }
+
+      private:
+        auto column(uint64_t const i) noexcept -> T* { return _s.data() + i * _n; }
+        auto h_column(uint64_t const i) noexcept -> T* { return _hs.data() + i * _n; }
+
+        /// Stores ⟨s|H|s⟩ of all basis states. It serves as a Jacobi preconditioner.
+        auto compute_diagonal() -> outcome::result<void>
+        {
+            ls_states* states = nullptr;
+            auto       status = ls_get_states(&states, _op.basis.get());
+            if (status != LS_SUCCESS) { return status; }
+            auto diagonal = std::vector<std::complex<double>>(_n);
+            status = ls_operator_batched_diagonal(&_op, _n, ls_states_get_data(states), 1,
+                                                  diagonal.data(), 1);
+            ls_destroy_states(states);
+            if (status != LS_SUCCESS) { return status; }
+            _diagonal.resize(_n);
+            std::transform(std::begin(diagonal), std::end(diagonal), std::begin(_diagonal),
+                           [](auto const& z) { return z.real(); });
+            return outcome::success();
+        }
+
+        /// Copies the user-provided initial block into X or fills it with deterministic
+        /// pseudo-random numbers.
+        auto initialize(T const* initial, uint64_t const initial_stride) -> void
+        {
+            auto const n = _n;
+            auto const k = _k;
+            auto*      x = _s.data();
+#pragma omp parallel for default(none) schedule(static) firstprivate(n, k, x, initial, initial_stride)
+            for (auto r = uint64_t{0}; r < n; ++r) {
+                for (auto i = uint64_t{0}; i < k; ++i) {
+                    if (initial != nullptr) { x[r + i * n] = initial[r + i * initial_stride]; }
+                    else {
+                        // Weyl sequence: cheap and different for every column
+                        auto const phase = static_cast<double>(r * (2 * i + 1)) * 0.6180339887498949;
+                        auto const value = 2.0 * (phase - std::floor(phase)) - 1.0;
+                        if constexpr (is_complex_v<T>) {
+                            x[r + i * n] = std::polar(1.0 + value, static_cast<double>(r + i));
+                        }
+                        else {
+                            x[r + i * n] = value;
+                        }
+                    }
+                }
+            }
+        }
+
+        /// H·S[:, first:first + count]
+        auto apply(uint64_t const first, uint64_t const count) -> outcome::result<void>
+        {
+            constexpr auto dtype  = std::is_same_v<T, double> ? LS_FLOAT64 : LS_COMPLEX128;
+            auto const     status = ls_operator_matmat(&_op, dtype, _n, count, column(first), _n,
+                                                       h_column(first), _n);
+            if (status != LS_SUCCESS) { return status; }
+            return outcome::success();
+        }
+
+        /// ‖H xᵢ - θᵢ xᵢ‖ for all i.
+        auto residual_norms(std::vector<double> const& theta) -> std::vector<double>
+        {
+            auto const  n  = _n;
+            auto const  k  = _k;
+            auto const* x  = _s.data();
+            auto const* hx = _hs.data();
+            auto const* t  = theta.data();
+            auto norms = parallel_accumulate<double>(
+                n, k, [=](uint64_t const first, uint64_t const last, double* acc) {
+                    for (auto i = uint64_t{0}; i < k; ++i) {
+                        for (auto r = first; r < last; ++r) {
+                            acc[i] += std::norm(hx[r + i * n] - t[i] * x[r + i * n]);
+                        }
+                    }
+                });
+            for (auto& norm : norms) {
+                norm = std::sqrt(norm);
+            }
+            return norms;
+        }
+
+        /// W[:, j] ← T (H xᵢ - θᵢ xᵢ) for i = active[j], where T is the inverse of the (shifted)
+        /// diagonal. The shift is bounded from below to avoid amplifying noise.
+        auto compute_search_directions(std::vector<double> const& theta,
+                                       std::vector<uint64_t> const& active) -> void
+        {
+            auto const  n        = _n;
+            auto const  k        = _k;
+            auto const  count    = active.size();
+            auto const* indices  = active.data();
+            auto const* t        = theta.data();
+            auto const* x        = _s.data();
+            auto const* hx       = _hs.data();
+            auto*       w        = _s.data() + k * n;
+            auto const* diagonal = _diagonal.empty() ? nullptr : _diagonal.data();
+            auto const  spread   = std::max(theta.back() - theta.front(), 1.0);
+            auto const  cutoff   = 1e-2 * spread;
+#pragma omp parallel for default(none) schedule(static)                                            \
+    firstprivate(n, count, indices, t, x, hx, w, diagonal, cutoff)
+            for (auto r = uint64_t{0}; r < n; ++r) {
+                for (auto j = uint64_t{0}; j < count; ++j) {
+                    auto const i        = indices[j];
+                    auto const residual = hx[r + i * n] - t[i] * x[r + i * n];
+                    w[r + j * n] =
+                        diagonal != nullptr
+                            ? residual / std::max(std::abs(diagonal[r] - t[i]), cutoff)
+                            : residual;
+                }
+            }
+        }
+
+        /// Rayleigh-Ritz procedure in the span of S[:, columns]. On success, X and H·X are
+        /// replaced by Ritz vectors and, if `update_p`, P and H·P by their components along all
+        /// but the first k columns. Returns Ritz values in ascending order or nothing if the
+        /// search space has dimension smaller than k.
+        auto rayleigh_ritz(std::vector<uint64_t> const& columns, bool const update_p)
+            -> std::optional<std::vector<double>>
+        {
+            auto const s     = columns.size();
+            auto const n     = _n;
+            auto const k     = _k;
+            auto const* cols = columns.data();
+            auto const* data = _s.data();
+            auto const* hdata = _hs.data();
+            // Gram matrix ⟨sᵢ|sⱼ⟩ followed by the projected operator ⟨sᵢ|H|sⱼ⟩
+            auto const sums = parallel_accumulate<T>(
+                n, 2 * s * s, [=](uint64_t const first, uint64_t const last, T* acc) {
+                    auto v  = std::vector<T>(s);
+                    auto hv = std::vector<T>(s);
+                    for (auto r = first; r < last; ++r) {
+                        for (auto i = uint64_t{0}; i < s; ++i) {
+                            v[i]  = data[r + cols[i] * n];
+                            hv[i] = hdata[r + cols[i] * n];
+                        }
+                        for (auto i = uint64_t{0}; i < s; ++i) {
+                            auto const c = conj_if_complex(v[i]);
+                            for (auto j = uint64_t{0}; j < s; ++j) {
+                                acc[i * s + j] += c * v[j];
+                                acc[s * s + i * s + j] += c * hv[j];
+                            }
+                        }
+                    }
+                });
+
+            // Implicit column normalization
+            auto d = std::vector<double>(s);
+            for (auto i = uint64_t{0}; i < s; ++i) {
+                auto const norm_squared = std::real(sums[i * s + i]);
+                d[i] = norm_squared > 0.0 ? 1.0 / std::sqrt(norm_squared) : 0.0;
+            }
+            auto gram      = std::vector<T>(s * s);
+            auto projected = std::vector<T>(s * s);
+            for (auto i = uint64_t{0}; i < s; ++i) {
+                for (auto j = uint64_t{0}; j < s; ++j) {
+                    gram[i * s + j]      = d[i] * d[j] * sums[i * s + j];
+                    projected[i * s + j] = d[i] * d[j]
+                                           * 0.5
+                                           * (sums[s * s + i * s + j]
+                                              + conj_if_complex(sums[s * s + j * s + i]));
+                }
+            }
+
+            // Orthonormal basis of the search space: Q = U μ^{-1/2} for all μ above the cutoff
+            auto       u  = std::vector<T>(s * s);
+            auto const mu = hermitian_eigen(s, gram.data(), u.data());
+            auto       q  = std::vector<uint64_t>{};
+            for (auto j = uint64_t{0}; j < s; ++j) {
+                if (mu[j] > 1e-10 * mu.back()) { q.push_back(j); }
+            }
+            auto const m = q.size();
+            if (m < k) { return std::nullopt; }
+            auto basis = std::vector<T>(s * m);
+            for (auto i = uint64_t{0}; i < s; ++i) {
+                for (auto j = uint64_t{0}; j < m; ++j) {
+                    basis[i * m + j] = u[i * s + q[j]] / std::sqrt(mu[q[j]]);
+                }
+            }
+            // Q† A Q
+            auto reduced = std::vector<T>(m * m);
+            for (auto a = uint64_t{0}; a < m; ++a) {
+                for (auto b = uint64_t{0}; b < m; ++b) {
+                    auto sum = T{0};
+                    for (auto i = uint64_t{0}; i < s; ++i) {
+                        auto inner = T{0};
+                        for (auto j = uint64_t{0}; j < s; ++j) {
+                            inner += projected[i * s + j] * basis[j * m + b];
+                        }
+                        sum += conj_if_complex(basis[i * m + a]) * inner;
+                    }
+                    reduced[a * m + b] = sum;
+                }
+            }
+            auto y     = std::vector<T>(m * m);
+            auto theta = hermitian_eigen(m, reduced.data(), y.data());
+            theta.resize(k);
+            // Coefficients with respect to the original (unnormalized) columns
+            auto coefficients = std::vector<T>(s * k);
+            for (auto i = uint64_t{0}; i < s; ++i) {
+                for (auto j = uint64_t{0}; j < k; ++j) {
+                    auto sum = T{0};
+                    for (auto a = uint64_t{0}; a < m; ++a) {
+                        sum += basis[i * m + a] * y[a * m + j];
+                    }
+                    coefficients[i * k + j] = d[i] * sum;
+                }
+            }
+            update(columns, coefficients, update_p);
+            return theta;
+        }
+
+        /// X ← S C, P ← S[:, k:] C[k:, :] and the same for H·X and H·P.
+        auto update(std::vector<uint64_t> const& columns, std::vector<T> const& coefficients,
+                    bool const update_p) -> void
+        {
+            auto const s     = columns.size();
+            auto const n     = _n;
+            auto const k     = _k;
+            auto const* cols = columns.data();
+            auto const* c    = coefficients.data();
+            auto*       data = _s.data();
+            auto*       hdata = _hs.data();
+#pragma omp parallel default(none) firstprivate(s, n, k, cols, c, data, hdata, update_p)
+            {
+                auto v  = std::vector<T>(s);
+                auto hv = std::vector<T>(s);
+#pragma omp for schedule(static)
+                for (auto r = uint64_t{0}; r < n; ++r) {
+                    for (auto i = uint64_t{0}; i < s; ++i) {
+                        v[i]  = data[r + cols[i] * n];
+                        hv[i] = hdata[r + cols[i] * n];
+                    }
+                    for (auto j = uint64_t{0}; j < k; ++j) {
+                        auto p  = T{0};
+                        auto hp = T{0};
+                        for (auto i = k; i < s; ++i) {
+                            p += v[i] * c[i * k + j];
+                            hp += hv[i] * c[i * k + j];
+                        }
+                        auto x  = p;
+                        auto hx = hp;
+                        for (auto i = uint64_t{0}; i < k; ++i) {
+                            x += v[i] * c[i * k + j];
+                            hx += hv[i] * c[i * k + j];
+                        }
+                        data[r + j * n]  = x;
+                        hdata[r + j * n] = hx;
+                        if (update_p) {
+                            data[r + (2 * k + j) * n]  = p;
+                            hdata[r + (2 * k + j) * n] = hp;
+                        }
+                    }
+                }
+            }
+        }
+
+        ls_operator const&  _op;
+        uint64_t            _n;
+        uint64_t            _k;
+        std::vector<T>      _s;
+        std::vector<T>      _hs;
+        std::vector<double> _diagonal;
+    };
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_lobpcg_default_options(ls_lobpcg_options* options)
+{
+    options->number_eigenvalues = 1;
+    options->max_iterations     = 1000;
+    options->tolerance          = 1e-8;
+    options->precondition       = true;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_lobpcg(ls_operator const* op, ls_datatype const dtype, uint64_t const size,
+                   ls_lobpcg_options const* options, void const* initial,
+                   uint64_t const initial_stride, double* eigenvalues, void* eigenvectors,
+                   uint64_t const eigenvectors_stride, ls_lobpcg_info* info)
+{
+    auto status = check_square(*op, size);
+    if (status != LS_SUCCESS) { return status; }
+    auto defaults = ls_lobpcg_options{};
+    if (options == nullptr) {
+        ls_lobpcg_default_options(&defaults);
+        options = &defaults;
+    }
+    auto const k = static_cast<uint64_t>(options->number_eigenvalues);
+    // The search space [X, W, P] must fit into the Hilbert space
+    if (k == 0 || 3 * k > size) { return LS_INVALID_ARGUMENT; }
+    if (initial != nullptr && initial_stride < size) { return LS_INVALID_ARGUMENT; }
+    if (eigenvectors != nullptr && eigenvectors_stride < size) { return LS_INVALID_ARGUMENT; }
+    auto dummy = ls_lobpcg_info{};
+    if (info == nullptr) { info = &dummy; }
+    *info = ls_lobpcg_info{0, 0, false, 0.0};
+
+    auto const result = [&]() -> outcome::result<void> {
+        switch (dtype) {
+        case LS_FLOAT64:
+            return lobpcg_t<double>{*op, size, k}.run(
+                *options, static_cast<double const*>(initial), initial_stride, eigenvalues,
+                static_cast<double*>(eigenvectors), eigenvectors_stride, *info);
+        case LS_COMPLEX128:
+            return lobpcg_t<std::complex<double>>{*op, size, k}.run(
+                *options, static_cast<std::complex<double> const*>(initial), initial_stride,
+                eigenvalues, static_cast<std::complex<double>*>(eigenvectors), eigenvectors_stride,
+                *info);
+        default: return LS_INVALID_DATATYPE;
+        }
+    }();
+    return to_error_code(result);
+}
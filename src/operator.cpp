@@ -1,7 +1,11 @@
 #include "operator.hpp"
 #include "basis.hpp"
 #include "bits.hpp"
-#include "lattice_symmetries/lattice_symmetries.h"
+#include "cache.hpp"
+#include "cpu/operator_kernels.hpp"
+#include "cpu/state_info.hpp"
+#include "jit.hpp"
+#include "lattice_symmetries/lattice_symmetries.hpp"
 #include <omp.h>
 #include <algorithm>
 #include <complex>
@@ -9,20 +13,13 @@
 #include <cstring>
 #include <memory>
 #include <numeric>
+#include <type_traits>
 #include <span.hpp>
 #include <variant>
 #include <vector>
 
 namespace lattice_symmetries {
 
-inline constexpr auto l1_cache_size = 64;
-
-template <class T, class = void> struct is_complex : std::false_type {};
-template <class T>
-struct is_complex<std::complex<T>, std::enable_if_t<std::is_floating_point<T>::value>>
-    : std::true_type {};
-template <class T> inline constexpr bool is_complex_v = is_complex<T>::value;
-
 constexpr auto to_bits(ls_bits512 const& x) noexcept -> uint64_t const*
 {
     return static_cast<uint64_t const*>(x.words);
@@ -42,142 +39,48 @@ constexpr auto set_bits(ls_bits512& x, uint64_t const y) noexcept -> void
 }
 
 namespace {
-    template <unsigned N> auto transpose(std::complex<double> (&matrix)[N][N]) noexcept -> void
+    /// Adds diagonal matrix elements of `self` to `re` and `im` for a block of `count` spin
+    /// configurations. Spin configurations are read directly from `spins` (which is an array of
+    /// words with stride `stride`) such that the inner loop runs over states and can be vectorized.
+    template <unsigned N>
+    auto accumulate_diagonal(interaction_t<N> const& self, uint64_t const count,
+                             uint64_t const* spins, uint64_t const stride, double* re,
+                             double* im) noexcept -> void
     {
-        for (auto i = 0U; i < N; ++i) {
-            for (auto j = 0U; j < i; ++j) {
-                std::swap(matrix[i][j], matrix[j][i]);
-            }
+        constexpr auto Dim = interaction_t<N>::Dim;
+        alignas(l1_cache_size) double diag_re[Dim];
+        alignas(l1_cache_size) double diag_im[Dim];
+        auto has_diagonal = false;
+        for (auto k = 0U; k < Dim; ++k) {
+            // interaction_t stores the Hermitian conjugate of the user-provided matrix (see
+            // ls_operator::ls_operator), so we conjugate to obtain ⟨σ|O|σ⟩
+            auto const& element = self.matrix->payload[k][k];
+            diag_re[k]          = element.real();
+            diag_im[k]          = -element.imag();
+            has_diagonal        = has_diagonal || element != 0.0;
         }
-    }
-
-    template <unsigned N> auto conjugate(std::complex<double> (&matrix)[N][N]) noexcept -> void
-    {
-        for (auto i = 0U; i < N; ++i) {
-            for (auto j = 0U; j < N; ++j) {
-                matrix[i][j] = std::conj(matrix[i][j]);
+        // Purely off-diagonal terms (e.g. σˣ or σ⁺σ⁻ + σ⁻σ⁺) are very common, skip them
+        if (!has_diagonal) { return; }
+
+        constexpr auto bits_in_word = 64U;
+        for (auto const& edge : self.sites) {
+            uint64_t const* words[N];
+            unsigned        shifts[N];
+            for (auto m = 0U; m < N; ++m) {
+                words[m]  = spins + edge[m] / bits_in_word;
+                shifts[m] = edge[m] % bits_in_word;
             }
-        }
-    }
-} // namespace
-
-template <unsigned NumberSpins> struct interaction_t {
-    struct free_fn_t {
-        // NOLINTNEXTLINE: we are using RAII, that's the purpose of this struct
-        auto operator()(void* p) const noexcept -> void { std::free(p); }
-    };
-
-    static constexpr unsigned Dim = 1U << NumberSpins;
-
-    struct alignas(l1_cache_size) matrix_t {
-        std::complex<double> payload[Dim][Dim];
-
-        explicit matrix_t(std::complex<double> const* data) noexcept
-        {
-            // NOLINTNEXTLINE: we do want array to pointer decay here
-            std::memcpy(payload, data, Dim * Dim * sizeof(std::complex<double>));
-        }
-
-        explicit matrix_t(std::complex<double> const (&data)[Dim][Dim]) noexcept
-            : matrix_t{&data[0][0]}
-        {}
-    };
-    using sites_t = std::vector<std::array<uint16_t, NumberSpins>>;
-
-    std::unique_ptr<matrix_t> matrix;
-    sites_t                   sites;
-
-    interaction_t(std::complex<double> const*                        _matrix,
-                  tcb::span<std::array<uint16_t, NumberSpins> const> _sites)
-        : matrix{std::make_unique<matrix_t>(_matrix)}, sites{std::begin(_sites), std::end(_sites)}
-    {
-        // Transpose comes from the fact that we store the matrix in column major order, but the
-        // user passes it in row major order.
-        transpose(matrix->payload);
-    }
-
-    auto hermitian_conjugate() noexcept -> void
-    {
-        transpose(matrix->payload);
-        conjugate(matrix->payload);
-    }
-
-    interaction_t(interaction_t&&) noexcept = default;
-    interaction_t(interaction_t const& other)
-        : matrix{std::make_unique<matrix_t>(other.matrix->payload)}, sites{other.sites}
-    {}
-    auto operator=(interaction_t const&) -> interaction_t& = delete;
-    auto operator=(interaction_t&&) -> interaction_t& = delete;
-
-    ~interaction_t() noexcept = default;
-};
-
-namespace {
-    template <std::size_t N>
-    constexpr auto gather_bits(ls_bits512 const&              bits,
-                               std::array<uint16_t, N> const& indices) noexcept -> unsigned
-    {
-        // ============================= IMPORTANT ==============================
-        // The order is REALLY important here. This is done to adhere to the
-        // definition of cronecker product, i.e. that
-        //
-        //     kron(A, B) =  A00 B     A01 B     A02 B  ...
-        //                   A10 B     A11 B     A12 B  ...
-        //                    .
-        //                    .
-        //                    .
-        //
-        // In other words, if you change it to
-        //    r |= test_bit(bits, i);
-        //    r <<= 1U;
-        // shit will break in really difficult to track ways...
-        auto r = 0U;
-        for (auto const i : indices) {
-            LATTICE_SYMMETRIES_ASSERT(i < 64, "index out of bounds");
-            r <<= 1U;
-            r |= test_bit(bits, i);
-        }
-        return r;
-    }
-
-    template <std::size_t N>
-    auto scatter_bits(ls_bits512& bits, unsigned r, std::array<uint16_t, N> const& indices) -> void
-    {
-        for (auto i = N; i-- > 0;) {
-            LATTICE_SYMMETRIES_ASSERT(indices[i] < 64, "index out of bounds");
-            set_bit_to(bits, indices[i], r & 1U);
-            r >>= 1U;
-        }
-    }
-
-    template <class OffDiag> struct interaction_apply_fn_t {
-        ls_bits512 const&     x;
-        std::complex<double>& diagonal;
-        OffDiag               off_diag;
-
-        static constexpr bool is_noexcept = noexcept(std::declval<OffDiag const&>()(
-            std::declval<ls_bits512 const&>(), std::declval<std::complex<double> const&>()));
-
-        template <unsigned N>
-        auto operator()(interaction_t<N> const& self) const noexcept(is_noexcept) -> ls_error_code
-        {
-            for (auto const edge : self.sites) {
-                auto const  k    = gather_bits(x, edge);
-                auto const& data = self.matrix->payload[k];
-                for (auto n = 0U; n < std::size(data); ++n) {
-                    if (data[n] == 0.0) { continue; }
-                    if (n == k) { diagonal += data[n]; }
-                    else {
-                        auto y = x;
-                        scatter_bits(y, n, edge);
-                        auto const status = off_diag(y, data[n]);
-                        if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
-                    }
+            for (auto j = uint64_t{0}; j < count; ++j) {
+                // Same bit order as in gather_bits
+                auto k = 0U;
+                for (auto m = 0U; m < N; ++m) {
+                    k = (k << 1U) | static_cast<unsigned>((words[m][j * stride] >> shifts[m]) & 1U);
                 }
+                re[j] += diag_re[k];
+                im[j] += diag_im[k];
             }
-            return LS_SUCCESS;
         }
-    };
+    }
 
     template <unsigned N>
     constexpr auto max_index(interaction_t<N> const& interaction) noexcept -> unsigned
@@ -195,27 +98,8 @@ namespace {
 
 using namespace lattice_symmetries;
 
-struct ls_interaction {
-    std::variant<interaction_t<1>, interaction_t<2>, interaction_t<3>, interaction_t<4>> payload;
-
-    template <class T, class Arg, class... Args>
-    ls_interaction(std::in_place_type_t<T> tag, Arg&& arg, Args&&... args)
-        : payload{tag, std::forward<Arg>(arg), std::forward<Args>(args)...}
-    {}
-};
-
 namespace lattice_symmetries {
 namespace {
-    template <class OffDiag>
-    auto apply(ls_interaction const& interaction, ls_bits512 const& spin,
-               std::complex<double>& diagonal,
-               OffDiag off_diag) noexcept(interaction_apply_fn_t<OffDiag>::is_noexcept)
-        -> ls_error_code
-    {
-        interaction_apply_fn_t<OffDiag> visitor{spin, diagonal, std::move(off_diag)};
-        return std::visit(std::cref(visitor), interaction.payload);
-    }
-
     template <size_t Dim>
     constexpr auto max_nonzeros(std::complex<double> const (&matrix)[Dim][Dim]) noexcept -> uint64_t
     {
@@ -238,21 +122,6 @@ namespace {
     }
 #endif
 
-    auto max_buffer_size(ls_interaction const& interaction) noexcept -> uint64_t
-    {
-        return std::visit(
-            [](auto const& x) noexcept { return x.sites.size() * max_nonzeros(x.matrix->payload); },
-            interaction.payload);
-    }
-
-    auto max_buffer_size(tcb::span<ls_interaction const> interactions) noexcept -> uint64_t
-    {
-        return std::accumulate(std::begin(interactions), std::end(interactions), uint64_t{0},
-                               [](auto const total, auto const& interaction) {
-                                   return total + max_buffer_size(interaction);
-                               });
-    }
-
     constexpr auto max_index(ls_interaction const& interaction) noexcept -> unsigned
     {
         return std::visit([](auto const& x) noexcept { return max_index(x); }, interaction.payload);
@@ -266,36 +135,65 @@ namespace {
                                });
     }
 } // namespace
-} // namespace lattice_symmetries
 
-struct ls_operator {
-    struct basis_deleter_fn_t {
-        auto operator()(ls_spin_basis* p) const noexcept -> void { ls_destroy_spin_basis(p); }
-    };
-    using basis_ptr_t = std::unique_ptr<ls_spin_basis, basis_deleter_fn_t>;
+auto max_buffer_size(ls_interaction const& interaction) noexcept -> uint64_t
+{
+    return std::visit(
+        [](auto const& x) noexcept { return x.sites.size() * max_nonzeros(x.matrix->payload); },
+        interaction.payload);
+}
 
-    basis_ptr_t                 basis;
-    std::vector<ls_interaction> terms;
-    bool                        is_real;
+auto max_buffer_size(tcb::span<ls_interaction const> interactions) noexcept -> uint64_t
+{
+    return std::accumulate(std::begin(interactions), std::end(interactions), uint64_t{0},
+                           [](auto const total, auto const& interaction) {
+                               return total + max_buffer_size(interaction);
+                           });
+}
 
-    ls_operator(ls_spin_basis const* _basis, tcb::span<ls_interaction const* const> _terms)
-        : basis{ls_copy_spin_basis(_basis)}
-    {
-        terms.reserve(_terms.size());
-        // We Hermitian conjugate every term to make sure that our matrix-matrix product function
-        // works for non-Hermitian operators as well.
-        std::transform(std::begin(_terms), std::end(_terms), std::back_inserter(terms),
-                       [](auto const* x) noexcept {
-                           auto new_x = *x;
-                           std::visit([](auto& p) noexcept { p.hermitian_conjugate(); },
-                                      new_x.payload);
-                           return new_x;
-                       });
-        is_real = lattice_symmetries::is_real(*basis)
-                  && std::all_of(std::begin(terms), std::end(terms),
-                                 [](auto const& x) { return ls_interaction_is_real(&x); });
+auto check_square(ls_operator const& op, uint64_t const size) noexcept -> ls_error_code
+{
+    if (op.input_basis != nullptr) { return LS_INVALID_ARGUMENT; }
+    auto number_states = uint64_t{0};
+    auto status        = ls_get_number_states(op.basis.get(), &number_states);
+    if (status != LS_SUCCESS) { return status; }
+    if (number_states != size) { return LS_DIMENSION_MISMATCH; }
+    return LS_SUCCESS;
+}
+
+auto to_error_code(std::error_code const& error) noexcept -> ls_error_code
+{
+    if (error.category() == get_error_category()) {
+        return static_cast<ls_error_code>(error.value());
     }
-};
+    return LS_SYSTEM_ERROR;
+}
+
+auto to_error_code(outcome::result<void> const& r) noexcept -> ls_error_code
+{
+    return r ? LS_SUCCESS : to_error_code(r.error());
+}
+
+} // namespace lattice_symmetries
+
+ls_operator::ls_operator(ls_spin_basis const*                   _basis,
+                         tcb::span<ls_interaction const* const> _terms)
+    : basis{ls_copy_spin_basis(_basis)}
+{
+    terms.reserve(_terms.size());
+    // We Hermitian conjugate every term to make sure that our matrix-matrix product function
+    // works for non-Hermitian operators as well.
+    std::transform(std::begin(_terms), std::end(_terms), std::back_inserter(terms),
+                   [](auto const* x) noexcept {
+                       auto new_x = *x;
+                       std::visit([](auto& p) noexcept { p.hermitian_conjugate(); },
+                                  new_x.payload);
+                       return new_x;
+                   });
+    is_real = lattice_symmetries::is_real(*basis)
+              && std::all_of(std::begin(terms), std::end(terms),
+                             [](auto const& x) { return ls_interaction_is_real(&x); });
+}
 
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
 ls_create_interaction1(ls_interaction** ptr, void const* matrix_2x2, unsigned const number_nodes,
@@ -377,40 +275,31 @@ extern "C" LATTICE_SYMMETRIES_EXPORT bool ls_operator_is_real(ls_operator const*
     return op->is_real;
 }
 
-namespace lattice_symmetries {
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_spin_basis const*
+ls_operator_get_basis(ls_operator const* op)
+{
+    return op->basis.get();
+}
 
-template <class Callback>
-auto apply_helper(ls_operator const& op, ls_bits512 const& spin, Callback callback) noexcept(
-    noexcept(std::declval<Callback&>()(std::declval<ls_bits512 const&>(),
-                                       std::declval<std::complex<double> const&>())))
-    -> ls_error_code
-{
-    auto                 repr = spin;
-    std::complex<double> eigenvalue;
-    double               norm; // NOLINT: norm is initialized by ls_get_state_info
-    ls_get_state_info(op.basis.get(), &spin, &repr, &eigenvalue, &norm);
-    if (norm == 0.0) { return LS_INVALID_STATE; }
-    auto const old_norm = norm;
-    auto       diagonal = std::complex<double>{0.0, 0.0};
-    auto const off_diag = [&](ls_bits512 const& x, std::complex<double> const& c) {
-        ls_get_state_info(op.basis.get(), &x, &repr, &eigenvalue, &norm);
-        if (norm > 0.0) {
-            LATTICE_SYMMETRIES_ASSERT(c * norm / old_norm * eigenvalue != 0.0, "");
-            auto const status = callback(repr, c * norm / old_norm * eigenvalue);
-            if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
-        }
-        return LS_SUCCESS;
-    };
-    auto status = LS_SUCCESS;
-    for (auto const& term : op.terms) {
-        status = apply(term, spin, diagonal, std::cref(off_diag));
-        if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
-    }
-    if (diagonal != 0.0) { status = callback(spin, diagonal); }
-    return status;
+extern "C" LATTICE_SYMMETRIES_EXPORT unsigned ls_operator_get_number_terms(ls_operator const* op)
+{
+    return static_cast<unsigned>(op->terms.size());
 }
 
-} // namespace lattice_symmetries
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_operator_get_term(ls_operator const* op,
+                                                               unsigned const     i,
+                                                               ls_term_view*      term)
+{
+    LATTICE_SYMMETRIES_CHECK(i < op->terms.size(), "index out of bounds");
+    std::visit(
+        [term](auto const& x) noexcept {
+            term->number_spins = std::decay_t<decltype(x)>::number_spins;
+            term->matrix       = &x.matrix->payload[0][0];
+            term->number_sites = x.sites.size();
+            term->sites        = x.sites.empty() ? nullptr : x.sites.front().data();
+        },
+        op->terms[i].payload);
+}
 
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_apply(ls_operator const* op,
                                                                      ls_bits512 const*  bits,
@@ -423,242 +312,274 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_apply(ls_operator
                         });
 }
 
-namespace lattice_symmetries {
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_apply_64(ls_operator const* op,
+                                                                        ls_bits64 const    bits,
+                                                                        ls_callback64 func,
+                                                                        void*         cxt)
+{
+    using namespace lattice_symmetries;
+    if (!std::holds_alternative<small_basis_t>(op->basis->payload)) { return LS_WRONG_BASIS_TYPE; }
+    return apply_helper(*op, bits, [func, cxt](ls_bits64 const x, std::complex<double> const& c) {
+        return (*func)(x, &c, cxt);
+    });
+}
 
-namespace detail {
-    inline auto aligned_alloc(uint64_t const alignment, uint64_t const size) noexcept -> void*
-    {
-#if defined(__APPLE__)
-        return ::aligned_alloc(alignment, size);
-#else
-        return std::aligned_alloc(alignment, size);
-#endif
-    }
-} // namespace detail
-
-template <class T> struct block_acc_t {
-    using acc_t = std::conditional_t<is_complex_v<T>, std::complex<double>, double>;
-    struct free_fn_t {
-        // NOLINTNEXTLINE: we are using RAII, that's the purpose of this struct
-        auto operator()(void* p) const noexcept -> void { std::free(p); }
-    };
-
-    explicit block_acc_t(uint64_t const _block_size)
-        : data{}
-        , num_threads{static_cast<unsigned>(omp_get_max_threads())}
-        , block_size{_block_size}
-        , stride{l1_cache_size * ((block_size + l1_cache_size - 1) / l1_cache_size)}
+namespace lattice_symmetries {
+namespace {
+    template <class Bits>
+    auto apply_chunked_helper(ls_operator const& op, uint64_t const count, ls_bits512 const* spins,
+                              uint64_t const chunk_size, ls_chunk_callback func, void* cxt)
+        -> ls_error_code
     {
-        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
-        auto* p = detail::aligned_alloc(l1_cache_size, sizeof(acc_t) * num_threads * stride);
+        // A single input never produces more than max_buffer_size elements, so reserving
+        // chunk_size + max_buffer_size guarantees that the buffers are never reallocated.
+        auto const capacity = chunk_size + max_buffer_size(op.terms);
+        std::vector<ls_bits512>           out_spins;
+        std::vector<std::complex<double>> out_coeffs;
+        std::vector<uint64_t>             offsets;
+        out_spins.reserve(capacity);
+        out_coeffs.reserve(capacity);
+        offsets.push_back(0);
+
+        auto       first = uint64_t{0};
+        auto const flush = [&](uint64_t const next) {
+            auto const status = (*func)(first, offsets.size() - 1, offsets.data(), out_spins.data(),
+                                        out_coeffs.data(), cxt);
+            out_spins.clear();
+            out_coeffs.clear();
+            offsets.resize(1);
+            first = next;
+            return status;
+        };
+        auto const store = [&out_spins, &out_coeffs](Bits const& y, std::complex<double> const& c) {
+            ls_bits512 z; // NOLINT: initialized by set_bits
+            set_bits(z, y);
+            out_spins.push_back(z);
+            out_coeffs.push_back(c);
+            return LS_SUCCESS;
+        };
 
-        LATTICE_SYMMETRIES_CHECK(p != nullptr, "memory allocation failed");
-        data = std::unique_ptr<acc_t, free_fn_t>{static_cast<acc_t*>(p)};
-        std::fill_n(data.get(), num_threads * stride, acc_t{0});
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            auto status = LS_SUCCESS;
+            if constexpr (std::is_same_v<Bits, ls_bits64>) {
+                status = apply_helper(op, spins[i].words[0], store);
+            }
+            else {
+                status = apply_helper(op, spins[i], store);
+            }
+            if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+            offsets.push_back(out_spins.size());
+            if (out_spins.size() >= chunk_size) {
+                status = flush(i + 1);
+                if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+            }
+        }
+        if (offsets.size() > 1) { return flush(count); }
+        return LS_SUCCESS;
     }
+} // namespace
+} // namespace lattice_symmetries
 
-    constexpr auto operator[](unsigned const thread_num) const noexcept -> tcb::span<acc_t>
-    {
-        LATTICE_SYMMETRIES_ASSERT(thread_num < num_threads, "index out of bounds");
-        return {data.get() + stride * thread_num, block_size};
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_apply_chunked(ls_operator const* op, uint64_t const count, ls_bits512 const* spins,
+                          uint64_t const chunk_size, ls_chunk_callback func, void* cxt)
+{
+    using namespace lattice_symmetries;
+    if (chunk_size == 0) { return LS_INVALID_ARGUMENT; }
+    if (std::holds_alternative<small_basis_t>(op->basis->payload)) {
+        return apply_chunked_helper<ls_bits64>(*op, count, spins, chunk_size, func, cxt);
     }
+    return apply_chunked_helper<ls_bits512>(*op, count, spins, chunk_size, func, cxt);
+}
 
-#if LATTICE_SYMMETRIES_GCC()
-#    pragma GCC diagnostic push
-#    pragma GCC diagnostic ignored "-Wclass-memaccess"
-#endif
-    auto set_zero(unsigned const thread_num) const noexcept -> void
+namespace lattice_symmetries {
+namespace {
+    /// Applies `op` to spins[begin], ..., spins[end - 1] writing the results to `out_spins` and
+    /// `out_coeffs`. Returns the number of elements written.
+    ///
+    /// Spin configurations are processed in groups of #apply_batch_size using #apply_term_8 such
+    /// that generation of off-diagonal elements is vectorized. Canonicalization remains scalar.
+    auto batched_apply_64(ls_operator const& op, tcb::span<ls_term_view const> terms,
+                          uint64_t const begin, uint64_t const end, ls_bits512 const* spins,
+                          uint64_t const max_size, ls_bits512* out_spins,
+                          std::complex<double>* out_coeffs, uint64_t* out_counts) -> uint64_t
     {
-        // memset for std::complex is okay since it's standard layout.
-        std::memset(data.get() + stride * thread_num, 0, sizeof(acc_t) * block_size);
-    }
-#if LATTICE_SYMMETRIES_GCC()
-#    pragma GCC diagnostic pop
-#endif
+        auto const& header = op.basis->header;
+        auto const& body   = *std::get_if<small_basis_t>(&op.basis->payload);
+        std::vector<uint64_t>             raw_spins(apply_batch_size * max_size);
+        std::vector<std::complex<double>> raw_coeffs(apply_batch_size * max_size);
+
+        auto written = uint64_t{0};
+        for (auto first = begin; first < end; first += apply_batch_size) {
+            auto const size = std::min<uint64_t>(apply_batch_size, end - first);
+            // Unused lanes are filled with copies of the last spin configuration
+            alignas(64) uint64_t x[apply_batch_size];
+            double               old_norm[apply_batch_size];
+            for (auto lane = 0U; lane < apply_batch_size; ++lane) {
+                x[lane] = spins[first + std::min<uint64_t>(lane, size - 1)].words[0];
+            }
+            for (auto lane = 0U; lane < size; ++lane) {
+                uint64_t             repr; // NOLINT: initialized by get_state_info_64
+                std::complex<double> eigenvalue;
+                get_state_info_64(header, body, x[lane], repr, eigenvalue, old_norm[lane]);
+            }
 
-    auto sum_over_threads(tcb::span<std::complex<double>> out) noexcept -> void
-    {
-        auto const* p = data.get();
-        for (auto j = 0U; j < block_size; ++j) {
-            auto sum = acc_t{0.0};
-            for (auto i = 0U; i < num_threads; ++i) {
-                sum += p[stride * i + j];
+            uint64_t             counts[apply_batch_size]   = {};
+            std::complex<double> diagonal[apply_batch_size] = {};
+            for (auto const& term : terms) {
+                apply_term_8(term, x, max_size, raw_spins.data(), raw_coeffs.data(), counts,
+                             diagonal);
+            }
+
+            for (auto lane = 0U; lane < size; ++lane) {
+                // Same as apply_helper: states which do not belong to the basis produce nothing
+                if (old_norm[lane] == 0.0) {
+                    out_counts[first + lane] = 0;
+                    continue;
+                }
+                auto const local_begin = written;
+                for (auto j = uint64_t{0}; j < counts[lane]; ++j) {
+                    uint64_t             repr; // NOLINT: initialized by get_state_info_64
+                    std::complex<double> eigenvalue;
+                    double               norm; // NOLINT: initialized by get_state_info_64
+                    get_state_info_64(header, body, raw_spins[lane * max_size + j], repr,
+                                      eigenvalue, norm);
+                    if (norm > 0.0) {
+                        set_bits(out_spins[written], repr);
+                        out_coeffs[written] =
+                            raw_coeffs[lane * max_size + j] * norm / old_norm[lane] * eigenvalue;
+                        ++written;
+                    }
+                }
+                if (diagonal[lane] != 0.0) {
+                    set_bits(out_spins[written], x[lane]);
+                    out_coeffs[written] = diagonal[lane];
+                    ++written;
+                }
+                out_counts[first + lane] = written - local_begin;
             }
-            out[j] = sum;
         }
+        return written;
     }
 
-  private:
-    std::unique_ptr<acc_t, free_fn_t> data;
-    uint64_t                          num_threads;
-    uint64_t                          block_size;
-    uint64_t                          stride;
-};
-
-namespace {
-    auto get_basis_representatives(ls_spin_basis const& basis) noexcept
-        -> outcome::result<tcb::span<uint64_t const>>
+    auto batched_apply_512(ls_operator const& op, uint64_t const begin, uint64_t const end,
+                           ls_bits512 const* spins, ls_bits512* out_spins,
+                           std::complex<double>* out_coeffs, uint64_t* out_counts) -> uint64_t
     {
-        ls_states* states = nullptr;
-        auto const status = ls_get_states(&states, &basis);
-        if (status != LS_SUCCESS) { return status; }
-        auto const representatives =
-            tcb::span<uint64_t const>{ls_states_get_data(states), ls_states_get_size(states)};
-        ls_destroy_states(states);
-        return representatives;
+        auto written = uint64_t{0};
+        for (auto i = begin; i < end; ++i) {
+            auto const local_begin = written;
+            auto const status =
+                apply_helper(op, spins[i],
+                             [&](ls_bits512 const& y, std::complex<double> const& c) noexcept {
+                                 out_spins[written]  = y;
+                                 out_coeffs[written] = c;
+                                 ++written;
+                                 return LS_SUCCESS;
+                             });
+            // LS_INVALID_STATE is returned before anything is written
+            LATTICE_SYMMETRIES_ASSERT(status == LS_SUCCESS || status == LS_INVALID_STATE, nullptr);
+            static_cast<void>(status);
+            out_counts[i] = written - local_begin;
+        }
+        return written;
     }
 } // namespace
+} // namespace lattice_symmetries
 
-template <class T>
-auto matmat_helper(ls_operator const& op, uint64_t const size, uint64_t const block_size,
-                   T const* x, uint64_t const x_stride, T* y, uint64_t const y_stride) noexcept
-    -> outcome::result<void>
-{
-    if (!is_complex_v<T> && !op.is_real) { return LS_OPERATOR_IS_COMPLEX; }
-    // gcc-7.3 gets confused by OUTCOME_TRY here (because of auto&&), so we expand it manually
-    auto&& _r = get_basis_representatives(*op.basis);
-    if (!_r) { return _r.as_failure(); }
-    auto const representatives = _r.value(); // OUTCOME_TRY uses auto&& here
-    if (size != representatives.size()) { return LS_DIMENSION_MISMATCH; }
-
-    alignas(l1_cache_size) auto status    = LS_SUCCESS;
-    alignas(l1_cache_size) auto block_acc = block_acc_t<T>{block_size};
-    using acc_t                           = typename block_acc_t<T>::acc_t;
-
-    auto const chunk_size = std::max<uint64_t>(
-        500U, representatives.size() / (100U * static_cast<unsigned>(omp_get_max_threads())));
-#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
-    firstprivate(x, x_stride, y, y_stride, chunk_size, representatives)                            \
-        shared(status, block_acc, op)
-    for (auto i = uint64_t{0}; i < representatives.size(); ++i) {
-        ls_error_code local_status; // NOLINT: initialized by atomic read
-#pragma omp atomic read
-        local_status = status;
-        if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
-        // Load the representative into ls_bits512
-        ls_bits512 local_state; // NOLINT: initialized by set_zero
-        set_zero(local_state);
-        local_state.words[0] = representatives[i];
-        // Reset the accumulator
-        auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
-        block_acc.set_zero(thread_num);
-        // Define a callback function
-        struct cxt_t {
-            tcb::span<acc_t> const     acc;
-            ls_spin_basis const* const basis;
-            T const* const             x;
-            uint64_t const             x_stride;
-        };
-        auto cxt  = cxt_t{block_acc[thread_num], op.basis.get(), x, x_stride};
-        auto func = [](ls_bits512 const* spin, void const* coeff, void* raw_cxt) noexcept {
-            auto const& _cxt = *static_cast<cxt_t*>(raw_cxt);
-            uint64_t    index; // NOLINT: index is initialized by ls_get_index
-            auto const  _status = ls_get_index(_cxt.basis, spin->words[0], &index);
-            if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
-                for (auto j = uint64_t{0}; j < _cxt.acc.size(); ++j) {
-                    if constexpr (is_complex_v<T>) {
-                        _cxt.acc[j] += std::conj(*static_cast<std::complex<double> const*>(coeff))
-                                       * static_cast<acc_t>(_cxt.x[index + _cxt.x_stride * j]);
-                    }
-                    else {
-                        _cxt.acc[j] += *static_cast<double const*>(coeff)
-                                       * static_cast<acc_t>(_cxt.x[index + _cxt.x_stride * j]);
-                    }
-                }
-            }
-            return _status;
-        };
-        // Apply the operator to local_state
-        local_status = ls_operator_apply(&op, &local_state, func, &cxt);
-        // Store the results
-        if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
-#pragma omp atomic write
-            status = local_status;
-        }
-        else {
-            for (auto j = uint64_t{0}; j < cxt.acc.size(); ++j) {
-                y[i + y_stride * j] = static_cast<T>(cxt.acc[j]);
-            }
-        }
+extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t
+ls_batched_operator_apply(ls_operator const* op, uint64_t const count, ls_bits512 const* spins,
+                          ls_bits512* out_spins, std::complex<double>* out_coeffs,
+                          uint64_t* out_counts)
+{
+    using namespace lattice_symmetries;
+    auto const max_size    = max_buffer_size(op->terms);
+    auto const num_threads = omp_in_parallel() ? 1U : static_cast<unsigned>(omp_get_max_threads());
+    auto const chunk_size  = (count + (num_threads - 1)) / num_threads;
+    // The vectorized path canonicalizes in op->basis, so sector-changing operators use the
+    // generic one
+    auto const is_small = std::holds_alternative<small_basis_t>(op->basis->payload)
+                          && op->input_basis == nullptr;
+    std::vector<ls_term_view> terms(op->terms.size());
+    for (auto i = 0U; i < terms.size(); ++i) {
+        ls_operator_get_term(op, i, &terms[i]);
     }
-    return status;
-}
-
-template <class T>
-auto expectation_helper(ls_operator const& op, uint64_t const size, uint64_t const block_size,
-                        T const* x, uint64_t const x_stride, std::complex<double>* out) noexcept
-    -> outcome::result<void>
-{
-    // gcc-7.3 gets confused by OUTCOME_TRY here (because of auto&&), so we expand it manually
-    auto&& _r = get_basis_representatives(*op.basis);
-    if (!_r) { return _r.as_failure(); }
-    auto const representatives = _r.value(); // OUTCOME_TRY uses auto&& here
-    if (size != representatives.size()) { return LS_DIMENSION_MISMATCH; }
-
-    alignas(l1_cache_size) auto status    = LS_SUCCESS;
-    alignas(l1_cache_size) auto block_acc = block_acc_t<std::complex<double>>{block_size};
-    alignas(l1_cache_size) auto sum_acc   = block_acc_t<std::complex<double>>{block_size};
-    using acc_t                           = std::complex<double>;
-
-    auto const chunk_size = std::max<uint64_t>(
-        500U, representatives.size() / (100U * static_cast<unsigned>(omp_get_max_threads())));
-#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
-    firstprivate(x, x_stride, chunk_size, representatives) shared(status, block_acc, sum_acc, op)
-    for (auto i = uint64_t{0}; i < representatives.size(); ++i) {
-        ls_error_code local_status; // NOLINT: initialized by atomic read
-#pragma omp atomic read
-        local_status = status;
-        if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
-        // Load the representative into ls_bits512
-        ls_bits512 local_state; // NOLINT: initialized by set_zero
-        set_zero(local_state);
-        local_state.words[0] = representatives[i];
-        // Reset the accumulator
-        auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
-        block_acc.set_zero(thread_num);
-        // Define a callback function
-        struct cxt_t { // NOLINT: we don't care about constructors here
-            tcb::span<acc_t> const     acc;
-            ls_spin_basis const* const basis;
-            T const* const             x;
-            uint64_t const             x_stride;
-        };
-        auto cxt  = cxt_t{block_acc[thread_num], op.basis.get(), x, x_stride};
-        auto func = [](ls_bits512 const* spin, void const* coeff, void* raw_cxt) noexcept {
-            auto const& _cxt = *static_cast<cxt_t*>(raw_cxt);
-            uint64_t    index; // NOLINT: index is initialized by ls_get_index
-            auto const  _status = ls_get_index(_cxt.basis, spin->words[0], &index);
-            if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
-                for (auto j = uint64_t{0}; j < _cxt.acc.size(); ++j) {
-                    using T_ = typename block_acc_t<T>::acc_t;
-                    _cxt.acc[j] += std::conj(*static_cast<std::complex<double> const*>(coeff))
-                                   * static_cast<T_>(_cxt.x[index + _cxt.x_stride * j]);
-                }
-            }
-            return _status;
-        };
-        // Apply the operator to local_state
-        local_status = ls_operator_apply(&op, &local_state, func, &cxt);
-        if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
-#pragma omp atomic write
-            status = local_status;
-            continue;
-        }
-        // Accumulate the results into thread local sum
-        auto const sum = sum_acc[thread_num];
-        for (auto j = uint64_t{0}; j < cxt.acc.size(); ++j) {
-            sum[j] += static_cast<acc_t>(std::conj(x[i + x_stride * j])) * cxt.acc[j];
-        }
+    std::vector<uint64_t> chunk_counts(num_threads, 0);
+
+#pragma omp parallel if (num_threads > 1) num_threads(num_threads) default(none)                   \
+    firstprivate(op, chunk_size, count, spins, max_size, out_spins, out_coeffs, out_counts,        \
+                 is_small) shared(terms, chunk_counts)
+    {
+        auto const thread_id = static_cast<unsigned>(omp_get_thread_num());
+        auto const begin     = std::min(count, thread_id * chunk_size);
+        auto const end       = std::min(count, begin + chunk_size);
+        auto const offset    = begin * max_size;
+        chunk_counts[thread_id] =
+            is_small ? batched_apply_64(*op, terms, begin, end, spins, max_size, out_spins + offset,
+                                        out_coeffs + offset, out_counts)
+                     : batched_apply_512(*op, begin, end, spins, out_spins + offset,
+                                         out_coeffs + offset, out_counts);
     }
-    if (LATTICE_SYMMETRIES_LIKELY(status == LS_SUCCESS)) {
-        // Compute the final reduction
-        sum_acc.sum_over_threads(tcb::span{out, block_size});
+
+    auto offset = chunk_counts[0];
+    for (auto i = 1U; i < num_threads; ++i) {
+        auto const chunk_offset = std::min(count, i * chunk_size) * max_size;
+        std::memmove(out_spins + offset, out_spins + chunk_offset,
+                     sizeof(ls_bits512) * chunk_counts[i]);
+        std::memmove(static_cast<void*>(out_coeffs + offset), out_coeffs + chunk_offset,
+                     sizeof(std::complex<double>) * chunk_counts[i]);
+        offset += chunk_counts[i];
     }
-    return status;
+    return offset;
 }
 
+namespace lattice_symmetries {
+namespace {
+    constexpr auto diagonal_block_size = uint64_t{256};
+
+    auto batched_diagonal_helper(ls_operator const& op, uint64_t const count,
+                                 uint64_t const* spins, uint64_t const spins_stride,
+                                 std::complex<double>* out, uint64_t const out_stride) noexcept
+        -> void
+    {
+        auto const number_blocks = (count + diagonal_block_size - 1) / diagonal_block_size;
+#pragma omp parallel for default(none) schedule(static) if (number_blocks > 1)                     \
+    firstprivate(count, spins, spins_stride, out, out_stride, number_blocks) shared(op)
+        for (auto i = uint64_t{0}; i < number_blocks; ++i) {
+            auto const first       = i * diagonal_block_size;
+            auto const local_count = std::min(count - first, uint64_t{diagonal_block_size});
+            alignas(l1_cache_size) double re[diagonal_block_size];
+            alignas(l1_cache_size) double im[diagonal_block_size];
+            std::fill_n(re, local_count, 0.0);
+            std::fill_n(im, local_count, 0.0);
+            for (auto const& term : op.terms) {
+                std::visit(
+                    [&](auto const& x) noexcept {
+                        accumulate_diagonal(x, local_count, spins + first * spins_stride,
+                                            spins_stride, re, im);
+                    },
+                    term.payload);
+            }
+            for (auto j = uint64_t{0}; j < local_count; ++j) {
+                out[(first + j) * out_stride] = std::complex{re[j], im[j]};
+            }
+        }
+    }
+} // namespace
 } // namespace lattice_symmetries
 
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_batched_diagonal(ls_operator const* op, uint64_t const count, uint64_t const* spins,
+                             uint64_t const spins_stride, std::complex<double>* out,
+                             uint64_t const out_stride)
+{
+    // NOLINTNEXTLINE: 64 is the number of bits in uint64_t
+    auto const words_per_state = ls_get_number_bits(op->basis.get()) / 64U;
+    if (spins_stride < words_per_state) { return LS_INVALID_ARGUMENT; }
+    batched_diagonal_helper(*op, count, spins, spins_stride, out, out_stride);
+    return LS_SUCCESS;
+}
+
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
 ls_create_operator(ls_operator** ptr, ls_spin_basis const* basis, unsigned const number_terms,
                    ls_interaction const* const terms[])
@@ -671,6 +592,38 @@ ls_create_operator(ls_operator** ptr, ls_spin_basis const* basis, unsigned const
     return LS_SUCCESS;
 }
 
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_create_sector_operator(ls_operator** ptr, ls_spin_basis const* input_basis,
+                          ls_spin_basis const* output_basis, unsigned const number_terms,
+                          ls_interaction const* const terms[])
+{
+    if (!std::holds_alternative<small_basis_t>(input_basis->payload)
+        || !std::holds_alternative<small_basis_t>(output_basis->payload)) {
+        return LS_WRONG_BASIS_TYPE;
+    }
+    if (ls_get_number_spins(input_basis) != ls_get_number_spins(output_basis)) {
+        return LS_INVALID_NUMBER_SPINS;
+    }
+    auto const _terms                = tcb::span<ls_interaction const* const>{terms, number_terms};
+    auto       expected_number_spins = 1U + max_index(_terms);
+    if (expected_number_spins > ls_get_number_spins(input_basis)) {
+        return LS_INVALID_NUMBER_SPINS;
+    }
+    // Rows of the matrix (i.e. the basis from which we generate matrix elements of the Hermitian
+    // conjugated terms) belong to the output basis
+    auto p         = std::make_unique<ls_operator>(output_basis, _terms);
+    p->input_basis = ls_operator::basis_ptr_t{ls_copy_spin_basis(input_basis)};
+    p->is_real     = p->is_real && is_real(*input_basis);
+    *ptr           = p.release();
+    return LS_SUCCESS;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_spin_basis const*
+ls_operator_get_input_basis(ls_operator const* op)
+{
+    return &input_basis_of(*op);
+}
+
 extern "C" LATTICE_SYMMETRIES_EXPORT void ls_destroy_operator(ls_operator* op)
 {
     LATTICE_SYMMETRIES_LOG_DEBUG("Destroying operator %p\n", static_cast<void*>(op));
@@ -682,60 +635,54 @@ extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t ls_operator_max_buffer_size(ls_ope
     return max_buffer_size(op->terms);
 }
 
-// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
-#define LS_CALL_MATMAT_HELPER(dtype)                                                               \
-    matmat_helper<dtype>(*op, size, block_size, static_cast<dtype const*>(x), x_stride,            \
-                         static_cast<dtype*>(y), y_stride) // NOLINT(bugprone-macro-parentheses)
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_enable_jit(ls_operator* op)
+{
+    if (!std::holds_alternative<small_basis_t>(op->basis->payload)) { return LS_WRONG_BASIS_TYPE; }
+    if (op->jit != nullptr) { return LS_SUCCESS; }
+    std::vector<ls_term_view> terms(op->terms.size());
+    for (auto i = 0U; i < terms.size(); ++i) {
+        ls_operator_get_term(op, i, &terms[i]);
+    }
+    auto r = compile_jit_kernel(terms);
+    if (!r) { return to_error_code(r.error()); }
+    op->jit = std::move(r).value();
+    return LS_SUCCESS;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT bool ls_operator_has_jit(ls_operator const* op)
+{
+    return op->jit != nullptr;
+}
 
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
 ls_operator_matmat(ls_operator const* op, ls_datatype dtype, uint64_t size, uint64_t block_size,
                    void const* x, uint64_t x_stride, void* y, uint64_t y_stride)
 {
-    auto r = [&]() noexcept -> outcome::result<void> {
-        switch (dtype) {
-        case LS_FLOAT32: return LS_CALL_MATMAT_HELPER(float);
-        case LS_FLOAT64: return LS_CALL_MATMAT_HELPER(double);
-        case LS_COMPLEX64: return LS_CALL_MATMAT_HELPER(std::complex<float>);
-        case LS_COMPLEX128: return LS_CALL_MATMAT_HELPER(std::complex<double>);
-        default: return LS_INVALID_DATATYPE;
-        }
-    }();
-    if (!r) {
-        if (r.error().category() == get_error_category()) {
-            return static_cast<ls_error_code>(r.error().value());
-        }
-        return LS_SYSTEM_ERROR;
+    // y lives in op->basis which for sector-changing operators differs from the basis of x
+    auto number_rows = size;
+    if (op->input_basis != nullptr) {
+        auto const status = ls_get_number_states(op->basis.get(), &number_rows);
+        if (status != LS_SUCCESS) { return status; }
     }
-    return LS_SUCCESS;
+    auto r = operator_matmat(*op, dtype, size, block_size, x, x_stride, y, y_stride, 0,
+                             number_rows, nullptr);
+    return to_error_code(r);
 }
 
-#undef LS_CALL_MATMAT_HELPER
-
-// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
-#define LS_CALL_EXPECTATION_HELPER(dtype)                                                          \
-    expectation_helper<dtype>(*op, size, block_size, static_cast<dtype const*>(x), x_stride,       \
-                              static_cast<std::complex<double>*>(out))
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_matmat_rows(ls_operator const* op, ls_datatype dtype, uint64_t size, uint64_t block_size,
+                        void const* x, uint64_t x_stride, uint64_t number_rows,
+                        uint64_t const rows[], void* y, uint64_t y_stride)
+{
+    auto r = operator_matmat(*op, dtype, size, block_size, x, x_stride, y, y_stride, 0,
+                             number_rows, rows);
+    return to_error_code(r);
+}
 
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
 ls_operator_expectation(ls_operator const* op, ls_datatype dtype, uint64_t size,
                         uint64_t block_size, void const* x, uint64_t x_stride, void* out)
 {
-    auto r = [&]() noexcept -> outcome::result<void> {
-        switch (dtype) {
-        case LS_FLOAT32: return LS_CALL_EXPECTATION_HELPER(float);
-        case LS_FLOAT64: return LS_CALL_EXPECTATION_HELPER(double);
-        case LS_COMPLEX64: return LS_CALL_EXPECTATION_HELPER(std::complex<float>);
-        case LS_COMPLEX128: return LS_CALL_EXPECTATION_HELPER(std::complex<double>);
-        default: return LS_INVALID_DATATYPE;
-        }
-    }();
-    if (!r) {
-        if (r.error().category() == get_error_category()) {
-            return static_cast<ls_error_code>(r.error().value());
-        }
-        return LS_SYSTEM_ERROR;
-    }
-    return LS_SUCCESS;
+    auto r = operator_expectation(*op, dtype, size, block_size, x, x_stride, out);
+    return to_error_code(r);
 }
-
-#undef LS_CALL_EXPECTATION_HELPER
@@ -27,3 +27,326 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
+
+#include "basis.hpp"
+#include "cpu/state_info.hpp"
+#include "jit.hpp"
+#include "plan.hpp"
+#include "lattice_symmetries/lattice_symmetries.hpp"
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <span.hpp>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace lattice_symmetries {
+
+inline constexpr auto l1_cache_size = 64;
+
+template <class T, class = void> struct is_complex : std::false_type {};
+template <class T>
+struct is_complex<std::complex<T>, std::enable_if_t<std::is_floating_point<T>::value>>
+    : std::true_type {};
+template <class T> inline constexpr bool is_complex_v = is_complex<T>::value;
+
+template <unsigned N> auto transpose(std::complex<double> (&matrix)[N][N]) noexcept -> void
+{
+    for (auto i = 0U; i < N; ++i) {
+        for (auto j = 0U; j < i; ++j) {
+            std::swap(matrix[i][j], matrix[j][i]);
+        }
+    }
+}
+
+template <unsigned N> auto conjugate(std::complex<double> (&matrix)[N][N]) noexcept -> void
+{
+    for (auto i = 0U; i < N; ++i) {
+        for (auto j = 0U; j < N; ++j) {
+            matrix[i][j] = std::conj(matrix[i][j]);
+        }
+    }
+}
+
+template <unsigned NumberSpins> struct interaction_t {
+    struct free_fn_t {
+        // NOLINTNEXTLINE: we are using RAII, that's the purpose of this struct
+        auto operator()(void* p) const noexcept -> void { std::free(p); }
+    };
+
+    static constexpr unsigned number_spins = NumberSpins;
+    static constexpr unsigned Dim          = 1U << NumberSpins;
+
+    struct alignas(l1_cache_size) matrix_t {
+        std::complex<double> payload[Dim][Dim];
+
+        explicit matrix_t(std::complex<double> const* data) noexcept
+        {
+            // NOLINTNEXTLINE: we do want array to pointer decay here
+            std::memcpy(payload, data, Dim * Dim * sizeof(std::complex<double>));
+        }
+
+        explicit matrix_t(std::complex<double> const (&data)[Dim][Dim]) noexcept
+            : matrix_t{&data[0][0]}
+        {}
+    };
+    using sites_t = std::vector<std::array<uint16_t, NumberSpins>>;
+
+    std::unique_ptr<matrix_t> matrix;
+    sites_t                   sites;
+
+    interaction_t(std::complex<double> const*                        _matrix,
+                  tcb::span<std::array<uint16_t, NumberSpins> const> _sites)
+        : matrix{std::make_unique<matrix_t>(_matrix)}, sites{std::begin(_sites), std::end(_sites)}
+    {
+        // Transpose comes from the fact that we store the matrix in column major order, but the
+        // user passes it in row major order.
+        transpose(matrix->payload);
+    }
+
+    auto hermitian_conjugate() noexcept -> void
+    {
+        transpose(matrix->payload);
+        conjugate(matrix->payload);
+    }
+
+    interaction_t(interaction_t&&) noexcept = default;
+    interaction_t(interaction_t const& other)
+        : matrix{std::make_unique<matrix_t>(other.matrix->payload)}, sites{other.sites}
+    {}
+    auto operator=(interaction_t const&) -> interaction_t& = delete;
+    auto operator=(interaction_t&&) -> interaction_t& = delete;
+
+    ~interaction_t() noexcept = default;
+};
+
+} // namespace lattice_symmetries
+
+struct ls_interaction {
+    std::variant<lattice_symmetries::interaction_t<1>, lattice_symmetries::interaction_t<2>,
+                 lattice_symmetries::interaction_t<3>, lattice_symmetries::interaction_t<4>>
+        payload;
+
+    template <class T, class Arg, class... Args>
+    ls_interaction(std::in_place_type_t<T> tag, Arg&& arg, Args&&... args)
+        : payload{tag, std::forward<Arg>(arg), std::forward<Args>(args)...}
+    {}
+};
+
+namespace lattice_symmetries {
+/// Upper bound on the number of matrix elements produced by applying `interaction` to a single
+/// spin configuration.
+auto max_buffer_size(ls_interaction const& interaction) noexcept -> uint64_t;
+auto max_buffer_size(tcb::span<ls_interaction const> interactions) noexcept -> uint64_t;
+} // namespace lattice_symmetries
+
+struct ls_operator {
+    struct basis_deleter_fn_t {
+        auto operator()(ls_spin_basis* p) const noexcept -> void { ls_destroy_spin_basis(p); }
+    };
+    using basis_ptr_t = std::unique_ptr<ls_spin_basis, basis_deleter_fn_t>;
+
+    basis_ptr_t                                       basis;
+    /// Basis of input vectors for operators created with ls_create_sector_operator, nullptr
+    /// otherwise. Matrix elements generated by #apply_helper are expressed in this basis.
+    basis_ptr_t                                       input_basis;
+    std::vector<ls_interaction>                       terms;
+    bool                                              is_real;
+    std::unique_ptr<lattice_symmetries::jit_kernel_t> jit;
+    /// Plan used for shapes which ls_operator_plan has not been called for
+    lattice_symmetries::operator_plan_t               plan;
+    std::vector<lattice_symmetries::keyed_plan_t>     plans;
+
+    ls_operator(ls_spin_basis const* _basis, tcb::span<ls_interaction const* const> _terms);
+};
+
+namespace lattice_symmetries {
+
+/// Returns the basis of vectors to which `op` is applied. It differs from `op.basis` (the basis of
+/// results) only for sector-changing operators.
+inline auto input_basis_of(ls_operator const& op) noexcept -> ls_spin_basis const&
+{
+    return op.input_basis != nullptr ? *op.input_basis : *op.basis;
+}
+
+/// Checks that `op` maps a sector onto itself (eigenvalues and exp(-iHt) are only defined for
+/// such operators) and that the dimension of this sector is `size`.
+auto check_square(ls_operator const& op, uint64_t size) noexcept -> ls_error_code;
+
+/// Converts errors of internal computations to error codes for the C interface. Errors from
+/// other categories become #LS_SYSTEM_ERROR.
+auto to_error_code(std::error_code const& error) noexcept -> ls_error_code;
+auto to_error_code(outcome::result<void> const& r) noexcept -> ls_error_code;
+
+// NOTE: Functions below live in an anonymous namespace on purpose. This header is included by the
+// per-architecture kernels in src/cpu/ and every translation unit must get its own copy compiled
+// for the corresponding instruction set. With external linkage the linker would be free to pick
+// e.g. the AVX2 instantiation for everyone.
+namespace { // NOLINT(cert-dcl59-cpp, google-build-namespaces)
+    template <class T> constexpr auto datatype_of() noexcept -> ls_datatype
+    {
+        if constexpr (std::is_same_v<T, float>) { return LS_FLOAT32; }
+        else if constexpr (std::is_same_v<T, double>) {
+            return LS_FLOAT64;
+        }
+        else if constexpr (std::is_same_v<T, std::complex<float>>) {
+            return LS_COMPLEX64;
+        }
+        else {
+            static_assert(std::is_same_v<T, std::complex<double>>);
+            return LS_COMPLEX128;
+        }
+    }
+
+    template <class Bits, class OffDiag> struct interaction_apply_fn_t {
+        Bits const&           x;
+        std::complex<double>& diagonal;
+        OffDiag               off_diag;
+
+        static constexpr bool is_noexcept = noexcept(std::declval<OffDiag const&>()(
+            std::declval<Bits const&>(), std::declval<std::complex<double> const&>()));
+
+        template <unsigned N>
+        auto operator()(interaction_t<N> const& self) const noexcept(is_noexcept) -> ls_error_code
+        {
+            for (auto const edge : self.sites) {
+                auto const  k    = detail::gather_bits(x, edge);
+                auto const& data = self.matrix->payload[k];
+                for (auto n = 0U; n < std::size(data); ++n) {
+                    if (data[n] == 0.0) { continue; }
+                    if (n == k) { diagonal += data[n]; }
+                    else {
+                        auto y = x;
+                        detail::scatter_bits(y, n, edge);
+                        auto const status = off_diag(y, data[n]);
+                        if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+                    }
+                }
+            }
+            return LS_SUCCESS;
+        }
+    };
+
+    template <class Bits, class OffDiag>
+    auto apply(ls_interaction const& interaction, Bits const& spin, std::complex<double>& diagonal,
+               OffDiag off_diag) noexcept(interaction_apply_fn_t<Bits, OffDiag>::is_noexcept)
+        -> ls_error_code
+    {
+        interaction_apply_fn_t<Bits, OffDiag> visitor{spin, diagonal, std::move(off_diag)};
+        return std::visit(std::cref(visitor), interaction.payload);
+    }
+
+    /// Returns a function which computes the representative, character and norm of a spin
+    /// configuration. For `ls_bits64` we call `get_state_info_64` directly (the basis must then be
+    /// a `small_basis_t`) to avoid going through `ls_bits512`.
+    template <class Bits> auto make_state_info_fn(ls_spin_basis const& basis) noexcept
+    {
+        if constexpr (std::is_same_v<Bits, ls_bits64>) {
+            auto const* body = std::get_if<small_basis_t>(&basis.payload);
+            LATTICE_SYMMETRIES_ASSERT(body != nullptr, "64-bit path requires a small basis");
+            return [&header = basis.header, body](ls_bits64 const& x, ls_bits64& repr,
+                                                  std::complex<double>& character,
+                                                  double& norm) noexcept {
+                get_state_info_64(header, *body, x, repr, character, norm);
+            };
+        }
+        else {
+            return [&basis](ls_bits512 const& x, ls_bits512& repr, std::complex<double>& character,
+                            double& norm) noexcept {
+                ls_get_state_info(&basis, &x, &repr, &character, &norm);
+            };
+        }
+    }
+
+    template <class Bits, class Callback>
+    auto apply_helper(ls_operator const& op, Bits const& spin, Callback callback) noexcept(
+        noexcept(std::declval<Callback&>()(std::declval<Bits const&>(),
+                                           std::declval<std::complex<double> const&>())))
+        -> ls_error_code
+    {
+        auto const           state_info = make_state_info_fn<Bits>(*op.basis);
+        auto const           input_info = make_state_info_fn<Bits>(input_basis_of(op));
+        auto                 repr       = spin;
+        std::complex<double> eigenvalue;
+        double               norm; // NOLINT: norm is initialized by state_info
+        state_info(spin, repr, eigenvalue, norm);
+        if (norm == 0.0) { return LS_INVALID_STATE; }
+        auto const old_norm = norm;
+        auto       diagonal = std::complex<double>{0.0, 0.0};
+        auto const off_diag = [&](Bits const& x, std::complex<double> const& c) {
+            input_info(x, repr, eigenvalue, norm);
+            if (norm > 0.0) {
+                LATTICE_SYMMETRIES_ASSERT(c * norm / old_norm * eigenvalue != 0.0, "");
+                auto const status = callback(repr, c * norm / old_norm * eigenvalue);
+                if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+            }
+            return LS_SUCCESS;
+        };
+        auto status = LS_SUCCESS;
+        for (auto const& term : op.terms) {
+            status = apply(term, spin, diagonal, std::cref(off_diag));
+            if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+        }
+        if (diagonal != 0.0) {
+            // For sector-changing operators spin has to be expressed in the input basis as well
+            if (LATTICE_SYMMETRIES_UNLIKELY(op.input_basis != nullptr)) {
+                return off_diag(spin, diagonal);
+            }
+            status = callback(spin, diagonal);
+        }
+        return status;
+    }
+
+    /// Scratch space for #jit_kernel_t::apply.
+    struct jit_scratch_t {
+        std::vector<uint64_t>             spins;
+        std::vector<std::complex<double>> coeffs;
+    };
+
+    /// Same as #apply_helper, but off-diagonal matrix elements are generated by a runtime compiled
+    /// kernel.
+    template <class Callback>
+    auto apply_helper(ls_operator const& op, jit_kernel_t const& kernel, ls_bits64 const spin,
+                      jit_scratch_t& scratch, Callback callback) noexcept(
+        noexcept(std::declval<Callback&>()(std::declval<ls_bits64 const&>(),
+                                           std::declval<std::complex<double> const&>())))
+        -> ls_error_code
+    {
+        auto const           state_info = make_state_info_fn<ls_bits64>(*op.basis);
+        auto const           input_info = make_state_info_fn<ls_bits64>(input_basis_of(op));
+        auto                 repr       = spin;
+        std::complex<double> eigenvalue;
+        double               norm; // NOLINT: norm is initialized by state_info
+        state_info(spin, repr, eigenvalue, norm);
+        if (norm == 0.0) { return LS_INVALID_STATE; }
+        auto const old_norm = norm;
+        auto       diagonal = std::complex<double>{0.0, 0.0};
+        // NOLINTNEXTLINE: std::complex<double> is layout-compatible with double[2]
+        auto const count = (*kernel.apply)(spin, scratch.spins.data(),
+                                           reinterpret_cast<double*>(scratch.coeffs.data()),
+                                           reinterpret_cast<double*>(&diagonal));
+        auto const off_diag = [&](ls_bits64 const x, std::complex<double> const& c) {
+            input_info(x, repr, eigenvalue, norm);
+            if (norm > 0.0) { return callback(repr, c * norm / old_norm * eigenvalue); }
+            return LS_SUCCESS;
+        };
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            auto const status = off_diag(scratch.spins[i], scratch.coeffs[i]);
+            if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) { return status; }
+        }
+        if (diagonal != 0.0) {
+            // For sector-changing operators spin has to be expressed in the input basis as well
+            if (LATTICE_SYMMETRIES_UNLIKELY(op.input_basis != nullptr)) {
+                return off_diag(spin, diagonal);
+            }
+            return callback(spin, diagonal);
+        }
+        return LS_SUCCESS;
+    }
+} // namespace
+
+} // namespace lattice_symmetries
@@ -0,0 +1,123 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "out_of_core.hpp"
+#include "operator.hpp"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Whether `filename` refers to the same file as `other` (e.g. through a different path or a
+    /// link). Returns false when `filename` does not exist.
+    auto is_same_file(char const* filename, char const* other) noexcept -> bool
+    {
+        struct stat a; // NOLINT: a is initialized by stat
+        struct stat b; // NOLINT: b is initialized by stat
+        if (::stat(filename, &a) != 0 || ::stat(other, &b) != 0) { return false; }
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+    }
+
+    auto matmat_file_helper(ls_operator const& op, ls_datatype const dtype, uint64_t const size,
+                            uint64_t const block_size, char const* x_filename,
+                            char const* y_filename, ls_out_of_core_options const& options)
+        -> outcome::result<void>
+    {
+        auto const element_size = datatype_size(dtype);
+        if (element_size == 0) { return LS_INVALID_DATATYPE; }
+        if (block_size == 0 || options.queue_depth == 0) { return LS_INVALID_ARGUMENT; }
+        // y lives in op.basis which for sector-changing operators differs from the basis of x
+        auto number_rows = size;
+        if (op.input_basis != nullptr) {
+            auto const status = ls_get_number_states(op.basis.get(), &number_rows);
+            if (status != LS_SUCCESS) { return status; }
+        }
+        auto const default_tile_rows =
+            std::max<uint64_t>(1, default_tile_bytes / (block_size * element_size));
+        auto const tile_rows = std::min(
+            number_rows, options.tile_rows != 0 ? options.tile_rows : default_tile_rows);
+
+        OUTCOME_TRY(x, map_file(x_filename, size * block_size * element_size));
+        // Truncating y would truncate the mapping of x under our feet (and raise SIGBUS)
+        if (is_same_file(y_filename, x_filename)) { return LS_INVALID_ARGUMENT; }
+        auto const y = file_t{::open(y_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+        if (y.fd < 0) { return LS_COULD_NOT_OPEN_FILE; }
+        if (::ftruncate(y.fd, static_cast<off_t>(number_rows * block_size * element_size)) != 0) {
+            return LS_FILE_IO_FAILED;
+        }
+
+        auto rows   = std::vector<uint64_t>(tile_rows);
+        auto writer = tile_writer_t{y.fd,     number_rows, block_size, element_size,
+                                    tile_rows, options.queue_depth};
+        for (auto first = uint64_t{0}; first < number_rows; first += tile_rows) {
+            auto* tile = writer.acquire();
+            if (tile == nullptr) { break; }
+            tile->first = first;
+            tile->count = std::min(tile_rows, number_rows - first);
+            std::iota(std::begin(rows), std::end(rows), first);
+            auto const status =
+                ls_operator_matmat_rows(&op, dtype, size, block_size, x.data, size, tile->count,
+                                        rows.data(), tile->data.data(), tile->count);
+            if (status != LS_SUCCESS) {
+                static_cast<void>(writer.finish());
+                return status;
+            }
+            writer.submit(tile);
+        }
+        auto const status = writer.finish();
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success();
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void
+ls_out_of_core_default_options(ls_out_of_core_options* options)
+{
+    options->tile_rows   = 0;
+    options->queue_depth = 2;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_matmat_file(ls_operator const* op, ls_datatype const dtype, uint64_t const size,
+                        uint64_t const block_size, char const* x_filename, char const* y_filename,
+                        ls_out_of_core_options const* options)
+{
+    auto defaults = ls_out_of_core_options{};
+    if (options == nullptr) {
+        ls_out_of_core_default_options(&defaults);
+        options = &defaults;
+    }
+    auto r = matmat_file_helper(*op, dtype, size, block_size, x_filename, y_filename, *options);
+    return to_error_code(r);
+}
@@ -0,0 +1,243 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <outcome.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <complex>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace outcome = OUTCOME_V2_NAMESPACE;
+
+namespace lattice_symmetries {
+
+constexpr auto default_tile_bytes = uint64_t{64} << 20U;
+
+constexpr auto datatype_size(ls_datatype const dtype) noexcept -> uint64_t
+{
+    switch (dtype) {
+    case LS_FLOAT32: return sizeof(float);
+    case LS_FLOAT64: return sizeof(double);
+    case LS_COMPLEX64: return sizeof(std::complex<float>);
+    case LS_COMPLEX128: return sizeof(std::complex<double>);
+    default: return 0;
+    }
+}
+
+struct file_t {
+    int fd = -1;
+
+    file_t() noexcept = default;
+    explicit file_t(int const _fd) noexcept : fd{_fd} {}
+    file_t(file_t const&) = delete;
+    file_t(file_t&& other) noexcept : fd{std::exchange(other.fd, -1)} {}
+    auto operator=(file_t const&) -> file_t& = delete;
+    auto operator=(file_t&&) -> file_t& = delete;
+    ~file_t()
+    {
+        if (fd >= 0) { ::close(fd); }
+    }
+};
+
+struct mapping_t {
+    void*    data = MAP_FAILED;
+    uint64_t size = 0;
+
+    mapping_t() noexcept = default;
+    mapping_t(void* _data, uint64_t const _size) noexcept : data{_data}, size{_size} {}
+    mapping_t(mapping_t const&) = delete;
+    mapping_t(mapping_t&& other) noexcept
+        : data{std::exchange(other.data, MAP_FAILED)}, size{other.size}
+    {}
+    auto operator=(mapping_t const&) -> mapping_t& = delete;
+    auto operator=(mapping_t&&) -> mapping_t& = delete;
+    ~mapping_t()
+    {
+        if (data != MAP_FAILED) { ::munmap(data, size); }
+    }
+};
+
+/// Maps the first `size` bytes of `filename` into memory. The whole file is mapped and read
+/// through the page cache: pages are loaded on first access and, being clean, may be evicted
+/// again under memory pressure.
+inline auto map_file(char const* filename, uint64_t const size) noexcept
+    -> outcome::result<mapping_t>
+{
+    auto const file = file_t{::open(filename, O_RDONLY)};
+    if (file.fd < 0) { return LS_COULD_NOT_OPEN_FILE; }
+    struct stat buf; // NOLINT: buf is initialized by fstat
+    if (::fstat(file.fd, &buf) != 0) { return LS_FILE_IO_FAILED; }
+    if (static_cast<uint64_t>(buf.st_size) < size) { return LS_DIMENSION_MISMATCH; }
+    auto* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, file.fd, 0);
+    if (data == MAP_FAILED) { return LS_FILE_IO_FAILED; }
+    return mapping_t{data, size};
+}
+
+inline auto write_all(int const fd, char const* data, uint64_t size, uint64_t offset) noexcept
+    -> ls_error_code
+{
+    while (size > 0) {
+        auto const written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            return LS_FILE_IO_FAILED;
+        }
+        auto const n = static_cast<uint64_t>(written);
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return LS_SUCCESS;
+}
+
+/// A tile of rows [first, first + count) of y stored column-major with stride count
+struct tile_t {
+    std::vector<char> data;
+    uint64_t          first;
+    uint64_t          count;
+};
+
+/// Writes tiles of y to a file on a background thread such that computation of the next
+/// tile overlaps with I/O of the previous ones. At most `depth` tiles are queued; #acquire
+/// blocks until a buffer becomes free.
+class tile_writer_t {
+  public:
+    tile_writer_t(int const fd, uint64_t const number_rows, uint64_t const block_size,
+                  uint64_t const element_size, uint64_t const tile_rows, unsigned const depth)
+        : _fd{fd}
+        , _number_rows{number_rows}
+        , _block_size{block_size}
+        , _element_size{element_size}
+        , _tiles(depth + 1)
+    {
+        for (auto& tile : _tiles) {
+            tile.data.resize(tile_rows * block_size * element_size);
+            _free.push_back(&tile);
+        }
+        _thread = std::thread{[this]() { loop(); }};
+    }
+
+    tile_writer_t(tile_writer_t const&) = delete;
+    tile_writer_t(tile_writer_t&&)      = delete;
+    auto operator=(tile_writer_t const&) -> tile_writer_t& = delete;
+    auto operator=(tile_writer_t&&) -> tile_writer_t& = delete;
+    ~tile_writer_t() { finish(); }
+
+    /// Returns a free buffer or `nullptr` if writing has failed
+    auto acquire() -> tile_t*
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _changed.wait(lock, [this]() { return !_free.empty() || _status != LS_SUCCESS; });
+        if (_status != LS_SUCCESS) { return nullptr; }
+        auto* tile = _free.back();
+        _free.pop_back();
+        return tile;
+    }
+
+    auto submit(tile_t* tile) -> void
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _pending.push_back(tile);
+        }
+        _changed.notify_all();
+    }
+
+    /// Waits for all queued tiles to be written
+    auto finish() -> ls_error_code
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _done = true;
+        }
+        _changed.notify_all();
+        if (_thread.joinable()) { _thread.join(); }
+        return _status;
+    }
+
+  private:
+    auto loop() -> void
+    {
+        for (;;) {
+            tile_t* tile; // NOLINT: initialized inside the critical section
+            {
+                std::unique_lock<std::mutex> lock{_mutex};
+                _changed.wait(lock, [this]() { return !_pending.empty() || _done; });
+                if (_pending.empty()) { return; }
+                tile = _pending.front();
+                _pending.pop_front();
+            }
+            auto const status = write(*tile);
+            {
+                std::lock_guard<std::mutex> lock{_mutex};
+                if (status != LS_SUCCESS) { _status = status; }
+                _free.push_back(tile);
+            }
+            _changed.notify_all();
+        }
+    }
+
+    /// Column j of the tile goes to rows [first, first + count) of column j of y
+    auto write(tile_t const& tile) const noexcept -> ls_error_code
+    {
+        auto const bytes = tile.count * _element_size;
+        for (auto j = uint64_t{0}; j < _block_size; ++j) {
+            auto const status =
+                write_all(_fd, tile.data.data() + j * bytes, bytes,
+                          (j * _number_rows + tile.first) * _element_size);
+            if (status != LS_SUCCESS) { return status; }
+        }
+        return LS_SUCCESS;
+    }
+
+    int                     _fd;
+    uint64_t                _number_rows;
+    uint64_t                _block_size;
+    uint64_t                _element_size;
+    std::vector<tile_t>     _tiles;
+    std::vector<tile_t*>    _free;
+    std::deque<tile_t*>     _pending;
+    bool                    _done   = false;
+    ls_error_code           _status = LS_SUCCESS;
+    std::mutex              _mutex;
+    std::condition_variable _changed;
+    std::thread             _thread;
+};
+
+} // namespace lattice_symmetries
@@ -0,0 +1,373 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "plan.hpp"
+#include "bits.hpp"
+#include "cpu/operator_kernels.hpp"
+#include "operator.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <complex>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace lattice_symmetries {
+
+auto get_chunk_size(operator_plan_t const& plan, uint64_t const number_rows) noexcept -> uint64_t
+{
+    if (plan.chunk_size != 0) { return plan.chunk_size; }
+    return std::max<uint64_t>(
+        500U, number_rows / (100U * static_cast<unsigned>(omp_get_max_threads())));
+}
+
+auto get_plan(ls_operator const& op, ls_datatype const dtype, uint64_t const block_size) noexcept
+    -> operator_plan_t const&
+{
+    for (auto const& keyed : op.plans) {
+        if (keyed.dtype == dtype && keyed.block_size == block_size) { return keyed.plan; }
+    }
+    return op.plan;
+}
+
+namespace {
+    /// Maximal number of rows used to time a candidate plan
+    constexpr auto planner_sample_size = uint64_t{1} << 14U;
+    /// The sample consists of this many contiguous blocks of rows spread evenly over the basis
+    constexpr auto planner_sample_blocks = uint64_t{16};
+    /// Every candidate is timed this many times and the fastest run is used
+    constexpr auto planner_repetitions = 3U;
+    /// Candidate values of operator_plan_t::chunk_size
+    constexpr auto planner_chunk_sizes = std::array<uint64_t, 5>{0, 64, 256, 1024, 4096};
+    /// Candidate values of operator_plan_t::tile_size (in addition to untiled execution)
+    constexpr auto planner_tile_sizes = std::array<uint64_t, 3>{256, 1024, 4096};
+
+    /// Whether `plan` is one of the candidates considered by the planner. Plans read from wisdom
+    /// files are checked with it such that corrupted values never reach the kernels.
+    auto is_candidate(operator_plan_t const& plan) noexcept -> bool
+    {
+        auto const contains = [](auto const& values, uint64_t const x) {
+            return std::find(std::begin(values), std::end(values), x) != std::end(values);
+        };
+        return contains(planner_chunk_sizes, plan.chunk_size)
+               && (plan.tile_size == 0 || contains(planner_tile_sizes, plan.tile_size));
+    }
+
+    constexpr char const* wisdom_header = "# lattice_symmetries wisdom v2\n";
+
+    struct wisdom_t {
+        std::mutex                                    mutex;
+        std::unordered_map<uint64_t, operator_plan_t> plans;
+    };
+
+    auto get_wisdom() noexcept -> wisdom_t&
+    {
+        static wisdom_t wisdom;
+        return wisdom;
+    }
+
+    constexpr auto datatype_size(ls_datatype const dtype) noexcept -> uint64_t
+    {
+        switch (dtype) {
+        case LS_FLOAT32: return sizeof(float);
+        case LS_FLOAT64: return sizeof(double);
+        case LS_COMPLEX64: return sizeof(std::complex<float>);
+        case LS_COMPLEX128: return sizeof(std::complex<double>);
+        default: return 0;
+        }
+    }
+
+    /// Computes a key under which the plan is stored in the wisdom. Plans depend on the basis, the
+    /// terms of the operator, the shape of the problem and the number of threads.
+    auto get_plan_key(ls_operator const& op, tcb::span<uint64_t const> states,
+                      ls_datatype const dtype, uint64_t const block_size) noexcept -> uint64_t
+    {
+        auto hash = fnv1a(states.data(), states.size_bytes());
+        for (auto i = 0U; i < op.terms.size(); ++i) {
+            ls_term_view term;
+            ls_operator_get_term(&op, i, &term);
+            auto const dim = uint64_t{1} << term.number_spins;
+            hash           = fnv1a(&term.number_spins, sizeof(term.number_spins), hash);
+            hash           = fnv1a(term.matrix, dim * dim * sizeof(std::complex<double>), hash);
+            hash = fnv1a(term.sites, term.number_sites * term.number_spins * sizeof(uint16_t), hash);
+        }
+        std::array<uint64_t, 4> const parameters = {
+            static_cast<uint64_t>(dtype), block_size,
+            static_cast<uint64_t>(omp_get_max_threads()), uint64_t{op.jit != nullptr}};
+        return fnv1a(parameters.data(), sizeof(parameters), hash);
+    }
+
+    /// Extra memory (in bytes) required by `plan`
+    auto get_plan_memory(ls_operator const& op, operator_plan_t const& plan) noexcept -> uint64_t
+    {
+        auto const threads = static_cast<uint64_t>(omp_get_max_threads());
+        auto const buffer  = max_buffer_size(op.terms);
+        auto       memory  = uint64_t{0};
+        if (plan.use_jit && op.jit != nullptr) {
+            memory += threads * buffer * (sizeof(uint64_t) + sizeof(std::complex<double>));
+        }
+        if (plan.tile_size != 0) {
+            memory += threads * plan.tile_size * (buffer + 1) * tile_bytes_per_element;
+        }
+        return memory;
+    }
+
+    /// Rows used to time candidate plans. The cost of a row depends on its position in the basis
+    /// (e.g. through the number of non-zero matrix elements), so rows are taken from everywhere.
+    /// Blocks are contiguous such that tiled execution sees realistic locality.
+    auto get_sample_rows(uint64_t const size) -> std::vector<uint64_t>
+    {
+        auto const sample = std::min(size, planner_sample_size);
+        auto const blocks = std::min(sample, planner_sample_blocks);
+        auto       rows   = std::vector<uint64_t>{};
+        rows.reserve(sample);
+        for (auto block = uint64_t{0}; block < blocks; ++block) {
+            auto const first = size * block / blocks;
+            auto const count = sample * (block + 1) / blocks - sample * block / blocks;
+            for (auto i = uint64_t{0}; i < count; ++i) {
+                rows.push_back(first + i);
+            }
+        }
+        return rows;
+    }
+
+    /// Uses the plan for `dtype` and `block_size` if there is one, and adds it otherwise.
+    auto set_plan(ls_operator& op, ls_datatype const dtype, uint64_t const block_size,
+                  operator_plan_t const& plan) -> void
+    {
+        for (auto& keyed : op.plans) {
+            if (keyed.dtype == dtype && keyed.block_size == block_size) {
+                keyed.plan = plan;
+                return;
+            }
+        }
+        op.plans.push_back(keyed_plan_t{dtype, block_size, plan});
+    }
+
+    auto time_plan(ls_operator const& op, ls_datatype const dtype, uint64_t const size,
+                   uint64_t const block_size, void const* x, void* y,
+                   std::vector<uint64_t> const& rows) noexcept -> outcome::result<double>
+    {
+        auto const sample = rows.size();
+        auto       best   = std::numeric_limits<double>::max();
+        for (auto i = 0U; i < planner_repetitions; ++i) {
+            auto const start = std::chrono::steady_clock::now();
+            OUTCOME_TRY(operator_matmat(op, dtype, size, block_size, x, size, y, sample, 0, sample,
+                                        rows.data()));
+            auto const stop = std::chrono::steady_clock::now();
+            best            = std::min(best, std::chrono::duration<double>(stop - start).count());
+        }
+        return best;
+    }
+
+    auto plan_helper(ls_operator& op, ls_datatype const dtype, uint64_t const block_size,
+                     uint64_t const memory_budget) noexcept -> outcome::result<void>
+    {
+        if (!std::holds_alternative<small_basis_t>(op.basis->payload)) {
+            return LS_WRONG_BASIS_TYPE;
+        }
+        if (op.input_basis != nullptr) { return LS_INVALID_ARGUMENT; }
+        if (datatype_size(dtype) == 0) { return LS_INVALID_DATATYPE; }
+        if (block_size == 0) { return LS_INVALID_ARGUMENT; }
+
+        ls_states* states = nullptr;
+        auto const status = ls_get_states(&states, op.basis.get());
+        if (status != LS_SUCCESS) { return status; }
+        auto const size = ls_states_get_size(states);
+
+        // x has to be complete since rows in the sample reference arbitrary columns. Timing
+        // buffers count against the budget, so fewer than block_size columns may be timed. The
+        // plan is then only valid for that many columns and is stored under their number.
+        auto const rows         = get_sample_rows(size);
+        auto const sample       = rows.size();
+        auto const element_size = datatype_size(dtype);
+        auto const columns =
+            memory_budget == 0
+                ? block_size
+                : std::min(block_size, memory_budget / ((size + sample) * element_size));
+        if (columns == 0) {
+            ls_destroy_states(states);
+            LATTICE_SYMMETRIES_LOG_DEBUG("%s",
+                                         "Memory budget does not fit a single vector, keeping "
+                                         "the default plan\n");
+            return LS_SUCCESS;
+        }
+        if (columns != block_size) {
+            LATTICE_SYMMETRIES_LOG_DEBUG("Memory budget fits only %" PRIu64
+                                         " columns, planning for block_size=%" PRIu64 "\n",
+                                         columns, columns);
+        }
+        auto const key = get_plan_key(op, {ls_states_get_data(states), size}, dtype, columns);
+        ls_destroy_states(states);
+
+        auto& wisdom = get_wisdom();
+        {
+            std::lock_guard<std::mutex> lock{wisdom.mutex};
+            if (auto const it = wisdom.plans.find(key); it != wisdom.plans.end()) {
+                LATTICE_SYMMETRIES_LOG_DEBUG("Using plan %016" PRIx64 " from wisdom\n", key);
+                set_plan(op, dtype, columns, it->second);
+                return LS_SUCCESS;
+            }
+        }
+        auto const buffers = (size + sample) * columns * element_size;
+        auto const x       = std::vector<char>(size * columns * element_size);
+        auto       y       = std::vector<char>(sample * columns * element_size);
+
+        std::vector<operator_plan_t> candidates;
+        for (auto const use_jit : {false, true}) {
+            if (use_jit && op.jit == nullptr) { continue; }
+            for (auto const chunk_size : planner_chunk_sizes) {
+                candidates.push_back(operator_plan_t{chunk_size, use_jit, 0});
+            }
+            for (auto const tile_size : planner_tile_sizes) {
+                candidates.push_back(operator_plan_t{0, use_jit, tile_size});
+            }
+        }
+
+        auto const original  = op.plans;
+        auto       best      = get_plan(op, dtype, columns);
+        auto       best_time = std::numeric_limits<double>::max();
+        for (auto const& candidate : candidates) {
+            if (memory_budget != 0 && buffers + get_plan_memory(op, candidate) > memory_budget) {
+                continue;
+            }
+            set_plan(op, dtype, columns, candidate);
+            auto&& time = time_plan(op, dtype, size, columns, x.data(), y.data(), rows);
+            if (!time) {
+                op.plans = original;
+                return time.as_failure();
+            }
+            if (time.value() < best_time) {
+                best      = candidate;
+                best_time = time.value();
+            }
+        }
+        LATTICE_SYMMETRIES_LOG_DEBUG("Chose plan %016" PRIx64 ": chunk_size=%" PRIu64
+                                     ", use_jit=%i, tile_size=%" PRIu64
+                                     " (%g seconds for %" PRIu64 " rows)\n",
+                                     key, best.chunk_size, static_cast<int>(best.use_jit),
+                                     best.tile_size, best_time, sample);
+        op.plans = original;
+        set_plan(op, dtype, columns, best);
+        std::lock_guard<std::mutex> lock{wisdom.mutex};
+        wisdom.plans[key] = best;
+        return LS_SUCCESS;
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_plan(ls_operator*      op,
+                                                                    ls_datatype const dtype,
+                                                                    uint64_t const    block_size,
+                                                                    uint64_t const memory_budget)
+{
+    auto r = plan_helper(*op, dtype, block_size, memory_budget);
+    return to_error_code(r);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_operator_set_tile_size(ls_operator*   op,
+                                                                    uint64_t const tile_size)
+{
+    op->plan.tile_size = tile_size;
+    for (auto& keyed : op->plans) {
+        keyed.plan.tile_size = tile_size;
+    }
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_save_wisdom(char const* filename)
+{
+    // NOLINTNEXTLINE: we're not using GSL, so no gsl::owner
+    auto* stream = std::fopen(filename, "w");
+    if (stream == nullptr) { return LS_COULD_NOT_OPEN_FILE; }
+    auto& wisdom = get_wisdom();
+    auto  ok     = std::fputs(wisdom_header, stream) >= 0;
+    {
+        std::lock_guard<std::mutex> lock{wisdom.mutex};
+        for (auto const& [key, plan] : wisdom.plans) {
+            ok = ok
+                 && std::fprintf(stream, "%016" PRIx64 " %" PRIu64 " %i %" PRIu64 "\n", key,
+                                 plan.chunk_size, static_cast<int>(plan.use_jit), plan.tile_size)
+                        > 0;
+        }
+    }
+    auto const closed = std::fclose(stream);
+    return ok && closed == 0 ? LS_SUCCESS : LS_FILE_IO_FAILED;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_load_wisdom(char const* filename)
+{
+    // NOLINTNEXTLINE: we're not using GSL, so no gsl::owner
+    auto* stream = std::fopen(filename, "r");
+    if (stream == nullptr) { return LS_COULD_NOT_OPEN_FILE; }
+    std::array<char, 64> header; // NOLINT: initialized by fgets
+    auto ok = std::fgets(header.data(), static_cast<int>(header.size()), stream) != nullptr
+              && std::strcmp(header.data(), wisdom_header) == 0;
+    std::vector<std::pair<uint64_t, operator_plan_t>> plans;
+    auto                                              valid = true;
+    while (ok) {
+        uint64_t key;        // NOLINT: initialized by fscanf
+        uint64_t chunk_size; // NOLINT: initialized by fscanf
+        int      use_jit;    // NOLINT: initialized by fscanf
+        uint64_t tile_size;  // NOLINT: initialized by fscanf
+        auto const count = std::fscanf(stream, "%" SCNx64 " %" SCNu64 " %i %" SCNu64, &key,
+                                       &chunk_size, &use_jit, &tile_size);
+        if (count == EOF) { break; }
+        ok = count == 4;
+        if (!ok) { break; }
+        auto const plan = operator_plan_t{chunk_size, use_jit != 0, tile_size};
+        // Negative numbers wrap around when parsed, so they are rejected here as well
+        valid = (use_jit == 0 || use_jit == 1) && is_candidate(plan);
+        if (!valid) { break; }
+        plans.emplace_back(key, plan);
+    }
+    std::fclose(stream);
+    if (!ok) { return LS_FILE_IO_FAILED; }
+    if (!valid) { return LS_INVALID_ARGUMENT; }
+    auto& wisdom = get_wisdom();
+    std::lock_guard<std::mutex> lock{wisdom.mutex};
+    for (auto const& [key, plan] : plans) {
+        wisdom.plans[key] = plan;
+    }
+    return LS_SUCCESS;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_forget_wisdom()
+{
+    auto& wisdom = get_wisdom();
+    std::lock_guard<std::mutex> lock{wisdom.mutex};
+    wisdom.plans.clear();
+}
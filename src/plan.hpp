@@ -0,0 +1,72 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <cstdint>
+
+namespace lattice_symmetries {
+
+/// Describes how ls_operator_matmat and ls_operator_expectation are executed. Plans are chosen by
+/// ls_operator_plan by timing the candidates.
+struct operator_plan_t {
+    /// Number of consecutive rows processed by an OpenMP thread at a time. 0 means that a
+    /// heuristic based on the number of rows and threads is used.
+    uint64_t chunk_size = 0;
+    /// Whether to use the runtime generated kernel (only has effect if ls_operator_enable_jit has
+    /// been called).
+    bool use_jit = true;
+    /// Number of rows per tile in tiled mode, 0 disables tiling. In tiled mode all matrix elements
+    /// of a tile of rows are first collected, sorted by column index, and only then multiplied
+    /// by `x`. This turns random accesses to `x` into (almost) sequential ones which pays off when
+    /// `x` is much larger than the last level cache. chunk_size is ignored in tiled mode.
+    uint64_t tile_size = 0;
+};
+
+/// Plan chosen by ls_operator_plan for one element type and number of columns.
+struct keyed_plan_t {
+    ls_datatype     dtype;
+    uint64_t        block_size;
+    operator_plan_t plan;
+};
+
+/// Returns the plan for applying `op` to `block_size` vectors of type `dtype`: the one chosen by
+/// ls_operator_plan for exactly this shape if there is one, and `op.plan` otherwise.
+auto get_plan(ls_operator const& op, ls_datatype dtype, uint64_t block_size) noexcept
+    -> operator_plan_t const&;
+
+/// Returns the OpenMP chunk size to use for a loop over `number_rows` rows.
+auto get_chunk_size(operator_plan_t const& plan, uint64_t number_rows) noexcept -> uint64_t;
+
+/// Number of bytes used per matrix element in tiled mode: column index, row and coefficient, and
+/// the same again as scratch space for sorting.
+inline constexpr uint64_t tile_bytes_per_element =
+    2U * (2U * sizeof(uint64_t) + 2U * sizeof(double));
+
+} // namespace lattice_symmetries
@@ -0,0 +1,172 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cache.hpp"
+#include "operator.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// Calls `fn(j)` for every off-diagonal matrix element ⟨j|op|i⟩. Indices refer to the current
+    /// order of the basis.
+    template <class Function>
+    auto for_each_neighbour(ls_operator const& op, basis_cache_t const& cache, uint64_t const i,
+                            Function fn) noexcept -> ls_error_code
+    {
+        return apply_helper(op, cache.states()[i],
+                            [&cache, &fn, i](ls_bits64 const spin,
+                                             std::complex<double> const&) noexcept {
+                                uint64_t   j; // NOLINT: j is initialized by index
+                                auto const status = cache.index(spin, &j);
+                                if (LATTICE_SYMMETRIES_LIKELY(status == LS_SUCCESS) && j != i) {
+                                    fn(j);
+                                }
+                                return status;
+                            });
+    }
+
+    auto compute_degrees(ls_operator const& op, basis_cache_t const& cache)
+        -> outcome::result<std::vector<uint64_t>>
+    {
+        auto const size       = cache.number_states();
+        auto       degrees    = std::vector<uint64_t>(size);
+        auto const chunk_size = get_chunk_size(op.plan, size);
+        auto       status     = LS_SUCCESS;
+#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
+    firstprivate(size, chunk_size) shared(op, cache, degrees, status)
+        for (auto i = uint64_t{0}; i < size; ++i) {
+            ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            local_status = status;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+            auto degree  = uint64_t{0};
+            local_status = for_each_neighbour(op, cache, i, [&degree](uint64_t) { ++degree; });
+            degrees[i]   = degree;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+            }
+        }
+        if (status != LS_SUCCESS) { return status; }
+        return outcome::success(std::move(degrees));
+    }
+
+    /// Computes the Reverse Cuthill-McKee ordering of the graph in which basis states are vertices
+    /// and non-zero off-diagonal matrix elements of `op` are edges. Returns the new position of
+    /// every state (relative to the current order of the basis).
+    auto reverse_cuthill_mckee(ls_operator const& op, basis_cache_t const& cache)
+        -> outcome::result<std::vector<uint64_t>>
+    {
+        auto const size = cache.number_states();
+        OUTCOME_TRY(degrees, compute_degrees(op, cache));
+        auto const by_degree = [&degrees = degrees](uint64_t const a, uint64_t const b) {
+            return degrees[a] < degrees[b];
+        };
+
+        // Every connected component is started from one of its vertices with minimal degree
+        auto starts = std::vector<uint64_t>(size);
+        std::iota(std::begin(starts), std::end(starts), uint64_t{0});
+        std::stable_sort(std::begin(starts), std::end(starts), by_degree);
+
+        auto order      = std::vector<uint64_t>{};
+        auto visited    = std::vector<bool>(size, false);
+        auto neighbours = std::vector<uint64_t>{};
+        order.reserve(size);
+        for (auto const start : starts) {
+            if (visited[start]) { continue; }
+            visited[start] = true;
+            order.push_back(start);
+            // Breadth-first search visiting neighbours in the order of increasing degree
+            for (auto head = order.size() - 1; head < order.size(); ++head) {
+                neighbours.clear();
+                auto const status =
+                    for_each_neighbour(op, cache, order[head], [&visited, &neighbours](uint64_t j) {
+                        if (!visited[j]) {
+                            visited[j] = true;
+                            neighbours.push_back(j);
+                        }
+                    });
+                if (status != LS_SUCCESS) { return status; }
+                std::stable_sort(std::begin(neighbours), std::end(neighbours), by_degree);
+                order.insert(std::end(order), std::begin(neighbours), std::end(neighbours));
+            }
+        }
+        LATTICE_SYMMETRIES_CHECK(order.size() == size, "not all states visited");
+
+        auto positions = std::vector<uint64_t>(size);
+        for (auto i = uint64_t{0}; i < size; ++i) {
+            positions[order[i]] = size - 1 - i;
+        }
+        return outcome::success(std::move(positions));
+    }
+
+    auto reorder_basis_helper(ls_spin_basis& basis, ls_operator const& op)
+        -> outcome::result<void>
+    {
+        // The graph is only defined for operators which map the basis onto itself
+        if (op.basis.get() != &basis || op.input_basis != nullptr) { return LS_INVALID_ARGUMENT; }
+        auto* payload = std::get_if<small_basis_t>(&basis.payload);
+        if (payload == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        if (payload->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+        auto& cache = *payload->cache;
+        OUTCOME_TRY(positions, reverse_cuthill_mckee(op, cache));
+        // positions are relative to the current order, so we compose them with the previous
+        // permutation if there is one
+        auto       permutation = std::vector<uint64_t>(cache.number_states());
+        auto const old         = cache.permutation();
+        for (auto i = uint64_t{0}; i < permutation.size(); ++i) {
+            permutation[i] = positions[old.empty() ? i : old[i]];
+        }
+        auto const status = cache.set_permutation(std::move(permutation));
+        LATTICE_SYMMETRIES_CHECK(status == LS_SUCCESS, "invalid permutation");
+        return LS_SUCCESS;
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_reorder_basis(ls_spin_basis*     basis,
+                                                                    ls_operator const* op)
+{
+    auto r = reorder_basis_helper(*basis, *op);
+    return to_error_code(r);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_reset_basis_order(ls_spin_basis* basis)
+{
+    auto* payload = std::get_if<small_basis_t>(&basis->payload);
+    if (payload == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    if (payload->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+    return payload->cache->set_permutation({});
+}
@@ -0,0 +1,282 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "basis.hpp"
+#include "linalg.hpp"
+#include "operator.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+namespace lattice_symmetries {
+
+namespace {
+    /// A unit of work for #run_concurrently
+    struct task_t {
+        double   weight; ///< Estimate of the amount of work used for thread allotments
+        uint64_t memory; ///< Estimate of the peak memory usage in bytes
+    };
+
+    /// Runs `fn(i)` for every task on a shared pool of `number_threads` threads.
+    ///
+    /// Tasks are started in the order of decreasing weight. A task is started as soon as a thread
+    /// is free and its memory estimate fits into the remaining `memory_budget` (a task which does
+    /// not fit is run once nothing else is running). When started, task `i` is allotted a share
+    /// of the free threads proportional to its weight relative to the total weight of all
+    /// unfinished tasks. The allotment becomes the size of nested OpenMP teams created by `fn`.
+    template <class Fn>
+    auto run_concurrently(std::vector<task_t> const& tasks, unsigned const number_threads,
+                          uint64_t const memory_budget, Fn fn) -> void
+    {
+        constexpr auto none  = ~uint64_t{0};
+        auto const     count = tasks.size();
+        auto           order = std::vector<uint64_t>(count);
+        std::iota(std::begin(order), std::end(order), uint64_t{0});
+        std::stable_sort(std::begin(order), std::end(order), [&tasks](auto const a, auto const b) {
+            return tasks[a].weight > tasks[b].weight;
+        });
+
+        std::mutex              mutex;
+        std::condition_variable finished;
+        auto                    started      = std::vector<bool>(count, false);
+        auto                    number_left  = count;
+        auto                    running      = 0U;
+        auto                    free_threads = number_threads;
+        auto                    free_memory  = memory_budget;
+        auto                    unfinished   = std::accumulate(
+            std::begin(tasks), std::end(tasks), 0.0,
+            [](double const acc, task_t const& t) { return acc + t.weight; });
+        // Returns the first task which can be started now or `none`
+        auto const pick = [&]() {
+            if (free_threads == 0) { return none; }
+            for (auto const i : order) {
+                if (!started[i] && (tasks[i].memory <= free_memory || running == 0)) { return i; }
+            }
+            return none;
+        };
+
+        auto const previous_levels = omp_get_max_active_levels();
+        omp_set_max_active_levels(std::max(previous_levels, 2));
+#pragma omp parallel num_threads(number_threads) default(none)                                    \
+    firstprivate(number_threads, memory_budget, none)                                              \
+        shared(tasks, fn, mutex, finished, started, number_left, running, free_threads,            \
+               free_memory, unfinished, pick)
+        for (;;) {
+            auto i         = none;
+            auto allotment = 1U;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                finished.wait(lock, [&]() {
+                    if (number_left == 0) { return true; }
+                    i = pick();
+                    return i != none;
+                });
+                if (i == none) { break; }
+                auto const share = unfinished > 0.0 ? static_cast<double>(number_threads)
+                                                          * tasks[i].weight / unfinished
+                                                    : 1.0;
+                allotment = std::clamp(static_cast<unsigned>(std::round(share)), 1U, free_threads);
+                started[i] = true;
+                --number_left;
+                ++running;
+                free_threads -= allotment;
+                free_memory -= std::min(free_memory, tasks[i].memory);
+            }
+            omp_set_num_threads(static_cast<int>(allotment));
+            fn(i);
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                --running;
+                free_threads += allotment;
+                free_memory = std::min(memory_budget, free_memory + tasks[i].memory);
+                unfinished -= tasks[i].weight;
+            }
+            finished.notify_all();
+        }
+        omp_set_max_active_levels(previous_levels);
+    }
+
+    /// Estimate of the number of states in `basis` which does not require building it
+    auto estimate_number_states(ls_spin_basis const& basis) noexcept -> double
+    {
+        auto const n      = static_cast<double>(basis.header.number_spins);
+        auto       states = std::pow(2.0, n);
+        if (basis.header.hamming_weight.has_value()) {
+            auto const k = static_cast<double>(*basis.header.hamming_weight);
+            states       = std::exp(std::lgamma(n + 1.0) - std::lgamma(k + 1.0)
+                                    - std::lgamma(n - k + 1.0));
+        }
+        auto group_size = 1.0;
+        if (auto const* p = std::get_if<small_basis_t>(&basis.payload); p != nullptr) {
+            group_size = static_cast<double>(p->batched_symmetries.size()
+                                                  * batched_small_symmetry_t::batch_size
+                                              + p->number_other_symmetries);
+        }
+        if (basis.header.spin_inversion != 0) { group_size *= 2.0; }
+        return states / std::max(group_size, 1.0);
+    }
+
+    constexpr auto element_size(ls_datatype const dtype) noexcept -> uint64_t
+    {
+        return dtype == LS_COMPLEX128 ? sizeof(std::complex<double>) : sizeof(double);
+    }
+
+    auto job_task(ls_sector_job const& job, uint64_t const n) noexcept -> task_t
+    {
+        auto const size = static_cast<double>(n);
+        auto const bytes = element_size(job.dtype);
+        switch (job.kind) {
+        case LS_JOB_SPECTRUM:
+            // Identity, H and the Jacobi workspace
+            return {size * size * size, 3 * n * n * bytes};
+        case LS_JOB_LANCZOS: {
+            auto options = ls_lanczos_options{};
+            ls_lanczos_default_options(&options);
+            if (job.lanczos_options != nullptr) { options = *job.lanczos_options; }
+            return {size, (options.krylov_dimension + options.number_eigenvalues + 4) * n * bytes};
+        }
+        case LS_JOB_KPM_DOS:
+            return {size * static_cast<double>(job.number_moments * job.number_vectors),
+                    (3 * job.block_size + 2) * n * bytes};
+        default: return {0.0, 0};
+        }
+    }
+
+    auto run_job(ls_sector_job& job, uint64_t const n) -> ls_error_code
+    {
+        auto const& op = *job.op;
+        switch (job.kind) {
+        case LS_JOB_BUILD: return LS_SUCCESS;
+        case LS_JOB_SPECTRUM: {
+            if (job.values == nullptr && n != 0) { return LS_INVALID_ARGUMENT; }
+            auto eigenvalues = std::vector<double>{};
+            auto status      = LS_SUCCESS;
+            switch (job.dtype) {
+            case LS_FLOAT64:
+                if (!op.is_real) { return LS_OPERATOR_IS_COMPLEX; }
+                status = dense_spectrum<double>(op, n, eigenvalues);
+                break;
+            case LS_COMPLEX128:
+                status = dense_spectrum<std::complex<double>>(op, n, eigenvalues);
+                break;
+            default: return LS_INVALID_DATATYPE;
+            }
+            std::copy(std::begin(eigenvalues), std::end(eigenvalues), job.values);
+            return status;
+        }
+        case LS_JOB_LANCZOS:
+            return ls_operator_lanczos(&op, job.dtype, n, job.lanczos_options, nullptr, job.values,
+                                       job.vectors, n, job.lanczos_info);
+        case LS_JOB_KPM_DOS:
+            if (!(job.lower < job.upper)) {
+                auto const status =
+                    ls_operator_spectral_bounds(&op, job.dtype, n, &job.lower, &job.upper);
+                if (status != LS_SUCCESS) { return status; }
+            }
+            return ls_operator_kpm_dos(&op, job.dtype, n, job.lower, job.upper, job.number_moments,
+                                       job.number_vectors, job.block_size, job.seed, job.values);
+        default: return LS_INVALID_ARGUMENT;
+        }
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void
+ls_scheduler_default_options(ls_scheduler_options* options)
+{
+    options->number_threads = 0;
+    options->memory_budget  = 0;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_run_sector_jobs(uint64_t const number_jobs, ls_sector_job jobs[],
+                   ls_scheduler_options const* options)
+{
+    auto defaults = ls_scheduler_options{};
+    if (options == nullptr) {
+        ls_scheduler_default_options(&defaults);
+        options = &defaults;
+    }
+    auto const number_threads = options->number_threads != 0
+                                    ? options->number_threads
+                                    : static_cast<unsigned>(omp_get_max_threads());
+    auto const memory_budget =
+        options->memory_budget != 0 ? options->memory_budget : ~uint64_t{0};
+    for (auto i = uint64_t{0}; i < number_jobs; ++i) {
+        if (jobs[i].op == nullptr || jobs[i].op->input_basis != nullptr) {
+            return LS_INVALID_ARGUMENT;
+        }
+    }
+
+    // Build all distinct bases first. Until they are built, their dimensions are estimated
+    auto bases = std::vector<ls_spin_basis*>{};
+    for (auto i = uint64_t{0}; i < number_jobs; ++i) {
+        auto* basis = jobs[i].op->basis.get();
+        auto  n     = uint64_t{0};
+        if (ls_get_number_states(basis, &n) == LS_CACHE_NOT_BUILT
+            && std::find(std::begin(bases), std::end(bases), basis) == std::end(bases)) {
+            bases.push_back(basis);
+        }
+    }
+    auto build_status = std::vector<ls_error_code>(bases.size(), LS_SUCCESS);
+    {
+        auto tasks = std::vector<task_t>{};
+        for (auto const* basis : bases) {
+            auto const states = estimate_number_states(*basis);
+            tasks.push_back({states, static_cast<uint64_t>(states) * sizeof(uint64_t)});
+        }
+        run_concurrently(tasks, number_threads, memory_budget, [&bases, &build_status](auto i) {
+            build_status[i] = ls_build(bases[i]);
+        });
+    }
+
+    auto dimensions = std::vector<uint64_t>(number_jobs);
+    auto tasks      = std::vector<task_t>(number_jobs);
+    for (auto i = uint64_t{0}; i < number_jobs; ++i) {
+        jobs[i].status = ls_get_number_states(jobs[i].op->basis.get(), &dimensions[i]);
+        if (jobs[i].status == LS_SUCCESS) { tasks[i] = job_task(jobs[i], dimensions[i]); }
+    }
+    run_concurrently(tasks, number_threads, memory_budget, [jobs, &dimensions](auto i) {
+        if (jobs[i].status == LS_SUCCESS) { jobs[i].status = run_job(jobs[i], dimensions[i]); }
+    });
+
+    for (auto const status : build_status) {
+        if (status != LS_SUCCESS) { return status; }
+    }
+    for (auto i = uint64_t{0}; i < number_jobs; ++i) {
+        if (jobs[i].status != LS_SUCCESS) { return jobs[i].status; }
+    }
+    return LS_SUCCESS;
+}
@@ -0,0 +1,161 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cache.hpp"
+#include "operator.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+struct ls_sparse_vector {
+    std::vector<uint64_t>             indices;
+    std::vector<std::complex<double>> values;
+};
+
+namespace lattice_symmetries {
+
+namespace {
+    auto apply_sparse_helper(ls_operator const& op, uint64_t const count, uint64_t const* indices,
+                             std::complex<double> const* values) noexcept
+        -> outcome::result<std::unique_ptr<ls_sparse_vector>>
+    {
+        auto const* input  = std::get_if<small_basis_t>(&input_basis_of(op).payload);
+        auto const* output = std::get_if<small_basis_t>(&op.basis->payload);
+        if (input == nullptr || output == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        if (input->cache == nullptr || output->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+        auto const states = input->cache->states();
+        auto const* cache = output->cache.get();
+        if (!std::all_of(indices, indices + count,
+                         [size = states.size()](auto const i) { return i < size; })) {
+            return LS_INVALID_ARGUMENT;
+        }
+        // Terms of op are Hermitian conjugated (see ls_operator::ls_operator), so applying them
+        // to |i⟩ gives ⟨j|O†|i⟩. For push-style generation we need ⟨j|O|i⟩ instead, so we undo
+        // the conjugation. The roles of input and output bases are swapped accordingly.
+        auto original_terms = std::vector<ls_interaction const*>(op.terms.size());
+        std::transform(std::begin(op.terms), std::end(op.terms), std::begin(original_terms),
+                       [](auto const& term) { return &term; });
+        auto original = ls_operator{&input_basis_of(op), original_terms};
+        if (op.input_basis != nullptr) {
+            original.input_basis = ls_operator::basis_ptr_t{ls_copy_spin_basis(op.basis.get())};
+        }
+
+        // Matrix elements are pushed into per-thread hash tables which are merged afterwards. The
+        // number of non-zeros in the result is usually small compared to the basis size, so this
+        // is much cheaper than a dense output vector.
+        using table_t         = std::unordered_map<uint64_t, std::complex<double>>;
+        auto       tables     = std::vector<table_t>(static_cast<unsigned>(omp_get_max_threads()));
+        auto       status     = LS_SUCCESS;
+        auto const chunk_size = get_chunk_size(op.plan, count);
+#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
+    firstprivate(count, indices, values, states, cache, chunk_size)                                \
+        shared(original, tables, status)
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            local_status = status;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+            auto& table = tables[static_cast<unsigned>(omp_get_thread_num())];
+            local_status =
+                apply_helper(original, states[indices[i]],
+                             [&table, cache, value = values[i]](
+                                 ls_bits64 const spin, std::complex<double> const& coeff) noexcept {
+                                 uint64_t   j; // NOLINT: j is initialized by index
+                                 auto const _status = cache->index(spin, &j);
+                                 if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
+                                     table[j] += coeff * value;
+                                 }
+                                 return _status;
+                             });
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+            }
+        }
+        if (status != LS_SUCCESS) { return status; }
+
+        auto elements = std::vector<std::pair<uint64_t, std::complex<double>>>{};
+        for (auto const& table : tables) {
+            elements.insert(std::end(elements), std::begin(table), std::end(table));
+        }
+        std::sort(std::begin(elements), std::end(elements),
+                  [](auto const& a, auto const& b) { return a.first < b.first; });
+        auto result = std::make_unique<ls_sparse_vector>();
+        for (auto first = std::begin(elements); first != std::end(elements);) {
+            auto const index = first->first;
+            auto       value = std::complex<double>{0.0, 0.0};
+            for (; first != std::end(elements) && first->first == index; ++first) {
+                value += first->second;
+            }
+            if (value != 0.0) {
+                result->indices.push_back(index);
+                result->values.push_back(value);
+            }
+        }
+        return result;
+    }
+} // namespace
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_operator_apply_sparse(ls_operator const* op, uint64_t const count, uint64_t const indices[],
+                         void const* values, ls_sparse_vector** out)
+{
+    auto r = apply_sparse_helper(*op, count, indices,
+                                 static_cast<std::complex<double> const*>(values));
+    if (!r) { return to_error_code(r.error()); }
+    *out = std::move(r).value().release();
+    return LS_SUCCESS;
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_destroy_sparse_vector(ls_sparse_vector* vector)
+{
+    std::default_delete<ls_sparse_vector>{}(vector);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t
+ls_sparse_vector_get_size(ls_sparse_vector const* vector)
+{
+    return vector->indices.size();
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t const*
+ls_sparse_vector_get_indices(ls_sparse_vector const* vector)
+{
+    return vector->indices.data();
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT void const*
+ls_sparse_vector_get_values(ls_sparse_vector const* vector)
+{
+    return vector->values.data();
+}
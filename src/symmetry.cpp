@@ -89,6 +89,22 @@ auto is_real(big_symmetry_t const& symmetry) noexcept -> bool
     return symmetry.eigenvalue.imag() == 0.0;
 }
 
+auto site_permutations(batched_small_symmetry_t const& batch, unsigned const count,
+                       unsigned const number_spins) -> std::vector<std::vector<unsigned>>
+{
+    constexpr auto batch_size = batched_small_symmetry_t::batch_size;
+    auto permutations         = std::vector<std::vector<unsigned>>(count);
+    for (auto i = 0U; i < number_spins; ++i) {
+        std::array<uint64_t, batch_size> bits; // NOLINT: initialized by fill
+        bits.fill(uint64_t{1} << i);
+        batch.network(bits.data());
+        for (auto k = 0U; k < count; ++k) {
+            permutations[k].push_back(static_cast<unsigned>(__builtin_ctzl(bits[k])));
+        }
+    }
+    return permutations;
+}
+
 } // namespace lattice_symmetries
 
 extern "C" {
@@ -33,6 +33,7 @@
 #include <array>
 #include <complex>
 #include <variant>
+#include <vector>
 
 namespace lattice_symmetries {
 
@@ -79,6 +80,11 @@ auto is_real(small_symmetry_t const&) noexcept -> bool;
 auto is_real(batched_small_symmetry_t const&) noexcept -> bool;
 auto is_real(big_symmetry_t const&) noexcept -> bool;
 
+/// Recovers the site permutations performed by the first `count` symmetries in `batch` by pushing
+/// single bits through the Benes network.
+auto site_permutations(batched_small_symmetry_t const& batch, unsigned count,
+                       unsigned number_spins) -> std::vector<std::vector<unsigned>>;
+
 } // namespace lattice_symmetries
 
 struct ls_symmetry {
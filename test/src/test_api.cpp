@@ -1,10 +1,14 @@
 #include "bits.hpp"
 #include "cpu/search_sorted.hpp"
-#include "lattice_symmetries/lattice_symmetries.h"
+#include "lattice_symmetries/lattice_symmetries.hpp"
+#include <dirent.h>
+#include <unistd.h>
 #include <bitset>
 #include <catch2/catch.hpp>
 #include <complex>
 #include <cstdio>
+#include <cstdlib>
+#include <string>
 #include <iostream>
 #include <memory>
 #include <numeric>
@@ -450,3 +454,2074 @@ TEST_CASE("constructs interactions", "[api]")
         ls_destroy_interaction(interaction);
     }
 }
+
+namespace {
+auto make_heisenberg_chain(unsigned const number_spins, int const hamming_weight,
+                           int const spin_inversion, unsigned const momentum,
+                           bool const build = true)
+{
+    std::vector<unsigned> T(number_spins);
+    for (auto i = 0U; i < number_spins; ++i) {
+        T[i] = (i + 1U) % number_spins;
+    }
+    auto const group = make_group({make_symmetry(T.size(), T.data(), momentum)});
+    auto       basis = make_spin_basis(group.get(), number_spins, hamming_weight, spin_inversion);
+    if (build) { REQUIRE(ls_build(basis.get()) == LS_SUCCESS); }
+
+    std::complex<double> const matrix[4][4] = {{1.0, 0.0, 0.0, 0.0},
+                                               {0.0, -1.0, 2.0, 0.0},
+                                               {0.0, 2.0, -1.0, 0.0},
+                                               {0.0, 0.0, 0.0, 1.0}};
+    std::vector<std::array<uint16_t, 2>> edges(number_spins);
+    for (auto i = 0U; i < number_spins; ++i) {
+        edges[i] = {static_cast<uint16_t>(i), static_cast<uint16_t>((i + 1U) % number_spins)};
+    }
+    ls_interaction* interaction = nullptr;
+    REQUIRE(ls_create_interaction2(&interaction, &(matrix[0][0]), edges.size(),
+                                   reinterpret_cast<uint16_t const(*)[2]>(edges.data()))
+            == LS_SUCCESS);
+    ls_operator*          op      = nullptr;
+    ls_interaction const* terms[] = {interaction};
+    REQUIRE(ls_create_operator(&op, basis.get(), std::size(terms), terms) == LS_SUCCESS);
+    ls_destroy_interaction(interaction);
+    return std::make_pair(std::move(basis),
+                          std::unique_ptr<ls_operator, void (*)(ls_operator*)>{
+                              op, &ls_destroy_operator});
+}
+} // namespace
+
+TEST_CASE("computes diagonal matrix elements", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(10, 5, 0, 0);
+    auto const states      = get_states(basis.get());
+    auto const count       = ls_states_get_size(states.get());
+    auto const spins       = ls_states_get_data(states.get());
+
+    std::vector<std::complex<double>> expected(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        ls_bits512 x;
+        lattice_symmetries::set_zero(x);
+        x.words[0] = spins[i];
+        struct cxt_t {
+            ls_bits512           x;
+            std::complex<double> diagonal;
+        } cxt{x, 0.0};
+        auto const status = ls_operator_apply(
+            op.get(), &x,
+            [](ls_bits512 const* y, void const* c, void* raw) {
+                auto* _cxt = static_cast<cxt_t*>(raw);
+                if (*y == _cxt->x) {
+                    _cxt->diagonal += *static_cast<std::complex<double> const*>(c);
+                }
+                return LS_SUCCESS;
+            },
+            &cxt);
+        REQUIRE(status == LS_SUCCESS);
+        expected[i] = cxt.diagonal;
+    }
+
+    std::vector<std::complex<double>> predicted(count);
+    REQUIRE(ls_operator_batched_diagonal(op.get(), count, spins, 1, predicted.data(), 1)
+            == LS_SUCCESS);
+    REQUIRE(predicted == expected);
+
+    std::vector<ls_bits512> wide(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        wide[i] = lattice_symmetries::widen(spins[i]);
+    }
+    std::fill(std::begin(predicted), std::end(predicted), 0.0);
+    REQUIRE(ls_operator_batched_diagonal(op.get(), count, &wide[0].words[0], 8, predicted.data(),
+                                         1)
+            == LS_SUCCESS);
+    REQUIRE(predicted == expected);
+
+    SECTION("complex diagonal")
+    {
+        // O = Σᵢ diag(1, 2ⅈ)ᵢ, i.e. ⟨σ|O|σ⟩ = Σᵢ (σᵢ ? 2ⅈ : 1)
+        auto const group     = make_group({});
+        auto const full      = make_spin_basis(group.get(), 4, -1, 0);
+        REQUIRE(ls_build(full.get()) == LS_SUCCESS);
+        std::complex<double> const matrix[2][2] = {{1.0, 0.0}, {0.0, {0.0, 2.0}}};
+        uint16_t const             sites[4]     = {0, 1, 2, 3};
+        ls_interaction*            interaction  = nullptr;
+        REQUIRE(ls_create_interaction1(&interaction, &(matrix[0][0]), std::size(sites), sites)
+                == LS_SUCCESS);
+        ls_interaction const* terms[] = {interaction};
+        ls_operator*          complex_op = nullptr;
+        REQUIRE(ls_create_operator(&complex_op, full.get(), 1, terms) == LS_SUCCESS);
+        ls_destroy_interaction(interaction);
+
+        auto const full_states = get_states(full.get());
+        auto const n           = ls_states_get_size(full_states.get());
+        std::vector<std::complex<double>> identity(n * n);
+        for (auto i = uint64_t{0}; i < n; ++i) {
+            identity[i * n + i] = 1.0;
+        }
+        std::vector<std::complex<double>> dense(n * n);
+        REQUIRE(ls_operator_matmat(complex_op, LS_COMPLEX128, n, n, identity.data(), n,
+                                   dense.data(), n)
+                == LS_SUCCESS);
+        std::vector<std::complex<double>> diagonal(n);
+        REQUIRE(ls_operator_batched_diagonal(complex_op, n, ls_states_get_data(full_states.get()),
+                                             1, diagonal.data(), 1)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < n; ++i) {
+            auto const s        = ls_states_get_data(full_states.get())[i];
+            auto const up       = static_cast<double>(lattice_symmetries::popcount(s));
+            auto const expected = std::complex<double>{4.0 - up, 2.0 * up};
+            REQUIRE(dense[i * n + i] == expected);
+            REQUIRE(diagonal[i] == expected);
+        }
+        ls_destroy_operator(complex_op);
+    }
+}
+
+TEST_CASE("applies operator to 64-bit spin configurations", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    auto const states      = get_states(basis.get());
+    auto const count       = ls_states_get_size(states.get());
+    auto const spins       = ls_states_get_data(states.get());
+
+    using element_t = std::pair<uint64_t, std::complex<double>>;
+    std::vector<std::complex<double>> x(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        x[i] = std::complex<double>{std::cos(0.1 * i), std::sin(0.3 * i)};
+    }
+    std::vector<std::complex<double>> expected(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        std::vector<element_t> wide_elements;
+        ls_bits512             spin = lattice_symmetries::widen(spins[i]);
+        REQUIRE(ls_operator_apply(
+                    op.get(), &spin,
+                    [](ls_bits512 const* y, void const* c, void* raw) {
+                        static_cast<std::vector<element_t>*>(raw)->emplace_back(
+                            y->words[0], *static_cast<std::complex<double> const*>(c));
+                        return LS_SUCCESS;
+                    },
+                    &wide_elements)
+                == LS_SUCCESS);
+        std::vector<element_t> elements;
+        REQUIRE(ls_operator_apply_64(
+                    op.get(), spins[i],
+                    [](ls_bits64 const y, void const* c, void* raw) {
+                        static_cast<std::vector<element_t>*>(raw)->emplace_back(
+                            y, *static_cast<std::complex<double> const*>(c));
+                        return LS_SUCCESS;
+                    },
+                    &elements)
+                == LS_SUCCESS);
+        REQUIRE(elements == wide_elements);
+
+        for (auto const& [y, c] : elements) {
+            uint64_t index;
+            REQUIRE(ls_get_index(basis.get(), y, &index) == LS_SUCCESS);
+            expected[i] += std::conj(c) * x[index];
+        }
+    }
+
+    std::vector<std::complex<double>> predicted(count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                               predicted.data(), count)
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        REQUIRE(std::abs(predicted[i] - expected[i]) < 1e-12);
+    }
+}
+
+TEST_CASE("applies operator in chunks", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    auto const states      = get_states(basis.get());
+    auto const count       = ls_states_get_size(states.get());
+    std::vector<ls_bits512> spins(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        spins[i] = lattice_symmetries::widen(ls_states_get_data(states.get())[i]);
+    }
+
+    using element_t = std::pair<uint64_t, std::complex<double>>;
+    std::vector<std::vector<element_t>> expected(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        REQUIRE(ls_operator_apply(
+                    op.get(), &spins[i],
+                    [](ls_bits512 const* y, void const* c, void* raw) {
+                        static_cast<std::vector<element_t>*>(raw)->emplace_back(
+                            y->words[0], *static_cast<std::complex<double> const*>(c));
+                        return LS_SUCCESS;
+                    },
+                    &expected[i])
+                == LS_SUCCESS);
+    }
+
+    for (auto const chunk_size : {1U, 7U, 10000U}) {
+        struct cxt_t {
+            uint64_t                            next;
+            std::vector<std::vector<element_t>> elements;
+        } cxt{0, std::vector<std::vector<element_t>>(count)};
+        auto const status = ls_operator_apply_chunked(
+            op.get(), count, spins.data(), chunk_size,
+            [](uint64_t first, uint64_t number_inputs, uint64_t const* offsets,
+               ls_bits512 const* ys, void const* cs, void* raw) {
+                auto& _cxt = *static_cast<cxt_t*>(raw);
+                if (first != _cxt.next || offsets[0] != 0) { return LS_INVALID_ARGUMENT; }
+                auto const* coeffs = static_cast<std::complex<double> const*>(cs);
+                for (auto i = uint64_t{0}; i < number_inputs; ++i) {
+                    for (auto j = offsets[i]; j < offsets[i + 1]; ++j) {
+                        _cxt.elements[first + i].emplace_back(ys[j].words[0], coeffs[j]);
+                    }
+                }
+                _cxt.next = first + number_inputs;
+                return LS_SUCCESS;
+            },
+            &cxt);
+        REQUIRE(status == LS_SUCCESS);
+        REQUIRE(cxt.next == count);
+        REQUIRE(cxt.elements == expected);
+    }
+}
+
+TEST_CASE("applies operator using the C++ interface", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    auto const states      = get_states(basis.get());
+    auto const count       = ls_states_get_size(states.get());
+    auto const spins       = ls_states_get_data(states.get());
+    auto const view        = lattice_symmetries::operator_view_t{op.get()};
+    REQUIRE(view.basis() == basis.get());
+    REQUIRE(view.terms().size() == 1);
+    REQUIRE(view.terms()[0].number_spins == 2);
+    REQUIRE(view.terms()[0].number_sites == 10);
+
+    using element_t = std::pair<uint64_t, std::complex<double>>;
+    std::vector<std::vector<element_t>> batched(count);
+    REQUIRE(lattice_symmetries::batched_apply(
+                view, count, spins,
+                [&batched](uint64_t const i, ls_bits64 const y, std::complex<double> const& c) {
+                    batched[i].emplace_back(y, c);
+                    return LS_SUCCESS;
+                })
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        std::vector<element_t> expected;
+        REQUIRE(ls_operator_apply_64(
+                    op.get(), spins[i],
+                    [](ls_bits64 const y, void const* c, void* raw) {
+                        static_cast<std::vector<element_t>*>(raw)->emplace_back(
+                            y, *static_cast<std::complex<double> const*>(c));
+                        return LS_SUCCESS;
+                    },
+                    &expected)
+                == LS_SUCCESS);
+        REQUIRE(batched[i] == expected);
+
+        std::vector<element_t> wide;
+        auto const store = [&wide](ls_bits512 const& y, std::complex<double> const& c) {
+            wide.emplace_back(y.words[0], c);
+            return LS_SUCCESS;
+        };
+        REQUIRE(lattice_symmetries::apply(view, lattice_symmetries::widen(spins[i]), store)
+                == LS_SUCCESS);
+        REQUIRE(wide == expected);
+    }
+
+    SECTION("exposes conjugated matrices")
+    {
+        auto const group = make_group({});
+        auto const full  = make_spin_basis(group.get(), 2, -1, 0);
+        std::complex<double> const matrix[2][2] = {{1.0, {0.0, 2.0}}, {3.0, {4.0, -1.0}}};
+        uint16_t const             sites[2]     = {0, 1};
+        ls_interaction*            interaction  = nullptr;
+        REQUIRE(ls_create_interaction1(&interaction, &(matrix[0][0]), std::size(sites), sites)
+                == LS_SUCCESS);
+        ls_interaction const* terms[] = {interaction};
+        ls_operator*          other   = nullptr;
+        REQUIRE(ls_create_operator(&other, full.get(), 1, terms) == LS_SUCCESS);
+        ls_destroy_interaction(interaction);
+        ls_term_view term;
+        ls_operator_get_term(other, 0, &term);
+        REQUIRE(term.number_spins == 1);
+        REQUIRE(term.number_sites == 2);
+        for (auto k = 0U; k < 2U; ++k) {
+            for (auto m = 0U; m < 2U; ++m) {
+                REQUIRE(term.matrix[k * 2U + m] == std::conj(matrix[k][m]));
+            }
+        }
+        ls_destroy_operator(other);
+    }
+}
+
+TEST_CASE("applies operator to batches of spin configurations", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    auto const states      = get_states(basis.get());
+    auto const count       = ls_states_get_size(states.get());
+    std::vector<ls_bits512> spins(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        spins[i] = lattice_symmetries::widen(ls_states_get_data(states.get())[i]);
+    }
+    // 0101010101 is invariant under T², but T² has a non-trivial character for momentum 1, so the
+    // state has zero norm and must produce nothing
+    spins.insert(spins.begin() + 3, lattice_symmetries::widen(uint64_t{0b0101010101}));
+
+    using element_t = std::pair<uint64_t, std::complex<double>>;
+    std::vector<element_t> expected;
+    std::vector<uint64_t>  expected_counts;
+    for (auto const& x : spins) {
+        auto const size   = expected.size();
+        auto const status = ls_operator_apply(
+            op.get(), &x,
+            [](ls_bits512 const* y, void const* c, void* raw) {
+                static_cast<std::vector<element_t>*>(raw)->emplace_back(
+                    y->words[0], *static_cast<std::complex<double> const*>(c));
+                return LS_SUCCESS;
+            },
+            &expected);
+        REQUIRE((status == LS_SUCCESS || status == LS_INVALID_STATE));
+        expected_counts.push_back(expected.size() - size);
+    }
+    REQUIRE(expected_counts[3] == 0);
+
+    auto const max_size = ls_operator_max_buffer_size(op.get());
+    std::vector<ls_bits512>           out_spins(spins.size() * max_size);
+    std::vector<std::complex<double>> out_coeffs(spins.size() * max_size);
+    std::vector<uint64_t>             out_counts(spins.size());
+    auto const written =
+        ls_batched_operator_apply(op.get(), spins.size(), spins.data(), out_spins.data(),
+                                  out_coeffs.data(), out_counts.data());
+    REQUIRE(written == expected.size());
+    REQUIRE(out_counts == expected_counts);
+    for (auto i = uint64_t{0}; i < written; ++i) {
+        REQUIRE(out_spins[i].words[0] == expected[i].first);
+        REQUIRE(out_coeffs[i] == expected[i].second);
+    }
+}
+
+TEST_CASE("applies operator using generated code", "[api]")
+{
+    auto [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    uint64_t count;
+    REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+    std::vector<std::complex<double>> x(2 * count);
+    for (auto i = uint64_t{0}; i < x.size(); ++i) {
+        x[i] = std::complex<double>{std::cos(0.1 * i), std::sin(0.3 * i)};
+    }
+    std::vector<std::complex<double>> expected(2 * count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 2, x.data(), count,
+                               expected.data(), count)
+            == LS_SUCCESS);
+
+    // Compile into a temporary cache directory rather than the user's one
+    char cache_dir[] = "test_jit_cache_XXXXXX";
+    REQUIRE(mkdtemp(cache_dir) != nullptr);
+    REQUIRE(setenv("LATTICE_SYMMETRIES_JIT_CACHE", cache_dir, 1) == 0);
+    REQUIRE(!ls_operator_has_jit(op.get()));
+    auto const status = ls_operator_enable_jit(op.get());
+    unsetenv("LATTICE_SYMMETRIES_JIT_CACHE");
+    if (auto* dir = opendir(cache_dir); dir != nullptr) {
+        for (auto const* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+            std::remove((std::string{cache_dir} + "/" + entry->d_name).c_str());
+        }
+        closedir(dir);
+    }
+    REQUIRE(rmdir(cache_dir) == 0);
+    // No C++ compiler available at runtime, nothing to test
+    if (status == LS_COMPILATION_FAILED) { return; }
+    REQUIRE(status == LS_SUCCESS);
+    REQUIRE(ls_operator_has_jit(op.get()));
+
+    std::vector<std::complex<double>> predicted(2 * count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 2, x.data(), count,
+                               predicted.data(), count)
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < predicted.size(); ++i) {
+        REQUIRE(std::abs(predicted[i] - expected[i]) < 1e-12);
+    }
+}
+
+TEST_CASE("plans operator application", "[api]")
+{
+    auto [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    uint64_t count;
+    REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+    std::vector<std::complex<double>> x(count);
+    for (auto i = uint64_t{0}; i < x.size(); ++i) {
+        x[i] = std::complex<double>{std::cos(0.1 * i), std::sin(0.3 * i)};
+    }
+    std::vector<std::complex<double>> expected(count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                               expected.data(), count)
+            == LS_SUCCESS);
+
+    REQUIRE(ls_operator_plan(op.get(), LS_COMPLEX128, 0, 0) == LS_INVALID_ARGUMENT);
+    REQUIRE(ls_operator_plan(op.get(), LS_COMPLEX128, 1, 0) == LS_SUCCESS);
+    std::vector<std::complex<double>> predicted(count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                               predicted.data(), count)
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        REQUIRE(std::abs(predicted[i] - expected[i]) < 1e-12);
+    }
+
+    // Plans for other shapes do not replace the one above. Budgets which do not fit all timing
+    // buffers (or not even a single vector) are respected
+    REQUIRE(ls_operator_plan(op.get(), LS_COMPLEX128, 4, 3 * count * sizeof(x[0])) == LS_SUCCESS);
+    REQUIRE(ls_operator_plan(op.get(), LS_COMPLEX64, 1, 1) == LS_SUCCESS);
+    std::vector<std::complex<double>> block(4 * count);
+    for (auto j = uint64_t{0}; j < 4; ++j) {
+        std::copy(std::begin(x), std::end(x), std::begin(block) + j * count);
+    }
+    std::vector<std::complex<double>> predicted_block(4 * count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 4, block.data(), count,
+                               predicted_block.data(), count)
+            == LS_SUCCESS);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                               predicted.data(), count)
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        REQUIRE(std::abs(predicted[i] - expected[i]) < 1e-12);
+        for (auto j = uint64_t{0}; j < 4; ++j) {
+            REQUIRE(std::abs(predicted_block[i + j * count] - expected[i]) < 1e-12);
+        }
+    }
+
+    auto const filename = "test_plans_operator_application.wisdom";
+    REQUIRE(ls_save_wisdom(filename) == LS_SUCCESS);
+    ls_forget_wisdom();
+    REQUIRE(ls_load_wisdom(filename) == LS_SUCCESS);
+    REQUIRE(ls_operator_plan(op.get(), LS_COMPLEX128, 1, 0) == LS_SUCCESS);
+    REQUIRE(ls_load_wisdom("non_existent.wisdom") == LS_COULD_NOT_OPEN_FILE);
+    // Values which the planner never chooses are rejected
+    for (auto const* line : {"0123456789abcdef 7 0 0\n", "0123456789abcdef 0 0 -1\n",
+                             "0123456789abcdef 0 2 256\n"}) {
+        auto* stream = std::fopen(filename, "w");
+        REQUIRE(stream != nullptr);
+        std::fputs("# lattice_symmetries wisdom v2\n", stream);
+        std::fputs(line, stream);
+        std::fclose(stream);
+        REQUIRE(ls_load_wisdom(filename) == LS_INVALID_ARGUMENT);
+    }
+    std::remove(filename);
+}
+
+TEST_CASE("applies operator in tiles", "[api]")
+{
+    auto [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    uint64_t count;
+    REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+    constexpr auto                    block_size = uint64_t{2};
+    std::vector<std::complex<double>> x(count * block_size);
+    for (auto i = uint64_t{0}; i < x.size(); ++i) {
+        x[i] = std::complex<double>{std::cos(0.1 * i), std::sin(0.3 * i)};
+    }
+    std::vector<std::complex<double>> expected(count * block_size);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, block_size, x.data(), count,
+                               expected.data(), count)
+            == LS_SUCCESS);
+
+    for (auto const tile_size : {uint64_t{1}, uint64_t{7}, uint64_t{256}, count + 1}) {
+        ls_operator_set_tile_size(op.get(), tile_size);
+        std::vector<std::complex<double>> predicted(count * block_size);
+        REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, block_size, x.data(), count,
+                                   predicted.data(), count)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < predicted.size(); ++i) {
+            REQUIRE(std::abs(predicted[i] - expected[i]) < 1e-12);
+        }
+    }
+    ls_operator_set_tile_size(op.get(), 0);
+}
+
+TEST_CASE("reorders basis", "[api]")
+{
+    auto [basis, op]       = make_heisenberg_chain(12, 6, 0, 0);
+    auto const original    = get_states(basis.get());
+    auto const count       = ls_states_get_size(original.get());
+    auto const* old_states = ls_states_get_data(original.get());
+    std::vector<uint64_t> sorted{old_states, old_states + count};
+
+    // Vector elements are functions of spin configurations, so they don't depend on the order
+    auto const make_x = [count](uint64_t const* spins) {
+        std::vector<double> x(count);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            x[i] = std::cos(0.1 * static_cast<double>(spins[i]));
+        }
+        return x;
+    };
+    auto const x = make_x(sorted.data());
+    std::vector<double> expected(count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_FLOAT64, count, 1, x.data(), count, expected.data(),
+                               count)
+            == LS_SUCCESS);
+
+    {
+        // The operator has to be defined on the basis which is reordered
+        auto const [other_basis, other] = make_heisenberg_chain(12, 6, 0, 0);
+        REQUIRE(ls_reorder_basis(basis.get(), other.get()) == LS_INVALID_ARGUMENT);
+    }
+    REQUIRE(ls_reorder_basis(basis.get(), op.get()) == LS_SUCCESS);
+    auto const reordered = get_states(basis.get());
+    auto const* states   = ls_states_get_data(reordered.get());
+    REQUIRE(ls_states_get_size(reordered.get()) == count);
+    REQUIRE(!std::equal(states, states + count, sorted.data()));
+    REQUIRE(std::is_permutation(states, states + count, sorted.data()));
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        uint64_t index;
+        REQUIRE(ls_get_index(basis.get(), states[i], &index) == LS_SUCCESS);
+        REQUIRE(index == i);
+    }
+
+    auto const          y = make_x(states);
+    std::vector<double> predicted(count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_FLOAT64, count, 1, y.data(), count, predicted.data(),
+                               count)
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        auto const j = static_cast<uint64_t>(
+            std::lower_bound(std::begin(sorted), std::end(sorted), states[i]) - std::begin(sorted));
+        REQUIRE(std::abs(predicted[i] - expected[j]) < 1e-12);
+    }
+
+    auto const filename = "test_reorders_basis.cache";
+    REQUIRE(ls_save_cache(basis.get(), filename) == LS_SUCCESS);
+    {
+        std::vector<unsigned> T(12);
+        for (auto i = 0U; i < T.size(); ++i) {
+            T[i] = (i + 1U) % T.size();
+        }
+        auto const group  = make_group({make_symmetry(T.size(), T.data(), 0)});
+        auto const loaded = make_spin_basis(group.get(), 12, 6, 0);
+        REQUIRE(ls_load_cache(loaded.get(), filename) == LS_SUCCESS);
+        auto const loaded_states = get_states(loaded.get());
+        REQUIRE(ls_states_get_size(loaded_states.get()) == count);
+        REQUIRE(std::equal(states, states + count, ls_states_get_data(loaded_states.get())));
+    }
+    std::remove(filename);
+
+    REQUIRE(ls_reset_basis_order(basis.get()) == LS_SUCCESS);
+    auto const restored = get_states(basis.get());
+    REQUIRE(std::equal(sorted.data(), sorted.data() + count, ls_states_get_data(restored.get())));
+}
+
+TEST_CASE("applies operator to sparse vectors", "[api]")
+{
+    auto [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    uint64_t count;
+    REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+    std::vector<std::complex<double>> x(count);
+    std::vector<uint64_t>             indices;
+    std::vector<std::complex<double>> values;
+    for (auto i = uint64_t{0}; i < count; i += 5) {
+        x[i] = std::complex<double>{std::cos(0.1 * i), std::sin(0.3 * i)};
+        indices.push_back(i);
+        values.push_back(x[i]);
+    }
+    std::vector<std::complex<double>> expected(count);
+    REQUIRE(ls_operator_matmat(op.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                               expected.data(), count)
+            == LS_SUCCESS);
+
+    ls_sparse_vector* y = nullptr;
+    REQUIRE(ls_operator_apply_sparse(op.get(), indices.size(), indices.data(), values.data(), &y)
+            == LS_SUCCESS);
+    auto const  size      = ls_sparse_vector_get_size(y);
+    auto const* y_indices = ls_sparse_vector_get_indices(y);
+    auto const* y_values =
+        static_cast<std::complex<double> const*>(ls_sparse_vector_get_values(y));
+    REQUIRE(std::is_sorted(y_indices, y_indices + size));
+    std::vector<std::complex<double>> predicted(count);
+    for (auto i = uint64_t{0}; i < size; ++i) {
+        predicted[y_indices[i]] = y_values[i];
+    }
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        REQUIRE(std::abs(predicted[i] - expected[i]) < 1e-12);
+    }
+    ls_destroy_sparse_vector(y);
+
+    auto const invalid = count;
+    REQUIRE(ls_operator_apply_sparse(op.get(), 1, &invalid, values.data(), &y)
+            == LS_INVALID_ARGUMENT);
+
+    std::vector<uint64_t> const       rows = {count - 1, 0, count / 2, 0};
+    std::vector<std::complex<double>> selected(rows.size() * 2);
+    std::vector<std::complex<double>> block(count * 2);
+    std::copy(std::begin(x), std::end(x), std::begin(block));
+    std::copy(std::begin(x), std::end(x), std::begin(block) + static_cast<int64_t>(count));
+    REQUIRE(ls_operator_matmat_rows(op.get(), LS_COMPLEX128, count, 2, block.data(), count,
+                                    rows.size(), rows.data(), selected.data(), rows.size())
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < rows.size(); ++i) {
+        REQUIRE(std::abs(selected[i] - expected[rows[i]]) < 1e-12);
+        REQUIRE(std::abs(selected[i + rows.size()] - expected[rows[i]]) < 1e-12);
+    }
+    REQUIRE(ls_operator_matmat_rows(op.get(), LS_COMPLEX128, count, 1, x.data(), count, 1,
+                                    &invalid, selected.data(), 1)
+            == LS_INVALID_ARGUMENT);
+
+    // Non-Hermitian operator
+    {
+        auto const group = make_group({});
+        auto const basis = make_spin_basis(group.get(), 6, 3, 0);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+        std::complex<double> const matrix[4][4] = {{0.0, 0.0, 0.0, 0.0},
+                                                   {0.0, 0.0, {1.0, 2.0}, 0.0},
+                                                   {0.0, 0.0, 0.0, 0.0},
+                                                   {0.0, 0.0, 0.0, 0.0}};
+        uint16_t const       edges[][2]   = {{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}};
+        ls_interaction*      interaction  = nullptr;
+        REQUIRE(ls_create_interaction2(&interaction, &(matrix[0][0]), std::size(edges), edges)
+                == LS_SUCCESS);
+        ls_operator*          hopping = nullptr;
+        ls_interaction const* terms[] = {interaction};
+        REQUIRE(ls_create_operator(&hopping, basis.get(), 1, terms) == LS_SUCCESS);
+        ls_destroy_interaction(interaction);
+
+        uint64_t dim;
+        REQUIRE(ls_get_number_states(basis.get(), &dim) == LS_SUCCESS);
+        for (auto k = uint64_t{0}; k < dim; ++k) {
+            auto const                        one = std::complex<double>{1.0, 0.0};
+            std::vector<std::complex<double>> e_k(dim);
+            std::vector<std::complex<double>> column(dim);
+            e_k[k] = one;
+            REQUIRE(ls_operator_matmat(hopping, LS_COMPLEX128, dim, 1, e_k.data(), dim,
+                                       column.data(), dim)
+                    == LS_SUCCESS);
+            REQUIRE(ls_operator_apply_sparse(hopping, 1, &k, &one, &y) == LS_SUCCESS);
+            std::vector<std::complex<double>> sparse_column(dim);
+            auto const* column_values =
+                static_cast<std::complex<double> const*>(ls_sparse_vector_get_values(y));
+            for (auto i = uint64_t{0}; i < ls_sparse_vector_get_size(y); ++i) {
+                sparse_column[ls_sparse_vector_get_indices(y)[i]] = column_values[i];
+            }
+            ls_destroy_sparse_vector(y);
+            for (auto i = uint64_t{0}; i < dim; ++i) {
+                REQUIRE(std::abs(sparse_column[i] - column[i]) < 1e-12);
+            }
+        }
+        ls_destroy_operator(hopping);
+    }
+}
+
+TEST_CASE("applies sector-changing operators", "[api]")
+{
+    auto const group  = make_group({});
+    auto const input  = make_spin_basis(group.get(), 6, 2, 0);
+    auto const output = make_spin_basis(group.get(), 6, 3, 0);
+    REQUIRE(ls_build(input.get()) == LS_SUCCESS);
+    REQUIRE(ls_build(output.get()) == LS_SUCCESS);
+
+    // c · Σᵢ σ⁺ᵢ
+    auto const           c            = std::complex<double>{1.0, 2.0};
+    std::complex<double> matrix[2][2] = {{0.0, 0.0}, {c, 0.0}};
+    uint16_t const       sites[]      = {0, 1, 2, 3, 4, 5};
+    ls_interaction*      interaction  = nullptr;
+    REQUIRE(ls_create_interaction1(&interaction, &(matrix[0][0]), std::size(sites), sites)
+            == LS_SUCCESS);
+    ls_interaction const* terms[] = {interaction};
+    ls_operator*          op      = nullptr;
+    REQUIRE(ls_create_sector_operator(&op, input.get(), output.get(), 1, terms) == LS_SUCCESS);
+    REQUIRE(ls_operator_get_basis(op) == output.get());
+    REQUIRE(ls_operator_get_input_basis(op) == input.get());
+
+    uint64_t input_count, output_count;
+    REQUIRE(ls_get_number_states(input.get(), &input_count) == LS_SUCCESS);
+    REQUIRE(ls_get_number_states(output.get(), &output_count) == LS_SUCCESS);
+    std::vector<std::complex<double>> x(input_count);
+    for (auto i = uint64_t{0}; i < input_count; ++i) {
+        x[i] = std::complex<double>{std::cos(0.7 * i), std::sin(0.2 * i)};
+    }
+    std::vector<std::complex<double>> y(output_count);
+    REQUIRE(ls_operator_matmat(op, LS_COMPLEX128, input_count, 1, x.data(), input_count, y.data(),
+                               output_count)
+            == LS_SUCCESS);
+
+    auto const states = get_states(output.get());
+    auto const data   = ls_states_get_data(states.get());
+    for (auto j = uint64_t{0}; j < output_count; ++j) {
+        auto expected = std::complex<double>{0.0, 0.0};
+        for (auto i = 0U; i < 6U; ++i) {
+            if (((data[j] >> i) & 1U) == 0U) { continue; }
+            uint64_t index;
+            REQUIRE(ls_get_index(input.get(), data[j] ^ (uint64_t{1} << i), &index) == LS_SUCCESS);
+            expected += c * x[index];
+        }
+        REQUIRE(std::abs(y[j] - expected) < 1e-12);
+    }
+
+    std::vector<uint64_t> indices(input_count);
+    std::iota(std::begin(indices), std::end(indices), uint64_t{0});
+    ls_sparse_vector* sparse = nullptr;
+    REQUIRE(ls_operator_apply_sparse(op, input_count, indices.data(), x.data(), &sparse)
+            == LS_SUCCESS);
+    REQUIRE(ls_sparse_vector_get_size(sparse) == output_count);
+    auto const* values =
+        static_cast<std::complex<double> const*>(ls_sparse_vector_get_values(sparse));
+    for (auto j = uint64_t{0}; j < output_count; ++j) {
+        REQUIRE(ls_sparse_vector_get_indices(sparse)[j] == j);
+        REQUIRE(std::abs(values[j] - y[j]) < 1e-12);
+    }
+    ls_destroy_sparse_vector(sparse);
+
+    uint64_t const       row = output_count - 1;
+    std::complex<double> selected;
+    REQUIRE(ls_operator_matmat_rows(op, LS_COMPLEX128, input_count, 1, x.data(), input_count, 1,
+                                    &row, &selected, 1)
+            == LS_SUCCESS);
+    REQUIRE(std::abs(selected - y[row]) < 1e-12);
+
+    std::complex<double> energy;
+    REQUIRE(ls_operator_expectation(op, LS_COMPLEX128, input_count, 1, x.data(), input_count,
+                                    &energy)
+            == LS_INVALID_ARGUMENT);
+    REQUIRE(ls_operator_matmat(op, LS_COMPLEX128, output_count, 1, y.data(), output_count,
+                               y.data(), output_count)
+            == LS_DIMENSION_MISMATCH);
+
+    ls_destroy_operator(op);
+    ls_destroy_interaction(interaction);
+
+    // Sᶻ(q) = Σⱼ exp(iqj) nⱼ maps momentum k onto k + q
+    {
+        constexpr auto number_spins = 6U;
+        constexpr auto pi           = 3.14159265358979323846;
+        unsigned const translation[number_spins] = {1, 2, 3, 4, 5, 0};
+        auto const     full                      = make_spin_basis(group.get(), number_spins, 3, 0);
+        REQUIRE(ls_build(full.get()) == LS_SUCCESS);
+        uint64_t full_count;
+        REQUIRE(ls_get_number_states(full.get(), &full_count) == LS_SUCCESS);
+        auto const full_states = get_states(full.get());
+        auto const full_data   = ls_states_get_data(full_states.get());
+
+        for (auto const [k, m] : {std::pair{0U, 1U}, std::pair{1U, 2U}, std::pair{5U, 3U}}) {
+            auto const q = 2.0 * pi * m / number_spins;
+            std::vector<ls_interaction*>       interactions;
+            std::vector<ls_interaction const*> sz_q;
+            for (uint16_t j = 0; j < number_spins; ++j) {
+                std::complex<double> const n_j[2][2] = {{0.0, 0.0}, {0.0, std::polar(1.0, q * j)}};
+                ls_interaction*            term      = nullptr;
+                REQUIRE(ls_create_interaction1(&term, &(n_j[0][0]), 1, &j) == LS_SUCCESS);
+                interactions.push_back(term);
+                sz_q.push_back(term);
+            }
+            auto const in_group  = make_group({make_symmetry(number_spins, translation, k)});
+            auto const out_group = make_group(
+                {make_symmetry(number_spins, translation, (k + m) % number_spins)});
+            auto const in_basis  = make_spin_basis(in_group.get(), number_spins, 3, 0);
+            auto const out_basis = make_spin_basis(out_group.get(), number_spins, 3, 0);
+            REQUIRE(ls_build(in_basis.get()) == LS_SUCCESS);
+            REQUIRE(ls_build(out_basis.get()) == LS_SUCCESS);
+            REQUIRE(ls_create_sector_operator(&op, in_basis.get(), out_basis.get(),
+                                              number_spins, sz_q.data())
+                    == LS_SUCCESS);
+
+            uint64_t in_count, out_count;
+            REQUIRE(ls_get_number_states(in_basis.get(), &in_count) == LS_SUCCESS);
+            REQUIRE(ls_get_number_states(out_basis.get(), &out_count) == LS_SUCCESS);
+            std::vector<std::complex<double>> v(in_count);
+            for (auto i = uint64_t{0}; i < in_count; ++i) {
+                v[i] = std::complex<double>{std::cos(0.3 * i), std::sin(0.5 * i + k)};
+            }
+            std::vector<std::complex<double>> w(out_count);
+            REQUIRE(ls_operator_matmat(op, LS_COMPLEX128, in_count, 1, v.data(), in_count,
+                                       w.data(), out_count)
+                    == LS_SUCCESS);
+
+            // Compare with Sᶻ(q) applied in the basis without translations
+            std::vector<std::complex<double>> psi(full_count);
+            std::vector<std::complex<double>> phi(full_count);
+            REQUIRE(ls_unpack_vector(in_basis.get(), full.get(), LS_COMPLEX128, in_count, 1,
+                                     v.data(), in_count, psi.data(), full_count)
+                    == LS_SUCCESS);
+            REQUIRE(ls_unpack_vector(out_basis.get(), full.get(), LS_COMPLEX128, out_count, 1,
+                                     w.data(), out_count, phi.data(), full_count)
+                    == LS_SUCCESS);
+            auto norm = 0.0;
+            for (auto i = uint64_t{0}; i < full_count; ++i) {
+                auto eigenvalue = std::complex<double>{0.0, 0.0};
+                for (auto j = 0U; j < number_spins; ++j) {
+                    if (((full_data[i] >> j) & 1U) != 0U) { eigenvalue += std::polar(1.0, q * j); }
+                }
+                REQUIRE(std::abs(phi[i] - eigenvalue * psi[i]) < 1e-12);
+                norm += std::norm(phi[i]);
+            }
+            REQUIRE(norm > 1e-6);
+
+            ls_destroy_operator(op);
+            for (auto* term : interactions) {
+                ls_destroy_interaction(term);
+            }
+        }
+    }
+}
+
+TEST_CASE("computes spin correlations", "[api]")
+{
+    std::complex<double> const heisenberg[4][4] = {
+        {1.0, 0.0, 0.0, 0.0}, {0.0, -1.0, 2.0, 0.0}, {0.0, 2.0, -1.0, 0.0}, {0.0, 0.0, 0.0, 1.0}};
+    std::complex<double> const zz[4][4] = {
+        {1.0, 0.0, 0.0, 0.0}, {0.0, -1.0, 0.0, 0.0}, {0.0, 0.0, -1.0, 0.0}, {0.0, 0.0, 0.0, 1.0}};
+    // Computes ⟨x|scale·Σ_{(i, j) ∈ edges} Oᵢⱼ|x⟩ using ls_operator_expectation
+    auto const expectation = [](ls_spin_basis const* basis, std::complex<double> const(&m)[4][4],
+                                std::vector<std::array<uint16_t, 2>> const& edges,
+                                double const scale, std::vector<std::complex<double>> const& x) {
+        std::complex<double> matrix[4][4];
+        for (auto a = 0U; a < 4U; ++a) {
+            for (auto b = 0U; b < 4U; ++b) {
+                matrix[a][b] = scale * m[a][b];
+            }
+        }
+        ls_interaction* interaction = nullptr;
+        REQUIRE(ls_create_interaction2(&interaction, &(matrix[0][0]), edges.size(),
+                                       reinterpret_cast<uint16_t const(*)[2]>(edges.data()))
+                == LS_SUCCESS);
+        ls_operator*          op      = nullptr;
+        ls_interaction const* terms[] = {interaction};
+        REQUIRE(ls_create_operator(&op, basis, 1, terms) == LS_SUCCESS);
+        ls_destroy_interaction(interaction);
+        std::complex<double> r;
+        REQUIRE(ls_operator_expectation(op, LS_COMPLEX128, x.size(), 1, x.data(), x.size(), &r)
+                == LS_SUCCESS);
+        ls_destroy_operator(op);
+        return r.real();
+    };
+    auto const make_vector = [](ls_spin_basis const* basis) {
+        uint64_t count;
+        REQUIRE(ls_get_number_states(basis, &count) == LS_SUCCESS);
+        std::vector<std::complex<double>> x(count);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            x[i] = std::complex<double>{std::cos(0.3 * i), std::sin(1.1 * i)};
+        }
+        return x;
+    };
+
+    SECTION("without symmetries")
+    {
+        auto const group = make_group({});
+        auto const basis = make_spin_basis(group.get(), 8, 4, 0);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+        auto const x = make_vector(basis.get());
+        auto const n = 8U;
+        std::vector<double> correlations(n * n);
+        for (auto const kind : {LS_CORRELATOR_ZZ, LS_CORRELATOR_HEISENBERG}) {
+            auto const& matrix = kind == LS_CORRELATOR_ZZ ? zz : heisenberg;
+            REQUIRE(ls_spin_correlations(basis.get(), kind, LS_COMPLEX128, x.size(), x.data(),
+                                         correlations.data(), 0, nullptr, nullptr)
+                    == LS_SUCCESS);
+            auto const norm = std::real(std::inner_product(
+                std::begin(x), std::end(x), std::begin(x), std::complex<double>{0.0, 0.0},
+                std::plus<>{}, [](auto const& a, auto const& b) { return std::conj(a) * b; }));
+            for (auto i = 0U; i < n; ++i) {
+                REQUIRE(correlations[i * n + i]
+                        == Approx((kind == LS_CORRELATOR_ZZ ? 1.0 : 3.0) * norm));
+                for (auto j = 0U; j < n; ++j) {
+                    if (i == j) { continue; }
+                    auto const expected =
+                        expectation(basis.get(), matrix,
+                                    {{static_cast<uint16_t>(i), static_cast<uint16_t>(j)}}, 1.0, x);
+                    REQUIRE(correlations[i * n + j] == Approx(expected).margin(1e-10));
+                }
+            }
+        }
+        REQUIRE(ls_spin_correlations(basis.get(), LS_CORRELATOR_ZZ, LS_COMPLEX128, x.size() - 1,
+                                     x.data(), correlations.data(), 0, nullptr, nullptr)
+                == LS_DIMENSION_MISMATCH);
+    }
+
+    SECTION("with translations")
+    {
+        auto const n = 10U;
+        for (auto const momentum : {0U, 2U}) {
+            auto const [basis, op] = make_heisenberg_chain(n, 5, 0, momentum);
+            auto const          x  = make_vector(basis.get());
+            std::vector<double> correlations(n * n);
+            std::vector<double> phases(n * n);
+            for (auto k = 0U; k < n; ++k) {
+                for (auto i = 0U; i < n; ++i) {
+                    phases[k * n + i] = 2.0 * M_PI * k * i / n;
+                }
+            }
+            std::vector<double> structure_factor(n);
+            REQUIRE(ls_spin_correlations(basis.get(), LS_CORRELATOR_HEISENBERG, LS_COMPLEX128,
+                                         x.size(), x.data(), correlations.data(), n,
+                                         phases.data(), structure_factor.data())
+                    == LS_SUCCESS);
+            for (auto d = 1U; d < n; ++d) {
+                std::vector<std::array<uint16_t, 2>> edges(n);
+                for (auto i = 0U; i < n; ++i) {
+                    edges[i] = {static_cast<uint16_t>(i), static_cast<uint16_t>((i + d) % n)};
+                }
+                auto const expected = expectation(basis.get(), heisenberg, edges, 1.0 / n, x);
+                for (auto i = 0U; i < n; ++i) {
+                    REQUIRE(correlations[i * n + (i + d) % n] == Approx(expected).margin(1e-10));
+                }
+            }
+            for (auto k = 0U; k < n; ++k) {
+                auto expected = 0.0;
+                for (auto i = 0U; i < n; ++i) {
+                    for (auto j = 0U; j < n; ++j) {
+                        expected += std::cos(2.0 * M_PI * k * (static_cast<double>(i) - j) / n)
+                                    * correlations[i * n + j];
+                    }
+                }
+                REQUIRE(structure_factor[k] == Approx(expected / n).margin(1e-10));
+            }
+        }
+    }
+}
+
+TEST_CASE("computes reduced density matrices", "[api]")
+{
+    auto const n          = 10U;
+    auto const [basis, _] = make_heisenberg_chain(n, 5, 0, 2);
+    uint64_t count;
+    REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+    std::vector<std::complex<double>> x(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        x[i] = std::complex<double>{std::cos(0.3 * i), std::sin(1.1 * i)};
+    }
+
+    // Expand x into the full basis: ψ(s) = x[index(r)]·‖r‖·χ̄
+    auto const group = make_group({});
+    auto const full  = make_spin_basis(group.get(), n, 5, 0);
+    REQUIRE(ls_build(full.get()) == LS_SUCCESS);
+    auto const states     = get_states(full.get());
+    auto const full_count = ls_states_get_size(states.get());
+    auto const spins      = ls_states_get_data(states.get());
+    std::vector<std::complex<double>> psi(full_count);
+    auto const expand = [&](std::vector<std::complex<double>> const& v) {
+        std::vector<std::complex<double>> r(full_count);
+        for (auto i = uint64_t{0}; i < full_count; ++i) {
+            uint64_t             repr;
+            std::complex<double> character;
+            double               norm;
+            ls_get_state_info_64(basis.get(), spins[i], &repr, &character, &norm);
+            if (norm == 0.0) { continue; }
+            uint64_t index;
+            REQUIRE(ls_get_index(basis.get(), repr, &index) == LS_SUCCESS);
+            r[i] = v[index] * norm * std::conj(character);
+        }
+        return r;
+    };
+    psi = expand(x);
+
+    // Sanity check of the expansion using a complex translationally invariant operator
+    {
+        auto const                 i            = std::complex<double>{0.0, 1.0};
+        std::complex<double> const matrix[4][4] = {
+            {1.0, 0.0, 0.0, 0.0}, {0.0, -1.0, i, 0.0}, {0.0, -i, -1.0, 0.0}, {0.0, 0.0, 0.0, 1.0}};
+        std::vector<std::array<uint16_t, 2>> edges(n);
+        for (auto k = 0U; k < n; ++k) {
+            edges[k] = {static_cast<uint16_t>(k), static_cast<uint16_t>((k + 1U) % n)};
+        }
+        ls_interaction* interaction = nullptr;
+        REQUIRE(ls_create_interaction2(&interaction, &(matrix[0][0]), edges.size(),
+                                       reinterpret_cast<uint16_t const(*)[2]>(edges.data()))
+                == LS_SUCCESS);
+        ls_interaction const* terms[] = {interaction};
+        ls_operator*          op      = nullptr;
+        ls_operator*          full_op = nullptr;
+        REQUIRE(ls_create_operator(&op, basis.get(), 1, terms) == LS_SUCCESS);
+        REQUIRE(ls_create_operator(&full_op, full.get(), 1, terms) == LS_SUCCESS);
+        ls_destroy_interaction(interaction);
+        std::vector<std::complex<double>> y(count);
+        std::vector<std::complex<double>> full_y(full_count);
+        REQUIRE(ls_operator_matmat(op, LS_COMPLEX128, count, 1, x.data(), count, y.data(), count)
+                == LS_SUCCESS);
+        REQUIRE(ls_operator_matmat(full_op, LS_COMPLEX128, full_count, 1, psi.data(), full_count,
+                                   full_y.data(), full_count)
+                == LS_SUCCESS);
+        auto const expanded_y = expand(y);
+        for (auto k = uint64_t{0}; k < full_count; ++k) {
+            REQUIRE(std::abs(expanded_y[k] - full_y[k]) < 1e-10);
+        }
+        ls_destroy_operator(op);
+        ls_destroy_operator(full_op);
+    }
+
+    // Sites {0, 1, 2, 5}
+    auto const mask      = uint64_t{0b100111};
+    auto const dimension = uint64_t{16};
+    std::vector<std::complex<double>> expected(dimension * dimension);
+    {
+        std::vector<std::complex<double>> amplitudes(dimension << (n - 4U));
+        for (auto k = uint64_t{0}; k < full_count; ++k) {
+            auto a = uint64_t{0};
+            auto b = uint64_t{0};
+            for (auto site = 0U, i = 0U, j = 0U; site < n; ++site) {
+                auto const bit = (spins[k] >> site) & 1U;
+                if (((mask >> site) & 1U) != 0U) { a |= bit << i++; }
+                else {
+                    b |= bit << j++;
+                }
+            }
+            amplitudes[a * (1U << (n - 4U)) + b] = psi[k];
+        }
+        for (auto a = uint64_t{0}; a < dimension; ++a) {
+            for (auto c = uint64_t{0}; c < dimension; ++c) {
+                for (auto b = uint64_t{0}; b < (1U << (n - 4U)); ++b) {
+                    expected[a * dimension + c] += amplitudes[a * (1U << (n - 4U)) + b]
+                                                   * std::conj(amplitudes[c * (1U << (n - 4U)) + b]);
+                }
+            }
+        }
+    }
+    std::vector<std::complex<double>> rho(dimension * dimension);
+    REQUIRE(ls_reduced_density_matrix(basis.get(), LS_COMPLEX128, count, x.data(), mask,
+                                      rho.data())
+            == LS_SUCCESS);
+    for (auto k = uint64_t{0}; k < rho.size(); ++k) {
+        REQUIRE(std::abs(rho[k] - expected[k]) < 1e-10);
+    }
+    auto trace = 0.0;
+    for (auto a = uint64_t{0}; a < dimension; ++a) {
+        trace += rho[a * dimension + a].real();
+    }
+    auto const norm = std::real(std::inner_product(
+        std::begin(x), std::end(x), std::begin(x), std::complex<double>{0.0, 0.0}, std::plus<>{},
+        [](auto const& a, auto const& b) { return std::conj(a) * b; }));
+    REQUIRE(trace == Approx(norm));
+
+    // Rényi entropies via Tr ρⁿ
+    for (auto const order : {2U, 3U}) {
+        auto power = rho;
+        for (auto p = 1U; p < order; ++p) {
+            std::vector<std::complex<double>> next(dimension * dimension);
+            for (auto a = uint64_t{0}; a < dimension; ++a) {
+                for (auto b = uint64_t{0}; b < dimension; ++b) {
+                    for (auto c = uint64_t{0}; c < dimension; ++c) {
+                        next[a * dimension + b] += power[a * dimension + c] * rho[c * dimension + b];
+                    }
+                }
+            }
+            power = std::move(next);
+        }
+        auto moment = 0.0;
+        for (auto a = uint64_t{0}; a < dimension; ++a) {
+            moment += power[a * dimension + a].real();
+        }
+        moment /= std::pow(trace, order);
+        double entropy;
+        REQUIRE(ls_entanglement_entropy(dimension, rho.data(), order, &entropy) == LS_SUCCESS);
+        REQUIRE(entropy == Approx(std::log(moment) / (1.0 - order)));
+    }
+    double entropy;
+    REQUIRE(ls_entanglement_entropy(dimension, rho.data(), 1.0, &entropy) == LS_SUCCESS);
+    REQUIRE(entropy > 0.0);
+    REQUIRE(entropy < std::log(static_cast<double>(dimension)));
+
+    // Pure state with a complex off-diagonal element and the maximally mixed state
+    std::complex<double> const pure[2][2] = {{{0.5, 0.0}, {0.0, 0.5}}, {{0.0, -0.5}, {0.5, 0.0}}};
+    REQUIRE(ls_entanglement_entropy(2, &(pure[0][0]), 1.0, &entropy) == LS_SUCCESS);
+    REQUIRE(entropy == Approx(0.0).margin(1e-12));
+    std::vector<std::complex<double>> mixed(16);
+    for (auto a = 0U; a < 4U; ++a) {
+        mixed[a * 4U + a] = 1.0;
+    }
+    REQUIRE(ls_entanglement_entropy(4, mixed.data(), 1.0, &entropy) == LS_SUCCESS);
+    REQUIRE(entropy == Approx(std::log(4.0)));
+
+    REQUIRE(ls_reduced_density_matrix(basis.get(), LS_COMPLEX128, count, x.data(), 0, rho.data())
+            == LS_INVALID_ARGUMENT);
+    REQUIRE(ls_reduced_density_matrix(basis.get(), LS_COMPLEX128, count, x.data(),
+                                      uint64_t{1} << n, rho.data())
+            == LS_INVALID_ARGUMENT);
+    REQUIRE(ls_entanglement_entropy(4, mixed.data(), 0.0, &entropy) == LS_INVALID_ARGUMENT);
+}
+
+TEST_CASE("multiplies and adds operators", "[api]")
+{
+    using vector_t       = std::vector<std::complex<double>>;
+    auto const matvec    = [](ls_operator const* op, vector_t const& x) {
+        vector_t y(x.size());
+        REQUIRE(ls_operator_matmat(op, LS_COMPLEX128, x.size(), 1, x.data(), x.size(), y.data(),
+                                   x.size())
+                == LS_SUCCESS);
+        return y;
+    };
+    auto const make_vector = [](uint64_t const count) {
+        vector_t x(count);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            x[i] = std::complex<double>{std::cos(0.3 * i), std::sin(1.1 * i)};
+        }
+        return x;
+    };
+    auto const dot = [](vector_t const& a, vector_t const& b) {
+        return std::inner_product(std::begin(a), std::end(a), std::begin(b),
+                                  std::complex<double>{0.0, 0.0}, std::plus<>{},
+                                  [](auto const& u, auto const& v) { return std::conj(u) * v; });
+    };
+
+    SECTION("H²")
+    {
+        auto const [basis, op] = make_heisenberg_chain(8, 4, 0, 0);
+        ls_operator* squared   = nullptr;
+        REQUIRE(ls_operator_product(&squared, op.get(), op.get()) == LS_SUCCESS);
+        // 8 bonds squared, 8 pairs of adjacent bonds, and 8·5/2 pairs of disjoint bonds
+        REQUIRE(ls_operator_get_number_local_terms(op.get()) == 8);
+        REQUIRE(ls_operator_get_number_local_terms(squared) == 36);
+        uint64_t count;
+        REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+        auto const           x  = make_vector(count);
+        auto const           hx = matvec(op.get(), x);
+        std::complex<double> expectation;
+        REQUIRE(ls_operator_expectation(squared, LS_COMPLEX128, count, 1, x.data(), count,
+                                        &expectation)
+                == LS_SUCCESS);
+        REQUIRE(std::abs(expectation - dot(hx, hx)) < 1e-9);
+        auto const hhx = matvec(squared, x);
+        auto const expected = matvec(op.get(), hx);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(std::abs(hhx[i] - expected[i]) < 1e-10);
+        }
+        // H⁴ contains terms acting on up to 8 sites
+        ls_operator* fourth = nullptr;
+        REQUIRE(ls_operator_product(&fourth, squared, squared) == LS_INVALID_NUMBER_SPINS);
+        ls_destroy_operator(squared);
+    }
+
+    SECTION("commutators and sums")
+    {
+        auto const group = make_group({});
+        auto const basis = make_spin_basis(group.get(), 6, -1, 0);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+        auto const make_operator = [&basis](auto const& matrix, auto const& sites) {
+            ls_interaction* interaction = nullptr;
+            auto const      n           = std::size(sites);
+            auto const      status =
+                std::size(sites[0]) == 1
+                    ? ls_create_interaction1(&interaction, &(matrix[0][0]), n, &(sites[0][0]))
+                    : ls_create_interaction2(&interaction, &(matrix[0][0]), n,
+                                             reinterpret_cast<uint16_t const(*)[2]>(&sites[0]));
+            REQUIRE(status == LS_SUCCESS);
+            ls_interaction const* terms[] = {interaction};
+            ls_operator*          op      = nullptr;
+            REQUIRE(ls_create_operator(&op, basis.get(), 1, terms) == LS_SUCCESS);
+            ls_destroy_interaction(interaction);
+            return std::unique_ptr<ls_operator, void (*)(ls_operator*)>{op, &ls_destroy_operator};
+        };
+        std::complex<double> const heisenberg[4][4] = {{1.0, 0.0, 0.0, 0.0},
+                                                       {0.0, -1.0, 2.0, 0.0},
+                                                       {0.0, 2.0, -1.0, 0.0},
+                                                       {0.0, 0.0, 0.0, 1.0}};
+        uint16_t const             edges[][2] = {{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 0}};
+        std::complex<double> const sigma_plus[2][2] = {{0.0, 0.0}, {{0.0, 2.0}, 0.0}};
+        std::complex<double> const sigma_z[2][2]    = {{1.0, 0.0}, {0.0, -1.0}};
+        uint16_t const             first[][1]       = {{0}};
+        uint16_t const             all[][1]         = {{0}, {1}, {2}, {3}, {4}, {5}};
+        auto const                 h                = make_operator(heisenberg, edges);
+        auto const                 a                = make_operator(sigma_plus, first);
+        auto const                 sz               = make_operator(sigma_z, all);
+
+        uint64_t count;
+        REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+        auto const x   = make_vector(count);
+        auto const hx  = matvec(h.get(), x);
+        auto const ax  = matvec(a.get(), x);
+        auto const hax = matvec(h.get(), ax);
+        auto const ahx = matvec(a.get(), hx);
+
+        ls_operator* result = nullptr;
+        REQUIRE(ls_operator_sum(&result, h.get(), a.get()) == LS_SUCCESS);
+        auto y = matvec(result, x);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(std::abs(y[i] - (hx[i] + ax[i])) < 1e-10);
+        }
+        ls_destroy_operator(result);
+
+        REQUIRE(ls_operator_product(&result, h.get(), a.get()) == LS_SUCCESS);
+        y = matvec(result, x);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(std::abs(y[i] - hax[i]) < 1e-10);
+        }
+        ls_destroy_operator(result);
+
+        REQUIRE(ls_operator_commutator(&result, h.get(), a.get()) == LS_SUCCESS);
+        // Only the two bonds touching site 0 do not commute with σ⁺₀
+        REQUIRE(ls_operator_get_number_local_terms(result) == 2);
+        y = matvec(result, x);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(std::abs(y[i] - (hax[i] - ahx[i])) < 1e-10);
+        }
+        ls_destroy_operator(result);
+
+        // Heisenberg model conserves magnetization
+        REQUIRE(ls_operator_commutator(&result, h.get(), sz.get()) == LS_SUCCESS);
+        REQUIRE(ls_operator_get_number_local_terms(result) == 0);
+        ls_destroy_operator(result);
+
+        auto const [other_basis, other] = make_heisenberg_chain(6, 3, 0, 0);
+        REQUIRE(ls_operator_sum(&result, h.get(), other.get()) == LS_INVALID_ARGUMENT);
+    }
+}
+
+namespace {
+/// Checks that columns of `eigenvectors` are normalized eigenvectors of `op` with residuals below
+/// `tolerance` (relative to eigenvalues) and that `eigenvalues` are sorted.
+template <class T>
+auto check_eigenpairs(ls_operator const* op, std::vector<double> const& eigenvalues,
+                      std::vector<T> const& eigenvectors, uint64_t const size,
+                      double const tolerance) -> void
+{
+    auto const dtype = std::is_same_v<T, double> ? LS_FLOAT64 : LS_COMPLEX128;
+    auto       y     = std::vector<T>(eigenvectors.size());
+    REQUIRE(ls_operator_matmat(op, dtype, size, eigenvalues.size(), eigenvectors.data(), size,
+                               y.data(), size)
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < eigenvalues.size(); ++i) {
+        if (i > 0) { REQUIRE(eigenvalues[i - 1] <= eigenvalues[i]); }
+        auto residual = 0.0;
+        auto norm     = 0.0;
+        for (auto r = uint64_t{0}; r < size; ++r) {
+            auto const x = eigenvectors[r + i * size];
+            residual += std::norm(y[r + i * size] - eigenvalues[i] * x);
+            norm += std::norm(x);
+        }
+        REQUIRE(std::abs(norm - 1.0) < tolerance);
+        REQUIRE(std::sqrt(residual) < tolerance * std::abs(eigenvalues[i]));
+    }
+}
+
+// Ground state energy of a 12-site Heisenberg chain with σᵢ·σⱼ interactions
+constexpr auto heisenberg_12_ground_state_energy = -21.5495636686;
+} // namespace
+
+TEST_CASE("computes lowest eigenvalues using Lanczos", "[api]")
+{
+    constexpr auto ground_state_energy = heisenberg_12_ground_state_energy;
+    auto const [basis, op] = make_heisenberg_chain(12, 6, 0, 0);
+    uint64_t size          = 0;
+    REQUIRE(ls_get_number_states(basis.get(), &size) == LS_SUCCESS);
+    ls_lanczos_options options;
+    ls_lanczos_default_options(&options);
+    // Force restarts
+    options.krylov_dimension = 20;
+    REQUIRE(options.krylov_dimension < size);
+
+    SECTION("thick restart")
+    {
+        options.number_eigenvalues = 3;
+        std::vector<double> eigenvalues(3);
+        std::vector<double> eigenvectors(3 * size);
+        ls_lanczos_info     info;
+        REQUIRE(ls_operator_lanczos(op.get(), LS_FLOAT64, size, &options, nullptr,
+                                    eigenvalues.data(), eigenvectors.data(), size, &info)
+                == LS_SUCCESS);
+        REQUIRE(info.converged);
+        REQUIRE(info.number_restarts > 0);
+        REQUIRE(info.max_residual <= options.tolerance);
+        REQUIRE(std::abs(eigenvalues[0] - ground_state_energy) < 1e-8);
+        check_eigenpairs(op.get(), eigenvalues, eigenvectors, size, 1e-7);
+    }
+
+    SECTION("single precision storage")
+    {
+        // Default tolerance is below what single precision can resolve. It must be clamped
+        // rather than pursued for hundreds of iterations, and the reported residual must be the
+        // true one rather than the estimate from the projected matrix.
+        options.storage = LS_FLOAT32;
+        std::vector<double> eigenvalues(1);
+        std::vector<double> eigenvectors(size);
+        ls_lanczos_info     info;
+        REQUIRE(ls_operator_lanczos(op.get(), LS_FLOAT64, size, &options, nullptr,
+                                    eigenvalues.data(), eigenvectors.data(), size, &info)
+                == LS_SUCCESS);
+        REQUIRE(info.converged);
+        REQUIRE(info.number_iterations < 4 * options.krylov_dimension);
+        REQUIRE(info.max_residual <= 10 * std::numeric_limits<float>::epsilon());
+        REQUIRE(std::abs(eigenvalues[0] - ground_state_energy) < 1e-5);
+        check_eigenpairs(op.get(), eigenvalues, eigenvectors, size, 1e-6);
+    }
+
+    SECTION("two pass")
+    {
+        options.two_pass = true;
+        std::vector<double> eigenvalues(1);
+        std::vector<double> eigenvectors(size);
+        ls_lanczos_info     info;
+        REQUIRE(ls_operator_lanczos(op.get(), LS_FLOAT64, size, &options, nullptr,
+                                    eigenvalues.data(), eigenvectors.data(), size, &info)
+                == LS_SUCCESS);
+        REQUIRE(info.converged);
+        REQUIRE(std::abs(eigenvalues[0] - ground_state_energy) < 1e-8);
+        check_eigenpairs(op.get(), eigenvalues, eigenvectors, size, 1e-6);
+
+        options.number_eigenvalues = 2;
+        REQUIRE(ls_operator_lanczos(op.get(), LS_FLOAT64, size, &options, nullptr,
+                                    eigenvalues.data(), nullptr, 0, nullptr)
+                == LS_INVALID_ARGUMENT);
+    }
+
+    SECTION("complex sector")
+    {
+        auto const [other_basis, other] = make_heisenberg_chain(12, 6, 0, 1);
+        REQUIRE(ls_get_number_states(other_basis.get(), &size) == LS_SUCCESS);
+        options.number_eigenvalues = 2;
+        std::vector<double>               eigenvalues(2);
+        std::vector<std::complex<double>> eigenvectors(2 * size);
+        REQUIRE(ls_operator_lanczos(other.get(), LS_COMPLEX128, size, &options, nullptr,
+                                    eigenvalues.data(), eigenvectors.data(), size, nullptr)
+                == LS_SUCCESS);
+        REQUIRE(eigenvalues[0] > ground_state_energy);
+        check_eigenpairs(other.get(), eigenvalues, eigenvectors, size, 1e-7);
+
+        REQUIRE(ls_operator_lanczos(other.get(), LS_COMPLEX128, size + 1, &options, nullptr,
+                                    eigenvalues.data(), nullptr, 0, nullptr)
+                == LS_DIMENSION_MISMATCH);
+    }
+}
+
+TEST_CASE("computes lowest eigenvalues using LOBPCG", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(12, 6, 0, 0);
+    uint64_t size          = 0;
+    REQUIRE(ls_get_number_states(basis.get(), &size) == LS_SUCCESS);
+    ls_lobpcg_options options;
+    ls_lobpcg_default_options(&options);
+    options.number_eigenvalues = 4;
+
+    for (auto const precondition : {true, false}) {
+        options.precondition = precondition;
+        std::vector<double> eigenvalues(4);
+        std::vector<double> eigenvectors(4 * size);
+        ls_lobpcg_info      info;
+        REQUIRE(ls_operator_lobpcg(op.get(), LS_FLOAT64, size, &options, nullptr, 0,
+                                   eigenvalues.data(), eigenvectors.data(), size, &info)
+                == LS_SUCCESS);
+        REQUIRE(info.converged);
+        REQUIRE(info.max_residual <= options.tolerance);
+        REQUIRE(std::abs(eigenvalues[0] - heisenberg_12_ground_state_energy) < 1e-8);
+        check_eigenpairs(op.get(), eigenvalues, eigenvectors, size, 1e-6);
+
+        // Must agree with Lanczos
+        ls_lanczos_options lanczos_options;
+        ls_lanczos_default_options(&lanczos_options);
+        lanczos_options.number_eigenvalues = 4;
+        std::vector<double> expected(4);
+        REQUIRE(ls_operator_lanczos(op.get(), LS_FLOAT64, size, &lanczos_options, nullptr,
+                                    expected.data(), nullptr, 0, nullptr)
+                == LS_SUCCESS);
+        for (auto i = 0U; i < 4U; ++i) {
+            REQUIRE(std::abs(eigenvalues[i] - expected[i]) < 1e-7);
+        }
+    }
+
+    SECTION("complex sector")
+    {
+        auto const [other_basis, other] = make_heisenberg_chain(12, 6, 0, 1);
+        REQUIRE(ls_get_number_states(other_basis.get(), &size) == LS_SUCCESS);
+        options.number_eigenvalues = 2;
+        std::vector<double>               eigenvalues(2);
+        std::vector<std::complex<double>> eigenvectors(2 * size);
+        REQUIRE(ls_operator_lobpcg(other.get(), LS_COMPLEX128, size, &options, nullptr, 0,
+                                   eigenvalues.data(), eigenvectors.data(), size, nullptr)
+                == LS_SUCCESS);
+        check_eigenpairs(other.get(), eigenvalues, eigenvectors, size, 1e-6);
+
+        // Converged eigenvectors are a fixed point
+        ls_lobpcg_info info;
+        REQUIRE(ls_operator_lobpcg(other.get(), LS_COMPLEX128, size, &options,
+                                   eigenvectors.data(), size, eigenvalues.data(), nullptr, 0,
+                                   &info)
+                == LS_SUCCESS);
+        REQUIRE(info.number_iterations == 0);
+
+        // Linearly dependent initial block
+        std::copy_n(std::begin(eigenvectors), size, std::begin(eigenvectors) + size);
+        REQUIRE(ls_operator_lobpcg(other.get(), LS_COMPLEX128, size, &options,
+                                   eigenvectors.data(), size, eigenvalues.data(), nullptr, 0,
+                                   nullptr)
+                == LS_INVALID_ARGUMENT);
+
+        options.number_eigenvalues = static_cast<unsigned>(size);
+        REQUIRE(ls_operator_lobpcg(other.get(), LS_COMPLEX128, size, &options, nullptr, 0,
+                                   eigenvalues.data(), nullptr, 0, nullptr)
+                == LS_INVALID_ARGUMENT);
+    }
+}
+
+TEST_CASE("computes time evolution using Krylov subspaces", "[api]")
+{
+    using vector_t         = std::vector<std::complex<double>>;
+    auto const [basis, op] = make_heisenberg_chain(10, 5, 0, 1);
+    uint64_t size          = 0;
+    REQUIRE(ls_get_number_states(basis.get(), &size) == LS_SUCCESS);
+
+    auto const matvec = [size](ls_operator const* h, vector_t const& x) {
+        vector_t y(size);
+        REQUIRE(ls_operator_matmat(h, LS_COMPLEX128, size, 1, x.data(), size, y.data(), size)
+                == LS_SUCCESS);
+        return y;
+    };
+    // Reference: small steps (‖H‖·dt < 1) of a high-order Taylor expansion
+    auto const reference = [&](vector_t x, double const t) {
+        constexpr auto order        = 24;
+        auto const     number_steps = static_cast<int>(std::ceil(std::abs(t) / 0.05));
+        auto const     dt           = t / number_steps;
+        for (auto step = 0; step < number_steps; ++step) {
+            auto term = x;
+            for (auto k = 1; k <= order; ++k) {
+                term = matvec(op.get(), term);
+                for (auto& z : term) {
+                    z *= std::complex<double>{0.0, -dt / k};
+                }
+                for (auto i = uint64_t{0}; i < size; ++i) {
+                    x[i] += term[i];
+                }
+            }
+        }
+        return x;
+    };
+    auto const distance = [](vector_t const& a, vector_t const& b) {
+        auto sum = 0.0;
+        for (auto i = uint64_t{0}; i < a.size(); ++i) {
+            sum += std::norm(a[i] - b[i]);
+        }
+        return std::sqrt(sum);
+    };
+
+    vector_t x(size);
+    auto     norm = 0.0;
+    for (auto i = uint64_t{0}; i < size; ++i) {
+        x[i] = std::complex<double>{std::cos(0.7 * i), std::sin(1.3 * i)};
+        norm += std::norm(x[i]);
+    }
+    for (auto& z : x) {
+        z /= std::sqrt(norm);
+    }
+
+    ls_expm_options options;
+    ls_expm_default_options(&options);
+    options.krylov_dimension = 12;
+
+    SECTION("expm_multiply")
+    {
+        vector_t     y(size);
+        ls_expm_info info;
+        REQUIRE(ls_operator_expm_multiply(op.get(), size, 1.5, x.data(), y.data(), &options, &info)
+                == LS_SUCCESS);
+        REQUIRE(info.number_steps > 1);
+        REQUIRE(info.error_estimate <= options.tolerance);
+        REQUIRE(distance(y, reference(x, 1.5)) < 1e-9);
+
+        // Evolving backwards in time recovers x
+        vector_t z(size);
+        REQUIRE(ls_operator_expm_multiply(op.get(), size, -1.5, y.data(), z.data(), &options,
+                                          nullptr)
+                == LS_SUCCESS);
+        REQUIRE(distance(z, x) < 1e-9);
+
+        REQUIRE(ls_operator_expm_multiply(op.get(), size + 1, 1.5, x.data(), y.data(), &options,
+                                          nullptr)
+                == LS_DIMENSION_MISMATCH);
+    }
+
+    SECTION("evolve")
+    {
+        std::complex<double> const zz[4][4] = {
+            {1.0, 0.0, 0.0, 0.0}, {0.0, -1.0, 0.0, 0.0}, {0.0, 0.0, -1.0, 0.0}, {0.0, 0.0, 0.0, 1.0}};
+        std::vector<std::array<uint16_t, 2>> edges(10);
+        for (auto i = 0U; i < 10U; ++i) {
+            edges[i] = {static_cast<uint16_t>(i), static_cast<uint16_t>((i + 1U) % 10U)};
+        }
+        ls_interaction* interaction = nullptr;
+        REQUIRE(ls_create_interaction2(&interaction, &(zz[0][0]), edges.size(),
+                                       reinterpret_cast<uint16_t const(*)[2]>(edges.data()))
+                == LS_SUCCESS);
+        ls_operator*          correlator = nullptr;
+        ls_interaction const* terms[]    = {interaction};
+        REQUIRE(ls_create_operator(&correlator, basis.get(), 1, terms) == LS_SUCCESS);
+        ls_destroy_interaction(interaction);
+
+        double const             times[]       = {0.0, 0.25, 0.5, 1.0, 2.0};
+        ls_operator const* const observables[] = {op.get(), correlator};
+        vector_t                 expectations(std::size(times) * std::size(observables));
+        vector_t                 y(size);
+        REQUIRE(ls_operator_evolve(op.get(), size, x.data(), std::size(times), times,
+                                   std::size(observables), observables, expectations.data(),
+                                   y.data(), &options, nullptr)
+                == LS_SUCCESS);
+        auto state = x;
+        for (auto i = 0U; i < std::size(times); ++i) {
+            state = reference(state, times[i] - (i > 0 ? times[i - 1] : 0.0));
+            for (auto j = 0U; j < std::size(observables); ++j) {
+                auto const o        = matvec(observables[j], state);
+                auto const expected = std::inner_product(
+                    std::begin(state), std::end(state), std::begin(o),
+                    std::complex<double>{0.0, 0.0}, std::plus<>{},
+                    [](auto const& a, auto const& b) { return std::conj(a) * b; });
+                REQUIRE(std::abs(expectations[i * std::size(observables) + j] - expected) < 1e-8);
+            }
+            // Energy is conserved
+            REQUIRE(std::abs(expectations[i * std::size(observables)] - expectations[0]) < 1e-8);
+        }
+        REQUIRE(distance(y, state) < 1e-9);
+
+        double const unsorted[] = {1.0, 0.5};
+        REQUIRE(ls_operator_evolve(op.get(), size, x.data(), std::size(unsorted), unsorted, 0,
+                                   nullptr, nullptr, nullptr, &options, nullptr)
+                == LS_INVALID_ARGUMENT);
+        ls_destroy_operator(correlator);
+    }
+}
+
+TEST_CASE("computes Chebyshev moments", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(10, 5, 0, 0);
+    uint64_t size          = 0;
+    REQUIRE(ls_get_number_states(basis.get(), &size) == LS_SUCCESS);
+    constexpr auto number_moments = uint64_t{101};
+
+    double lower, upper; // NOLINT: initialized by ls_operator_spectral_bounds
+    REQUIRE(ls_operator_spectral_bounds(op.get(), LS_FLOAT64, size, &lower, &upper) == LS_SUCCESS);
+    std::vector<double> ground_state(1);
+    REQUIRE(ls_operator_lanczos(op.get(), LS_FLOAT64, size, nullptr, nullptr, ground_state.data(),
+                                nullptr, 0, nullptr)
+            == LS_SUCCESS);
+    REQUIRE(lower < ground_state[0]);
+
+    // Exact moments Tr Tₙ(H̃) / D using the Chebyshev recursion on the identity matrix
+    std::vector<double> exact(number_moments);
+    {
+        auto const          alpha = 2.0 / (upper - lower);
+        auto const          beta  = -(upper + lower) / (upper - lower);
+        std::vector<double> previous(size * size);
+        std::vector<double> current(size * size);
+        std::vector<double> y(size * size);
+        for (auto i = uint64_t{0}; i < size; ++i) {
+            current[i * size + i] = 1.0;
+        }
+        for (auto k = uint64_t{0}; k < number_moments; ++k) {
+            for (auto i = uint64_t{0}; i < size; ++i) {
+                exact[k] += current[i * size + i] / static_cast<double>(size);
+            }
+            REQUIRE(ls_operator_matmat(op.get(), LS_FLOAT64, size, size, current.data(), size,
+                                       y.data(), size)
+                    == LS_SUCCESS);
+            for (auto i = uint64_t{0}; i < size * size; ++i) {
+                auto const next = (k == 0 ? 1.0 : 2.0) * (alpha * y[i] + beta * current[i])
+                                  - (k == 0 ? 0.0 : previous[i]);
+                previous[i] = current[i];
+                current[i]  = next;
+            }
+        }
+    }
+    // Diagonal matrix elements ⟨i|Tₙ(H̃)|i⟩ with and without the doubling trick
+    for (auto const i : {uint64_t{0}, size / 2}) {
+        std::vector<double> e(size);
+        e[i] = 1.0;
+        std::vector<std::complex<double>> doubled(number_moments);
+        std::vector<std::complex<double>> direct(number_moments);
+        REQUIRE(ls_operator_kpm_correlation(op.get(), LS_FLOAT64, size, lower, upper,
+                                            number_moments, e.data(), nullptr, doubled.data())
+                == LS_SUCCESS);
+        REQUIRE(ls_operator_kpm_correlation(op.get(), LS_FLOAT64, size, lower, upper,
+                                            number_moments, e.data(), e.data(), direct.data())
+                == LS_SUCCESS);
+        for (auto k = uint64_t{0}; k < number_moments; ++k) {
+            REQUIRE(std::abs(doubled[k] - direct[k]) < 1e-10);
+        }
+    }
+    // |Tₙ(x)| ≤ 1 on [-1, 1], so moments are bounded iff the spectrum lies within the bounds
+    REQUIRE(exact[0] == Approx(1.0));
+    for (auto const mu : exact) {
+        REQUIRE(std::abs(mu) <= 1.0 + 1e-10);
+    }
+
+    SECTION("stochastic trace")
+    {
+        std::vector<double> blocked(number_moments);
+        std::vector<double> other(number_moments);
+        // Random vectors do not depend on the block size
+        REQUIRE(ls_operator_kpm_dos(op.get(), LS_FLOAT64, size, lower, upper, number_moments, 32,
+                                    8, 42, blocked.data())
+                == LS_SUCCESS);
+        REQUIRE(ls_operator_kpm_dos(op.get(), LS_FLOAT64, size, lower, upper, number_moments, 32,
+                                    3, 42, other.data())
+                == LS_SUCCESS);
+        REQUIRE(blocked[0] == Approx(1.0));
+        for (auto k = uint64_t{0}; k < number_moments; ++k) {
+            REQUIRE(std::abs(blocked[k] - other[k]) < 1e-12);
+            // Statistical error is of order 1/√(32·D)
+            REQUIRE(std::abs(blocked[k] - exact[k]) < 0.15);
+        }
+
+        std::vector<double> complex_moments(number_moments);
+        REQUIRE(ls_operator_kpm_dos(op.get(), LS_COMPLEX128, size, lower, upper, number_moments,
+                                    32, 16, 42, complex_moments.data())
+                == LS_SUCCESS);
+        for (auto k = uint64_t{0}; k < number_moments; ++k) {
+            REQUIRE(std::abs(complex_moments[k] - exact[k]) < 0.15);
+        }
+    }
+
+    SECTION("reconstruction")
+    {
+        constexpr auto      number_points = uint64_t{4000};
+        std::vector<double> energies(number_points);
+        for (auto i = uint64_t{0}; i < number_points; ++i) {
+            energies[i] = lower + (upper - lower) * (static_cast<double>(i) + 0.5) / number_points;
+        }
+        std::vector<double> density(number_points);
+        for (auto const kernel : {LS_KPM_JACKSON, LS_KPM_LORENTZ}) {
+            REQUIRE(ls_kpm_reconstruct(number_moments, exact.data(), kernel, 4.0, lower, upper,
+                                       number_points, energies.data(), density.data())
+                    == LS_SUCCESS);
+            auto integral = 0.0;
+            for (auto const rho : density) {
+                // Both kernels are positive
+                REQUIRE(rho > -1e-10);
+                integral += rho * (upper - lower) / number_points;
+            }
+            REQUIRE(integral == Approx(1.0).epsilon(1e-3));
+        }
+        REQUIRE(ls_kpm_reconstruct(number_moments, exact.data(), LS_KPM_LORENTZ, 0.0, lower,
+                                   upper, number_points, energies.data(), density.data())
+                == LS_INVALID_ARGUMENT);
+    }
+}
+
+TEST_CASE("computes thermodynamics using FTLM", "[api]")
+{
+    std::vector<double> const temperatures = {0.1, 0.5, 1.0, 2.0, 5.0, 20.0, 1e6};
+    auto const                count        = temperatures.size();
+
+    SECTION("sums over all sectors")
+    {
+        // With all sectors of a 10-site chain and exact diagonalization of each of them, the
+        // infinite temperature limit of Z is 2¹⁰
+        std::vector<decltype(make_heisenberg_chain(10, 0, 0, 0))> sectors;
+        std::vector<ls_operator const*>                           operators;
+        for (auto hamming_weight = 0; hamming_weight <= 10; ++hamming_weight) {
+            for (auto momentum = 0U; momentum < 10U; ++momentum) {
+                sectors.push_back(make_heisenberg_chain(10, hamming_weight, 0, momentum));
+                operators.push_back(sectors.back().second.get());
+            }
+        }
+        std::vector<double> log_z(count);
+        std::vector<double> energy(count);
+        std::vector<double> specific_heat(count);
+        REQUIRE(ls_ftlm(static_cast<unsigned>(operators.size()), operators.data(), nullptr,
+                        nullptr, count, temperatures.data(), log_z.data(), energy.data(),
+                        specific_heat.data())
+                == LS_SUCCESS);
+        REQUIRE(log_z.back() == Approx(10 * std::log(2.0)).epsilon(1e-4));
+        // Tr H = 0 for the Heisenberg model
+        REQUIRE(std::abs(energy.back()) < 1e-3);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(specific_heat[i] >= 0.0);
+            if (i > 0) { REQUIRE(energy[i] > energy[i - 1]); }
+        }
+    }
+
+    SECTION("agrees with exact diagonalization")
+    {
+        auto const [basis, op] = make_heisenberg_chain(12, 6, 0, 0);
+        ls_operator const* operators[] = {op.get()};
+        ls_ftlm_options    options;
+        ls_ftlm_default_options(&options);
+        std::vector<double> exact_log_z(count);
+        std::vector<double> exact_energy(count);
+        std::vector<double> exact_specific_heat(count);
+        REQUIRE(ls_ftlm(1, operators, nullptr, &options, count, temperatures.data(),
+                        exact_log_z.data(), exact_energy.data(), exact_specific_heat.data())
+                == LS_SUCCESS);
+        REQUIRE(exact_energy[0] == Approx(heisenberg_12_ground_state_energy).epsilon(1e-3));
+
+        // Fewer Lanczos steps than the dimension of the sector forces FTLM
+        options.krylov_dimension = 30;
+        options.number_vectors   = 100;
+        options.block_size       = 16;
+        std::vector<double> log_z(count);
+        std::vector<double> energy(count);
+        std::vector<double> specific_heat(count);
+        REQUIRE(ls_ftlm(1, operators, nullptr, &options, count, temperatures.data(),
+                        log_z.data(), energy.data(), specific_heat.data())
+                == LS_SUCCESS);
+        // The ground state converges, but its weight is only known up to O(1/√R) statistical error
+        REQUIRE(energy[0] == Approx(exact_energy[0]).epsilon(1e-8));
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(std::abs(log_z[i] - exact_log_z[i]) < 0.15);
+            REQUIRE(std::abs(energy[i] - exact_energy[i]) < 0.3);
+            REQUIRE(std::abs(specific_heat[i] - exact_specific_heat[i]) < 0.3);
+        }
+        // Results do not depend on the block size
+        options.block_size = 50;
+        std::vector<double> other(count);
+        REQUIRE(ls_ftlm(1, operators, nullptr, &options, count, temperatures.data(), nullptr,
+                        other.data(), nullptr)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(other[i] == Approx(energy[i]).epsilon(1e-10));
+        }
+
+        double const negative[] = {-1.0};
+        REQUIRE(ls_ftlm(1, operators, nullptr, &options, 1, negative, nullptr, nullptr, nullptr)
+                == LS_INVALID_ARGUMENT);
+    }
+}
+
+TEST_CASE("runs sector jobs concurrently", "[api]")
+{
+    // All sectors of a 10-site chain. Bases are built by the scheduler
+    std::vector<decltype(make_heisenberg_chain(10, 0, 0, 0))> sectors;
+    std::vector<ls_sector_job>                                jobs;
+    for (auto hamming_weight = 0; hamming_weight <= 10; ++hamming_weight) {
+        for (auto momentum = 0U; momentum < 10U; ++momentum) {
+            sectors.push_back(make_heisenberg_chain(10, hamming_weight, 0, momentum, false));
+            ls_sector_job job{};
+            job.kind  = LS_JOB_BUILD;
+            job.op    = sectors.back().second.get();
+            job.dtype = LS_COMPLEX128;
+            jobs.push_back(job);
+        }
+    }
+    ls_scheduler_options options;
+    ls_scheduler_default_options(&options);
+    options.number_threads = 4;
+    REQUIRE(ls_run_sector_jobs(jobs.size(), jobs.data(), &options) == LS_SUCCESS);
+
+    // Full spectrum of every sector
+    std::vector<std::vector<double>> spectra(jobs.size());
+    auto                             total = uint64_t{0};
+    for (auto i = uint64_t{0}; i < jobs.size(); ++i) {
+        auto n = uint64_t{0};
+        REQUIRE(ls_get_number_states(ls_operator_get_basis(jobs[i].op), &n) == LS_SUCCESS);
+        spectra[i].resize(n);
+        jobs[i].kind   = LS_JOB_SPECTRUM;
+        jobs[i].values = spectra[i].data();
+        total += n;
+    }
+    REQUIRE(total == 1024);
+    // A tiny memory budget serializes the jobs
+    options.memory_budget = 1;
+    REQUIRE(ls_run_sector_jobs(jobs.size(), jobs.data(), &options) == LS_SUCCESS);
+    auto trace        = 0.0;
+    auto ground_state = std::numeric_limits<double>::max();
+    for (auto const& spectrum : spectra) {
+        for (auto const e : spectrum) {
+            trace += e;
+            ground_state = std::min(ground_state, e);
+        }
+    }
+    REQUIRE(std::abs(trace) < 1e-8);
+
+    // The ground state lies in the Sᶻ = 0 sector with momentum π
+    auto const [basis, op]  = make_heisenberg_chain(10, 5, 0, 5);
+    auto                eigenvalue = 0.0;
+    std::vector<double> moments(16);
+    ls_sector_job       other[2] = {};
+    other[0].kind                = LS_JOB_LANCZOS;
+    other[0].op                  = op.get();
+    other[0].dtype               = LS_FLOAT64;
+    other[0].values              = &eigenvalue;
+    other[1].kind                = LS_JOB_KPM_DOS;
+    other[1].op                  = op.get();
+    other[1].dtype               = LS_FLOAT64;
+    other[1].values              = moments.data();
+    other[1].number_moments      = moments.size();
+    other[1].number_vectors      = 4;
+    other[1].block_size          = 4;
+    options.memory_budget        = 0;
+    REQUIRE(ls_run_sector_jobs(2, other, &options) == LS_SUCCESS);
+    REQUIRE(eigenvalue == Approx(ground_state).epsilon(1e-8));
+    REQUIRE(other[1].lower < ground_state);
+    REQUIRE(moments[0] == Approx(1.0));
+
+    // Errors are reported per job
+    other[0].dtype = LS_FLOAT32;
+    REQUIRE(ls_run_sector_jobs(2, other, &options) == LS_INVALID_DATATYPE);
+    REQUIRE(other[0].status == LS_INVALID_DATATYPE);
+    REQUIRE(other[1].status == LS_SUCCESS);
+}
+
+TEST_CASE("computes out-of-core matrix-vector products", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(12, 6, 0, 0);
+    auto       n           = uint64_t{0};
+    REQUIRE(ls_get_number_states(basis.get(), &n) == LS_SUCCESS);
+    auto const block_size = uint64_t{3};
+    std::vector<double> x(n * block_size);
+    for (auto i = uint64_t{0}; i < x.size(); ++i) {
+        x[i] = std::cos(0.7 * i);
+    }
+    std::vector<double> expected(n * block_size);
+    REQUIRE(ls_operator_matmat(op.get(), LS_FLOAT64, n, block_size, x.data(), n, expected.data(),
+                               n)
+            == LS_SUCCESS);
+
+    auto const x_filename = "test_out_of_core_x.bin";
+    auto const y_filename = "test_out_of_core_y.bin";
+    {
+        auto* stream = std::fopen(x_filename, "wb");
+        REQUIRE(stream != nullptr);
+        REQUIRE(std::fwrite(x.data(), sizeof(double), x.size(), stream) == x.size());
+        std::fclose(stream);
+    }
+    ls_out_of_core_options options;
+    ls_out_of_core_default_options(&options);
+    // Many small tiles with a partial last one
+    for (auto const tile_rows : {uint64_t{7}, uint64_t{0}}) {
+        options.tile_rows = tile_rows;
+        REQUIRE(ls_operator_matmat_file(op.get(), LS_FLOAT64, n, block_size, x_filename,
+                                        y_filename, &options)
+                == LS_SUCCESS);
+        std::vector<double> y(n * block_size);
+        auto*               stream = std::fopen(y_filename, "rb");
+        REQUIRE(stream != nullptr);
+        REQUIRE(std::fread(y.data(), sizeof(double), y.size(), stream) == y.size());
+        std::fclose(stream);
+        for (auto i = uint64_t{0}; i < y.size(); ++i) {
+            REQUIRE(y[i] == Approx(expected[i]));
+        }
+    }
+
+    // The file holds fewer than block_size vectors
+    REQUIRE(ls_operator_matmat_file(op.get(), LS_FLOAT64, n, block_size + 1, x_filename,
+                                    y_filename, nullptr)
+            == LS_DIMENSION_MISMATCH);
+    // y must not overwrite x
+    REQUIRE(ls_operator_matmat_file(op.get(), LS_FLOAT64, n, block_size, x_filename, x_filename,
+                                    nullptr)
+            == LS_INVALID_ARGUMENT);
+    REQUIRE(ls_operator_matmat_file(op.get(), LS_FLOAT64, n, block_size, x_filename,
+                                    "./test_out_of_core_x.bin", nullptr)
+            == LS_INVALID_ARGUMENT);
+    std::remove(x_filename);
+    std::remove(y_filename);
+    REQUIRE(ls_operator_matmat_file(op.get(), LS_FLOAT64, n, block_size, x_filename, y_filename,
+                                    nullptr)
+            == LS_COULD_NOT_OPEN_FILE);
+}
+
+TEST_CASE("computes matrix-vector products asynchronously", "[api]")
+{
+    auto const [basis, op] = make_heisenberg_chain(12, 6, 0, 0);
+    auto       n           = uint64_t{0};
+    REQUIRE(ls_get_number_states(basis.get(), &n) == LS_SUCCESS);
+    std::vector<double> x(2 * n);
+    for (auto i = uint64_t{0}; i < x.size(); ++i) {
+        x[i] = std::cos(0.3 * i);
+    }
+    std::vector<double> expected(2 * n);
+    REQUIRE(ls_operator_matmat(op.get(), LS_FLOAT64, n, 2, x.data(), n, expected.data(), n)
+            == LS_SUCCESS);
+
+    // Two products are queued, and they complete in submission order
+    std::vector<double> y(2 * n);
+    ls_matmat_handle*   first  = nullptr;
+    ls_matmat_handle*   second = nullptr;
+    REQUIRE(ls_operator_matmat_async(op.get(), LS_FLOAT64, n, 1, x.data(), n, y.data(), n, &first)
+            == LS_SUCCESS);
+    REQUIRE(ls_operator_matmat_async(op.get(), LS_FLOAT64, n, 1, x.data() + n, n, y.data() + n, n,
+                                     &second)
+            == LS_SUCCESS);
+    REQUIRE(ls_matmat_wait(second) == LS_SUCCESS);
+    REQUIRE(ls_matmat_test(first));
+    REQUIRE(ls_matmat_test(second));
+    REQUIRE(ls_matmat_wait(first) == LS_SUCCESS);
+    ls_destroy_matmat_handle(first);
+    ls_destroy_matmat_handle(second);
+    for (auto i = uint64_t{0}; i < y.size(); ++i) {
+        REQUIRE(y[i] == Approx(expected[i]));
+    }
+
+    // Errors are reported when waiting
+    ls_matmat_handle* handle = nullptr;
+    REQUIRE(ls_operator_matmat_async(op.get(), LS_FLOAT64, n + 1, 1, x.data(), n + 1, y.data(),
+                                     n + 1, &handle)
+            == LS_SUCCESS);
+    REQUIRE(ls_matmat_wait(handle) == LS_DIMENSION_MISMATCH);
+    ls_destroy_matmat_handle(handle);
+    REQUIRE(ls_operator_matmat_async(op.get(), static_cast<ls_datatype>(42), n, 1, x.data(), n,
+                                     y.data(), n, &handle)
+            == LS_INVALID_DATATYPE);
+}
+
+TEST_CASE("converts vectors between bases", "[api]")
+{
+    auto const n          = 10U;
+    auto const [basis, _] = make_heisenberg_chain(n, 5, 0, 2);
+    uint64_t count;
+    REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+    std::vector<std::complex<double>> x(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        x[i] = std::complex<double>{std::cos(0.3 * i), std::sin(1.1 * i)};
+    }
+
+    auto const group = make_group({});
+    auto const full  = make_spin_basis(group.get(), n, 5, 0);
+    REQUIRE(ls_build(full.get()) == LS_SUCCESS);
+    auto const states     = get_states(full.get());
+    auto const full_count = ls_states_get_size(states.get());
+    auto const spins      = ls_states_get_data(states.get());
+    // ψ(s) = x[index(r)]·‖r‖·χ̄ (see "computes reduced density matrices")
+    std::vector<std::complex<double>> expected(full_count);
+    for (auto i = uint64_t{0}; i < full_count; ++i) {
+        uint64_t             repr;
+        std::complex<double> character;
+        double               norm;
+        ls_get_state_info_64(basis.get(), spins[i], &repr, &character, &norm);
+        if (norm == 0.0) { continue; }
+        uint64_t index;
+        REQUIRE(ls_get_index(basis.get(), repr, &index) == LS_SUCCESS);
+        expected[i] = x[index] * norm * std::conj(character);
+    }
+
+    std::vector<std::complex<double>> psi(full_count);
+    REQUIRE(ls_unpack_vector(basis.get(), full.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                             psi.data(), full_count)
+            == LS_SUCCESS);
+    auto norm_x   = 0.0;
+    auto norm_psi = 0.0;
+    for (auto i = uint64_t{0}; i < full_count; ++i) {
+        REQUIRE(std::abs(psi[i] - expected[i]) < 1e-12);
+        norm_psi += std::norm(psi[i]);
+    }
+    for (auto const& c : x) {
+        norm_x += std::norm(c);
+    }
+    REQUIRE(norm_psi == Approx(norm_x));
+
+    // Packing is the inverse of unpacking for vectors in the symmetry sector
+    std::vector<std::complex<double>> packed(count);
+    REQUIRE(ls_pack_vector(full.get(), basis.get(), LS_COMPLEX128, full_count, 1, psi.data(),
+                           full_count, packed.data(), count)
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        REQUIRE(std::abs(packed[i] - x[i]) < 1e-12);
+    }
+
+    SECTION("streams the result to a file")
+    {
+        auto const filename = "test_unpack_vector.bin";
+        ls_out_of_core_options options;
+        ls_out_of_core_default_options(&options);
+        options.tile_rows = 17;
+        REQUIRE(ls_unpack_vector_file(basis.get(), full.get(), LS_COMPLEX128, count, 1, x.data(),
+                                      count, filename, &options)
+                == LS_SUCCESS);
+        std::vector<std::complex<double>> y(full_count);
+        auto*                             stream = std::fopen(filename, "rb");
+        REQUIRE(stream != nullptr);
+        REQUIRE(std::fread(y.data(), sizeof(std::complex<double>), y.size(), stream) == y.size());
+        std::fclose(stream);
+        std::remove(filename);
+        for (auto i = uint64_t{0}; i < full_count; ++i) {
+            REQUIRE(y[i] == psi[i]);
+        }
+    }
+
+    SECTION("unpacks into a basis with a subgroup of symmetries")
+    {
+        auto const [symmetric, _1] = make_heisenberg_chain(n, 5, 1, 0);
+        auto const [subgroup, _2]  = make_heisenberg_chain(n, 5, 0, 0);
+        uint64_t   symmetric_count, subgroup_count;
+        REQUIRE(ls_get_number_states(symmetric.get(), &symmetric_count) == LS_SUCCESS);
+        REQUIRE(ls_get_number_states(subgroup.get(), &subgroup_count) == LS_SUCCESS);
+        std::vector<double> v(symmetric_count);
+        for (auto i = uint64_t{0}; i < symmetric_count; ++i) {
+            v[i] = std::cos(0.7 * i);
+        }
+        std::vector<double> w(subgroup_count);
+        std::vector<double> direct(full_count);
+        std::vector<double> indirect(full_count);
+        REQUIRE(ls_unpack_vector(symmetric.get(), subgroup.get(), LS_FLOAT64, symmetric_count, 1,
+                                 v.data(), symmetric_count, w.data(), subgroup_count)
+                == LS_SUCCESS);
+        REQUIRE(ls_unpack_vector(subgroup.get(), full.get(), LS_FLOAT64, subgroup_count, 1,
+                                 w.data(), subgroup_count, indirect.data(), full_count)
+                == LS_SUCCESS);
+        REQUIRE(ls_unpack_vector(symmetric.get(), full.get(), LS_FLOAT64, symmetric_count, 1,
+                                 v.data(), symmetric_count, direct.data(), full_count)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < full_count; ++i) {
+            REQUIRE(indirect[i] == Approx(direct[i]).margin(1e-12));
+        }
+    }
+
+    REQUIRE(ls_unpack_vector(basis.get(), full.get(), LS_FLOAT64, count, 1, x.data(), count,
+                             psi.data(), full_count)
+            == LS_INVALID_DATATYPE);
+    REQUIRE(ls_unpack_vector(basis.get(), full.get(), LS_COMPLEX128, count + 1, 1, x.data(),
+                             count + 1, psi.data(), full_count)
+            == LS_DIMENSION_MISMATCH);
+    auto const [other, _3] = make_heisenberg_chain(n, 4, 0, 0);
+    REQUIRE(ls_unpack_vector(other.get(), full.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                             psi.data(), full_count)
+            == LS_INVALID_HAMMING_WEIGHT);
+    // Neither group is a subgroup of the other one (different sectors of the same group)
+    auto const [moved, _4] = make_heisenberg_chain(n, 5, 0, 1);
+    uint64_t moved_count;
+    REQUIRE(ls_get_number_states(moved.get(), &moved_count) == LS_SUCCESS);
+    std::vector<std::complex<double>> y(moved_count);
+    REQUIRE(ls_unpack_vector(basis.get(), moved.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                             y.data(), moved_count)
+            == LS_INVALID_ARGUMENT);
+    REQUIRE(ls_pack_vector(moved.get(), basis.get(), LS_COMPLEX128, moved_count, 1, y.data(),
+                           moved_count, x.data(), count)
+            == LS_INVALID_ARGUMENT);
+}
+
+TEST_CASE("computes amplitudes of arbitrary spin configurations", "[api]")
+{
+    auto const n          = 10U;
+    auto const [basis, _] = make_heisenberg_chain(n, 5, 0, 2);
+    uint64_t count;
+    REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+    std::vector<std::complex<double>> x(count);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        x[i] = std::complex<double>{std::cos(0.3 * i), std::sin(1.1 * i)};
+    }
+
+    // All configurations including those with a different Hamming weight (ψ = 0)
+    auto const            number_spins = uint64_t{1} << n;
+    std::vector<uint64_t> spins(number_spins);
+    std::iota(std::begin(spins), std::end(spins), uint64_t{0});
+    std::vector<std::complex<double>> amplitudes(number_spins);
+    REQUIRE(ls_batched_amplitude(basis.get(), LS_COMPLEX128, count, x.data(), number_spins,
+                                 spins.data(), amplitudes.data())
+            == LS_SUCCESS);
+    for (auto const s : spins) {
+        auto expected = std::complex<double>{0.0, 0.0};
+        if (lattice_symmetries::popcount(s) == 5U) {
+            uint64_t             repr;
+            std::complex<double> character;
+            double               norm;
+            ls_get_state_info_64(basis.get(), s, &repr, &character, &norm);
+            if (norm != 0.0) {
+                uint64_t index;
+                REQUIRE(ls_get_index(basis.get(), repr, &index) == LS_SUCCESS);
+                expected = x[index] * norm * std::conj(character);
+            }
+        }
+        REQUIRE(std::abs(amplitudes[s] - expected) < 1e-12);
+    }
+
+    // Amplitudes agree with the unpacked vector
+    auto const group = make_group({});
+    auto const full  = make_spin_basis(group.get(), n, 5, 0);
+    REQUIRE(ls_build(full.get()) == LS_SUCCESS);
+    auto const states     = get_states(full.get());
+    auto const full_count = ls_states_get_size(states.get());
+    std::vector<std::complex<double>> psi(full_count);
+    std::vector<std::complex<double>> y(full_count);
+    REQUIRE(ls_unpack_vector(basis.get(), full.get(), LS_COMPLEX128, count, 1, x.data(), count,
+                             psi.data(), full_count)
+            == LS_SUCCESS);
+    REQUIRE(ls_batched_amplitude(basis.get(), LS_COMPLEX128, count, x.data(), full_count,
+                                 ls_states_get_data(states.get()), y.data())
+            == LS_SUCCESS);
+    for (auto i = uint64_t{0}; i < full_count; ++i) {
+        REQUIRE(y[i] == psi[i]);
+    }
+
+    REQUIRE(ls_batched_amplitude(basis.get(), LS_FLOAT64, count, x.data(), number_spins,
+                                 spins.data(), amplitudes.data())
+            == LS_INVALID_DATATYPE);
+    REQUIRE(ls_batched_amplitude(basis.get(), LS_COMPLEX128, count + 1, x.data(), number_spins,
+                                 spins.data(), amplitudes.data())
+            == LS_DIMENSION_MISMATCH);
+    spins[100] = number_spins | 1U;
+    REQUIRE(ls_batched_amplitude(basis.get(), LS_COMPLEX128, count, x.data(), number_spins,
+                                 spins.data(), amplitudes.data())
+            == LS_INVALID_STATE);
+}